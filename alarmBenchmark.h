@@ -0,0 +1,319 @@
+/*********************************************************************************************************************
+ * Project : Astro Alarm
+ * Author  : PEB <pebdev@lavache.com> 
+ * Date    : 2024.01.18
+ *********************************************************************************************************************
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ * 
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *********************************************************************************************************************/
+
+
+/** D E F I N E S ****************************************************************************************************/
+// Uncomment to run the alarm detector benchmark at startup (results are printed on the debug serial link)
+//#define CONFIG_ALARM_BENCHMARK_ENABLED      (1)
+
+// Replay settings
+#define ALARM_BENCHMARK_SAMPLE_PERIOD_MS      (200)     // Same rate as the frames sent by the server
+#define ALARM_BENCHMARK_WARMUP_S              (60)      // Disarmed period, used by the detector to learn the gyro bias
+#define ALARM_BENCHMARK_SEED                  (0x20240118)
+
+// Injected sensor noise (standard deviation)
+#define ALARM_BENCHMARK_NOISE_ACC_G           (0.002)
+#define ALARM_BENCHMARK_NOISE_VEL_DPS         (0.05)
+
+// Disturbances which must not trigger : each gust or step has a random peak, from 30% to 100% of the maximum
+#define ALARM_BENCHMARK_GUST_MAX_G            (0.05)
+#define ALARM_BENCHMARK_STEP_MAX_G            (0.05)
+
+// Acceleration margins tried, around ALARM_ACCELERATION_MARGIN_G
+#define ALARM_BENCHMARK_MARGIN_COUNT          (5)
+
+// Scenario types
+#define ALARM_SCENARIO_QUIET                  (0)       // Quiet night, sensor noise only
+#define ALARM_SCENARIO_WIND                   (1)       // Wind gusts shaking the mount
+#define ALARM_SCENARIO_WALKING                (2)       // People walking by the tripod
+#define ALARM_SCENARIO_BUMP                   (3)       // Real bump : the mount attitude changes, gravity moves by amplitude
+#define ALARM_SCENARIO_SLOW_ROTATION          (4)       // Real disturbance : slow rotation of the mount
+
+
+/** S T R U C T S ****************************************************************************************************/
+struct strAlarmScenario
+{
+  const char* name;
+  uint8_t type;
+  uint32_t duration_s;
+  int32_t eventStart_s;     // Labelled start of the real disturbance, -1 if the recording must not trigger
+  double amplitude;         // Bump : gravity change on an axis, in ALARM_ACCELERATION_MARGIN_G
+};
+
+struct strAlarmBenchmarkResult
+{
+  uint32_t samples;
+  uint32_t falsePositives;
+  int32_t latency_ms;       // -1 if the labelled event was missed
+  uint64_t cycles;
+};
+
+
+/** A L A R M  B E N C H M A R K *************************************************************************************/
+class AlarmBenchmark
+{
+private:
+  uint32_t prngState;
+
+  // Mount attitude of the current recording
+  double roll;
+  double pitch;
+  double yaw;
+
+  // Peak of the current gust or step (g)
+  double disturbance;
+
+
+public:
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Constructor
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  AlarmBenchmark (void)
+  {
+    this->prngState = ALARM_BENCHMARK_SEED;
+    this->roll      = 0.0;
+    this->pitch     = 0.0;
+    this->yaw       = 0.0;
+    this->disturbance = 0.0;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Replay the whole labelled corpus for each margin, with and without the motion stage, and print
+  //                 the report
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void run (void)
+  {
+    static const double margins[ALARM_BENCHMARK_MARGIN_COUNT] = {0.03, 0.045, ALARM_ACCELERATION_MARGIN_G, 0.09, 0.12};
+    static const struct strAlarmScenario corpus[] = {
+      {"quiet night",      ALARM_SCENARIO_QUIET,         3600, -1,  0.0},
+      {"wind gusts",       ALARM_SCENARIO_WIND,          1800, -1,  0.0},
+      {"people walking",   ALARM_SCENARIO_WALKING,       1800, -1,  0.0},
+      {"bump 0.5x",        ALARM_SCENARIO_BUMP,           600, 300, 0.5},
+      {"bump 1x",          ALARM_SCENARIO_BUMP,           600, 300, 1.0},
+      {"bump 2x",          ALARM_SCENARIO_BUMP,           600, 300, 2.0},
+      {"slow rotation",    ALARM_SCENARIO_SLOW_ROTATION,  900, 300, 0.0},
+    };
+
+    Serial.println("----------------------------------------------------------------------");
+    Serial.printf("ALARM BENCHMARK (bumps in margins of %.3f g)\n", ALARM_ACCELERATION_MARGIN_G);
+    Serial.printf("%-9s %-16s %-10s %8s %10s %12s %12s\n", "margin(g)", "scenario", "detector", "samples", "fp/hour",
+                  "latency(ms)", "cycles/smp");
+
+    for (const double margin : margins)
+    {
+      for (const auto& scenario : corpus)
+      {
+        for (uint8_t useMotion=0; useMotion<2; useMotion++)
+        {
+          struct strAlarmBenchmarkResult result = this->replay(scenario, margin, (useMotion == 1));
+          double hours = (double)scenario.duration_s / 3600.0;
+
+          Serial.printf("%-9.3f %-16s %-10s %8u %10.2f %12d %12u\n", margin, scenario.name, (useMotion == 1) ? "motion" : "acc-only",
+                        (unsigned int)result.samples, (double)result.falsePositives / hours, (int)result.latency_ms,
+                        (unsigned int)(result.cycles / ((result.samples > 0) ? result.samples : 1)));
+        }
+      }
+    }
+
+    Serial.println("----------------------------------------------------------------------");
+  }
+
+
+private:
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Replay one recording through a fresh AlarmManager
+  // @param _scenario   : labelled recording
+  // @param _margin_g   : acceleration margin of the detector
+  // @param _use_motion : true to feed the gyro stage, false for the acceleration only detector
+  // @return strAlarmBenchmarkResult data
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  struct strAlarmBenchmarkResult replay (const struct strAlarmScenario& _scenario, double _margin_g, bool _use_motion)
+  {
+    AlarmManager alarm = AlarmManager();
+    struct strAlarmBenchmarkResult result = {0, 0, -1, 0};
+    double dt_s = (double)ALARM_BENCHMARK_SAMPLE_PERIOD_MS / 1000.0;
+    uint32_t warmupSamples = (ALARM_BENCHMARK_WARMUP_S * 1000) / ALARM_BENCHMARK_SAMPLE_PERIOD_MS;
+    uint32_t totalSamples  = warmupSamples + (_scenario.duration_s * 1000) / ALARM_BENCHMARK_SAMPLE_PERIOD_MS;
+
+    // Same recording for both detectors
+    this->prngState = ALARM_BENCHMARK_SEED + _scenario.type;
+    this->roll      = 0.4;
+    this->pitch     = -0.7;
+    this->yaw       = 0.0;
+    this->disturbance = 0.0;
+    alarm.set_acceleration_margin(_margin_g);
+
+    for (uint32_t i=0; i<totalSamples; i++)
+    {
+      double acc[3];
+      double vel[3];
+      bool armed = (i >= warmupSamples);
+      uint32_t time_ms = (armed == true) ? (i - warmupSamples) * ALARM_BENCHMARK_SAMPLE_PERIOD_MS : 0;
+
+      this->generate_sample(_scenario, armed, time_ms, dt_s, acc, vel);
+
+      if (i == warmupSamples)
+        alarm.switch_state();
+
+      uint32_t start = ESP.getCycleCount();
+      struct strAlarmData data = alarm.update(false, acc[0], acc[1], acc[2], vel[0], vel[1], vel[2], (_use_motion == true) ? dt_s : 0.0);
+      uint32_t stop = ESP.getCycleCount();
+
+      if (armed == false)
+        continue;
+
+      result.samples++;
+      result.cycles += (uint32_t)(stop - start);
+
+      if (data.alarmStatus == ALARM_STATUS_TRIGGERED)
+      {
+        bool isEvent = (_scenario.eventStart_s >= 0) && (time_ms >= (uint32_t)_scenario.eventStart_s * 1000);
+
+        if (isEvent == false)
+          result.falsePositives++;
+        else if (result.latency_ms < 0)
+          result.latency_ms = time_ms - _scenario.eventStart_s * 1000;
+
+        // Re-arm on the current attitude, as the user would do
+        alarm.switch_state();
+        alarm.switch_state();
+      }
+
+      if ((i % 1000) == 0)
+        yield();
+    }
+
+    return result;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Synthesize the next sample of a recording
+  // @param _scenario : labelled recording
+  // @param _armed    : false during the warm-up period
+  // @param _time_ms  : time since the alarm was armed
+  // @param _dt_s     : sample period
+  // @param _acc      : output, acceleration (g)
+  // @param _vel      : output, angular velocity (°/s)
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void generate_sample (const struct strAlarmScenario& _scenario, bool _armed, uint32_t _time_ms, double _dt_s, double* _acc, double* _vel)
+  {
+    double t_s = (double)_time_ms / 1000.0;
+    double rate[3] = {0.0, 0.0, 0.0};     // Mount rotation rate (°/s)
+    double linear[3] = {0.0, 0.0, 0.0};   // Non gravity acceleration (g)
+
+    if (_armed == true)
+    {
+      switch (_scenario.type)
+      {
+        // Gust of ~8s every ~45s : the tube sways at 1.1Hz and comes back to its position
+        case ALARM_SCENARIO_WIND:
+        {
+          double phase = fmod(t_s, 45.0);
+          if (phase < _dt_s)
+            this->disturbance = ALARM_BENCHMARK_GUST_MAX_G * (0.3 + 0.7 * this->uniform());
+          if (phase < 8.0)
+          {
+            double envelope = sin(M_PI * phase / 8.0);
+            rate[0]   = 0.15 * envelope * cos(2.0 * M_PI * 1.1 * t_s);
+            linear[1] = this->disturbance * envelope * sin(2.0 * M_PI * 1.1 * t_s);
+          }
+          break;
+        }
+
+        // A walker every 2 minutes, 12 steps at 2Hz, each step rocks the ground back and forth
+        case ALARM_SCENARIO_WALKING:
+        {
+          double phase = fmod(t_s, 120.0);
+          if ((phase < 6.0) && (fmod(phase, 0.5) < _dt_s))
+          {
+            linear[2] = ALARM_BENCHMARK_STEP_MAX_G * (0.3 + 0.7 * this->uniform());
+            rate[1]   = ((uint32_t)(phase / 0.5) % 2 == 0) ? 0.1 : -0.1;
+          }
+          break;
+        }
+
+        // The mount is hit : it rolls in 0.4s, then stays there. Gravity on Y moves by the amplitude of the recording.
+        case ALARM_SCENARIO_BUMP:
+        {
+          // Two samples of 0.2s, the bounds are kept away from the sample times
+          double eventTime = t_s - _scenario.eventStart_s;
+          if ((eventTime > (-_dt_s / 2.0)) && (eventTime < (0.4 - _dt_s / 2.0)))
+          {
+            double start = 0.4 * M_PI / 180.0;
+            double target = asin(sin(start) + _scenario.amplitude * ALARM_ACCELERATION_MARGIN_G / cos(-0.7 * M_PI / 180.0));
+            rate[0] = (target - start) * 180.0 / M_PI / 0.4;
+          }
+          break;
+        }
+
+        // The mount slowly rotates (tripod leg sinking, clutch slipping)
+        case ALARM_SCENARIO_SLOW_ROTATION:
+        {
+          if (t_s >= _scenario.eventStart_s)
+            rate[2] = 0.08;
+          break;
+        }
+
+        default:
+          break;
+      }
+    }
+
+    this->roll  += rate[0] * _dt_s;
+    this->pitch += rate[1] * _dt_s;
+    this->yaw   += rate[2] * _dt_s;
+
+    // Gravity projection of the mount attitude, plus linear acceleration and sensor noise
+    double r = this->roll * M_PI / 180.0;
+    double p = this->pitch * M_PI / 180.0;
+
+    _acc[0] = -sin(p) + linear[0] + this->gaussian(ALARM_BENCHMARK_NOISE_ACC_G);
+    _acc[1] = sin(r) * cos(p) + linear[1] + this->gaussian(ALARM_BENCHMARK_NOISE_ACC_G);
+    _acc[2] = cos(r) * cos(p) + linear[2] + this->gaussian(ALARM_BENCHMARK_NOISE_ACC_G);
+
+    for (uint8_t i=0; i<3; i++)
+      _vel[i] = rate[i] + this->gaussian(ALARM_BENCHMARK_NOISE_VEL_DPS);
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Deterministic pseudo random number (xorshift32)
+  // @return value in ]0;1]
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  double uniform (void)
+  {
+    this->prngState ^= this->prngState << 13;
+    this->prngState ^= this->prngState >> 17;
+    this->prngState ^= this->prngState << 5;
+
+    return ((double)this->prngState + 1.0) / 4294967296.0;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Deterministic gaussian noise (Box-Muller)
+  // @param _sigma : standard deviation
+  // @return noise value
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  double gaussian (double _sigma)
+  {
+    double u1 = this->uniform();
+    double u2 = this->uniform();
+
+    return _sigma * sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+  }
+};
@@ -18,6 +18,10 @@
  *********************************************************************************************************************/
 
 
+/** I N C L U D E S **************************************************************************************************/
+#include "motionDetector.h"
+
+
 /** D E F I N E S ****************************************************************************************************/
 // Alarm state
 #define ALARM_STATE_ON                  (0)
@@ -30,6 +34,14 @@
 #define ALARM_STATUS_TRIGGERED          (1)
 #define ALARM_STATUS_WARNING            (2)
 
+// Alarm trigger source
+#define ALARM_TRIGGER_NONE              (0)
+#define ALARM_TRIGGER_ACCELERATION      (1)
+#define ALARM_TRIGGER_MOTION            (2)   // Gyro + acceleration fusion
+
+// Detection
+#define ALARM_ACCELERATION_MARGIN_G     (0.06)
+
 // TImeout
 #define REFRESH_WARNING_TIMEOUT_MS      (10000)
 
@@ -39,6 +51,7 @@ struct strAlarmData
 {
   uint8_t alarmState;
   uint8_t alarmStatus;
+  uint8_t alarmTrigger;
 
   // Inititial acceleration values
   double XaccInit;
@@ -57,7 +70,9 @@ class AlarmManager
 {
 private:
   uint32_t refresh_timestamp_ms;
+  double accelerationMargin_g;
   struct strAlarmData alarmData;
+  MotionDetector motionDetector;
   
   
 public:
@@ -67,8 +82,10 @@ public:
   AlarmManager (void)
   {
     this->refresh_timestamp_ms    = 0;
+    this->accelerationMargin_g    = ALARM_ACCELERATION_MARGIN_G;
     this->alarmData.alarmStatus   = ALARM_STATUS_NOT_TRIGGERED;
     this->alarmData.alarmState    = ALARM_STATE_OFF;
+    this->alarmData.alarmTrigger  = ALARM_TRIGGER_NONE;
     this->alarmData.XaccInit      = 0.0;
     this->alarmData.YaccInit      = 0.0;
     this->alarmData.ZaccInit      = 0.0;
@@ -87,6 +104,8 @@ public:
     {
       this->alarmData.alarmState  = ALARM_STATE_OFF;
       this->alarmData.alarmStatus = ALARM_STATUS_NOT_TRIGGERED;
+      this->alarmData.alarmTrigger = ALARM_TRIGGER_NONE;
+      this->motionDetector.disarm();
       Serial.println("ALARM : OFF");
     }
     else
@@ -99,7 +118,16 @@ public:
   }
   
   /*-------------------------------------------------------------------------------------------------------------------*/
-  // @brief [PUBLIC] Update the alarm state
+  // @brief [PUBLIC] Set the acceleration margin, ALARM_ACCELERATION_MARGIN_G by default (used to tune it)
+  // @param _margin_g : margin on each axis (g)
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void set_acceleration_margin (double _margin_g)
+  {
+    this->accelerationMargin_g = _margin_g;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Update the alarm state, acceleration only
   // @param _signal_lost : true if the root signal was lost, otherwise false
   // @param _Xacc : acceleration on X
   // @param _Yacc : acceleration on Y
@@ -108,7 +136,24 @@ public:
   /*-------------------------------------------------------------------------------------------------------------------*/
   struct strAlarmData update (bool _signal_lost, double _Xacc, double _Yacc, double _Zacc)
   {
-    double margin = 0.06;
+    return this->update(_signal_lost, _Xacc, _Yacc, _Zacc, 0.0, 0.0, 0.0, 0.0);
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Update the alarm state
+  // @param _signal_lost : true if the root signal was lost, otherwise false
+  // @param _Xacc : acceleration on X
+  // @param _Yacc : acceleration on Y
+  // @param _Zacc : acceleration on Z
+  // @param _Xvel : angular velocity on X
+  // @param _Yvel : angular velocity on Y
+  // @param _Zvel : angular velocity on Z
+  // @param _dt_s : elapsed time since the previous sample, 0 if values are not a new sample
+  // @return strAlarmData data
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  struct strAlarmData update (bool _signal_lost, double _Xacc, double _Yacc, double _Zacc, double _Xvel, double _Yvel, double _Zvel, double _dt_s)
+  {
+    double margin = this->accelerationMargin_g;
 
     // When we enable alarm, we record current inclinometer data to display these when alarm is triggered
     if (this->alarmData.alarmState == ALARM_STATE_ENABLING)
@@ -117,8 +162,14 @@ public:
       this->alarmData.YaccInit      = _Yacc;
       this->alarmData.ZaccInit      = _Zacc;
       this->alarmData.alarmState    = ALARM_STATE_ON;
+      this->motionDetector.arm(_Xacc, _Yacc, _Zacc);
     }
 
+    // Feed the motion detector with every sample, it learns the gyro bias while disarmed
+    bool motionDetected = false;
+    if (_signal_lost == false)
+      motionDetected = this->motionDetector.update(_Xacc, _Yacc, _Zacc, _Xvel, _Yvel, _Zvel, _dt_s);
+
     this->alarmData.XaccCurrent   = _Xacc;
     this->alarmData.YaccCurrent   = _Yacc;
     this->alarmData.ZaccCurrent   = _Zacc;
@@ -130,14 +181,29 @@ public:
       if (_signal_lost == false)
       {
         // Check trigger
-        if ((this->alarmData.alarmState == ALARM_STATE_LOCKED) 
-          || ((!this->is_in_range(this->alarmData.XaccInit, this->alarmData.XaccCurrent, margin) 
-          ||   !this->is_in_range(this->alarmData.YaccInit, this->alarmData.YaccCurrent, margin) 
-          ||   !this->is_in_range(this->alarmData.ZaccInit, this->alarmData.ZaccCurrent, margin))))
+        bool accelerationDetected = (!this->is_in_range(this->alarmData.XaccInit, this->alarmData.XaccCurrent, margin) 
+                                  || !this->is_in_range(this->alarmData.YaccInit, this->alarmData.YaccCurrent, margin) 
+                                  || !this->is_in_range(this->alarmData.ZaccInit, this->alarmData.ZaccCurrent, margin));
+
+        if ((this->alarmData.alarmState == ALARM_STATE_LOCKED) || (accelerationDetected == true) || (motionDetected == true))
         {
           this->alarmData.alarmState  = ALARM_STATE_LOCKED;
           this->alarmData.alarmStatus = ALARM_STATUS_TRIGGERED;
-          Serial.println("ALARM : TRIGGERED");
+
+          if (accelerationDetected == true)
+          {
+            this->alarmData.alarmTrigger = ALARM_TRIGGER_ACCELERATION;
+            Serial.println("ALARM : TRIGGERED (acceleration)");
+          }
+          else
+          {
+            this->alarmData.alarmTrigger = ALARM_TRIGGER_MOTION;
+            Serial.print("ALARM : TRIGGERED (motion, rotation=");
+            Serial.print(this->motionDetector.get_rotation());
+            Serial.print("° tilt=");
+            Serial.print(this->motionDetector.get_tilt_deviation());
+            Serial.println("°)");
+          }
         }
         else
         {
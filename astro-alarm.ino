@@ -19,14 +19,34 @@
 
 
 /** I N C L U D E S **************************************************************************************************/
-#include <vector>
+#include "bootTimeline.h"
+#include "memoryTracker.h"
+#include "powerManager.h"
+#include "boardManager.h"
 #include "inclinometer.h"
+#include "networkProtocol.h"
+#include "clockSync.h"
+#include "linkQuality.h"
+#include "transport.h"
+#ifdef CONFIG_TRANSPORT_ESPNOW
+#include "transportEspNow.h"
+#else
+#include "transportTcp.h"
+#endif
 #include "buttonManager.h"
 #include "wifiManager.h"
+#include "httpServer.h"
 #include "tftManager.h"
 #include "soundManager.h"
-#include "drawerManager.h"
 #include "alarmManager.h"
+#include "flightRecorder.h"
+#include "telemetryStream.h"
+#include "pixelKernels.h"
+#include "drawerManager.h"
+#include "alarmBenchmark.h"
+#include "protocolBenchmark.h"
+#include "pixelBenchmark.h"
+#include "loopProfiler.h"
 
 
 /** D E F I N E S ****************************************************************************************************/
@@ -34,244 +54,574 @@
 #define GPIO_IN_BUTTON              (14)
 #define GPIO_OUT_BUZZER             (21)
 
-// Board modes
-#define BOARD_MODE_UNKNOWN          (0)
-#define BOARD_MODE_SERVER           (1)
-#define BOARD_MODE_CLIENT           (2)
-
 // Timers
 #define TIMER_REFRESH_WIFI_DATA_MS  (200)
-#define TIMER_IDENTIFY_BOARD_MS     (2000)
 
-
-/** S T R U C T S ****************************************************************************************************/
-struct strComData
-{
-  uint8_t error;
-  struct strAngular incAngular;
-  struct strAngularVelocity inclAngularVelocity;
-  struct strAcceleration incAcceleration;
-};
+// Views
+#define VIEW_LIVE                   (0)   // Inclinometer target
+#define VIEW_STRIP_CHART            (1)   // History of the acceleration deviation and of the angle error
 
 
 /** D E C L A R A T I O N S ******************************************************************************************/
 // Board
-uint8_t boardMode = BOARD_MODE_UNKNOWN;
+BoardManager boardMgr     = BoardManager();
+uint8_t boardMode         = BOARD_MODE_UNKNOWN;
 
 // Devices
-Inclinometer inclinometer = Inclinometer();
 ButtonManager buttonMain  = ButtonManager(GPIO_IN_BUTTON);
-WifiManager wifiMgr       = WifiManager();
+#ifdef CONFIG_TRANSPORT_ESPNOW
+TransportEspNow transport = TransportEspNow();
+#else
+TransportTcp transport    = TransportTcp();
+#endif
+WifiManager wifiMgr       = WifiManager(&transport);
 TftManager tftMgr         = TftManager();
 
 // UI
 DrawerManager drawerMgr   = DrawerManager();
-SoundManager soundMgr     = SoundManager(GPIO_OUT_BUZZER);
-AlarmManager alarmMgr     = AlarmManager();
-
-// Timer
-unsigned long timerToIdentifyBoard_ms = millis();
-unsigned long timerButtonDelay_ms     = millis();
+TelemetryStream telemetry = TelemetryStream();
+uint8_t viewMode          = VIEW_LIVE;
 
-// Memory
+#ifdef BOARD_WITH_SERVER_ROLE
+// Server
+Inclinometer inclinometer = Inclinometer();
+HttpServer httpServer     = HttpServer();
+unsigned long timerStripSample_ms     = millis();
+unsigned long timerHttpPublish_ms     = millis();
 struct strAngular incAngularMemory;
+char networkFrame[COM_DATA_FRAME_SIZE];
+#endif
+
+#ifdef BOARD_WITH_CLIENT_ROLE
+// Client
+SoundManager soundMgr     = SoundManager(GPIO_OUT_BUZZER);
+AlarmManager alarmMgr     = AlarmManager();
+FlightRecorder recorder   = FlightRecorder();
+unsigned long timerLastSample_ms      = millis();
+uint32_t timestampLastSample_ms       = 0;
+#endif
 
 
 /** M A I N  F U N C T I O N S ***************************************************************************************/
 void setup (void)
 {
-  // Used to mesure the battery voltage
-  analogReadResolution(12);
+  BootTimeline::mark("setup");
 
   // Debug connection
   Serial.begin(115200);
 
+  // Start wifi first, the association with the router runs in background during the other initializations
+  wifiMgr.start();
+  BootTimeline::mark("wifi started");
+
+  // Power the screen, then the display is initialized by the drawer task in parallel
+  tftMgr.start();
+  drawerMgr.start();
+  BootTimeline::mark("display started");
+
   // Uart for the inclinometer
+  #ifdef BOARD_WITH_SERVER_ROLE
   Serial1.begin(115200, SERIAL_8N1, 18, 17);  // RX2=GPIO18, TX2=GPIO17
+  Serial1.onReceiveError(inclinometer_uart_error);
+  PowerManager::enable_uart_wakeup(UART_NUM_1);  // GPIO18 is the IO MUX pin of the UART1 RX
+  BootTimeline::mark("uart started");
+  #endif
 
-  // Start wifi
-  wifiMgr.start();
+  // Used to mesure the battery voltage
+  analogReadResolution(12);
+
+  // Inputs and outputs
+  buttonMain.start();
+  #ifdef BOARD_WITH_CLIENT_ROLE
+  soundMgr.start();
+  #endif
+
+  // Last known board mode is used immediately, it is confirmed in background by the loop
+  set_board_mode(boardMgr.start());
+  BootTimeline::mark("board mode loaded");
 
   // Initial value
+  #ifdef BOARD_WITH_SERVER_ROLE
   incAngularMemory.version = 0;
+  #endif
+
+  #if defined(CONFIG_ALARM_BENCHMARK_ENABLED) && defined(BOARD_WITH_CLIENT_ROLE)
+  AlarmBenchmark alarmBenchmark = AlarmBenchmark();
+  alarmBenchmark.run();
+  #endif
+
+  #ifdef CONFIG_PROTOCOL_BENCHMARK_ENABLED
+  ProtocolBenchmark protocolBenchmark = ProtocolBenchmark();
+  protocolBenchmark.run();
+  #endif
+
+  #ifdef CONFIG_PIXEL_BENCHMARK_ENABLED
+  PixelBenchmark pixelBenchmark = PixelBenchmark();
+  pixelBenchmark.run();
+  #endif
+
+  // Frequency scaling and light sleep, the loop gives the reasons to stay awake
+  PowerManager::start();
+
+  // The loop draws from its first iteration
+  drawerMgr.wait_ready();
+
+  #ifdef CONFIG_PIXEL_BENCHMARK_ENABLED
+  drawerMgr.benchmark_push();
+  #endif
+  BootTimeline::mark("setup done");
+
+  // From now, the loop should not allocate memory anymore
+  MemoryTracker::start_steady_state();
 }
 
 /*-------------------------------------------------------------------------------------------------------------------*/
 void loop (void)
 {
-  int8_t wifiStrength;
-  uint8_t wifiAppStatus;
-  struct strComData comData;
+  uint8_t wifiAppStatus = CONNECTION_STATUS_APP_DISCONNECTED;
 
   // --- COMMON --------------------------------------
-  // First loop, identify the board
-  if (boardMode == BOARD_MODE_UNKNOWN)
+  // Identify the board, the mode is corrected if it is not the stored one
+  #ifdef BOARD_WITH_SERVER_ROLE
+  uint8_t detectedMode = boardMgr.update(inclinometer.is_new_data_ready());
+  #else
+  uint8_t detectedMode = boardMgr.update(false);
+  #endif
+  if ((detectedMode != BOARD_MODE_UNKNOWN) && (detectedMode != boardMode))
   {
-    if (identify_board () == BOARD_MODE_UNKNOWN)
-      return;
+    if (boardMode != BOARD_MODE_UNKNOWN)
+      wifiMgr.reset();
+
+    set_board_mode(detectedMode);
   }
 
+  // Very first start, nothing is known yet
+  if (boardMode == BOARD_MODE_UNKNOWN)
+    return;
+
+  #ifdef CONFIG_LOOP_PROFILER_ENABLED
+  LoopProfiler::begin();
+  #endif
+
   // Battery status
   double Vbat_volt = ((double)analogRead(4) * 2.0 * 3.3) / 4096.0;
   double Vbat_percentage = (Vbat_volt * 100.0) / 4.0;
 
-
-  // --- SERVER --------------------------------------
+  // Role specific loop
+  #ifdef BOARD_WITH_SERVER_ROLE
   if (boardMode == BOARD_MODE_SERVER)
+    wifiAppStatus = loop_server(Vbat_percentage, Vbat_volt);
+  #endif
+
+  #ifdef BOARD_WITH_CLIENT_ROLE
+  if (boardMode == BOARD_MODE_CLIENT)
+    wifiAppStatus = loop_client(Vbat_percentage, Vbat_volt);
+  #endif
+
+  // Update
+  MEMORY_TRACKER_SITE("draw");
+  drawerMgr.draw_update();
+  drawerMgr.report();
+  tftMgr.update();
+
+  #ifdef CONFIG_LOOP_PROFILER_ENABLED
+  LoopProfiler::end();
+  LoopProfiler::report((boardMode == BOARD_MODE_SERVER) ? "SERVER" : "CLIENT");
+  #endif
+
+  // Boot is over when the link between the boards is up
+  static bool isFirstFrameMarked = false;
+  if (isFirstFrameMarked == false)
   {
-    // ------ Process inclinometer data --------
-    inclinometer.process_data ();
-    //inclinometer.show_data ();
-    comData.incAcceleration     = inclinometer.get_acceleration_data();
-    comData.inclAngularVelocity = inclinometer.get_angular_velocity_data();
-    comData.incAngular          = inclinometer.get_angular_data();
+    BootTimeline::mark("first frame");
+    isFirstFrameMarked = true;
+  }
+  if (wifiAppStatus == CONNECTION_STATUS_APP_CONNECTED)
+  {
+    BootTimeline::mark("link connected");
+    BootTimeline::print();
+  }
+  MEMORY_TRACKER_SITE("other");
+  #ifdef CONFIG_MEMORY_TRACKER_ENABLED
+  MemoryTracker::report();
+  #endif
+  PowerManager::report();
+  PowerManager::idle(10);
+}
 
-    // ------ Read button state ------------------
-    uint8_t buttonState = buttonMain.update();
+#ifdef BOARD_WITH_SERVER_ROLE
+/*-------------------------------------------------------------------------------------------------------------------*/
+uint8_t loop_server (double _battery_percentage, double _battery_voltage)
+{
+  int32_t linkRtt_ms;
+  struct strLinkQuality linkQuality;
+  uint8_t wifiAppStatus;
+  struct strComData comData;
 
-    if (buttonState == BUTTON_SHORT_PUSH)
-    {
-      if ((millis()-timerButtonDelay_ms) > 1000)
-        tftMgr.switch_state();
-    }
-    else if (buttonState == BUTTON_LONG_PUSH)
+  // ------ Process inclinometer data --------
+  MEMORY_TRACKER_SITE("inclinometer");
+  uint8_t updatedPackets = inclinometer.process_data();
+  //inclinometer.show_data ();
+  comData.incAcceleration     = inclinometer.get_acceleration_data();
+  comData.inclAngularVelocity = inclinometer.get_angular_velocity_data();
+  comData.incAngular          = inclinometer.get_angular_data();
+  comData.timestamp_ms        = (uint32_t)(ClockSync::local_time_us() / 1000);
+  comData.sensorHealth        = inclinometer.get_health().state;
+  if (updatedPackets != 0)
+    telemetry.send_sample(comData, comData.timestamp_ms, TELEMETRY_SOURCE_INCLINOMETER);
+  inclinometer.report();
+
+  // ------ Read button state ------------------
+  uint8_t buttonEvent = buttonMain.update();
+
+  if (buttonEvent == BUTTON_SHORT_PUSH)
+    tftMgr.switch_state();
+  else if (buttonEvent == BUTTON_LONG_PUSH)
+    incAngularMemory = comData.incAngular;
+  else if (buttonEvent == BUTTON_DOUBLE_PUSH)
+    switch_view();
+
+  // ------ Wifi management --------------------
+  MEMORY_TRACKER_SITE("wifi");
+  wifiAppStatus = wifiMgr.server_update();
+  linkQuality   = wifiMgr.get_link_quality()->get_data();
+  linkRtt_ms    = (linkQuality.health == LINK_HEALTH_UNKNOWN) ? -1 : (int32_t)(linkQuality.rtt_us / 1000);
+  if (wifiMgr.is_time_to_send(TIMER_REFRESH_WIFI_DATA_MS))
+  {
+    MEMORY_TRACKER_SITE("network_prepare_data");
+    network_prepare_data(comData, networkFrame, sizeof(networkFrame));
+    MEMORY_TRACKER_SITE("wifi");
+    wifiMgr.send_data(networkFrame, TIMER_REFRESH_WIFI_DATA_MS);
+  }
+  wifiMgr.report_tx();
+  wifiMgr.get_link_quality()->report();
+  telemetry.update_link(wifiAppStatus, linkQuality.rssi_dBm, NULL, comData.timestamp_ms);
+
+  // ------ Status page ------------------------
+  MEMORY_TRACKER_SITE("http");
+  httpServer.update();
+  if ((millis()-timerHttpPublish_ms) >= TIMER_REFRESH_WIFI_DATA_MS)
+  {
+    struct strHttpStatus status;
+    for (uint8_t i=0; i<3; i++)
     {
-      incAngularMemory = comData.incAngular;
-      timerButtonDelay_ms = millis();
+      status.angle[i]         = comData.incAngular.angle[i];
+      status.acceleration[i]  = comData.incAcceleration.acceleration[i];
     }
-  
-    // ------ Wifi management --------------------
-    wifiAppStatus = wifiMgr.server_update();
-    wifiStrength  = wifiMgr.signal_strength();
-    wifiMgr.send_data(network_prepare_data(comData), TIMER_REFRESH_WIFI_DATA_MS);
+    status.temperature        = comData.incAcceleration.temperature;
+    status.batteryPercentage  = _battery_percentage;
+    status.batteryVoltage     = _battery_voltage;
+    status.isClientConnected  = (wifiAppStatus == CONNECTION_STATUS_APP_CONNECTED);
+    status.sensorHealth       = comData.sensorHealth;
+    wifiMgr.get_alarm_state(&status.alarmState, &status.alarmStatus);
+
+    httpServer.publish(status);
+    timerHttpPublish_ms = millis();
+  }
+
+  // ------ Serial commands ------------------
+  while (Serial.available())
+    process_serial_command(Serial.read());
+
+  // ------ Screen drawing ---------------------
+  MEMORY_TRACKER_SITE("draw");
+  double angleError_deg = get_angle_error(comData.incAngular);
+  if ((millis()-timerStripSample_ms) >= TIMER_REFRESH_WIFI_DATA_MS)
+  {
+    drawerMgr.add_strip_sample(0.0, angleError_deg);
+    timerStripSample_ms = millis();
+  }
 
-    // ------ Screen drawing ---------------------
+  if (viewMode == VIEW_STRIP_CHART)
+  {
+    drawerMgr.draw_strip_chart(0.0, angleError_deg);
+    drawerMgr.draw_ping_status(wifiMgr.is_ping_received());
+    drawerMgr.draw_wifi_status(get_color_from_wifi_status(wifiAppStatus), get_color_from_link_health(linkQuality.health), linkRtt_ms);
+  }
+  else
+  {
     drawerMgr.draw_background();
     drawerMgr.draw_ping_status(wifiMgr.is_ping_received());
-    drawerMgr.draw_wifi_status(get_color_from_wifi_status(wifiAppStatus), wifiStrength);
+    drawerMgr.draw_wifi_status(get_color_from_wifi_status(wifiAppStatus), get_color_from_link_health(linkQuality.health), linkRtt_ms);
     drawerMgr.draw_north_point(comData.incAngular.angle[2]);
     drawerMgr.draw_main_point(comData.incAngular.angle[0], comData.incAngular.angle[1]);
     drawerMgr.draw_inclinometer_values(comData.incAngular.angle[0], comData.incAngular.angle[1]);
     drawerMgr.draw_temperature_value(comData.incAcceleration.temperature);
-    drawerMgr.draw_battery_data(Vbat_percentage, Vbat_volt);
+    drawerMgr.draw_battery_data(_battery_percentage, _battery_voltage);
     if (incAngularMemory.version > 0)
       drawerMgr.draw_memory_values(incAngularMemory.angle[0], incAngularMemory.angle[1]);
   }
-  
 
-  // --- CLIENT --------------------------------------
-  if (boardMode == BOARD_MODE_CLIENT)
+  // The sensor status is shown only when its values are not reliable
+  if (comData.sensorHealth >= INCLINOMETER_HEALTH_DEGRADED)
+    drawerMgr.draw_sensor_status(get_color_from_sensor_health(comData.sensorHealth), Inclinometer::get_health_text(comData.sensorHealth));
+
+  // ------ Power ------------------------------
+  // While the sensor streams, light sleep would lose its bytes. A stale sensor wakes the board up when it is back.
+  uint32_t awakeReasons = get_awake_reasons(buttonEvent);
+  if ((comData.sensorHealth == INCLINOMETER_HEALTH_OK) || (comData.sensorHealth == INCLINOMETER_HEALTH_DEGRADED))
+    awakeReasons |= POWER_AWAKE_SENSOR;
+  PowerManager::set_awake(awakeReasons);
+
+  return wifiAppStatus;
+}
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+void serialEvent1 (void) 
+{
+  PowerManager::acquire(POWER_LOCK_CPU);
+  while (Serial1.available())
   {
-    // ------ Read button state ------------------
-    uint8_t buttonState = buttonMain.update();
+    inclinometer.read(Serial1.read());
+  }
+  PowerManager::release(POWER_LOCK_CPU);
+}
 
-    if (buttonState == BUTTON_SHORT_PUSH)
-    {
-      if ((millis()-timerButtonDelay_ms) > 1000)
-        tftMgr.switch_state();
-    }
-    if (buttonState == BUTTON_LONG_PUSH)
-    {
-      if (alarmMgr.switch_state() == ALARM_STATE_ENABLING)
-        tftMgr.enable_auto_shutdown();
-      else
-        tftMgr.disable_auto_shutdown();
+/*-------------------------------------------------------------------------------------------------------------------*/
+void inclinometer_uart_error (hardwareSerial_error_t _error)
+{
+  // Bytes lost by the UART, the other errors are seen as checksum errors or resynchronizations
+  if ((_error == UART_BUFFER_FULL_ERROR) || (_error == UART_FIFO_OVF_ERROR))
+    inclinometer.count_overrun();
+}
+#endif
 
-      soundMgr.play_mode_change();
-      timerButtonDelay_ms = millis();
-    }
+#ifdef BOARD_WITH_CLIENT_ROLE
+/*-------------------------------------------------------------------------------------------------------------------*/
+uint8_t loop_client (double _battery_percentage, double _battery_voltage)
+{
+  int32_t linkRtt_ms;
+  struct strLinkQuality linkQuality;
+  uint8_t wifiAppStatus;
+  struct strComData comData;
 
-    // ------ Wifi management --------------------
-    wifiAppStatus = wifiMgr.client_update();
-    wifiStrength  = wifiMgr.signal_strength();
-    comData = network_parse_data(wifiMgr.read_data(true));
+  // ------ Read button state ------------------
+  MEMORY_TRACKER_SITE("button");
+  uint8_t buttonEvent = buttonMain.update();
 
-    // ------ Alarm update -----------------------
-    bool connection_lost = false;
-    if (wifiAppStatus != CONNECTION_STATUS_APP_CONNECTED)
-      connection_lost = true;
-    struct strAlarmData alarmData = alarmMgr.update(connection_lost, comData.incAcceleration.acceleration[0], comData.incAcceleration.acceleration[1], comData.incAcceleration.acceleration[2]);
+  if (buttonEvent == BUTTON_SHORT_PUSH)
+    tftMgr.switch_state();
+  else if (buttonEvent == BUTTON_LONG_PUSH)
+  {
+    if (alarmMgr.switch_state() == ALARM_STATE_ENABLING)
+      tftMgr.enable_auto_shutdown();
+    else
+      tftMgr.disable_auto_shutdown();
 
-    // ------ Screen drawing ---------------------
+    soundMgr.play_mode_change();
+  }
+  else if (buttonEvent == BUTTON_DOUBLE_PUSH)
+    switch_view();
+
+  // ------ Wifi management --------------------
+  MEMORY_TRACKER_SITE("wifi");
+  wifiAppStatus = wifiMgr.client_update();
+  linkQuality   = wifiMgr.get_link_quality()->get_data();
+  linkRtt_ms    = (linkQuality.health == LINK_HEALTH_UNKNOWN) ? -1 : (int32_t)(linkQuality.rtt_us / 1000);
+  const char* networkData = wifiMgr.read_data(true);
+  MEMORY_TRACKER_SITE("network_parse_data");
+  comData = network_parse_data(networkData);
+
+  if (comData.error > COM_DATA_ERROR_NO_DATA)
+  {
+    Serial.print("ERROR : invalid data from network, frame dropped (error=");
+    Serial.print(comData.error);
+    Serial.println(")");
+  }
+  wifiMgr.get_clock_sync()->report(comData.timestamp_ms);
+  wifiMgr.report_tx();
+  wifiMgr.get_link_quality()->report();
+
+  // ------ Alarm update -----------------------
+  MEMORY_TRACKER_SITE("alarm");
+  bool connection_lost = false;
+  if (wifiAppStatus != CONNECTION_STATUS_APP_CONNECTED)
+    connection_lost = true;
+
+  // A stale sensor is a lost signal too, its last values would look calm
+  if (comData.sensorHealth == INCLINOMETER_HEALTH_STALE)
+    connection_lost = true;
+
+  // Elapsed time since the previous sample, only when a new frame was received.
+  // Server timestamps are used when available, they are not affected by the network jitter.
+  double sampleDt_s = 0.0;
+  if (comData.error == 0)
+  {
+    if ((comData.timestamp_ms != 0) && (timestampLastSample_ms != 0))
+      sampleDt_s = (double)(comData.timestamp_ms - timestampLastSample_ms) / 1000.0;
+    else
+      sampleDt_s = (double)(millis()-timerLastSample_ms) / 1000.0;
+
+    timerLastSample_ms     = millis();
+    timestampLastSample_ms = comData.timestamp_ms;
+  }
+
+  PowerManager::begin_alarm();
+  struct strAlarmData alarmData = alarmMgr.update(connection_lost,
+                                                  comData.incAcceleration.acceleration[0], comData.incAcceleration.acceleration[1], comData.incAcceleration.acceleration[2],
+                                                  comData.inclAngularVelocity.velocity[0], comData.inclAngularVelocity.velocity[1], comData.inclAngularVelocity.velocity[2],
+                                                  sampleDt_s);
+  wifiMgr.set_alarm_state(alarmData.alarmState, alarmData.alarmStatus);
+
+  // The sound of an alarm delays the next evaluation on purpose
+  PowerManager::end_alarm(alarmData.alarmStatus == ALARM_STATUS_NOT_TRIGGERED);
+
+  // ------ Power ------------------------------
+  // The buzzer is stopped in light sleep
+  uint32_t awakeReasons = get_awake_reasons(buttonEvent);
+  if (alarmData.alarmStatus != ALARM_STATUS_NOT_TRIGGERED)
+    awakeReasons |= POWER_AWAKE_ALARM;
+  PowerManager::set_awake(awakeReasons);
+
+  // ------ Flight recorder --------------------
+  MEMORY_TRACKER_SITE("recorder");
+  // Server time of the frame, only for a new one : otherwise comData still holds the previous frame. Between two frames
+  // and during a link loss, the synchronized clock gives the server time, or millis() without synchronization.
+  uint32_t sampleTime_ms = millis();
+  if ((comData.error == COM_DATA_ERROR_NONE) && (comData.timestamp_ms != 0))
+    sampleTime_ms = comData.timestamp_ms;
+  else if (wifiMgr.get_clock_sync()->is_synced() == true)
+    sampleTime_ms = (uint32_t)(wifiMgr.get_clock_sync()->to_server_time_us(ClockSync::local_time_us()) / 1000);
+  if (comData.error == COM_DATA_ERROR_NONE)
+    recorder.record(comData, sampleTime_ms);
+  recorder.update_alarm(alarmData, sampleTime_ms);
+
+  // ------ Telemetry --------------------------
+  MEMORY_TRACKER_SITE("telemetry");
+  if (comData.error == COM_DATA_ERROR_NONE)
+    telemetry.send_sample(comData, sampleTime_ms, TELEMETRY_SOURCE_NETWORK);
+  telemetry.update_alarm(alarmData, sampleTime_ms);
+  telemetry.update_link(wifiAppStatus, linkQuality.rssi_dBm, wifiMgr.get_clock_sync(), millis());
+
+  while (Serial.available())
+    process_serial_command(Serial.read());
+
+  // ------ Screen drawing ---------------------
+  MEMORY_TRACKER_SITE("draw");
+  // Deviation from the armed position, the angle error is useful during the alignment
+  double accelerationDeviation_mg = 0.0;
+  if (alarmData.alarmState != ALARM_STATE_OFF)
+  {
+    accelerationDeviation_mg = max(abs(alarmData.XaccCurrent - alarmData.XaccInit),
+                                   max(abs(alarmData.YaccCurrent - alarmData.YaccInit), abs(alarmData.ZaccCurrent - alarmData.ZaccInit))) * 1000.0;
+  }
+  double angleError_deg = get_angle_error(comData.incAngular);
+  if (comData.error == COM_DATA_ERROR_NONE)
+    drawerMgr.add_strip_sample(accelerationDeviation_mg, angleError_deg);
+
+  // The live view is forced when the alarm is triggered
+  if ((viewMode == VIEW_STRIP_CHART) && (alarmData.alarmStatus != ALARM_STATUS_TRIGGERED))
+  {
+    drawerMgr.draw_strip_chart(accelerationDeviation_mg, angleError_deg);
+    drawerMgr.draw_ping_status(wifiMgr.is_ping_received());
+    drawerMgr.draw_wifi_status(get_color_from_wifi_status(wifiAppStatus), get_color_from_link_health(linkQuality.health), linkRtt_ms);
+  }
+  else
+  {
     drawerMgr.draw_background();
     drawerMgr.draw_ping_status(wifiMgr.is_ping_received());
-    drawerMgr.draw_wifi_status(get_color_from_wifi_status(wifiAppStatus), wifiStrength);
+    drawerMgr.draw_wifi_status(get_color_from_wifi_status(wifiAppStatus), get_color_from_link_health(linkQuality.health), linkRtt_ms);
     drawerMgr.draw_north_point(comData.incAngular.angle[2]);
     drawerMgr.draw_main_point(comData.incAngular.angle[0], comData.incAngular.angle[1]);
     drawerMgr.draw_inclinometer_values(comData.incAngular.angle[0], comData.incAngular.angle[1]);
     drawerMgr.draw_temperature_value(comData.incAcceleration.temperature);
-    drawerMgr.draw_battery_data(Vbat_percentage, Vbat_volt);
-    drawerMgr.draw_alarm_state(get_color_from_alarm_state(alarmData.alarmState), get_text_from_alarm_state(alarmData.alarmState));
+    drawerMgr.draw_battery_data(_battery_percentage, _battery_voltage);
+  }
+  if (comData.sensorHealth >= INCLINOMETER_HEALTH_DEGRADED)
+    drawerMgr.draw_sensor_status(get_color_from_sensor_health(comData.sensorHealth), Inclinometer::get_health_text(comData.sensorHealth));
+  drawerMgr.draw_alarm_state(get_color_from_alarm_state(alarmData.alarmState), get_text_from_alarm_state(alarmData.alarmState));
 
-    // ALARM TRIGGERED
-    if (alarmData.alarmStatus == ALARM_STATUS_TRIGGERED)
-    {
-      tftMgr.disable_auto_shutdown();
-      tftMgr.enable();
+  // Incident browsing (serial command), the live view is forced when the alarm is triggered
+  if ((recorder.get_browsed_incident() != NULL) && (alarmData.alarmStatus != ALARM_STATUS_TRIGGERED))
+    drawerMgr.draw_incident(recorder.get_browsed_incident());
 
-      drawerMgr.draw_alarm_data(alarmData.XaccInit, alarmData.YaccInit, alarmData.ZaccInit,
-                                alarmData.XaccCurrent, alarmData.YaccCurrent, alarmData.ZaccCurrent);
-      soundMgr.play_alarm();
-    }
+  // ALARM TRIGGERED
+  if (alarmData.alarmStatus == ALARM_STATUS_TRIGGERED)
+  {
+    tftMgr.disable_auto_shutdown();
+    tftMgr.enable();
+
+    drawerMgr.draw_alarm_data(alarmData.XaccInit, alarmData.YaccInit, alarmData.ZaccInit,
+                              alarmData.XaccCurrent, alarmData.YaccCurrent, alarmData.ZaccCurrent);
+    drawerMgr.draw_incident_trace(recorder.get_last_incident(), 80, 28);
+    MEMORY_TRACKER_SITE("sound");
+    soundMgr.play_alarm();
+  }
 
-    // ALARM WARNING (connection lost)
-    else if (alarmData.alarmStatus == ALARM_STATUS_WARNING)
-    {
-      tftMgr.disable_auto_shutdown();
-      tftMgr.enable();
+  // ALARM WARNING (connection lost)
+  else if (alarmData.alarmStatus == ALARM_STATUS_WARNING)
+  {
+    tftMgr.disable_auto_shutdown();
+    tftMgr.enable();
 
-      soundMgr.play_warning_alarm();
-    }
+    soundMgr.play_warning_alarm();
+  }
 
-    // NO ALARM
+  // NO ALARM
+  else
+  {
+    if (wifiAppStatus != CONNECTION_STATUS_APP_CONNECTED)
+      tftMgr.enable();
     else
-    {
-      if (wifiAppStatus != CONNECTION_STATUS_APP_CONNECTED)
-        tftMgr.enable();
-      else
-        if (alarmData.alarmState != ALARM_STATE_OFF)
-          tftMgr.enable_auto_shutdown();
-          
-      soundMgr.stop_alarm();
-    }    
-  }
+      if (alarmData.alarmState != ALARM_STATE_OFF)
+        tftMgr.enable_auto_shutdown();
+        
+    soundMgr.stop_alarm();
+  }    
 
-  // Update
-  drawerMgr.draw_update();
-  tftMgr.update();
-  delay(10);
+  return wifiAppStatus;
 }
+#endif
 
 /*-------------------------------------------------------------------------------------------------------------------*/
+void process_serial_command (char _command)
+{
+  // 'v' switches the view, other commands are for the telemetry stream and the flight recorder
+  if (telemetry.process_command(_command) == true)
+    return;
 
+  if (_command == 'v')
+    switch_view();
+
+  #ifdef BOARD_WITH_CLIENT_ROLE
+  else if (boardMode == BOARD_MODE_CLIENT)
+    recorder.process_command(_command);
+  #endif
+}
 
 /*-------------------------------------------------------------------------------------------------------------------*/
+void switch_view (void)
+{
+  viewMode = (viewMode == VIEW_LIVE) ? VIEW_STRIP_CHART : VIEW_LIVE;
+  Serial.println((viewMode == VIEW_LIVE) ? "VIEW : LIVE" : "VIEW : STRIP CHART");
+}
 
+/*-------------------------------------------------------------------------------------------------------------------*/
+double get_angle_error (const struct strAngular& _angular)
+{
+  return max(abs(_angular.angle[0]), abs(_angular.angle[1]));
+}
 
 /*-------------------------------------------------------------------------------------------------------------------*/
-void serialEvent1 (void) 
+uint32_t get_awake_reasons (uint8_t _button_event)
 {
-  while (Serial1.available())
-  {
-    inclinometer.read(Serial1.read());
-  }
+  uint32_t reasons = POWER_AWAKE_NONE;
+
+  if (tftMgr.is_enabled() == true)
+    reasons |= POWER_AWAKE_DISPLAY;
+  if (_button_event != BUTTON_NOT_PUSH)
+    reasons |= POWER_AWAKE_INPUT;
+  #ifdef CONFIG_TRANSPORT_ESPNOW
+  reasons |= POWER_AWAKE_RADIO;
+  #endif
+
+  return reasons;
 }
 
 /*-------------------------------------------------------------------------------------------------------------------*/
-uint8_t identify_board (void)
+void set_board_mode (uint8_t _mode)
 {
-  // Indenty the board
-  if (inclinometer.is_new_data_ready())
-  {
-    boardMode = BOARD_MODE_SERVER;
-  }
-  else
-  {
-    if ((millis()-timerToIdentifyBoard_ms)>TIMER_IDENTIFY_BOARD_MS)
-      boardMode = BOARD_MODE_CLIENT;
-    else
-      boardMode = BOARD_MODE_UNKNOWN;
-  }
+  boardMode = _mode;
 
   if (boardMode != BOARD_MODE_UNKNOWN)
   {
@@ -288,155 +638,82 @@ uint8_t identify_board (void)
     {
       Serial.println("CLIENT");
       Serial.println("----------------------------------------------------------------------");
+      tftMgr.disable_auto_shutdown();
       tftMgr.set_auto_shutdown_timeout(2*60*1000);
     }
   }
-
-  return boardMode;
 }
 
 /*-------------------------------------------------------------------------------------------------------------------*/
-std::vector<String> extract_substring (String _input, char _separator)
+uint32_t get_color_from_wifi_status (uint8_t _status)
 {
-  int16_t index      = 0;
-  int16_t lastIndex  = 0;
-  std::vector<String> retval;
+  uint32_t color = 0;
 
-  if (_input != "")
+  switch (_status)
   {
-    while (index != -1)
-    {
-      // Extract part of the string
-      index = _input.indexOf(_separator, lastIndex);
-
-      if (index != -1)
-      {
-        retval.push_back(_input.substring(lastIndex, index));
-        lastIndex = index + 1;
-      }
-      else
-      {
-        retval.push_back(_input.substring(lastIndex));
-      }
-    }
-  }
-
-  return retval;
-}
-
-/*-------------------------------------------------------------------------------------------------------------------*/
-String network_prepare_data (struct strComData _data)
-{
-  String retval = "isAlive=1;";
-
-  retval += "Xac="+String(_data.incAcceleration.acceleration[0])+";";
-  retval += "Yac="+String(_data.incAcceleration.acceleration[1])+";";
-  retval += "Zac="+String(_data.incAcceleration.acceleration[2])+";";
-
-  retval += "Xan="+String(_data.incAngular.angle[0])+";";
-  retval += "Yan="+String(_data.incAngular.angle[1])+";";
-  retval += "Zan="+String(_data.incAngular.angle[2])+";";
+    case CONNECTION_STATUS_APP_DISCONNECTED:
+      color = TFT_RED;
+      break;
 
-  retval += "Xve="+String(_data.inclAngularVelocity.velocity[0])+";";
-  retval += "Yve="+String(_data.inclAngularVelocity.velocity[1])+";";
-  retval += "Zve="+String(_data.inclAngularVelocity.velocity[2])+";";
-  
-  retval += "Tmp="+String(_data.incAcceleration.temperature);
+    case CONNECTION_STATUS_APP_CONNECTING:
+      color = TFT_ORANGE;
+      break;
+    
+    case CONNECTION_STATUS_APP_CONNECTED:
+      color = TFT_GREEN;
+      break;
+    
+    default:
+      color = TFT_DARKGREY;
+      break;
+  }
 
-  return retval;
+  return color;
 }
 
 /*-------------------------------------------------------------------------------------------------------------------*/
-struct strComData network_parse_data (String _data)
+uint32_t get_color_from_link_health (uint8_t _health)
 {
-  static struct strComData retval;
-  
-  if ((_data == "") || (_data.length() == 1))
-  {
-    retval.error = 1;
-    return retval;
-  }
+  uint32_t color = 0;
 
-  // Data initialization
-  retval.error = 0;
-  retval.incAcceleration.acceleration[0] = 0.0;
-  retval.incAcceleration.acceleration[1] = 0.0;
-  retval.incAcceleration.acceleration[2] = 0.0;
-  retval.incAcceleration.temperature     = 0.0;
-  retval.incAngular.angle[0]             = 0.0;
-  retval.incAngular.angle[1]             = 0.0;
-  retval.incAngular.angle[2]             = 0.0;
-  retval.incAngular.version              = 0;
-  retval.inclAngularVelocity.velocity[0] = 0.0;
-  retval.inclAngularVelocity.velocity[1] = 0.0;
-  retval.inclAngularVelocity.velocity[2] = 0.0;
-  retval.inclAngularVelocity.voltage     = 0.0;
-
-  std::vector<String> DataList = extract_substring(_data, ';');
-  for (const auto& data : DataList)
+  switch (_health)
   {
-    std::vector<String> var = extract_substring(data, '=');
-
-    if (var.size() < 2)
-    {
-      Serial.print("ERROR : invalid data from networkc => ");
-      Serial.print("[");
-      Serial.print(_data);
-      Serial.print("] len=");
-      Serial.println(_data.length());
-      continue;
-    }
-
-    if (var[0] == "Xac")
-      retval.incAcceleration.acceleration[0] = String(var[1]).toDouble();
-
-    if (var[0] == "Yac")
-      retval.incAcceleration.acceleration[1] = String(var[1]).toDouble();
-
-    if (var[0] == "Zac")
-      retval.incAcceleration.acceleration[2] = String(var[1]).toDouble();
-
-    if (var[0] == "Xan")
-      retval.incAngular.angle[0] = String(var[1]).toDouble();
-
-    if (var[0] == "Yan")
-      retval.incAngular.angle[1] = String(var[1]).toDouble();
-
-    if (var[0] == "Zan")
-      retval.incAngular.angle[2] = String(var[1]).toDouble();
-
-    if (var[0] == "Xve")
-      retval.inclAngularVelocity.velocity[0] = String(var[1]).toDouble();
-
-    if (var[0] == "Yve")
-      retval.inclAngularVelocity.velocity[1] = String(var[1]).toDouble();
+    case LINK_HEALTH_POOR:
+      color = TFT_RED;
+      break;
 
-    if (var[0] == "Zve")
-      retval.inclAngularVelocity.velocity[2] = String(var[1]).toDouble();
+    case LINK_HEALTH_FAIR:
+      color = TFT_ORANGE;
+      break;
     
-    if (var[0] == "Tmp")
-      retval.incAcceleration.temperature = String(var[1]).toDouble();
-  }
+    case LINK_HEALTH_GOOD:
+      color = TFT_GREEN;
+      break;
     
-  return retval;
+    default:
+      color = TFT_DARKGREY;
+      break;
+  }
+
+  return color;
 }
 
 /*-------------------------------------------------------------------------------------------------------------------*/
-uint32_t get_color_from_wifi_status (uint8_t _status)
+uint32_t get_color_from_sensor_health (uint8_t _health)
 {
   uint32_t color = 0;
 
-  switch (_status)
+  switch (_health)
   {
-    case CONNECTION_STATUS_APP_DISCONNECTED:
+    case INCLINOMETER_HEALTH_STALE:
       color = TFT_RED;
       break;
 
-    case CONNECTION_STATUS_APP_CONNECTING:
+    case INCLINOMETER_HEALTH_DEGRADED:
       color = TFT_ORANGE;
       break;
     
-    case CONNECTION_STATUS_APP_CONNECTED:
+    case INCLINOMETER_HEALTH_OK:
       color = TFT_GREEN;
       break;
     
@@ -476,9 +753,9 @@ uint32_t get_color_from_alarm_state (uint8_t _state)
 }
 
 /*-------------------------------------------------------------------------------------------------------------------*/
-String get_text_from_alarm_state (uint8_t _state)
+const char* get_text_from_alarm_state (uint8_t _state)
 {
-  String text = "";
+  const char* text = "";
 
   switch (_state)
   {
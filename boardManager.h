@@ -0,0 +1,141 @@
+/*********************************************************************************************************************
+ * Project : Astro Alarm
+ * Author  : PEB <pebdev@lavache.com> 
+ * Date    : 2024.01.18
+ *********************************************************************************************************************
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ * 
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *********************************************************************************************************************/
+
+
+/** I N C L U D E S **************************************************************************************************/
+#include <Preferences.h>
+
+
+/** D E F I N E S ****************************************************************************************************/
+// Uncomment one of them to build a single role firmware, the subsystems of the other role are compiled out.
+// Otherwise both roles are built and the role is detected at startup.
+//#define CONFIG_BOARD_ROLE_SERVER    (1)
+//#define CONFIG_BOARD_ROLE_CLIENT    (1)
+
+#if defined(CONFIG_BOARD_ROLE_SERVER) && defined(CONFIG_BOARD_ROLE_CLIENT)
+#error "CONFIG_BOARD_ROLE_SERVER and CONFIG_BOARD_ROLE_CLIENT can not be both defined"
+#endif
+
+// Roles built in the firmware
+#ifndef CONFIG_BOARD_ROLE_CLIENT
+#define BOARD_WITH_SERVER_ROLE      (1)
+#endif
+#ifndef CONFIG_BOARD_ROLE_SERVER
+#define BOARD_WITH_CLIENT_ROLE      (1)
+#endif
+
+// Board modes
+#define BOARD_MODE_UNKNOWN          (0)
+#define BOARD_MODE_SERVER           (1)
+#define BOARD_MODE_CLIENT           (2)
+
+// Role probe : the board is a server if an inclinometer frame is received within this time
+#define BOARD_PROBE_TIMEOUT_MS      (2000)
+
+// Persistent storage
+#define BOARD_NVS_NAMESPACE         "astro-alarm"
+#define BOARD_NVS_KEY_MODE          "mode"
+
+
+/** B O A R D ********************************************************************************************************/
+class BoardManager
+{
+private:
+  uint8_t storedMode;
+  uint8_t detectedMode;
+  unsigned long timerProbe_ms;
+  Preferences preferences;
+
+
+public:
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Constructor
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  BoardManager (void)
+  {
+    this->storedMode    = BOARD_MODE_UNKNOWN;
+    this->detectedMode  = BOARD_MODE_UNKNOWN;
+    this->timerProbe_ms = 0;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Load the last detected mode and start the probe of the inclinometer link
+  // @return BOARD_MODE_SERVER | BOARD_MODE_CLIENT, BOARD_MODE_UNKNOWN on the very first start
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  uint8_t start (void)
+  {
+    // Single role firmware, nothing to detect
+    #if defined(CONFIG_BOARD_ROLE_SERVER)
+    this->detectedMode = BOARD_MODE_SERVER;
+    return this->detectedMode;
+    #elif defined(CONFIG_BOARD_ROLE_CLIENT)
+    this->detectedMode = BOARD_MODE_CLIENT;
+    return this->detectedMode;
+    #endif
+
+    if (this->preferences.begin(BOARD_NVS_NAMESPACE, true) == true)
+    {
+      this->storedMode = this->preferences.getUChar(BOARD_NVS_KEY_MODE, BOARD_MODE_UNKNOWN);
+      this->preferences.end();
+    }
+
+    if ((this->storedMode != BOARD_MODE_SERVER) && (this->storedMode != BOARD_MODE_CLIENT))
+      this->storedMode = BOARD_MODE_UNKNOWN;
+
+    this->detectedMode  = BOARD_MODE_UNKNOWN;
+    this->timerProbe_ms = millis();
+
+    return this->storedMode;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Probe the inclinometer link in background, the detected mode is saved if it has changed
+  // @param _frame_received : true if an inclinometer frame was received since the previous call
+  // @return detected mode, BOARD_MODE_UNKNOWN while the probe is running
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  uint8_t update (bool _frame_received)
+  {
+    if (this->detectedMode != BOARD_MODE_UNKNOWN)
+      return this->detectedMode;
+
+    if (_frame_received == true)
+      this->detectedMode = BOARD_MODE_SERVER;
+    else if ((millis()-this->timerProbe_ms) > BOARD_PROBE_TIMEOUT_MS)
+      this->detectedMode = BOARD_MODE_CLIENT;
+    else
+      return BOARD_MODE_UNKNOWN;
+
+    // Only write when the mode has changed, to save the flash
+    if (this->detectedMode != this->storedMode)
+    {
+      if (this->preferences.begin(BOARD_NVS_NAMESPACE, false) == true)
+      {
+        this->preferences.putUChar(BOARD_NVS_KEY_MODE, this->detectedMode);
+        this->preferences.end();
+        this->storedMode = this->detectedMode;
+      }
+      else
+      {
+        Serial.println("BOARD : ERROR, unable to save the board mode");
+      }
+    }
+
+    return this->detectedMode;
+  }
+};
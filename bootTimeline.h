@@ -0,0 +1,94 @@
+/*********************************************************************************************************************
+ * Project : Astro Alarm
+ * Author  : PEB <pebdev@lavache.com> 
+ * Date    : 2024.01.18
+ *********************************************************************************************************************
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ * 
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *********************************************************************************************************************/
+
+
+/** I N C L U D E S **************************************************************************************************/
+#include <freertos/FreeRTOS.h>
+
+
+/** D E F I N E S ****************************************************************************************************/
+#define BOOT_TIMELINE_MAX_PHASES      (16)
+
+
+/** S T R U C T S ****************************************************************************************************/
+struct strBootPhase
+{
+  const char* name;
+  uint32_t time_us;     // Time since reset
+};
+
+
+/** D E C L A R A T I O N S ******************************************************************************************/
+struct strBootPhase bootTimelinePhases[BOOT_TIMELINE_MAX_PHASES];
+uint8_t bootTimelineCount     = 0;
+bool bootTimelinePrinted      = false;
+portMUX_TYPE bootTimelineLock = portMUX_INITIALIZER_UNLOCKED;
+
+
+/** B O O T  T I M E L I N E *****************************************************************************************/
+class BootTimeline
+{
+public:
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Timestamp the end of a boot phase, can be called from any task.
+  //                 A phase is recorded only once, and nothing is recorded anymore once the timeline is printed.
+  // @param _name : name of the phase, must be a constant string
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  static void mark (const char* _name)
+  {
+    if (bootTimelinePrinted == true)
+      return;
+
+    portENTER_CRITICAL(&bootTimelineLock);
+    uint32_t time_us = micros();
+    bool isKnown = false;
+    for (uint8_t i=0; i<bootTimelineCount; i++)
+      isKnown |= (bootTimelinePhases[i].name == _name);
+
+    if ((isKnown == false) && (bootTimelineCount < BOOT_TIMELINE_MAX_PHASES))
+    {
+      bootTimelinePhases[bootTimelineCount].name    = _name;
+      bootTimelinePhases[bootTimelineCount].time_us = time_us;
+      bootTimelineCount++;
+    }
+    portEXIT_CRITICAL(&bootTimelineLock);
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Print the timeline on the debug serial link, only the first call prints it
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  static void print (void)
+  {
+    uint32_t previous_us = 0;
+
+    if (bootTimelinePrinted == true)
+      return;
+    bootTimelinePrinted = true;
+
+    Serial.println("----------------------------------------------------------------------");
+    Serial.println("BOOT TIMELINE");
+    for (uint8_t i=0; i<bootTimelineCount; i++)
+    {
+      Serial.printf("%-20s : %8u us (+%u us)\n", bootTimelinePhases[i].name, (unsigned int)bootTimelinePhases[i].time_us,
+                    (unsigned int)(bootTimelinePhases[i].time_us - previous_us));
+      previous_us = bootTimelinePhases[i].time_us;
+    }
+    Serial.println("----------------------------------------------------------------------");
+  }
+};
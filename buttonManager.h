@@ -19,57 +19,88 @@
 
 
 /** I N C L U D E S **************************************************************************************************/
-#include <Button.h>   // Hardware Buttons library
+#include <driver/gpio.h>
+#include <esp_sleep.h>
 
 
 /** D E F I N E S ****************************************************************************************************/
-// Button states
+// Button events
 #define BUTTON_NOT_PUSH                     (0)
 #define BUTTON_SHORT_PUSH                   (1)
-#define BUTTON_LONG_PUSH                    (2)
-#define BUTTON_LONG_PUSH_NOT_YET_RELEASED   (3)
+#define BUTTON_LONG_PUSH                    (2)   // Reported once, when the press reaches BUTTON_LONG_PUSH_US
+#define BUTTON_DOUBLE_PUSH                  (3)
 
+// Timings, measured on the interrupt timestamps
+#define BUTTON_DEBOUNCE_US                  (20000)     // Edges closer than this to the last accepted edge are bounces
+#define BUTTON_LONG_PUSH_US                 (1000000)
+#define BUTTON_DOUBLE_PUSH_US               (300000)    // Maximal delay between a release and the next press
 
-/** D E C L A R A T I O N S ******************************************************************************************/
-uint8_t buttonState;
-Hardware::Button button = Hardware::Button(255);  //Because there is no default constructor, create dummy object
+// Queues, sizes are powers of two
+#define BUTTON_EDGE_QUEUE_SIZE              (32)
+#define BUTTON_EVENT_QUEUE_SIZE             (4)
 
 
-/** C A L L B A C K **************************************************************************************************/
-/*-------------------------------------------------------------------------------------------------------------------*/
-// @brief [PRIVATE] Callback on press action
-// @param _sender : sender info
-/*-------------------------------------------------------------------------------------------------------------------*/
-void button_onPress (Hardware::Button& _sender)
+/** S T R U C T S ****************************************************************************************************/
+struct strButtonEdge
 {
-  buttonState = BUTTON_SHORT_PUSH;
-}
+  uint32_t time_us;
+  uint8_t isPressed;
+};
 
-/*-------------------------------------------------------------------------------------------------------------------*/
-// @brief [PRIVATE] Callback on long pressing action (long press not finished)
-// @param _sender : sender info
-/*-------------------------------------------------------------------------------------------------------------------*/
-void button_onLongPressing (Hardware::Button& _sender)
-{
-  if ((buttonState == BUTTON_LONG_PUSH) || (buttonState == BUTTON_LONG_PUSH_NOT_YET_RELEASED))
-    buttonState = BUTTON_LONG_PUSH_NOT_YET_RELEASED;
-  else
-    buttonState = BUTTON_LONG_PUSH;
-}
 
+/** D E C L A R A T I O N S ******************************************************************************************/
+// Edges queue : written by the interrupt only (head), read by the loop only (tail)
+struct strButtonEdge buttonEdges[BUTTON_EDGE_QUEUE_SIZE];
+volatile uint8_t buttonEdgeHead     = 0;
+volatile uint8_t buttonEdgeTail     = 0;
+uint32_t buttonEdgeLost             = 0;    // Edges dropped because the loop did not read the queue
+int buttonGpio                      = -1;
+
+
+/** I N T E R R U P T ************************************************************************************************/
 /*-------------------------------------------------------------------------------------------------------------------*/
-// @brief [PRIVATE] Callback on long press action (long press finished)
-// @param _sender : sender info
+// @brief [PRIVATE] Called on each edge of the button input : the edge is timestamped and queued, nothing else
 /*-------------------------------------------------------------------------------------------------------------------*/
-void button_onLongPress (Hardware::Button& _sender)
+void IRAM_ATTR button_isr (void)
 {
-  buttonState = BUTTON_NOT_PUSH;
+  uint8_t head = buttonEdgeHead;
+  uint8_t next = (head + 1) & (BUTTON_EDGE_QUEUE_SIZE - 1);
+
+  if (next == __atomic_load_n(&buttonEdgeTail, __ATOMIC_ACQUIRE))
+  {
+    buttonEdgeLost++;
+    return;
+  }
+
+  // Active low input
+  buttonEdges[head].time_us   = (uint32_t)esp_timer_get_time();
+  buttonEdges[head].isPressed = (digitalRead(buttonGpio) == LOW) ? 1 : 0;
+  __atomic_store_n(&buttonEdgeHead, next, __ATOMIC_RELEASE);
 }
 
 
 /** B U T T O N ******************************************************************************************************/
 class ButtonManager
 {
+private:
+  int gpio;
+
+  // Debounced state
+  bool isPressed;
+  uint32_t lastEdge_us;
+  uint32_t pressStart_us;
+  bool isLongReported;
+
+  // Short push waiting for a possible second one
+  bool isClickPending;
+  uint32_t release_us;
+
+  // Classified events, waiting for the loop
+  uint8_t events[BUTTON_EVENT_QUEUE_SIZE];
+  uint8_t eventStart;
+  uint8_t eventCount;
+
+
 public:
   /*-------------------------------------------------------------------------------------------------------------------*/
   // @brief [PUBLIC] Constructor
@@ -77,34 +108,152 @@ public:
   /*-------------------------------------------------------------------------------------------------------------------*/
   ButtonManager (int _gpio)
   {
-    uint8_t buttonState = BUTTON_NOT_PUSH;
-    button = Hardware::Button(_gpio, true);
-    
-    // Callbacks
-    button.onPress        = &button_onPress;
-    button.onLongPress    = &button_onLongPress;
-    button.onLongPressing = &button_onLongPressing;
-
-    // Button settings
-    button.setPressTimeout(400);
-    button.setLongPressTimeout(1000);
+    this->gpio            = _gpio;
+    this->isPressed       = false;
+    this->lastEdge_us     = 0;
+    this->pressStart_us   = 0;
+    this->isLongReported  = false;
+    this->isClickPending  = false;
+    this->release_us      = 0;
+    this->eventStart      = 0;
+    this->eventCount      = 0;
   }
 
   /*-------------------------------------------------------------------------------------------------------------------*/
-  // @brief [PUBLIC] Function to update button state.
-  // @return BUTTON_NOT_PUSH | BUTTON_SHORT_PUSH | BUTTON_LONG_PUSH |BUTTON_LONG_PUSH_NOT_YET_RELEASED
+  // @brief [PUBLIC] Setup the button input, its interrupt and the wake up from light sleep
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void start (void)
+  {
+    buttonGpio = this->gpio;
+    pinMode(this->gpio, INPUT_PULLUP);
+    attachInterrupt(digitalPinToInterrupt(this->gpio), button_isr, CHANGE);
+
+    // A press wakes the board up from light sleep, the press is then found by update()
+    gpio_wakeup_enable((gpio_num_t)this->gpio, GPIO_INTR_LOW_LEVEL);
+    esp_sleep_enable_gpio_wakeup();
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Classify the queued edges. Timings come from the interrupt timestamps, so a press is classified
+  //                the same way whatever the duration of the loop.
+  // @return BUTTON_NOT_PUSH | BUTTON_SHORT_PUSH | BUTTON_LONG_PUSH | BUTTON_DOUBLE_PUSH
   /*-------------------------------------------------------------------------------------------------------------------*/
   uint8_t update (void)
   {
-    uint8_t retval = buttonState;
+    uint8_t tail = buttonEdgeTail;
+
+    while (tail != __atomic_load_n(&buttonEdgeHead, __ATOMIC_ACQUIRE))
+    {
+      struct strButtonEdge edge = buttonEdges[tail];
+      tail = (tail + 1) & (BUTTON_EDGE_QUEUE_SIZE - 1);
+      __atomic_store_n(&buttonEdgeTail, tail, __ATOMIC_RELEASE);
+
+      this->process_edge(edge.isPressed, edge.time_us);
+    }
+
+    uint32_t now_us = (uint32_t)esp_timer_get_time();
+
+    // The last bounce can be masked by the debounce, or the edge was missed during light sleep : the input level
+    // is the reference once the debounce time is over
+    bool isInputPressed = (digitalRead(this->gpio) == LOW);
+    if ((isInputPressed != this->isPressed) && ((now_us - this->lastEdge_us) > BUTTON_DEBOUNCE_US))
+      this->process_edge(isInputPressed, now_us);
+
+    // Long push, reported while the button is still pressed
+    if ((this->isPressed == true) && (this->isLongReported == false) && ((now_us - this->pressStart_us) >= BUTTON_LONG_PUSH_US))
+    {
+      if (this->isClickPending == true)
+      {
+        this->isClickPending = false;
+        this->push_event(BUTTON_SHORT_PUSH);
+      }
+
+      this->isLongReported = true;
+      this->push_event(BUTTON_LONG_PUSH);
+    }
+
+    // No second push
+    if ((this->isClickPending == true) && (this->isPressed == false) && ((now_us - this->release_us) > BUTTON_DOUBLE_PUSH_US))
+    {
+      this->isClickPending = false;
+      this->push_event(BUTTON_SHORT_PUSH);
+    }
+
+    return this->pop_event();
+  }
+
+
+private:
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Update the debounced state with an edge
+  // @param _is_pressed : input level after the edge
+  // @param _time_us    : time of the edge
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void process_edge (bool _is_pressed, uint32_t _time_us)
+  {
+    // Bounce, or no level change
+    if ((_is_pressed == this->isPressed) || ((_time_us - this->lastEdge_us) < BUTTON_DEBOUNCE_US))
+      return;
+
+    this->isPressed   = _is_pressed;
+    this->lastEdge_us = _time_us;
+
+    if (_is_pressed == true)
+    {
+      // Too late to be the second push of a double push
+      if ((this->isClickPending == true) && ((_time_us - this->release_us) > BUTTON_DOUBLE_PUSH_US))
+      {
+        this->isClickPending = false;
+        this->push_event(BUTTON_SHORT_PUSH);
+      }
+
+      this->pressStart_us  = _time_us;
+      this->isLongReported = false;
+      return;
+    }
+
+    // Release of a long push, it was already reported
+    if (this->isLongReported == true)
+      return;
+
+    if (this->isClickPending == true)
+    {
+      this->isClickPending = false;
+      this->push_event(BUTTON_DOUBLE_PUSH);
+    }
+    else
+    {
+      this->isClickPending = true;
+      this->release_us     = _time_us;
+    }
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Queue a classified event, it is dropped if the loop did not read the previous ones
+  // @param _event : BUTTON_xxx
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void push_event (uint8_t _event)
+  {
+    if (this->eventCount >= BUTTON_EVENT_QUEUE_SIZE)
+      return;
+
+    this->events[(this->eventStart + this->eventCount) & (BUTTON_EVENT_QUEUE_SIZE - 1)] = _event;
+    this->eventCount++;
+  }
 
-    // Reset button state if it's a short push, because not updated by a callback
-    if (buttonState == BUTTON_SHORT_PUSH)
-      buttonState = BUTTON_NOT_PUSH;
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Provide the oldest classified event
+  // @return BUTTON_xxx, BUTTON_NOT_PUSH if there is none
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  uint8_t pop_event (void)
+  {
+    if (this->eventCount == 0)
+      return BUTTON_NOT_PUSH;
 
-    // Update button callback
-    button.update();
+    uint8_t event = this->events[this->eventStart];
+    this->eventStart = (this->eventStart + 1) & (BUTTON_EVENT_QUEUE_SIZE - 1);
+    this->eventCount--;
 
-    return retval;
+    return event;
   }
 };
@@ -0,0 +1,290 @@
+/*********************************************************************************************************************
+ * Project : Astro Alarm
+ * Author  : PEB <pebdev@lavache.com> 
+ * Date    : 2024.01.18
+ *********************************************************************************************************************
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ * 
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *********************************************************************************************************************/
+
+
+/** I N C L U D E S **************************************************************************************************/
+#ifdef ARDUINO
+#include <esp_timer.h>
+#endif
+
+
+/** D E F I N E S ****************************************************************************************************/
+// Messages exchanged over the link, timestamps in us of each board timebase
+#define CLOCK_SYNC_REQUEST            "syncReq="    // syncReq=<t1 client send>
+#define CLOCK_SYNC_RESPONSE           "syncRsp="    // syncRsp=<t1 client send>,<t2 server receive>,<t3 server send>
+#define CLOCK_SYNC_MESSAGE_SIZE       (64)
+
+// Exchanges
+#define CLOCK_SYNC_INTERVAL_MS        (500)
+#define CLOCK_SYNC_MAX_DELAY_US       (100000)  // Exchanges with a longer round trip are rejected
+#define CLOCK_SYNC_WINDOW             (8)       // Exchanges per filtered point, the one with the shortest round trip is kept
+
+// Drift estimation : linear regression over the last filtered points
+#define CLOCK_SYNC_POINTS             (16)
+
+// Report
+#define CLOCK_SYNC_REPORT_INTERVAL_MS (10000)
+
+
+/** S T R U C T S ****************************************************************************************************/
+struct strClockPoint
+{
+  int64_t clientTime_us;
+  int64_t offset_us;      // server time - client time
+  int64_t delay_us;       // round trip, without the server processing time
+};
+
+
+/** C L O C K  S Y N C ***********************************************************************************************/
+class ClockSync
+{
+private:
+  // Current window of exchanges
+  struct strClockPoint best;
+  uint8_t windowCount;
+
+  // Filtered points, circular buffer
+  struct strClockPoint points[CLOCK_SYNC_POINTS];
+  uint8_t pointCount;
+  uint8_t pointIndex;
+
+  // Model : server time = client time + offset + drift * (client time - reference)
+  bool isSynced;
+  double offset_us;
+  double drift;
+  int64_t reference_us;
+
+  int64_t lastServerTime_us;           // Server send time of the last response, 0 if none
+  unsigned long timerRequest_ms;
+  uint32_t rejectedCount;
+
+
+public:
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Constructor
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  ClockSync (void)
+  {
+    this->timerRequest_ms = millis();
+    this->rejectedCount   = 0;
+    this->reset();
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Forget the exchanges and the model : a new link or a new server timebase must not be mixed with
+  //                 the points of the previous one
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void reset (void)
+  {
+    this->windowCount       = 0;
+    this->pointCount        = 0;
+    this->pointIndex        = 0;
+    this->isSynced          = false;
+    this->offset_us         = 0.0;
+    this->drift             = 0.0;
+    this->reference_us      = 0;
+    this->lastServerTime_us = 0;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Local time of this board
+  // @return time since reset in us
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  static int64_t local_time_us (void)
+  {
+    return esp_timer_get_time();
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Client side : build the next request, at most every CLOCK_SYNC_INTERVAL_MS
+  // @param _buffer : output, request message
+  // @param _size   : size of the output buffer
+  // @return true if a request must be sent, otherwise false
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  bool prepare_request (char* _buffer, uint16_t _size)
+  {
+    if ((millis()-this->timerRequest_ms) < CLOCK_SYNC_INTERVAL_MS)
+      return false;
+    this->timerRequest_ms = millis();
+
+    snprintf(_buffer, _size, CLOCK_SYNC_REQUEST "%lld", (long long)local_time_us());
+    return true;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Server side : build the response of a request
+  // @param _request    : received request
+  // @param _receive_us : local time when the request was received
+  // @param _buffer     : output, response message
+  // @param _size       : size of the output buffer
+  // @return true if the request is valid, otherwise false
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  static bool prepare_response (const char* _request, int64_t _receive_us, char* _buffer, uint16_t _size)
+  {
+    char* end = NULL;
+    long long t1 = strtoll(&_request[strlen(CLOCK_SYNC_REQUEST)], &end, 10);
+
+    if ((end == &_request[strlen(CLOCK_SYNC_REQUEST)]) || (*end != '\0'))
+      return false;
+
+    snprintf(_buffer, _size, CLOCK_SYNC_RESPONSE "%lld,%lld,%lld", t1, (long long)_receive_us, (long long)local_time_us());
+    return true;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Client side : process a response
+  // @param _response   : received response
+  // @param _receive_us : local time when the response was received
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void process_response (const char* _response, int64_t _receive_us)
+  {
+    long long t[3];
+    const char* text = &_response[strlen(CLOCK_SYNC_RESPONSE)];
+
+    for (uint8_t i=0; i<3; i++)
+    {
+      char* end = NULL;
+      t[i] = strtoll(text, &end, 10);
+
+      if ((end == text) || (*end != ((i < 2) ? ',' : '\0')))
+        return;
+      text = end + 1;
+    }
+
+    // The server restarted, its timebase is a new one
+    if (t[2] < this->lastServerTime_us)
+    {
+      Serial.println("CLOCK : server time went backwards, synchronization restarted");
+      this->reset();
+    }
+    this->lastServerTime_us = t[2];
+
+    // NTP computation : t1 and t4 are client times, t2 and t3 are server times
+    struct strClockPoint sample;
+    sample.delay_us      = (_receive_us - t[0]) - (t[2] - t[1]);
+    sample.offset_us     = ((t[1] - t[0]) + (t[2] - _receive_us)) / 2;
+    sample.clientTime_us = (t[0] + _receive_us) / 2;
+
+    // Late answers (loop busy, retransmission...) are asymmetric, they are not used
+    if ((sample.delay_us < 0) || (sample.delay_us > CLOCK_SYNC_MAX_DELAY_US) || (t[0] > _receive_us))
+    {
+      this->rejectedCount++;
+      return;
+    }
+
+    // Minimum delay filter over the window
+    if ((this->windowCount == 0) || (sample.delay_us < this->best.delay_us))
+      this->best = sample;
+    this->windowCount++;
+
+    if (this->windowCount >= CLOCK_SYNC_WINDOW)
+    {
+      this->add_point(this->best);
+      this->windowCount = 0;
+    }
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Allow user to know if the server time is available
+  // @return true | false
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  bool is_synced (void)
+  {
+    return this->isSynced;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Convert a local time into the server timebase
+  // @param _local_us : local time
+  // @return server time in us, local time if not synced
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  int64_t to_server_time_us (int64_t _local_us)
+  {
+    return _local_us + (int64_t)(this->offset_us + this->drift * (double)(_local_us - this->reference_us));
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Convert a server time into the local timebase
+  // @param _server_us : server time
+  // @return local time in us, server time if not synced
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  int64_t to_local_time_us (int64_t _server_us)
+  {
+    double local_us = ((double)_server_us - this->offset_us + this->drift * (double)this->reference_us) / (1.0 + this->drift);
+    return (int64_t)local_us;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Print the synchronization state, at most every CLOCK_SYNC_REPORT_INTERVAL_MS
+  // @param _frame_timestamp_ms : server timestamp of the last received frame
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void report (uint32_t _frame_timestamp_ms)
+  {
+    static unsigned long timerReport_ms = millis();
+
+    if ((this->isSynced == false) || ((millis()-timerReport_ms) < CLOCK_SYNC_REPORT_INTERVAL_MS))
+      return;
+    timerReport_ms = millis();
+
+    uint32_t serverTime_ms = (uint32_t)(this->to_server_time_us(local_time_us()) / 1000);
+    uint8_t last = (this->pointIndex + CLOCK_SYNC_POINTS - 1) % CLOCK_SYNC_POINTS;
+
+    Serial.printf("CLOCK : offset=%lldus drift=%.2fppm round trip=%lldus rejected=%u frame age=%dms\n",
+                  (long long)this->offset_us, this->drift * 1000000.0, (long long)this->points[last].delay_us,
+                  (unsigned int)this->rejectedCount, (int)(serverTime_ms - _frame_timestamp_ms));
+  }
+
+
+private:
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Add a filtered point and update the model (least squares of the offset over the client time)
+  // @param _point : filtered point
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void add_point (const struct strClockPoint& _point)
+  {
+    this->points[this->pointIndex] = _point;
+    this->pointIndex = (this->pointIndex + 1) % CLOCK_SYNC_POINTS;
+    if (this->pointCount < CLOCK_SYNC_POINTS)
+      this->pointCount++;
+
+    // Times relative to the newest point, to keep the precision of the doubles
+    double sumT = 0.0, sumO = 0.0, sumTT = 0.0, sumTO = 0.0;
+    for (uint8_t i=0; i<this->pointCount; i++)
+    {
+      double t = (double)(this->points[i].clientTime_us - _point.clientTime_us);
+      double o = (double)this->points[i].offset_us;
+
+      sumT  += t;
+      sumO  += o;
+      sumTT += t * t;
+      sumTO += t * o;
+    }
+
+    double n = (double)this->pointCount;
+    double denominator = n * sumTT - sumT * sumT;
+
+    this->drift        = (this->pointCount >= 2) && (denominator > 0.0) ? (n * sumTO - sumT * sumO) / denominator : 0.0;
+    this->offset_us    = (sumO - this->drift * sumT) / n;
+    this->reference_us = _point.clientTime_us;
+
+    if (this->isSynced == false)
+      Serial.println("CLOCK : synchronized with the server");
+    this->isSynced = true;
+  }
+};
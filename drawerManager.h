@@ -19,20 +19,165 @@
 
 
 /** I N C L U D E S **************************************************************************************************/
+#ifdef ARDUINO
 #include <SPI.h>
 #include <TFT_eSPI.h>
+#include <freertos/FreeRTOS.h>
+#include <esp_heap_caps.h>
+#endif
+
+
+/** D E F I N E S ****************************************************************************************************/
+#define DRAWER_LABEL_SIZE         (48)
+
+// Screen sprite : 4 bits per pixel, colors are indexes in a 16 colors palette (27KB instead of 106KB in RGB565)
+#define DRAWER_COLOR_DEPTH        (4)
+#define DRAWER_PALETTE_SIZE       (16)
+
+// Push task : sends a frame to the screen while the next one is drawn (the parallel bus has no DMA with TFT_eSPI)
+#define DRAWER_BUFFER_COUNT       (2)
+#define DRAWER_PUSH_TASK_CORE     (0)
+#define DRAWER_PUSH_TASK_PRIORITY (1)
+#define DRAWER_PUSH_TASK_STACK    (4096)
+
+// Push : the frame is expanded to RGB565 by blocks of lines (see PixelKernels::expand_4bpp)
+#define DRAWER_PUSH_LINES         (10)
+#define DRAWER_PUSH_MAX_WIDTH     (320)
+#define DRAWER_BENCHMARK_FRAMES   (20)      // Full frames sent by each path of benchmark_push
+
+// Background : rendered once into a snapshot which is copied at the start of each frame, internal RAM first (fastest
+// copy), PSRAM otherwise. Without memory for the snapshot, the background is rendered each frame.
+
+// Widgets of the live view, in drawing order : each one is composed again only when its view changed
+#define DRAWER_WIDGET_PING        (0)
+#define DRAWER_WIDGET_WIFI        (1)
+#define DRAWER_WIDGET_NORTH       (2)
+#define DRAWER_WIDGET_MAIN_POINT  (3)
+#define DRAWER_WIDGET_ANGLES      (4)
+#define DRAWER_WIDGET_TEMPERATURE (5)
+#define DRAWER_WIDGET_BATTERY     (6)
+#define DRAWER_WIDGET_MEMORY      (7)
+#define DRAWER_WIDGET_SENSOR      (8)
+#define DRAWER_WIDGET_ALARM_BAR   (9)
+#define DRAWER_WIDGET_COUNT       (10)
+#define DRAWER_ALARM_BAR_HEIGHT   (20)
+
+// Frame modes
+#define DRAWER_FRAME_NONE         (0)       // Nothing drawn yet
+#define DRAWER_FRAME_RETAINED     (1)       // Live view : the widgets are composed over the background by draw_update
+#define DRAWER_FRAME_IMMEDIATE    (2)       // Other views : drawn into the screen sprite, the whole frame is sent
+
+// Damage : changed areas of a frame, merged when they overlap or when the list is full
+#define DRAWER_DAMAGE_MAX_RECTS   (6)
+#define DRAWER_REPORT_MS          (10000)
+
+// Strip chart : one column per DRAWER_STRIP_SAMPLES_PER_COLUMN samples (peak value), ~3 minutes on the screen width
+#define DRAWER_STRIP_MAX_COLUMNS          (320)
+#define DRAWER_STRIP_SAMPLES_PER_COLUMN   (3)
+#define DRAWER_STRIP_TOP                  (28)      // Header height, values and connection status
+#define DRAWER_STRIP_BOTTOM               (DRAWER_ALARM_BAR_HEIGHT)
+#define DRAWER_STRIP_ACC_RANGE_MG         (100.0)   // Full scale of the acceleration deviation
+#define DRAWER_STRIP_ANGLE_RANGE_DEG      (2.0)     // Full scale of the angle error
+
+
+/** S T R U C T S ****************************************************************************************************/
+struct strStripColumn
+{
+  uint8_t acceleration;   // Height in pixels
+  uint8_t angle;          // Height in pixels
+};
+
+struct strDrawerRect
+{
+  int32_t x;
+  int32_t y;
+  int32_t width;
+  int32_t height;
+};
+
+struct strDrawerDamage
+{
+  bool isFull;            // The whole screen, the rectangles are not used
+  uint8_t count;
+  struct strDrawerRect rects[DRAWER_DAMAGE_MAX_RECTS];
+};
+
+// What a widget draws, compared as a whole to detect a change
+struct strDrawerView
+{
+  struct strDrawerRect bounds;          // Area covered in the screen, empty when the widget is hidden
+  int32_t points[6];                    // Positions of the shapes and texts
+  uint32_t colors[2];
+  char text[2][DRAWER_LABEL_SIZE];
+};
+
+struct strDrawerWidget
+{
+  bool isSet;                           // Given by the loop during this frame
+  double values[2];
+  uint32_t colors[2];
+  char text[DRAWER_LABEL_SIZE];
+  struct strDrawerView view;            // As composed in the screen buffers
+};
 
 
 /** D R A W E R ******************************************************************************************************/
 class DrawerManager
 {
 private:
-  uint16_t isAlarmBarDisplayed;
   unsigned long timerRrefreshPing_ms = millis();
   TFT_eSPI tft = TFT_eSPI();
-  TFT_eSprite spriteScreen = TFT_eSprite(&tft);
+  TFT_eSprite spriteBuffer[DRAWER_BUFFER_COUNT] = {TFT_eSprite(&tft), TFT_eSprite(&tft)};
+  TFT_eSprite* spriteScreen;
   unsigned long timerAlarmDraw_ms = 0;
 
+  // Palette of the screen sprite, index 0 is the background color
+  uint16_t palette[DRAWER_PALETTE_SIZE];
+  uint8_t paletteCount;
+
+  // Expansion table of the palette, rebuilt before a push when a color was added
+  uint32_t paletteTable[PIXEL_KERNELS_TABLE_SIZE];
+  bool isPaletteTableValid;
+
+  // Pixels expanded for the push, by pairs so that the lines are 32 bits aligned
+  uint32_t pushLines[DRAWER_PUSH_LINES * DRAWER_PUSH_MAX_WIDTH / 2];
+
+  // Background snapshot, in the layout of the screen sprite it was taken from
+  uint8_t* backgroundSnapshot;
+  uint32_t backgroundBytes;
+  int16_t backgroundWidth;
+  int16_t backgroundHeight;
+
+  // Double buffering : the loop draws into the back buffer while the push task sends the front buffer
+  uint8_t backBuffer;
+  volatile uint8_t pushBuffer;
+  TaskHandle_t pushTask;
+  SemaphoreHandle_t pushRequest;
+  SemaphoreHandle_t pushDone;
+  SemaphoreHandle_t displayReady;
+
+  // Strip chart : columns ring buffer, and columns already drawn in each screen buffer (the chart is scrolled)
+  struct strStripColumn stripColumns[DRAWER_STRIP_MAX_COLUMNS];
+  uint32_t stripColumnCount;
+  uint8_t stripSampleCount;
+  double stripPeakAcceleration_mg;
+  double stripPeakAngle_deg;
+  uint32_t stripDrawnCount[DRAWER_BUFFER_COUNT];
+  bool isStripValid[DRAWER_BUFFER_COUNT];
+
+  // Live view : widgets, buffers which hold the live view, and areas to send by the push task
+  struct strDrawerWidget widgets[DRAWER_WIDGET_COUNT];
+  bool isBufferComposed[DRAWER_BUFFER_COUNT];
+  struct strDrawerDamage pushDamage;
+  uint8_t frameMode;
+  bool isPanelValid;                    // The screen shows the last composed live view
+  bool isCpuLocked;                     // The frame being drawn holds the CPU lock of the power manager
+
+  // Statistics, printed every DRAWER_REPORT_MS
+  uint32_t reportFrames;
+  uint32_t reportFullFrames;
+  uint64_t reportPixels;
+
 
 public:
   /*-------------------------------------------------------------------------------------------------------------------*/
@@ -40,103 +185,223 @@ public:
   /*-------------------------------------------------------------------------------------------------------------------*/
   DrawerManager (void)
   {
-    this->isAlarmBarDisplayed = false;
-    
-    // Initialize the TFT
-    this->tft.init();
-    this->tft.setRotation(1);
-    this->tft.setSwapBytes(true);
+    // UI colors, other colors are added on first use
+    const uint16_t uiColors[] = {TFT_BLACK, TFT_WHITE, TFT_NAVY, TFT_DARKCYAN, TFT_RED, TFT_GREEN, TFT_ORANGE, TFT_DARKGREY};
+    this->paletteCount = sizeof(uiColors) / sizeof(uiColors[0]);
+    for (uint8_t i=0; i<DRAWER_PALETTE_SIZE; i++)
+      this->palette[i] = (i < this->paletteCount) ? uiColors[i] : TFT_BLACK;
+    PixelKernels::build_palette_table(this->paletteTable, this->palette);
+    this->isPaletteTableValid = true;
 
-    // Use sprite to avoid screen flickering
-    this->spriteScreen.createSprite(tft.width(), tft.height());
-    this->spriteScreen.setSwapBytes(true);
-    this->spriteScreen.setTextColor(TFT_WHITE, TFT_BLACK);
+    this->backBuffer    = 0;
+    this->pushBuffer    = 0;
+    this->pushTask      = NULL;
+    this->pushRequest   = NULL;
+    this->pushDone      = NULL;
+    this->displayReady  = NULL;
+    this->spriteScreen  = &this->spriteBuffer[this->backBuffer];
+
+    this->backgroundSnapshot  = NULL;
+    this->backgroundBytes     = 0;
+    this->backgroundWidth     = 0;
+    this->backgroundHeight    = 0;
+
+    this->stripColumnCount          = 0;
+    this->stripSampleCount          = 0;
+    this->stripPeakAcceleration_mg  = 0.0;
+    this->stripPeakAngle_deg        = 0.0;
+    for (uint8_t i=0; i<DRAWER_BUFFER_COUNT; i++)
+    {
+      this->stripDrawnCount[i]  = 0;
+      this->isStripValid[i]     = false;
+    }
+
+    memset(this->widgets, 0, sizeof(this->widgets));
+    for (uint8_t i=0; i<DRAWER_BUFFER_COUNT; i++)
+      this->isBufferComposed[i] = false;
+    this->clear_damage(&this->pushDamage, true);
+    this->frameMode     = DRAWER_FRAME_NONE;
+    this->isPanelValid  = false;
+    this->isCpuLocked   = false;
+
+    this->reportFrames      = 0;
+    this->reportFullFrames  = 0;
+    this->reportPixels      = 0;
   }
 
   /*-------------------------------------------------------------------------------------------------------------------*/
-  // @brief [PUBLIC] Update drawing
+  // @brief [PUBLIC] Start the push task, it initializes the display in background then sends the frames.
+  //                 Without the task, the display is initialized here and frames are pushed by draw_update.
   /*-------------------------------------------------------------------------------------------------------------------*/
-  void draw_update (void)
+  void start (void)
   {
-    // Send data to the TFT
-    this->spriteScreen.pushSprite(0, 0);
+    if (this->pushTask != NULL)
+      return;
+
+    this->pushRequest   = xSemaphoreCreateBinary();
+    this->pushDone      = xSemaphoreCreateBinary();
+    this->displayReady  = xSemaphoreCreateBinary();
+    if ((this->pushRequest == NULL) || (this->pushDone == NULL) || (this->displayReady == NULL))
+    {
+      Serial.println("DRAWER : ERROR, unable to create the push semaphores");
+      this->init_display();
+      return;
+    }
+
+    // No frame in progress
+    xSemaphoreGive(this->pushDone);
+
+    if (xTaskCreatePinnedToCore(DrawerManager::push_task, "drawerPush", DRAWER_PUSH_TASK_STACK, this,
+                                DRAWER_PUSH_TASK_PRIORITY, &this->pushTask, DRAWER_PUSH_TASK_CORE) != pdPASS)
+    {
+      this->pushTask = NULL;
+      Serial.println("DRAWER : ERROR, unable to create the push task");
+      this->init_display();
+      xSemaphoreGive(this->displayReady);
+    }
   }
 
   /*-------------------------------------------------------------------------------------------------------------------*/
-  // @brief [PUBLIC] Draw background
+  // @brief [PUBLIC] Wait for the end of the display initialization, must be done before the first drawing
   /*-------------------------------------------------------------------------------------------------------------------*/
-  void draw_background (void)
+  void wait_ready (void)
   {
-    uint32_t color  = TFT_DARKCYAN;
-    uint16_t size   = 5;
-    uint16_t cx     = this->tft.width() / 2;
-    uint16_t cy     = this->tft.height() / 2;
-    
-    // Clear screen
-    this->spriteScreen.fillSprite(TFT_BLACK);
-    
-    // Draw background
-    for (uint16_t i=0; i<7; i++)
+    if (this->displayReady == NULL)
+      return;
+
+    xSemaphoreTake(this->displayReady, portMAX_DELAY);
+    vSemaphoreDelete(this->displayReady);
+    this->displayReady = NULL;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Update drawing : the live view is composed where it changed, then the frame is sent in background
+  //                 and the next one is drawn into the other buffer
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void draw_update (void)
+  {
+    struct strDrawerDamage damage;
+
+    this->lock_cpu();
+    this->compose_frame(&damage);
+    this->count_frame(&damage);
+
+    // Push task not started, send data to the TFT
+    if (this->pushTask == NULL)
     {
-      if (color == TFT_DARKCYAN)
-        color = TFT_NAVY;
-      else
-        color = TFT_DARKCYAN;
-      
-      this->spriteScreen.drawCircle(cx, cy, i*size, color);
-      size += 3;
+      this->update_palette_table();
+      this->push_frame(this->spriteScreen, &damage);
+      this->end_frame();
+      return;
     }
 
-    // Lines
-    this->spriteScreen.drawLine(cx, 0, cx, this->tft.height(), TFT_NAVY);
-    this->spriteScreen.drawLine(0, cy, this->tft.width(), cy, TFT_NAVY);
-    this->spriteScreen.drawLine(0, 0, this->tft.width(), this->tft.height(), TFT_NAVY);
-    this->spriteScreen.drawLine(0, this->tft.height(), this->tft.width(), 0, TFT_NAVY);
+    // Fence : the previous frame must be fully sent before its buffer is drawn again, or its palette table changed
+    xSemaphoreTake(this->pushDone, portMAX_DELAY);
+    this->update_palette_table();
 
-    // axis name
-    this->spriteScreen.setTextColor(TFT_NAVY);
-    this->spriteScreen.setTextDatum(TL_DATUM);
-    this->spriteScreen.drawString("x+", cx+3, -5, 4);
-    this->spriteScreen.drawString("x-", cx+3, this->tft.height()-18, 4);
-    this->spriteScreen.drawString("y-", 3, cy+1, 4);
-    this->spriteScreen.drawString("y+", this->tft.width()-25, cy+1, 4);
+    this->pushDamage = damage;
+    this->pushBuffer = this->backBuffer;
+    xSemaphoreGive(this->pushRequest);
+
+    this->backBuffer   = (this->backBuffer + 1) % DRAWER_BUFFER_COUNT;
+    this->spriteScreen = &this->spriteBuffer[this->backBuffer];
+    this->end_frame();
   }
 
   /*-------------------------------------------------------------------------------------------------------------------*/
-  // @brief [PUBLIC] Draw main point of the inclinometer
-  // @param _x : X angle
-  // @param _y : Y angle
+  // @brief [PUBLIC] Measure a full frame on the display : clear and send with TFT_eSPI (fillSprite, then pushSprite
+  //                 with one palette lookup per pixel), then with the pixel kernels (fill, then push_frame). Must be
+  //                 called after wait_ready and before the first frame, the screen blinks.
   /*-------------------------------------------------------------------------------------------------------------------*/
-  void draw_main_point (double _x, double _y)
+  void benchmark_push (void)
   {
-    uint8_t circleSize = 7;
-    double scale  = 10.0;
-    double cx = this->tft.width() / 2;
-    double cy = this->tft.height() / 2;
-    double xp = (_y*scale + cx);
-    double yp = _x*scale + cy;
-    
-    if (xp < 0)
-      xp = circleSize;
-    
-    if (xp > (this->tft.width()-circleSize))
-      xp = this->tft.width()-circleSize;
-    
-    if (yp < 0)
-      yp = circleSize;
-    
-    if (this->isAlarmBarDisplayed == true)
+    uint8_t* frame = (uint8_t*)this->spriteScreen->getPointer();
+    uint32_t frameBytes = ((this->spriteScreen->width() + 1) / 2) * this->spriteScreen->height();
+    uint8_t colors[2] = {(uint8_t)this->color(TFT_BLACK), (uint8_t)this->color(TFT_NAVY)};
+    uint64_t sprite_us = 0;
+    uint64_t kernels_us = 0;
+    struct strDrawerDamage full;
+
+    if (frame == NULL)
     {
-      if (yp > (this->tft.height()-20-circleSize))
-        yp = this->tft.height()-20-circleSize;
+      Serial.println("DRAWER : ERROR, no screen sprite for the push benchmark");
+      return;
     }
-    else
+
+    // The push task must stay idle, and the frequency at its maximum
+    if (this->pushDone != NULL)
+      xSemaphoreTake(this->pushDone, portMAX_DELAY);
+    PowerManager::acquire(POWER_LOCK_CPU);
+    this->update_palette_table();
+    this->clear_damage(&full, true);
+
+    for (uint8_t i=0; i<DRAWER_BENCHMARK_FRAMES; i++)
     {
-      if (yp > (this->tft.height()-circleSize))
-        yp = this->tft.height()-circleSize;
+      uint8_t index = colors[i % 2];
+      unsigned long start_us;
+
+      start_us = micros();
+      this->spriteScreen->fillSprite(index);
+      this->spriteScreen->pushSprite(0, 0);
+      sprite_us += micros() - start_us;
+
+      start_us = micros();
+      PixelKernels::fill(frame, (index << 4) | index, frameBytes);
+      this->push_frame(this->spriteScreen, &full);
+      kernels_us += micros() - start_us;
     }
 
-    this->spriteScreen.fillCircle(xp, yp, circleSize-2, TFT_RED);
+    PowerManager::release(POWER_LOCK_CPU);
+    if (this->pushDone != NULL)
+      xSemaphoreGive(this->pushDone);
+
+    sprite_us  /= DRAWER_BENCHMARK_FRAMES;
+    kernels_us /= DRAWER_BENCHMARK_FRAMES;
+    Serial.printf("DRAWER : full frame, TFT_eSPI %u us, kernels %u us (x%.2f, %d us saved)\n", (unsigned int)sprite_us,
+                  (unsigned int)kernels_us, (double)sprite_us / ((kernels_us > 0) ? kernels_us : 1), (int)sprite_us - (int)kernels_us);
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Print the share of the screen sent to the TFT, every DRAWER_REPORT_MS
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void report (void)
+  {
+    static unsigned long timerReport_ms = millis();
+    uint64_t screenPixels = (uint64_t)this->tft.width() * this->tft.height();
+
+    if (((millis()-timerReport_ms) < DRAWER_REPORT_MS) || (this->reportFrames == 0))
+      return;
+    timerReport_ms = millis();
+
+    Serial.printf("DRAWER : %u frames, %u full, %u%% of the pixels sent\n", (unsigned int)this->reportFrames,
+                  (unsigned int)this->reportFullFrames, (unsigned int)(this->reportPixels * 100 / (screenPixels * this->reportFrames)));
+
+    this->reportFrames      = 0;
+    this->reportFullFrames  = 0;
+    this->reportPixels      = 0;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Draw background : starts a frame of the live view, the widgets given until draw_update are
+  //                 composed over the background snapshot, only where they changed
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void draw_background (void)
+  {
+    // The strip chart of this buffer is lost
+    this->isStripValid[this->backBuffer] = false;
+    this->frameMode = DRAWER_FRAME_RETAINED;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Draw main point of the inclinometer
+  // @param _x : X angle
+  // @param _y : Y angle
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void draw_main_point (double _x, double _y)
+  {
+    this->widgets[DRAWER_WIDGET_MAIN_POINT].values[0] = _x;
+    this->widgets[DRAWER_WIDGET_MAIN_POINT].values[1] = _y;
+    this->set_widget(DRAWER_WIDGET_MAIN_POINT);
   }
 
   /*-------------------------------------------------------------------------------------------------------------------*/
@@ -155,25 +420,8 @@ public:
   /*-------------------------------------------------------------------------------------------------------------------*/
   void draw_north_point (double _z)
   {
-    int32_t x0 = this->tft.width() / 2;
-    int32_t y0 = this->tft.height() / 2;
-    double circleRadius1 = 55.0;
-    double circleRadius2 = 45.0;
-
-    double zAngle = (_z + 90);
-
-    double vertex1 = toRadians(zAngle);
-    double vertex2 = toRadians(zAngle + 15);
-    double vertex3 = toRadians(zAngle - 15);
-
-    int32_t x1 = x0 + circleRadius1 * cos(vertex1);
-    int32_t y1 = y0 + circleRadius1 * sin(vertex1);
-    int32_t x2 = x0 + circleRadius2 * cos(vertex2);
-    int32_t y2 = y0 + circleRadius2 * sin(vertex2);
-    int32_t x3 = x0 + circleRadius2 * cos(vertex3);
-    int32_t y3 = y0 + circleRadius2 * sin(vertex3);
-    
-    this->spriteScreen.fillTriangle(x1, y1, x2, y2, x3, y3, TFT_DARKCYAN);
+    this->widgets[DRAWER_WIDGET_NORTH].values[0] = _z;
+    this->set_widget(DRAWER_WIDGET_NORTH);
   }
 
   /*-------------------------------------------------------------------------------------------------------------------*/
@@ -183,19 +431,9 @@ public:
   /*-------------------------------------------------------------------------------------------------------------------*/
   void draw_inclinometer_values (double _x, double _y)
   {
-    uint32_t color = TFT_RED;
-    String Xval = "X=" + String(_x);
-    String Yval = "Y=" + String(_y);
-
-    if ((abs(_x) < 0.1) && (abs(_y) < 0.1))
-      color = TFT_GREEN;
-    else if ((abs(_x) < 1.0) && (abs(_y) < 1.0))
-      color = TFT_ORANGE;
-
-    this->spriteScreen.setTextColor(color);
-    this->spriteScreen.setTextDatum(TL_DATUM);
-    this->spriteScreen.drawString(Xval, 2, 0, 4);
-    this->spriteScreen.drawString(Yval, 2, 25, 4);
+    this->widgets[DRAWER_WIDGET_ANGLES].values[0] = _x;
+    this->widgets[DRAWER_WIDGET_ANGLES].values[1] = _y;
+    this->set_widget(DRAWER_WIDGET_ANGLES);
   }
 
   /*-------------------------------------------------------------------------------------------------------------------*/
@@ -205,13 +443,9 @@ public:
   /*-------------------------------------------------------------------------------------------------------------------*/
   void draw_memory_values (double _x, double _y)
   {
-    String Xval = "Xm=" + String(_x);
-    String Yval = "Ym=" + String(_y);
-
-    this->spriteScreen.setTextColor(TFT_DARKCYAN);
-    this->spriteScreen.setTextDatum(TL_DATUM);
-    this->spriteScreen.drawString(Xval, this->tft.width()-80, this->tft.height()-35, 2);
-    this->spriteScreen.drawString(Yval, this->tft.width()-80, this->tft.height()-20, 2);
+    this->widgets[DRAWER_WIDGET_MEMORY].values[0] = _x;
+    this->widgets[DRAWER_WIDGET_MEMORY].values[1] = _y;
+    this->set_widget(DRAWER_WIDGET_MEMORY);
   }
 
   /*-------------------------------------------------------------------------------------------------------------------*/
@@ -220,15 +454,8 @@ public:
   /*-------------------------------------------------------------------------------------------------------------------*/
   void draw_temperature_value (double _temperature)
   {
-    uint32_t heightObject = this->tft.height()-35;
-    String Stemperature = "T=" + String(int(_temperature))+"C";
-
-    if (this->isAlarmBarDisplayed == true)
-      heightObject -= 20;
-
-    this->spriteScreen.setTextColor(TFT_DARKCYAN);
-    this->spriteScreen.setTextDatum(TL_DATUM);
-    this->spriteScreen.drawString(Stemperature, 2, heightObject, 2);
+    this->widgets[DRAWER_WIDGET_TEMPERATURE].values[0] = _temperature;
+    this->set_widget(DRAWER_WIDGET_TEMPERATURE);
   }
 
   /*-------------------------------------------------------------------------------------------------------------------*/
@@ -238,20 +465,9 @@ public:
   /*-------------------------------------------------------------------------------------------------------------------*/
   void draw_battery_data (double _vbat_percentage, double _vbat_voltage)
   {
-    uint32_t heightObject = this->tft.height()-20;
-    String VbatData = "";
-
-    if (this->isAlarmBarDisplayed == true)
-      heightObject -= 20;
-
-    if (_vbat_voltage > 4.5)
-      VbatData = "VBat=charging...";
-    else
-      VbatData = "VBat=" + String(int(_vbat_percentage))+"%"; //-"+String(_vbat_voltage)+"V";
-
-    this->spriteScreen.setTextColor(TFT_DARKCYAN);
-    this->spriteScreen.setTextDatum(TL_DATUM);
-    this->spriteScreen.drawString(VbatData, 2, heightObject, 2);
+    this->widgets[DRAWER_WIDGET_BATTERY].values[0] = _vbat_percentage;
+    this->widgets[DRAWER_WIDGET_BATTERY].values[1] = _vbat_voltage;
+    this->set_widget(DRAWER_WIDGET_BATTERY);
   }
 
   /*-------------------------------------------------------------------------------------------------------------------*/
@@ -265,8 +481,13 @@ public:
   /*-------------------------------------------------------------------------------------------------------------------*/
   void draw_alarm_data (double _Xacc_init, double _Yacc_init, double _Zacc_init, double _Xacc_current, double _Yacc_current, double _Zacc_current)
   {
-    String AccelerationCurrent = "Acc.curr="+String(_Xacc_init)+" | "+String(_Yacc_init)+" | "+String(_Zacc_init);
-    String AccelerationInit    = "Acc.init="+String(_Xacc_current)+" | "+String(_Yacc_current)+" | "+String(_Zacc_current);
+    char AccelerationCurrent[DRAWER_LABEL_SIZE];
+    char AccelerationInit[DRAWER_LABEL_SIZE];
+
+    snprintf(AccelerationCurrent, sizeof(AccelerationCurrent), "Acc.curr=%.2f | %.2f | %.2f", _Xacc_current, _Yacc_current, _Zacc_current);
+    snprintf(AccelerationInit, sizeof(AccelerationInit), "Acc.init=%.2f | %.2f | %.2f", _Xacc_init, _Yacc_init, _Zacc_init);
+
+    this->begin_immediate();
     
     // if alarm display is not yet enabled
     if (timerAlarmDraw_ms == 0)
@@ -274,9 +495,9 @@ public:
 
     if ((millis()-timerAlarmDraw_ms) < 500)
     {
-      this->spriteScreen.setTextColor(TFT_RED);
-      this->spriteScreen.setTextDatum(TL_DATUM);
-      this->spriteScreen.drawString("ALARM TRIGGERED", 45, 55, 4);
+      this->spriteScreen->setTextColor(this->color(TFT_RED));
+      this->spriteScreen->setTextDatum(TL_DATUM);
+      this->spriteScreen->drawString("ALARM TRIGGERED", 45, 55, 4);
     }
 
     if ((millis()-timerAlarmDraw_ms) > 250)
@@ -284,23 +505,181 @@ public:
       timerAlarmDraw_ms = 0;
     }
 
-    this->spriteScreen.setTextColor(TFT_RED);
-    this->spriteScreen.drawString(AccelerationCurrent, 10, this->tft.height()-60, 2);
-    this->spriteScreen.drawString(AccelerationInit, 10, this->tft.height()-40, 2);
+    this->spriteScreen->setTextColor(this->color(TFT_RED));
+    this->spriteScreen->drawString(AccelerationCurrent, 10, this->tft.height()-60, 2);
+    this->spriteScreen->drawString(AccelerationInit, 10, this->tft.height()-40, 2);
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Draw a recorded incident on the whole screen
+  // @param _incident : incident to draw
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void draw_incident (const struct strRecorderIncident* _incident)
+  {
+    char title[DRAWER_LABEL_SIZE];
+    const char* trigger = (_incident->trigger == ALARM_TRIGGER_MOTION) ? "motion" : "acceleration";
+
+    snprintf(title, sizeof(title), "INCIDENT #%u (%s)", (unsigned int)_incident->number, trigger);
+
+    this->begin_immediate();
+    this->fill_rect(0, 0, this->tft.width(), this->tft.height(), TFT_BLACK);
+    this->isStripValid[this->backBuffer] = false;
+    this->spriteScreen->setTextColor(this->color(TFT_RED));
+    this->spriteScreen->setTextDatum(TL_DATUM);
+    this->spriteScreen->drawString(title, 2, 0, 2);
+    this->draw_incident_trace(_incident, 20, this->tft.height()-20);
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Draw the acceleration deviation from the armed baseline during an incident
+  // @param _incident : incident to draw
+  // @param _top      : top of the trace
+  // @param _height   : height of the trace
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void draw_incident_trace (const struct strRecorderIncident* _incident, int32_t _top, int32_t _height)
+  {
+    char scale[DRAWER_LABEL_SIZE];
+    float deviation_mg[RECORDER_INCIDENT_SAMPLES];
+    double maximum_mg = 10.0;
+    int32_t width = this->tft.width();
+
+    if (_incident == NULL)
+      return;
+
+    this->begin_immediate();
+
+    for (uint16_t i=0; i<_incident->sampleCount; i++)
+    {
+      double sum = 0.0;
+      for (uint8_t j=0; j<3; j++)
+      {
+        double delta = (double)(_incident->samples[i].acceleration[j] - _incident->baseline[j]);
+        sum += delta * delta;
+      }
+
+      deviation_mg[i] = sqrt(sum) * 1000.0 / RECORDER_ACCELERATION_LSB_PER_G;
+      maximum_mg = fmax(maximum_mg, (double)deviation_mg[i]);
+    }
+
+    // Trigger position
+    int32_t xTrigger = (int32_t)_incident->triggerIndex * width / RECORDER_INCIDENT_SAMPLES;
+    this->spriteScreen->drawFastVLine(xTrigger, _top, _height, this->color(TFT_DARKGREY));
+    this->spriteScreen->drawFastHLine(0, _top+_height-1, width, this->color(TFT_NAVY));
+
+    for (uint16_t i=1; i<_incident->sampleCount; i++)
+    {
+      int32_t x0 = (int32_t)(i-1) * width / RECORDER_INCIDENT_SAMPLES;
+      int32_t x1 = (int32_t)i * width / RECORDER_INCIDENT_SAMPLES;
+      int32_t y0 = _top + _height - 1 - (int32_t)(deviation_mg[i-1] * (_height-1) / maximum_mg);
+      int32_t y1 = _top + _height - 1 - (int32_t)(deviation_mg[i] * (_height-1) / maximum_mg);
+
+      this->spriteScreen->drawLine(x0, y0, x1, y1, this->color(TFT_RED));
+    }
+
+    snprintf(scale, sizeof(scale), "%dmg", (int)maximum_mg);
+    this->spriteScreen->setTextColor(this->color(TFT_DARKCYAN));
+    this->spriteScreen->setTextDatum(TR_DATUM);
+    this->spriteScreen->drawString(scale, width-2, _top, 2);
+    this->spriteScreen->setTextDatum(TL_DATUM);
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Add a sample to the strip chart, a column is added every DRAWER_STRIP_SAMPLES_PER_COLUMN samples
+  // @param _acceleration_mg : acceleration deviation from the armed position
+  // @param _angle_deg       : angle error from the level position
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void add_strip_sample (double _acceleration_mg, double _angle_deg)
+  {
+    int32_t height = this->tft.height() - DRAWER_STRIP_TOP - DRAWER_STRIP_BOTTOM;
+
+    // Peak values, a short knock must stay visible
+    this->stripPeakAcceleration_mg = fmax(this->stripPeakAcceleration_mg, abs(_acceleration_mg));
+    this->stripPeakAngle_deg       = fmax(this->stripPeakAngle_deg, abs(_angle_deg));
+
+    if (++this->stripSampleCount < DRAWER_STRIP_SAMPLES_PER_COLUMN)
+      return;
+
+    struct strStripColumn* column = &this->stripColumns[this->stripColumnCount % DRAWER_STRIP_MAX_COLUMNS];
+    column->acceleration  = (uint8_t)(fmin(this->stripPeakAcceleration_mg / DRAWER_STRIP_ACC_RANGE_MG, 1.0) * (height-1));
+    column->angle         = (uint8_t)(fmin(this->stripPeakAngle_deg / DRAWER_STRIP_ANGLE_RANGE_DEG, 1.0) * (height-1));
+    this->stripColumnCount++;
+
+    this->stripSampleCount          = 0;
+    this->stripPeakAcceleration_mg  = 0.0;
+    this->stripPeakAngle_deg        = 0.0;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Draw the strip chart view : the chart of the buffer is scrolled and only the new columns are drawn,
+  //                 it is fully drawn only when the buffer was used by another view
+  // @param _acceleration_mg : current acceleration deviation from the armed position
+  // @param _angle_deg       : current angle error from the level position
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void draw_strip_chart (double _acceleration_mg, double _angle_deg)
+  {
+    char values[DRAWER_LABEL_SIZE];
+    int32_t width = min((int32_t)this->tft.width(), (int32_t)DRAWER_STRIP_MAX_COLUMNS);
+    int32_t height = this->tft.height() - DRAWER_STRIP_TOP - DRAWER_STRIP_BOTTOM;
+    uint32_t newColumns = this->stripColumnCount - this->stripDrawnCount[this->backBuffer];
+    uint32_t first = this->stripColumnCount - min(newColumns, (uint32_t)width);
+
+    this->begin_immediate();
+
+    if ((this->isStripValid[this->backBuffer] == false) || (newColumns >= (uint32_t)width))
+    {
+      this->fill_rect(0, 0, this->tft.width(), this->tft.height(), TFT_BLACK);
+      first = (this->stripColumnCount > (uint32_t)width) ? this->stripColumnCount - width : 0;
+    }
+    else if (newColumns > 0)
+    {
+      // TFT_eSprite::scroll does not handle the 4 bits per pixel sprites, the frame is scrolled in place
+      uint8_t* frame = (uint8_t*)this->spriteScreen->getPointer();
+      if (frame != NULL)
+        PixelKernels::scroll_left_4bpp(frame, (this->spriteScreen->width() + 1) / 2, 0, DRAWER_STRIP_TOP, width, height,
+                                       (int32_t)newColumns, this->color(TFT_BLACK));
+    }
+
+    // Newest column on the right
+    for (uint32_t i=first; i<this->stripColumnCount; i++)
+      this->draw_strip_column(width - (int32_t)(this->stripColumnCount - i), i, height);
+
+    this->stripDrawnCount[this->backBuffer] = this->stripColumnCount;
+    this->isStripValid[this->backBuffer]    = true;
+
+    // Header, redrawn each frame
+    snprintf(values, sizeof(values), "dAcc=%dmg Ang=%.2f", (int)_acceleration_mg, _angle_deg);
+    this->fill_rect(0, 0, this->tft.width(), DRAWER_STRIP_TOP, TFT_BLACK);
+    this->spriteScreen->setTextColor(this->color(TFT_RED));
+    this->spriteScreen->setTextDatum(TL_DATUM);
+    this->spriteScreen->drawString(values, 2, 4, 2);
+    this->spriteScreen->setTextColor(this->color(TFT_GREEN));
+    this->spriteScreen->drawString("angle", 170, 4, 2);
   }
 
   /*-------------------------------------------------------------------------------------------------------------------*/
   // @brief [PUBLIC] Draw wifi status
-  // @param _color            : color of the indicator
-  // @param _signal_strength  : wifi signal strength
+  // @param _color        : color of the indicator
+  // @param _health_color : color of the link health
+  // @param _rtt_ms       : round trip of the link, negative if not measured
   /*-------------------------------------------------------------------------------------------------------------------*/
-  void draw_wifi_status (uint32_t _color, int16_t _signal_strength)
+  void draw_wifi_status (uint32_t _color, uint32_t _health_color, int32_t _rtt_ms)
   {
-    String wifiQuality = String(_signal_strength)+"%";
+    this->widgets[DRAWER_WIDGET_WIFI].colors[0] = _color;
+    this->widgets[DRAWER_WIDGET_WIFI].colors[1] = _health_color;
+    this->widgets[DRAWER_WIDGET_WIFI].values[0] = _rtt_ms;
+    this->set_widget(DRAWER_WIDGET_WIFI);
+  }
 
-    this->spriteScreen.fillRoundRect(this->tft.width()-50, 0, 50, 5, 3, _color);
-    this->spriteScreen.setTextColor(_color);
-    this->spriteScreen.drawString(wifiQuality, this->tft.width()-37, 10, 2);
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Draw sensor health, left of the connection status
+  // @param _color : color of the text
+  // @param _state : health of the sensor
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void draw_sensor_status (uint32_t _color, const char* _state)
+  {
+    this->widgets[DRAWER_WIDGET_SENSOR].colors[0] = _color;
+    snprintf(this->widgets[DRAWER_WIDGET_SENSOR].text, DRAWER_LABEL_SIZE, "%s", _state);
+    this->set_widget(DRAWER_WIDGET_SENSOR);
   }
 
   /*-------------------------------------------------------------------------------------------------------------------*/
@@ -318,7 +697,7 @@ public:
     }
     
     if ((millis()-this->timerRrefreshPing_ms) < timeout_ms)
-      this->spriteScreen.fillRoundRect(this->tft.width()-70, 0, 8, 5, 3, TFT_GREEN);
+      this->set_widget(DRAWER_WIDGET_PING);
   }
 
   /*-------------------------------------------------------------------------------------------------------------------*/
@@ -326,14 +705,823 @@ public:
   // @param _color : color of the indicator
   // @param _state : state of the alarm
   /*-------------------------------------------------------------------------------------------------------------------*/
-  void draw_alarm_state (uint32_t _color, String _state)
+  void draw_alarm_state (uint32_t _color, const char* _state)
+  {
+    this->widgets[DRAWER_WIDGET_ALARM_BAR].colors[0] = _color;
+    snprintf(this->widgets[DRAWER_WIDGET_ALARM_BAR].text, DRAWER_LABEL_SIZE, "%s", _state);
+    this->set_widget(DRAWER_WIDGET_ALARM_BAR);
+  }
+
+
+private:
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Initialize the TFT and allocate the screen sprites (slow, mostly the controller reset delays)
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void init_display (void)
+  {
+    this->tft.init();
+    this->tft.setRotation(1);
+    this->tft.setSwapBytes(true);
+
+    // Use sprites to avoid screen flickering, they are expanded to RGB565 through the palette when pushed
+    for (uint8_t i=0; i<DRAWER_BUFFER_COUNT; i++)
+    {
+      this->spriteBuffer[i].setColorDepth(DRAWER_COLOR_DEPTH);
+      this->spriteBuffer[i].createSprite(tft.width(), tft.height());
+      this->spriteBuffer[i].createPalette(this->palette, DRAWER_PALETTE_SIZE);
+      this->spriteBuffer[i].setSwapBytes(true);
+      this->spriteBuffer[i].setTextColor(this->color(TFT_WHITE), this->color(TFT_BLACK));
+    }
+
+    // Background snapshot, with the size of a screen sprite
+    this->backgroundBytes = ((this->spriteBuffer[0].width() + 1) / 2) * this->spriteBuffer[0].height();
+    this->backgroundSnapshot = this->alloc_snapshot(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (this->backgroundSnapshot == NULL)
+      this->backgroundSnapshot = this->alloc_snapshot(MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (this->backgroundSnapshot == NULL)
+      Serial.println("DRAWER : ERROR, no memory for the background snapshot, it is rendered each frame");
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Allocate the background snapshot, the copy is a memcpy : any word alignment will do
+  // @param _caps : MALLOC_CAP_xxx
+  // @return snapshot, NULL without memory
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  uint8_t* alloc_snapshot (uint32_t _caps)
+  {
+    return (uint8_t*)heap_caps_malloc(this->backgroundBytes, _caps);
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Push task : send the requested buffer to the TFT, then release it
+  // @param _param : DrawerManager instance
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  static void push_task (void* _param)
+  {
+    DrawerManager* drawer = (DrawerManager*)_param;
+
+    drawer->init_display();
+    BootTimeline::mark("display ready");
+    xSemaphoreGive(drawer->displayReady);
+
+    while (true)
+    {
+      xSemaphoreTake(drawer->pushRequest, portMAX_DELAY);
+      PowerManager::acquire(POWER_LOCK_CPU);
+      drawer->push_frame(&drawer->spriteBuffer[drawer->pushBuffer], &drawer->pushDamage);
+      PowerManager::release(POWER_LOCK_CPU);
+      xSemaphoreGive(drawer->pushDone);
+    }
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Set a widget of the live view, it is composed by draw_update. Outside of the live view, it is
+  //                  drawn at once over the current view.
+  // @param _id : DRAWER_WIDGET_xxx
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void set_widget (uint8_t _id)
+  {
+    this->widgets[_id].isSet = true;
+
+    if (this->frameMode == DRAWER_FRAME_RETAINED)
+      return;
+
+    this->begin_immediate();
+    this->layout_widget(_id, &this->widgets[_id].view);
+    this->draw_widget(_id);
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Switch the frame to the immediate mode, before drawing directly into the screen sprite. The live
+  //                  view already given is composed first, so that the drawing is over it.
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void begin_immediate (void)
+  {
+    struct strDrawerDamage full;
+
+    this->lock_cpu();
+    if (this->frameMode == DRAWER_FRAME_RETAINED)
+    {
+      for (uint8_t i=0; i<DRAWER_WIDGET_COUNT; i++)
+        this->layout_widget(i, &this->widgets[i].view);
+
+      this->clear_damage(&full, true);
+      this->compose_widgets(&full);
+    }
+
+    this->frameMode = DRAWER_FRAME_IMMEDIATE;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Compose the frame of the back buffer. In the live view, the damage is the old and new bounds of
+  //                  the widgets whose view changed : it is composed from the background, then sent to the TFT. The
+  //                  rest of the buffer can be older than the screen, it is not sent.
+  // @param _damage : output, areas to send to the TFT
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void compose_frame (struct strDrawerDamage* _damage)
+  {
+    struct strDrawerDamage frameDamage;
+
+    // Immediate frame : sent as a whole, and the next live view is composed from scratch in every buffer
+    if ((this->frameMode != DRAWER_FRAME_RETAINED) || ((this->spriteScreen->width() % 2) != 0))
+    {
+      if (this->frameMode == DRAWER_FRAME_RETAINED)
+        this->begin_immediate();
+
+      for (uint8_t i=0; i<DRAWER_BUFFER_COUNT; i++)
+        this->isBufferComposed[i] = false;
+      this->clear_damage(_damage, true);
+      this->isPanelValid = false;
+      return;
+    }
+
+    this->clear_damage(&frameDamage, false);
+    for (uint8_t i=0; i<DRAWER_WIDGET_COUNT; i++)
+    {
+      struct strDrawerView view;
+
+      this->layout_widget(i, &view);
+      if (memcmp(&view, &this->widgets[i].view, sizeof(view)) == 0)
+        continue;
+
+      this->add_damage(&frameDamage, this->widgets[i].view.bounds);
+      this->add_damage(&frameDamage, view.bounds);
+      this->widgets[i].view = view;
+    }
+
+    // A buffer which held another view is composed as a whole
+    if (this->isBufferComposed[this->backBuffer] == false)
+    {
+      struct strDrawerDamage full;
+
+      this->clear_damage(&full, true);
+      this->compose_widgets(&full);
+      this->isBufferComposed[this->backBuffer] = true;
+    }
+    else
+      this->compose_widgets(&frameDamage);
+
+    if (this->isPanelValid == true)
+      *_damage = frameDamage;
+    else
+      this->clear_damage(_damage, true);
+    this->isPanelValid = true;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Restore the background of the damaged areas, then draw the widgets which cross them, clipped
+  // @param _damage : areas to compose
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void compose_widgets (const struct strDrawerDamage* _damage)
+  {
+    bool isSnapshotValid = (this->backgroundSnapshot != NULL) && (this->backgroundWidth == this->spriteScreen->width()) &&
+                           (this->backgroundHeight == this->spriteScreen->height());
+
+    if ((_damage->isFull == true) || (isSnapshotValid == false))
+    {
+      this->draw_full_background();
+      for (uint8_t i=0; i<DRAWER_WIDGET_COUNT; i++)
+      {
+        if (this->widgets[i].view.bounds.width > 0)
+          this->draw_widget(i);
+      }
+      return;
+    }
+
+    for (uint8_t i=0; i<_damage->count; i++)
+    {
+      const struct strDrawerRect* rect = &_damage->rects[i];
+
+      this->restore_background(rect);
+      this->spriteScreen->setViewport(rect->x, rect->y, rect->width, rect->height, false);
+      for (uint8_t j=0; j<DRAWER_WIDGET_COUNT; j++)
+      {
+        if (this->is_intersecting(&this->widgets[j].view.bounds, rect) == true)
+          this->draw_widget(j);
+      }
+      this->spriteScreen->resetViewport();
+    }
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] End of a frame : the widgets must be given again by the next one
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void end_frame (void)
+  {
+    for (uint8_t i=0; i<DRAWER_WIDGET_COUNT; i++)
+      this->widgets[i].isSet = false;
+    this->frameMode = DRAWER_FRAME_NONE;
+
+    if (this->isCpuLocked == true)
+    {
+      this->isCpuLocked = false;
+      PowerManager::release(POWER_LOCK_CPU);
+    }
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Take the CPU lock of the power manager for the composition of the frame, until end_frame()
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void lock_cpu (void)
+  {
+    if (this->isCpuLocked == true)
+      return;
+
+    this->isCpuLocked = true;
+    PowerManager::acquire(POWER_LOCK_CPU);
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Count a frame in the statistics
+  // @param _damage : areas sent to the TFT
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void count_frame (const struct strDrawerDamage* _damage)
+  {
+    this->reportFrames++;
+
+    if (_damage->isFull == true)
+    {
+      this->reportFullFrames++;
+      this->reportPixels += (uint64_t)this->tft.width() * this->tft.height();
+      return;
+    }
+
+    for (uint8_t i=0; i<_damage->count; i++)
+      this->reportPixels += (uint64_t)_damage->rects[i].width * _damage->rects[i].height;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Compute the view of a widget from the values given by the loop
+  // @param _id   : DRAWER_WIDGET_xxx
+  // @param _view : output, empty when the widget was not given during this frame
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void layout_widget (uint8_t _id, struct strDrawerView* _view)
+  {
+    const struct strDrawerWidget* widget = &this->widgets[_id];
+    int32_t width = this->tft.width();
+    int32_t height = this->tft.height();
+    int32_t cx = width / 2;
+    int32_t cy = height / 2;
+
+    // Bottom of the free area, the alarm bar is over the bottom of the screen
+    int32_t bottom = (this->widgets[DRAWER_WIDGET_ALARM_BAR].isSet == true) ? height-DRAWER_ALARM_BAR_HEIGHT : height;
+
+    memset(_view, 0, sizeof(struct strDrawerView));
+    if (widget->isSet == false)
+      return;
+
+    switch (_id)
+    {
+      case DRAWER_WIDGET_PING:
+        _view->points[0] = width-70;
+        _view->colors[0] = TFT_GREEN;
+        _view->bounds = {_view->points[0], 0, 8, 5};
+        break;
+
+      case DRAWER_WIDGET_WIFI:
+        if (widget->values[0] < 0)
+          snprintf(_view->text[0], DRAWER_LABEL_SIZE, "--");
+        else
+          snprintf(_view->text[0], DRAWER_LABEL_SIZE, "%dms", (int)min(widget->values[0], 999.0));
+        _view->points[0] = width-50;
+        _view->points[1] = width-42;
+        _view->colors[0] = widget->colors[0];
+        _view->colors[1] = widget->colors[1];
+        _view->bounds = {_view->points[0], 0, 50, 5};
+        _view->bounds = this->get_union(&_view->bounds, this->text_bounds(_view->text[0], _view->points[1], 10, 2, TL_DATUM));
+        break;
+
+      case DRAWER_WIDGET_NORTH:
+      {
+        double circleRadius1 = 55.0;
+        double circleRadius2 = 45.0;
+        double zAngle = (widget->values[0] + 90);
+
+        _view->points[0] = cx + circleRadius1 * cos(toRadians(zAngle));
+        _view->points[1] = cy + circleRadius1 * sin(toRadians(zAngle));
+        _view->points[2] = cx + circleRadius2 * cos(toRadians(zAngle + 15));
+        _view->points[3] = cy + circleRadius2 * sin(toRadians(zAngle + 15));
+        _view->points[4] = cx + circleRadius2 * cos(toRadians(zAngle - 15));
+        _view->points[5] = cy + circleRadius2 * sin(toRadians(zAngle - 15));
+        _view->colors[0] = TFT_DARKCYAN;
+
+        int32_t left = min(_view->points[0], min(_view->points[2], _view->points[4]));
+        int32_t top = min(_view->points[1], min(_view->points[3], _view->points[5]));
+        int32_t right = max(_view->points[0], max(_view->points[2], _view->points[4]));
+        int32_t low = max(_view->points[1], max(_view->points[3], _view->points[5]));
+        _view->bounds = {left, top, right - left + 1, low - top + 1};
+        break;
+      }
+
+      case DRAWER_WIDGET_MAIN_POINT:
+      {
+        uint8_t circleSize = 7;
+        double scale  = 10.0;
+        double xp = (widget->values[1]*scale + cx);
+        double yp = widget->values[0]*scale + cy;
+
+        if (xp < 0)
+          xp = circleSize;
+        if (xp > (width-circleSize))
+          xp = width-circleSize;
+        if (yp < 0)
+          yp = circleSize;
+        if (yp > (bottom-circleSize))
+          yp = bottom-circleSize;
+
+        _view->points[0] = xp;
+        _view->points[1] = yp;
+        _view->points[2] = circleSize-2;
+        _view->colors[0] = TFT_RED;
+        _view->bounds = {_view->points[0] - _view->points[2], _view->points[1] - _view->points[2], 2*_view->points[2] + 1, 2*_view->points[2] + 1};
+        break;
+      }
+
+      case DRAWER_WIDGET_ANGLES:
+        snprintf(_view->text[0], DRAWER_LABEL_SIZE, "X=%.2f", widget->values[0]);
+        snprintf(_view->text[1], DRAWER_LABEL_SIZE, "Y=%.2f", widget->values[1]);
+        if ((abs(widget->values[0]) < 0.1) && (abs(widget->values[1]) < 0.1))
+          _view->colors[0] = TFT_GREEN;
+        else if ((abs(widget->values[0]) < 1.0) && (abs(widget->values[1]) < 1.0))
+          _view->colors[0] = TFT_ORANGE;
+        else
+          _view->colors[0] = TFT_RED;
+        _view->points[0] = 2;
+        _view->points[1] = 0;
+        _view->points[2] = 2;
+        _view->points[3] = 25;
+        _view->points[4] = 4;
+        break;
+
+      case DRAWER_WIDGET_TEMPERATURE:
+        snprintf(_view->text[0], DRAWER_LABEL_SIZE, "T=%dC", int(widget->values[0]));
+        _view->colors[0] = TFT_DARKCYAN;
+        _view->points[0] = 2;
+        _view->points[1] = bottom-35;
+        _view->points[4] = 2;
+        break;
+
+      case DRAWER_WIDGET_BATTERY:
+        if (widget->values[1] > 4.5)
+          snprintf(_view->text[0], DRAWER_LABEL_SIZE, "VBat=charging...");
+        else
+          snprintf(_view->text[0], DRAWER_LABEL_SIZE, "VBat=%d%%", int(widget->values[0]));
+        _view->colors[0] = TFT_DARKCYAN;
+        _view->points[0] = 2;
+        _view->points[1] = bottom-20;
+        _view->points[4] = 2;
+        break;
+
+      case DRAWER_WIDGET_MEMORY:
+        snprintf(_view->text[0], DRAWER_LABEL_SIZE, "Xm=%.2f", widget->values[0]);
+        snprintf(_view->text[1], DRAWER_LABEL_SIZE, "Ym=%.2f", widget->values[1]);
+        _view->colors[0] = TFT_DARKCYAN;
+        _view->points[0] = width-80;
+        _view->points[1] = height-35;
+        _view->points[2] = width-80;
+        _view->points[3] = height-20;
+        _view->points[4] = 2;
+        break;
+
+      case DRAWER_WIDGET_SENSOR:
+        snprintf(_view->text[0], DRAWER_LABEL_SIZE, "SENSOR %.*s", (int)(DRAWER_LABEL_SIZE-sizeof("SENSOR ")), widget->text);
+        _view->colors[0] = widget->colors[0];
+        _view->points[0] = width-48;
+        _view->points[1] = 10;
+        _view->bounds = this->text_bounds(_view->text[0], _view->points[0], _view->points[1], 2, TR_DATUM);
+        break;
+
+      case DRAWER_WIDGET_ALARM_BAR:
+        snprintf(_view->text[0], DRAWER_LABEL_SIZE, "ALARM %.*s", (int)(DRAWER_LABEL_SIZE-sizeof("ALARM ")), widget->text);
+        _view->colors[0] = widget->colors[0];
+        _view->points[0] = height-DRAWER_ALARM_BAR_HEIGHT;
+        _view->bounds = {0, _view->points[0], width, DRAWER_ALARM_BAR_HEIGHT};
+        break;
+
+      default:
+        break;
+    }
+
+    // Labels : one or two texts, top left aligned, with the font in points[4]
+    if ((_id == DRAWER_WIDGET_ANGLES) || (_id == DRAWER_WIDGET_TEMPERATURE) || (_id == DRAWER_WIDGET_BATTERY) || (_id == DRAWER_WIDGET_MEMORY))
+    {
+      _view->bounds = this->text_bounds(_view->text[0], _view->points[0], _view->points[1], _view->points[4], TL_DATUM);
+      if (_view->text[1][0] != '\0')
+        _view->bounds = this->get_union(&_view->bounds, this->text_bounds(_view->text[1], _view->points[2], _view->points[3], _view->points[4], TL_DATUM));
+    }
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Draw a widget from its view, into the screen sprite
+  // @param _id : DRAWER_WIDGET_xxx
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void draw_widget (uint8_t _id)
   {
-    isAlarmBarDisplayed = true;
-    String state = "ALARM "+_state;
+    const struct strDrawerView* view = &this->widgets[_id].view;
+
+    if (view->bounds.width <= 0)
+      return;
+
+    switch (_id)
+    {
+      case DRAWER_WIDGET_PING:
+        this->spriteScreen->fillRoundRect(view->points[0], 0, 8, 5, 3, this->color(view->colors[0]));
+        break;
+
+      case DRAWER_WIDGET_WIFI:
+        this->spriteScreen->fillRoundRect(view->points[0], 0, 50, 5, 3, this->color(view->colors[0]));
+        this->spriteScreen->setTextColor(this->color(view->colors[1]));
+        this->spriteScreen->setTextDatum(TL_DATUM);
+        this->spriteScreen->drawString(view->text[0], view->points[1], 10, 2);
+        break;
+
+      case DRAWER_WIDGET_NORTH:
+        this->spriteScreen->fillTriangle(view->points[0], view->points[1], view->points[2], view->points[3], view->points[4], view->points[5], this->color(view->colors[0]));
+        break;
+
+      case DRAWER_WIDGET_MAIN_POINT:
+        this->spriteScreen->fillCircle(view->points[0], view->points[1], view->points[2], this->color(view->colors[0]));
+        break;
+
+      case DRAWER_WIDGET_SENSOR:
+        this->spriteScreen->setTextColor(this->color(view->colors[0]));
+        this->spriteScreen->setTextDatum(TR_DATUM);
+        this->spriteScreen->drawString(view->text[0], view->points[0], view->points[1], 2);
+        this->spriteScreen->setTextDatum(TL_DATUM);
+        break;
+
+      case DRAWER_WIDGET_ALARM_BAR:
+        this->spriteScreen->fillRoundRect(0, view->points[0], view->bounds.width, this->tft.height(), 3, this->color(view->colors[0]));
+        this->spriteScreen->setTextColor(this->color(TFT_NAVY));
+        this->spriteScreen->setTextDatum(TL_DATUM);
+        this->spriteScreen->drawString(view->text[0], 55, view->points[0], 4);
+        break;
+
+      default:
+        this->spriteScreen->setTextColor(this->color(view->colors[0]));
+        this->spriteScreen->setTextDatum(TL_DATUM);
+        this->spriteScreen->drawString(view->text[0], view->points[0], view->points[1], view->points[4]);
+        if (view->text[1][0] != '\0')
+          this->spriteScreen->drawString(view->text[1], view->points[2], view->points[3], view->points[4]);
+        break;
+    }
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Area covered by a text
+  // @param _text  : text
+  // @param _x     : position of the datum
+  // @param _y     : position of the datum
+  // @param _font  : font number
+  // @param _datum : TL_DATUM or TR_DATUM
+  // @return area of the text
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  struct strDrawerRect text_bounds (const char* _text, int32_t _x, int32_t _y, uint8_t _font, uint8_t _datum)
+  {
+    int32_t width = this->spriteScreen->textWidth(_text, _font);
+    struct strDrawerRect bounds = {_x, _y, width, this->spriteScreen->fontHeight(_font)};
+
+    if (_datum == TR_DATUM)
+      bounds.x -= width;
+
+    return bounds;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Draw the whole background : copy of the snapshot, which is rendered again when the layout changed
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void draw_full_background (void)
+  {
+    uint8_t* frame = (uint8_t*)this->spriteScreen->getPointer();
+
+    if ((this->backgroundSnapshot == NULL) || (frame == NULL))
+    {
+      this->render_background();
+      return;
+    }
+
+    if ((this->backgroundWidth != this->spriteScreen->width()) || (this->backgroundHeight != this->spriteScreen->height()))
+    {
+      this->render_background();
+      PixelKernels::copy(this->backgroundSnapshot, frame, this->backgroundBytes);
+      this->backgroundWidth  = this->spriteScreen->width();
+      this->backgroundHeight = this->spriteScreen->height();
+      return;
+    }
+
+    PixelKernels::copy(frame, this->backgroundSnapshot, this->backgroundBytes);
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Restore the background of a rectangle from the snapshot
+  // @param _rect : rectangle on whole bytes of the frame
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void restore_background (const struct strDrawerRect* _rect)
+  {
+    uint8_t* frame = (uint8_t*)this->spriteScreen->getPointer();
+    int32_t stride = (this->spriteScreen->width() + 1) / 2;
+
+    for (int32_t y=_rect->y; y<(_rect->y + _rect->height); y++)
+      PixelKernels::copy(&frame[y * stride + _rect->x / 2], &this->backgroundSnapshot[y * stride + _rect->x / 2], _rect->width / 2);
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Empty a damage
+  // @param _damage : damage
+  // @param _isFull : true for the whole screen
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void clear_damage (struct strDrawerDamage* _damage, bool _isFull)
+  {
+    _damage->isFull = _isFull;
+    _damage->count  = 0;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Add a rectangle to a damage : it is clipped to the screen and widened to whole bytes of the frame,
+  //                  then merged with the rectangles it crosses. When the list is full, it is merged with the rectangle
+  //                  which grows the least.
+  // @param _damage : damage
+  // @param _rect   : changed area
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void add_damage (struct strDrawerDamage* _damage, struct strDrawerRect _rect)
+  {
+    int32_t left = max(_rect.x, (int32_t)0) & ~1;
+    int32_t top = max(_rect.y, (int32_t)0);
+    int32_t right = min(_rect.x + _rect.width, (int32_t)this->tft.width());
+    int32_t bottom = min(_rect.y + _rect.height, (int32_t)this->tft.height());
+
+    if ((_damage->isFull == true) || (_rect.width <= 0) || (_rect.height <= 0) || (right <= left) || (bottom <= top))
+      return;
+
+    _rect = {left, top, ((right + 1) & ~1) - left, bottom - top};
+
+    for (uint8_t i=0; i<_damage->count; )
+    {
+      if (this->is_intersecting(&_damage->rects[i], &_rect) == false)
+      {
+        i++;
+        continue;
+      }
+
+      // The merged rectangle can cross rectangles already checked
+      _rect = this->get_union(&_damage->rects[i], _rect);
+      _damage->rects[i] = _damage->rects[--_damage->count];
+      i = 0;
+    }
+
+    if (_damage->count < DRAWER_DAMAGE_MAX_RECTS)
+    {
+      _damage->rects[_damage->count++] = _rect;
+      return;
+    }
+
+    uint8_t nearest = 0;
+    int64_t nearestGrowth = INT64_MAX;
+    for (uint8_t i=0; i<_damage->count; i++)
+    {
+      struct strDrawerRect merged = this->get_union(&_damage->rects[i], _rect);
+      int64_t growth = (int64_t)merged.width * merged.height - (int64_t)_damage->rects[i].width * _damage->rects[i].height;
+
+      if (growth < nearestGrowth)
+      {
+        nearestGrowth = growth;
+        nearest = i;
+      }
+    }
+    _damage->rects[nearest] = this->get_union(&_damage->rects[nearest], _rect);
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Check if two rectangles cross each other
+  // @return true if they have a common area
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  bool is_intersecting (const struct strDrawerRect* _a, const struct strDrawerRect* _b)
+  {
+    if ((_a->width <= 0) || (_a->height <= 0) || (_b->width <= 0) || (_b->height <= 0))
+      return false;
+
+    return (_a->x < (_b->x + _b->width)) && (_b->x < (_a->x + _a->width)) &&
+           (_a->y < (_b->y + _b->height)) && (_b->y < (_a->y + _a->height));
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Smallest rectangle containing two rectangles, an empty rectangle is ignored
+  // @return union of the rectangles
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  struct strDrawerRect get_union (const struct strDrawerRect* _a, struct strDrawerRect _b)
+  {
+    if ((_a->width <= 0) || (_a->height <= 0))
+      return _b;
+    if ((_b.width <= 0) || (_b.height <= 0))
+      return *_a;
+
+    int32_t left = min(_a->x, _b.x);
+    int32_t top = min(_a->y, _b.y);
+    int32_t right = max(_a->x + _a->width, _b.x + _b.width);
+    int32_t bottom = max(_a->y + _a->height, _b.y + _b.height);
+
+    return {left, top, right - left, bottom - top};
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Render the background into the screen sprite
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void render_background (void)
+  {
+    uint32_t color  = TFT_DARKCYAN;
+    uint16_t size   = 5;
+    uint16_t cx     = this->tft.width() / 2;
+    uint16_t cy     = this->tft.height() / 2;
+
+    this->fill_rect(0, 0, this->tft.width(), this->tft.height(), TFT_BLACK);
+
+    // Circles
+    for (uint16_t i=0; i<7; i++)
+    {
+      if (color == TFT_DARKCYAN)
+        color = TFT_NAVY;
+      else
+        color = TFT_DARKCYAN;
+      
+      this->spriteScreen->drawCircle(cx, cy, i*size, this->color(color));
+      size += 3;
+    }
+
+    // Lines
+    this->spriteScreen->drawLine(cx, 0, cx, this->tft.height(), this->color(TFT_NAVY));
+    this->spriteScreen->drawLine(0, cy, this->tft.width(), cy, this->color(TFT_NAVY));
+    this->spriteScreen->drawLine(0, 0, this->tft.width(), this->tft.height(), this->color(TFT_NAVY));
+    this->spriteScreen->drawLine(0, this->tft.height(), this->tft.width(), 0, this->color(TFT_NAVY));
+
+    // axis name
+    this->spriteScreen->setTextColor(this->color(TFT_NAVY));
+    this->spriteScreen->setTextDatum(TL_DATUM);
+    this->spriteScreen->drawString("x+", cx+3, -5, 4);
+    this->spriteScreen->drawString("x-", cx+3, this->tft.height()-18, 4);
+    this->spriteScreen->drawString("y-", 3, cy+1, 4);
+    this->spriteScreen->drawString("y+", this->tft.width()-25, cy+1, 4);
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Send a frame to the TFT : the 4 bits pixels are expanded through the palette table by blocks of
+  //                  lines, already in the byte order of the bus, instead of one palette lookup per pixel in TFT_eSPI
+  // @param _sprite : frame to send
+  // @param _damage : areas to send, the rectangles are on whole bytes of the frame
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void push_frame (TFT_eSprite* _sprite, const struct strDrawerDamage* _damage)
+  {
+    const uint8_t* frame = (const uint8_t*)_sprite->getPointer();
+    struct strDrawerRect screen = {0, 0, _sprite->width(), _sprite->height()};
+
+    // The expanded lines must stay 32 bits aligned
+    if ((frame == NULL) || (screen.width > DRAWER_PUSH_MAX_WIDTH) || ((screen.width % 2) != 0))
+    {
+      _sprite->pushSprite(0, 0);
+      return;
+    }
+
+    bool isSwapped = this->tft.getSwapBytes();
+    this->tft.setSwapBytes(false);
+    this->tft.startWrite();
+
+    if (_damage->isFull == true)
+      this->push_rect(frame, screen.width / 2, &screen);
+    else
+    {
+      for (uint8_t i=0; i<_damage->count; i++)
+        this->push_rect(frame, screen.width / 2, &_damage->rects[i]);
+    }
+
+    this->tft.endWrite();
+    this->tft.setSwapBytes(isSwapped);
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Send a rectangle of a frame, the TFT must be selected
+  // @param _frame  : first byte of the frame
+  // @param _stride : bytes per line of the frame
+  // @param _rect   : rectangle to send, on whole bytes of the frame
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void push_rect (const uint8_t* _frame, int32_t _stride, const struct strDrawerRect* _rect)
+  {
+    int32_t blockLines = (DRAWER_PUSH_LINES * DRAWER_PUSH_MAX_WIDTH) / _rect->width;
+    uint16_t* pixels = (uint16_t*)this->pushLines;
+
+    this->tft.setAddrWindow(_rect->x, _rect->y, _rect->width, _rect->height);
+
+    for (int32_t y=_rect->y; y<(_rect->y + _rect->height); y+=blockLines)
+    {
+      int32_t lines = min(blockLines, _rect->y + _rect->height - y);
+
+      for (int32_t i=0; i<lines; i++)
+        PixelKernels::expand_4bpp(&pixels[i * _rect->width], &_frame[(y + i) * _stride + _rect->x / 2], _rect->width, this->paletteTable);
+      this->tft.pushPixels(pixels, lines * _rect->width);
+    }
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Rebuild the palette table if a color was added, no frame must be in progress
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void update_palette_table (void)
+  {
+    if (this->isPaletteTableValid == true)
+      return;
+
+    PixelKernels::build_palette_table(this->paletteTable, this->palette);
+    this->isPaletteTableValid = true;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Fill a rectangle of the screen sprite, clipped to the sprite. TFT_eSprite fills the rectangles
+  //                  with an odd position or width pixel per pixel, the kernel only writes nibbles on the edges.
+  // @param _x      : left of the rectangle
+  // @param _y      : top of the rectangle
+  // @param _width  : width of the rectangle
+  // @param _height : height of the rectangle
+  // @param _color  : RGB565 color
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void fill_rect (int32_t _x, int32_t _y, int32_t _width, int32_t _height, uint32_t _color)
+  {
+    uint8_t* frame = (uint8_t*)this->spriteScreen->getPointer();
+    int32_t width = this->spriteScreen->width();
+    int32_t height = this->spriteScreen->height();
+    int32_t left = max(_x, (int32_t)0);
+    int32_t top = max(_y, (int32_t)0);
+    int32_t right = min(_x + _width, width);
+    int32_t bottom = min(_y + _height, height);
+
+    if ((frame == NULL) || (right <= left) || (bottom <= top))
+      return;
+
+    PixelKernels::fill_rect_4bpp(frame, (width + 1) / 2, left, top, right - left, bottom - top, this->color(_color));
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Draw one column of the strip chart, joined to the previous one
+  // @param _x      : position of the column
+  // @param _index  : index of the column since startup
+  // @param _height : height of the chart
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void draw_strip_column (int32_t _x, uint32_t _index, int32_t _height)
+  {
+    const struct strStripColumn* column = &this->stripColumns[_index % DRAWER_STRIP_MAX_COLUMNS];
+    const struct strStripColumn* previous = (_index > 0) ? &this->stripColumns[(_index-1) % DRAWER_STRIP_MAX_COLUMNS] : column;
+    int32_t bottom = DRAWER_STRIP_TOP + _height - 1;
+
+    // Alarm threshold, the dots follow their column when the chart scrolls
+    int32_t threshold = (int32_t)(ALARM_ACCELERATION_MARGIN_G * 1000.0 / DRAWER_STRIP_ACC_RANGE_MG * (_height-1));
+    if ((_index % 4) == 0)
+      this->spriteScreen->drawPixel(_x, bottom - threshold, this->color(TFT_NAVY));
+
+    int32_t low = min(column->angle, previous->angle);
+    int32_t high = max(column->angle, previous->angle);
+    this->spriteScreen->drawFastVLine(_x, bottom - high, high - low + 1, this->color(TFT_GREEN));
+
+    low = min(column->acceleration, previous->acceleration);
+    high = max(column->acceleration, previous->acceleration);
+    this->spriteScreen->drawFastVLine(_x, bottom - high, high - low + 1, this->color(TFT_RED));
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Convert a RGB565 color into its palette index. An unknown color is added to the palette,
+  //                  or replaced by the nearest one when the palette is full.
+  // @param _color : RGB565 color
+  // @return palette index
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  uint16_t color (uint32_t _color)
+  {
+    uint8_t nearest = 0;
+    int32_t nearestDistance = INT32_MAX;
+
+    for (uint8_t i=0; i<this->paletteCount; i++)
+    {
+      if (this->palette[i] == _color)
+        return i;
+    }
+
+    if (this->paletteCount < DRAWER_PALETTE_SIZE)
+    {
+      this->palette[this->paletteCount] = _color;
+      for (uint8_t i=0; i<DRAWER_BUFFER_COUNT; i++)
+        this->spriteBuffer[i].setPaletteColor(this->paletteCount, _color);
+      this->isPaletteTableValid = false;
+      return this->paletteCount++;
+    }
+
+    for (uint8_t i=0; i<this->paletteCount; i++)
+    {
+      int32_t dr = (int32_t)((this->palette[i] >> 11) & 0x1F) - (int32_t)((_color >> 11) & 0x1F);
+      int32_t dg = (int32_t)((this->palette[i] >> 5) & 0x3F) - (int32_t)((_color >> 5) & 0x3F);
+      int32_t db = (int32_t)(this->palette[i] & 0x1F) - (int32_t)(_color & 0x1F);
+      int32_t distance = 4*dr*dr + dg*dg + 4*db*db;
+
+      if (distance < nearestDistance)
+      {
+        nearestDistance = distance;
+        nearest = i;
+      }
+    }
 
-    this->spriteScreen.fillRoundRect(0, this->tft.height()-20, this->tft.width(), this->tft.height(), 3, _color);
-    this->spriteScreen.setTextColor(TFT_NAVY);
-    this->spriteScreen.setTextDatum(TL_DATUM);
-    this->spriteScreen.drawString(state, 55, this->tft.height()-20, 4);
+    return nearest;
   }
 };
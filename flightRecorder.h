@@ -0,0 +1,373 @@
+/*********************************************************************************************************************
+ * Project : Astro Alarm
+ * Author  : PEB <pebdev@lavache.com> 
+ * Date    : 2024.01.18
+ *********************************************************************************************************************
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ * 
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *********************************************************************************************************************/
+
+
+/** D E F I N E S ****************************************************************************************************/
+// Recording, samples are received every ~200ms
+#define RECORDER_PRE_TRIGGER_SAMPLES      (150)   // ~30s before the trigger
+#define RECORDER_POST_TRIGGER_SAMPLES     (50)    // ~10s after the trigger
+#define RECORDER_INCIDENT_SAMPLES         (RECORDER_PRE_TRIGGER_SAMPLES + RECORDER_POST_TRIGGER_SAMPLES)
+#define RECORDER_MAX_INCIDENTS            (4)     // The oldest incident is replaced when full
+
+// Sample scales, same as the WT906 raw values
+#define RECORDER_ACCELERATION_LSB_PER_G   (2048.0)              // +/-16g
+#define RECORDER_VELOCITY_LSB_PER_DPS     (32768.0 / 2000.0)    // +/-2000°/s
+
+// Binary dump of an incident, all the values are little endian, independent of the struct layout :
+//   "FR", version (u8), size of the incident data (u16)
+//   incident data : number (u32), triggerTime_ms (u32), trigger (u8), triggerIndex (u16), sampleCount (u16),
+//                   baseline x/y/z (3 x i16), then sampleCount samples
+//   sample        : timestamp_ms (u32), acceleration x/y/z (3 x i16), velocity x/y/z (3 x i16)
+//   Fletcher-16 of the incident data : sum1 (u8), sum2 (u8)
+#define RECORDER_DUMP_MAGIC               "FR"
+#define RECORDER_DUMP_VERSION             (2)   // 1 was the raw struct bytes
+#define RECORDER_DUMP_HEADER_SIZE         (5)
+#define RECORDER_DUMP_INCIDENT_SIZE       (19)
+#define RECORDER_DUMP_SAMPLE_SIZE         (16)
+
+// Browsing on the TFT
+#define RECORDER_BROWSE_NONE              (-1)
+
+
+/** S T R U C T S ****************************************************************************************************/
+struct strRecorderSample
+{
+  uint32_t timestamp_ms;    // Server time when available, otherwise client time
+  int16_t acceleration[3];
+  int16_t velocity[3];
+};
+
+struct strRecorderIncident
+{
+  uint32_t number;          // Incident number since startup, 0 if the slot is empty
+  uint32_t triggerTime_ms;
+  uint8_t trigger;          // ALARM_TRIGGER_xxx
+  uint16_t triggerIndex;    // Index of the first sample after the trigger
+  uint16_t sampleCount;
+  int16_t baseline[3];      // Acceleration recorded when the alarm was armed
+  struct strRecorderSample samples[RECORDER_INCIDENT_SAMPLES];
+};
+
+
+/** F L I G H T  R E C O R D E R *************************************************************************************/
+class FlightRecorder
+{
+private:
+  // Last received samples, circular buffer
+  struct strRecorderSample history[RECORDER_PRE_TRIGGER_SAMPLES];
+  uint16_t historyIndex;
+  uint16_t historyCount;
+
+  // Frozen incidents
+  struct strRecorderIncident incidents[RECORDER_MAX_INCIDENTS];
+  uint32_t incidentCount;
+  int8_t recordingIncident;   // Incident receiving post trigger samples, -1 if none
+  bool isTriggered;
+  int8_t browsedIncident;
+
+
+public:
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Constructor
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  FlightRecorder (void)
+  {
+    this->historyIndex      = 0;
+    this->historyCount      = 0;
+    this->incidentCount     = 0;
+    this->recordingIncident = -1;
+    this->isTriggered       = false;
+    this->browsedIncident   = RECORDER_BROWSE_NONE;
+
+    for (uint8_t i=0; i<RECORDER_MAX_INCIDENTS; i++)
+    {
+      this->incidents[i].number       = 0;
+      this->incidents[i].sampleCount  = 0;
+    }
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Record a received sample, O(1) and without allocation
+  // @param _data         : received data
+  // @param _timestamp_ms : time of the sample
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void record (const struct strComData& _data, uint32_t _timestamp_ms)
+  {
+    struct strRecorderSample sample;
+
+    sample.timestamp_ms = _timestamp_ms;
+    for (uint8_t i=0; i<3; i++)
+    {
+      sample.acceleration[i] = this->to_raw(_data.incAcceleration.acceleration[i], RECORDER_ACCELERATION_LSB_PER_G);
+      sample.velocity[i]     = this->to_raw(_data.inclAngularVelocity.velocity[i], RECORDER_VELOCITY_LSB_PER_DPS);
+    }
+
+    this->history[this->historyIndex] = sample;
+    this->historyIndex = (this->historyIndex + 1) % RECORDER_PRE_TRIGGER_SAMPLES;
+    if (this->historyCount < RECORDER_PRE_TRIGGER_SAMPLES)
+      this->historyCount++;
+
+    // Post trigger recording
+    if (this->recordingIncident >= 0)
+    {
+      struct strRecorderIncident* incident = &this->incidents[this->recordingIncident];
+
+      incident->samples[incident->sampleCount++] = sample;
+      if (incident->sampleCount >= RECORDER_INCIDENT_SAMPLES)
+      {
+        this->recordingIncident = -1;
+        Serial.print("RECORDER : incident ");
+        Serial.print(incident->number);
+        Serial.println(" recorded");
+      }
+    }
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Update the alarm status : the history is frozen into a new incident when the alarm triggers
+  // @param _alarm_data : alarm data
+  // @param _time_ms    : current time
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void update_alarm (const struct strAlarmData& _alarm_data, uint32_t _time_ms)
+  {
+    bool triggered = (_alarm_data.alarmStatus == ALARM_STATUS_TRIGGERED);
+
+    // Rising edge only, the alarm stays triggered until it is switched off
+    if ((triggered == true) && (this->isTriggered == false))
+    {
+      uint8_t slot = this->incidentCount % RECORDER_MAX_INCIDENTS;
+      struct strRecorderIncident* incident = &this->incidents[slot];
+
+      this->incidentCount++;
+      incident->number         = this->incidentCount;
+      incident->triggerTime_ms = _time_ms;
+      incident->trigger        = _alarm_data.alarmTrigger;
+      incident->baseline[0]    = this->to_raw(_alarm_data.XaccInit, RECORDER_ACCELERATION_LSB_PER_G);
+      incident->baseline[1]    = this->to_raw(_alarm_data.YaccInit, RECORDER_ACCELERATION_LSB_PER_G);
+      incident->baseline[2]    = this->to_raw(_alarm_data.ZaccInit, RECORDER_ACCELERATION_LSB_PER_G);
+
+      // Oldest first
+      uint16_t first = (this->historyIndex + RECORDER_PRE_TRIGGER_SAMPLES - this->historyCount) % RECORDER_PRE_TRIGGER_SAMPLES;
+      for (uint16_t i=0; i<this->historyCount; i++)
+        incident->samples[i] = this->history[(first + i) % RECORDER_PRE_TRIGGER_SAMPLES];
+
+      incident->sampleCount   = this->historyCount;
+      incident->triggerIndex  = this->historyCount;
+      this->recordingIncident = slot;
+
+      if (this->browsedIncident == (int8_t)slot)
+        this->browsedIncident = RECORDER_BROWSE_NONE;
+    }
+
+    this->isTriggered = triggered;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Process a command received on the debug serial link
+  //                 'l' : list the incidents
+  //                 'd' : dump the incidents in binary form
+  //                 'b' : browse the incidents on the TFT, one by one, then back to the live view
+  // @param _command : received character
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void process_command (char _command)
+  {
+    switch (_command)
+    {
+      case 'l':
+        this->list();
+        break;
+
+      case 'd':
+        this->dump();
+        break;
+
+      case 'b':
+        this->browse_next();
+        break;
+
+      default:
+        break;
+    }
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Provide the incident being recorded or the last one
+  // @return incident, NULL if there is none
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  const struct strRecorderIncident* get_last_incident (void)
+  {
+    if (this->incidentCount == 0)
+      return NULL;
+
+    return &this->incidents[(this->incidentCount - 1) % RECORDER_MAX_INCIDENTS];
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Provide the incident selected for the TFT
+  // @return incident, NULL for the live view
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  const struct strRecorderIncident* get_browsed_incident (void)
+  {
+    if (this->browsedIncident == RECORDER_BROWSE_NONE)
+      return NULL;
+
+    return &this->incidents[this->browsedIncident];
+  }
+
+
+private:
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Convert a value into its saturated raw form
+  // @param _value : value to convert
+  // @param _scale : LSB per unit
+  // @return raw value
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  int16_t to_raw (double _value, double _scale)
+  {
+    double raw = round(_value * _scale);
+    return (int16_t)constrain(raw, -32768.0, 32767.0);
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Select the next recorded incident, after the newest one the live view is selected
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void browse_next (void)
+  {
+    uint32_t oldest = (this->incidentCount > RECORDER_MAX_INCIDENTS) ? this->incidentCount - RECORDER_MAX_INCIDENTS + 1 : 1;
+    uint32_t next = oldest;
+
+    if (this->browsedIncident != RECORDER_BROWSE_NONE)
+      next = this->incidents[this->browsedIncident].number + 1;
+
+    if ((this->incidentCount == 0) || (next > this->incidentCount))
+    {
+      this->browsedIncident = RECORDER_BROWSE_NONE;
+      Serial.println("RECORDER : live view");
+      return;
+    }
+
+    this->browsedIncident = (next - 1) % RECORDER_MAX_INCIDENTS;
+    Serial.print("RECORDER : browsing incident ");
+    Serial.println(next);
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Print the list of the recorded incidents
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void list (void)
+  {
+    Serial.printf("RECORDER : %u incident(s) since startup\n", (unsigned int)this->incidentCount);
+
+    for (uint8_t i=0; i<RECORDER_MAX_INCIDENTS; i++)
+    {
+      const struct strRecorderIncident* incident = &this->incidents[i];
+
+      if (incident->number == 0)
+        continue;
+
+      Serial.printf("RECORDER : #%u at %ums, trigger=%u, samples=%u (%u before)\n", (unsigned int)incident->number,
+                    (unsigned int)incident->triggerTime_ms, (unsigned int)incident->trigger,
+                    (unsigned int)incident->sampleCount, (unsigned int)incident->triggerIndex);
+    }
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Dump the recorded incidents in binary form, oldest first (layout in RECORDER_DUMP_VERSION)
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void dump (void)
+  {
+    for (uint8_t n=0; n<RECORDER_MAX_INCIDENTS; n++)
+    {
+      const struct strRecorderIncident* incident = &this->incidents[(this->incidentCount + n) % RECORDER_MAX_INCIDENTS];
+      uint8_t sums[2] = {0, 0};
+      uint8_t buffer[RECORDER_DUMP_INCIDENT_SIZE];
+      uint8_t length = 0;
+
+      if ((incident->number == 0) || ((int8_t)((this->incidentCount + n) % RECORDER_MAX_INCIDENTS) == this->recordingIncident))
+        continue;
+
+      // Only the used samples are sent
+      uint16_t size = RECORDER_DUMP_INCIDENT_SIZE + incident->sampleCount * RECORDER_DUMP_SAMPLE_SIZE;
+
+      length = this->put_bytes(buffer, length, RECORDER_DUMP_MAGIC[0], 1);
+      length = this->put_bytes(buffer, length, RECORDER_DUMP_MAGIC[1], 1);
+      length = this->put_bytes(buffer, length, RECORDER_DUMP_VERSION, 1);
+      length = this->put_bytes(buffer, length, size, 2);
+      Serial.write(buffer, length);
+
+      length = 0;
+      length = this->put_bytes(buffer, length, incident->number, 4);
+      length = this->put_bytes(buffer, length, incident->triggerTime_ms, 4);
+      length = this->put_bytes(buffer, length, incident->trigger, 1);
+      length = this->put_bytes(buffer, length, incident->triggerIndex, 2);
+      length = this->put_bytes(buffer, length, incident->sampleCount, 2);
+      for (uint8_t i=0; i<3; i++)
+        length = this->put_bytes(buffer, length, (uint16_t)incident->baseline[i], 2);
+      this->write_checked(buffer, length, sums);
+
+      for (uint16_t s=0; s<incident->sampleCount; s++)
+      {
+        const struct strRecorderSample* sample = &incident->samples[s];
+
+        length = 0;
+        length = this->put_bytes(buffer, length, sample->timestamp_ms, 4);
+        for (uint8_t i=0; i<3; i++)
+          length = this->put_bytes(buffer, length, (uint16_t)sample->acceleration[i], 2);
+        for (uint8_t i=0; i<3; i++)
+          length = this->put_bytes(buffer, length, (uint16_t)sample->velocity[i], 2);
+        this->write_checked(buffer, length, sums);
+      }
+
+      Serial.write(sums, sizeof(sums));
+    }
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Append a value to a dump buffer, little endian
+  // @param _buffer : dump buffer
+  // @param _offset : position of the value in the buffer
+  // @param _value  : value to append
+  // @param _size   : number of bytes of the value
+  // @return position after the value
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  uint8_t put_bytes (uint8_t* _buffer, uint8_t _offset, uint32_t _value, uint8_t _size)
+  {
+    for (uint8_t i=0; i<_size; i++)
+      _buffer[_offset + i] = (uint8_t)(_value >> (8 * i));
+
+    return _offset + _size;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Send a part of the incident data and add it to its Fletcher-16
+  // @param _data   : bytes to send
+  // @param _length : number of bytes
+  // @param _sums   : sum1 and sum2 of the Fletcher-16
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void write_checked (const uint8_t* _data, uint8_t _length, uint8_t* _sums)
+  {
+    for (uint8_t i=0; i<_length; i++)
+    {
+      _sums[0] = (_sums[0] + _data[i]) % 255;
+      _sums[1] = (_sums[1] + _sums[0]) % 255;
+    }
+
+    Serial.write(_data, _length);
+  }
+};
@@ -0,0 +1,433 @@
+/*********************************************************************************************************************
+ * Project : Astro Alarm
+ * Author  : PEB <pebdev@lavache.com> 
+ * Date    : 2024.01.18
+ *********************************************************************************************************************
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ * 
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *********************************************************************************************************************/
+
+
+/** I N C L U D E S **************************************************************************************************/
+#ifdef ARDUINO
+#include <lwip/sockets.h>
+#endif
+
+
+/** D E F I N E S ****************************************************************************************************/
+// Settings
+#define HTTP_SERVER_PORT              (80)
+#define HTTP_MAX_CLIENTS              (4)       // Browsers connected at the same time, page requests included
+#define HTTP_REQUEST_SIZE             (256)     // Request line and headers, longer requests are truncated
+#define HTTP_OUTPUT_BUFFER_SIZE       (1024)    // Per client, a subscriber which can not keep up is dropped
+#define HTTP_EVENT_SIZE               (256)
+#define HTTP_REQUEST_TIMEOUT_MS       (2000)
+#define HTTP_RESPONSE_TIMEOUT_MS      (5000)    // Without progress, a browser which stops reading its response is dropped
+#define HTTP_RETRY_INTERVAL_MS        (2000)    // Reconnection delay requested to the browsers
+
+// Client states
+#define HTTP_CLIENT_FREE              (0)
+#define HTTP_CLIENT_REQUEST           (1)       // Waiting for the end of the request headers
+#define HTTP_CLIENT_RESPONSE          (2)       // Sending a response, the connection is closed at the end
+#define HTTP_CLIENT_SUBSCRIBER        (3)       // Receiving the events
+
+
+/** S T R U C T S ****************************************************************************************************/
+struct strHttpStatus
+{
+  double angle[3];
+  double acceleration[3];
+  double temperature;
+  double batteryPercentage;
+  double batteryVoltage;
+  bool isClientConnected;
+  uint8_t alarmState;       // ALARM_STATE_xxx, reported by the Client
+  uint8_t alarmStatus;      // ALARM_STATUS_xxx, reported by the Client
+  uint8_t sensorHealth;     // INCLINOMETER_HEALTH_xxx
+};
+
+
+/** P A G E **********************************************************************************************************/
+// Status page, stored in flash
+const char HTTP_STATUS_PAGE[] PROGMEM = R"rawliteral(<!DOCTYPE html>
+<html><head><meta charset="utf-8"><meta name="viewport" content="width=device-width, initial-scale=1">
+<title>Astro Alarm</title>
+<style>body{font-family:sans-serif;background:#000;color:#ddd;margin:1em}td{padding:.2em .8em}.v{color:#fff;font-weight:bold}#link{color:#f80}</style>
+</head><body>
+<h2>Astro Alarm <span id="link">connecting...</span></h2>
+<table>
+<tr><td>Angle X / Y</td><td class="v" id="angle"></td></tr>
+<tr><td>North</td><td class="v" id="north"></td></tr>
+<tr><td>Acceleration</td><td class="v" id="acc"></td></tr>
+<tr><td>Sensor</td><td class="v" id="sensor"></td></tr>
+<tr><td>Temperature</td><td class="v" id="temp"></td></tr>
+<tr><td>Battery</td><td class="v" id="bat"></td></tr>
+<tr><td>Client</td><td class="v" id="client"></td></tr>
+<tr><td>Alarm</td><td class="v" id="alarm"></td></tr>
+</table>
+<script>
+const states=["ON","OFF","ENABLING","LOCKED"],status=["","TRIGGERED","WARNING"],health=["unknown","OK","DEGRADED","STALE"];
+function set(id,text){document.getElementById(id).textContent=text;}
+const source=new EventSource("/events");
+source.onopen=()=>set("link","");
+source.onerror=()=>set("link","connection lost");
+source.onmessage=(e)=>{
+  const d=JSON.parse(e.data);
+  set("angle",d.angle[0].toFixed(2)+"° / "+d.angle[1].toFixed(2)+"°");
+  set("north",d.angle[2].toFixed(1)+"°");
+  set("acc",d.acc.map(v=>v.toFixed(3)).join(" / ")+" g");
+  set("sensor",health[d.sensor]||"?");
+  set("temp",d.temp.toFixed(1)+" °C");
+  set("bat",d.bat.toFixed(0)+"% ("+d.batV.toFixed(2)+" V)");
+  set("client",d.client?"connected":"disconnected");
+  set("alarm",d.client?(states[d.alarmState]||"?")+" "+(status[d.alarmStatus]||""):"unknown");
+};
+</script>
+</body></html>
+)rawliteral";
+
+
+/** H T T P  S E R V E R *********************************************************************************************/
+class HttpServer
+{
+private:
+  struct strHttpClient
+  {
+    WiFiClient client;
+    uint8_t state;
+    unsigned long timer_ms;
+
+    // Request
+    char request[HTTP_REQUEST_SIZE];
+    uint16_t requestLength;
+    uint8_t requestEnd;         // Matched characters of the empty line ending the headers
+
+    // Output : circular buffer, then an optional body read from flash
+    char output[HTTP_OUTPUT_BUFFER_SIZE];
+    uint16_t outputStart;
+    uint16_t outputLength;
+    const char* body;
+    uint32_t bodyLength;
+  };
+
+  WiFiServer server;
+  bool isStarted;
+  struct strHttpClient clients[HTTP_MAX_CLIENTS];
+  uint32_t droppedSubscribers;
+
+
+public:
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Constructor
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  HttpServer (void) : server(HTTP_SERVER_PORT)
+  {
+    this->isStarted           = false;
+    this->droppedSubscribers  = 0;
+
+    for (uint8_t i=0; i<HTTP_MAX_CLIENTS; i++)
+      this->clients[i].state = HTTP_CLIENT_FREE;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Accept the new connections, read the requests and send the pending data, without blocking
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void update (void)
+  {
+    if (this->isStarted == false)
+    {
+      this->server.begin();
+      this->isStarted = true;
+      Serial.println("HTTP : server started");
+    }
+
+    // New connection
+    WiFiClient client = this->server.available();
+    if (client)
+    {
+      struct strHttpClient* slot = NULL;
+      for (uint8_t i=0; (i<HTTP_MAX_CLIENTS) && (slot == NULL); i++)
+      {
+        if (this->clients[i].state == HTTP_CLIENT_FREE)
+          slot = &this->clients[i];
+      }
+
+      if (slot == NULL)
+      {
+        const char* busy = "HTTP/1.1 503 Service Unavailable\r\nConnection: close\r\nContent-Length: 0\r\n\r\n";
+        send(client.fd(), busy, strlen(busy), MSG_DONTWAIT);
+        client.stop();
+      }
+      else
+      {
+        slot->client        = client;
+        slot->state         = HTTP_CLIENT_REQUEST;
+        slot->timer_ms      = millis();
+        slot->requestLength = 0;
+        slot->requestEnd    = 0;
+        slot->outputStart   = 0;
+        slot->outputLength  = 0;
+        slot->body          = NULL;
+        slot->bodyLength    = 0;
+      }
+    }
+
+    for (uint8_t i=0; i<HTTP_MAX_CLIENTS; i++)
+    {
+      struct strHttpClient* slot = &this->clients[i];
+
+      if (slot->state == HTTP_CLIENT_FREE)
+        continue;
+
+      if (this->receive(slot) == false)
+        continue;
+
+      if (((slot->state == HTTP_CLIENT_REQUEST) && ((millis()-slot->timer_ms) > HTTP_REQUEST_TIMEOUT_MS)) ||
+          ((slot->state == HTTP_CLIENT_RESPONSE) && ((millis()-slot->timer_ms) > HTTP_RESPONSE_TIMEOUT_MS)))
+      {
+        this->close(slot);
+        continue;
+      }
+
+      this->transmit(slot);
+    }
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Send the status to every subscriber
+  // @param _status : current status
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void publish (const struct strHttpStatus& _status)
+  {
+    char event[HTTP_EVENT_SIZE];
+
+    int length = snprintf(event, sizeof(event),
+                          "data: {\"angle\":[%.2f,%.2f,%.2f],\"acc\":[%.4f,%.4f,%.4f],\"temp\":%.2f,\"bat\":%.1f,\"batV\":%.2f,"
+                          "\"client\":%d,\"alarmState\":%u,\"alarmStatus\":%u,\"sensor\":%u}\n\n",
+                          _status.angle[0], _status.angle[1], _status.angle[2],
+                          _status.acceleration[0], _status.acceleration[1], _status.acceleration[2],
+                          _status.temperature, _status.batteryPercentage, _status.batteryVoltage,
+                          (_status.isClientConnected == true) ? 1 : 0, _status.alarmState, _status.alarmStatus, _status.sensorHealth);
+
+    if ((length < 0) || (length >= (int)sizeof(event)))
+      return;
+
+    for (uint8_t i=0; i<HTTP_MAX_CLIENTS; i++)
+    {
+      struct strHttpClient* slot = &this->clients[i];
+
+      if (slot->state != HTTP_CLIENT_SUBSCRIBER)
+        continue;
+
+      // Slow reader, it is dropped instead of delaying the others
+      if (this->append(slot, event, length) == false)
+      {
+        this->droppedSubscribers++;
+        Serial.println("HTTP : slow subscriber dropped");
+        this->close(slot);
+        continue;
+      }
+
+      this->transmit(slot);
+    }
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Provide the number of subscribers receiving the events
+  // @return subscriber count
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  uint8_t get_subscriber_count (void)
+  {
+    uint8_t count = 0;
+
+    for (uint8_t i=0; i<HTTP_MAX_CLIENTS; i++)
+    {
+      if (this->clients[i].state == HTTP_CLIENT_SUBSCRIBER)
+        count++;
+    }
+
+    return count;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Provide the number of subscribers dropped because they did not read fast enough
+  // @return dropped subscriber count
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  uint32_t get_dropped_subscribers (void)
+  {
+    return this->droppedSubscribers;
+  }
+
+
+private:
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Read the received bytes : the request until the end of its headers, then they are ignored
+  // @param _slot : client
+  // @return false if the connection is closed
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  bool receive (struct strHttpClient* _slot)
+  {
+    char data[64];
+
+    while (true)
+    {
+      int length = recv(_slot->client.fd(), data, sizeof(data), MSG_DONTWAIT);
+
+      if (length == 0)
+      {
+        this->close(_slot);
+        return false;
+      }
+
+      if (length < 0)
+      {
+        if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+          return true;
+
+        this->close(_slot);
+        return false;
+      }
+
+      if (_slot->state != HTTP_CLIENT_REQUEST)
+        continue;
+
+      // Only the beginning of the request is kept, the request line is in it
+      for (int i=0; (i<length) && (_slot->state == HTTP_CLIENT_REQUEST); i++)
+      {
+        if (_slot->requestLength < (HTTP_REQUEST_SIZE-1))
+          _slot->request[_slot->requestLength++] = data[i];
+
+        if (data[i] == "\r\n\r\n"[_slot->requestEnd])
+          _slot->requestEnd++;
+        else
+          _slot->requestEnd = (data[i] == '\r') ? 1 : 0;
+
+        if (_slot->requestEnd == 4)
+        {
+          _slot->request[_slot->requestLength] = '\0';
+          this->process_request(_slot);
+        }
+      }
+    }
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Answer a complete request
+  // @param _slot : client
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void process_request (struct strHttpClient* _slot)
+  {
+    char header[160];
+
+    if (strncmp(_slot->request, "GET /events ", 12) == 0)
+    {
+      const char* response = "HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\nCache-Control: no-cache\r\n"
+                             "Connection: keep-alive\r\nAccess-Control-Allow-Origin: *\r\n\r\n";
+      snprintf(header, sizeof(header), "%sretry: %d\n\n", response, HTTP_RETRY_INTERVAL_MS);
+      this->append(_slot, header, strlen(header));
+      _slot->state = HTTP_CLIENT_SUBSCRIBER;
+      Serial.println("HTTP : new subscriber");
+    }
+    else if ((strncmp(_slot->request, "GET / ", 6) == 0) || (strncmp(_slot->request, "GET /index.html ", 16) == 0))
+    {
+      _slot->body       = HTTP_STATUS_PAGE;
+      _slot->bodyLength = strlen(HTTP_STATUS_PAGE);
+      snprintf(header, sizeof(header), "HTTP/1.1 200 OK\r\nContent-Type: text/html; charset=utf-8\r\nContent-Length: %u\r\nConnection: close\r\n\r\n",
+               (unsigned int)_slot->bodyLength);
+      this->append(_slot, header, strlen(header));
+      _slot->state    = HTTP_CLIENT_RESPONSE;
+      _slot->timer_ms = millis();
+    }
+    else
+    {
+      const char* response = "HTTP/1.1 404 Not Found\r\nConnection: close\r\nContent-Length: 0\r\n\r\n";
+      this->append(_slot, response, strlen(response));
+      _slot->state    = HTTP_CLIENT_RESPONSE;
+      _slot->timer_ms = millis();
+    }
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Add data to the output buffer of a client
+  // @param _slot   : client
+  // @param _data   : data
+  // @param _length : length of the data
+  // @return false if there is not enough space, nothing is added
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  bool append (struct strHttpClient* _slot, const char* _data, uint16_t _length)
+  {
+    if ((HTTP_OUTPUT_BUFFER_SIZE - _slot->outputLength) < _length)
+      return false;
+
+    for (uint16_t i=0; i<_length; i++)
+      _slot->output[(_slot->outputStart + _slot->outputLength + i) % HTTP_OUTPUT_BUFFER_SIZE] = _data[i];
+    _slot->outputLength += _length;
+
+    return true;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Send as much pending data as the socket accepts, without blocking
+  // @param _slot : client
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void transmit (struct strHttpClient* _slot)
+  {
+    while (_slot->outputLength > 0)
+    {
+      // Contiguous part of the circular buffer
+      uint16_t length = min((uint16_t)(HTTP_OUTPUT_BUFFER_SIZE - _slot->outputStart), _slot->outputLength);
+      int sent = send(_slot->client.fd(), &_slot->output[_slot->outputStart], length, MSG_DONTWAIT);
+
+      if (sent <= 0)
+      {
+        if ((sent < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK))
+          this->close(_slot);
+        return;
+      }
+
+      _slot->outputStart   = (_slot->outputStart + sent) % HTTP_OUTPUT_BUFFER_SIZE;
+      _slot->outputLength -= sent;
+      _slot->timer_ms      = millis();
+    }
+
+    // Body from flash, sent without copy
+    while (_slot->bodyLength > 0)
+    {
+      int sent = send(_slot->client.fd(), _slot->body, _slot->bodyLength, MSG_DONTWAIT);
+
+      if (sent <= 0)
+      {
+        if ((sent < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK))
+          this->close(_slot);
+        return;
+      }
+
+      _slot->body       += sent;
+      _slot->bodyLength -= sent;
+      _slot->timer_ms    = millis();
+    }
+
+    if (_slot->state == HTTP_CLIENT_RESPONSE)
+      this->close(_slot);
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Close a connection and free its slot
+  // @param _slot : client
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void close (struct strHttpClient* _slot)
+  {
+    _slot->client.stop();
+    _slot->state = HTTP_CLIENT_FREE;
+  }
+};
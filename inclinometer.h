@@ -18,6 +18,34 @@
  *********************************************************************************************************************/
 
 
+/** D E F I N E S ****************************************************************************************************/
+// Packet types, their index in the snapshots and their bit in the mask returned by process_data
+#define INCLINOMETER_PACKET_ACCELERATION      (0)
+#define INCLINOMETER_PACKET_VELOCITY          (1)
+#define INCLINOMETER_PACKET_ANGULAR           (2)
+#define INCLINOMETER_PACKET_COUNT             (3)
+#define INCLINOMETER_PACKET_MASK(packet)      (1 << (packet))
+
+// Frame of the HWT906 : 0x55, id (0x51 + packet), 4 x uint16_t values, checksum
+#define INCLINOMETER_FRAME_HEADER             (0x55)
+#define INCLINOMETER_FRAME_ID_FIRST           (0x51)
+#define INCLINOMETER_FRAME_SIZE               (11)
+#define INCLINOMETER_SNAPSHOT_RETRY           (3)
+
+// Health of the sensor pipeline : rates and errors are measured over a window, a sensor without valid packet during
+// the timeout is stale (its last values are kept but not reliable)
+#define INCLINOMETER_HEALTH_WINDOW_MS         (1000)
+#define INCLINOMETER_HEALTH_STALE_MS          (2000)
+#define INCLINOMETER_HEALTH_DEGRADED_ERRORS   (3)       // Errors in a window (checksum, resync, overrun)
+#define INCLINOMETER_HEALTH_REPORT_MS         (10000)
+
+// Health states, sent to the client
+#define INCLINOMETER_HEALTH_UNKNOWN           (0)       // Nothing received yet, or not provided by the server
+#define INCLINOMETER_HEALTH_OK                (1)
+#define INCLINOMETER_HEALTH_DEGRADED          (2)
+#define INCLINOMETER_HEALTH_STALE             (3)
+
+
 /** S T R U C T S ****************************************************************************************************/
 struct strAcceleration
 {
@@ -39,40 +67,49 @@ struct strAngular
 	uint16_t version;       // Version Formula number=(VH<<8)|VL
 };
 
+struct strSensorHealth
+{
+  uint8_t state;                                    // INCLINOMETER_HEALTH_xxx
+  float rate_hz[INCLINOMETER_PACKET_COUNT];         // Valid packets per second, last window
+  uint32_t packets[INCLINOMETER_PACKET_COUNT];      // Valid packets since the start
+  uint32_t checksumErrors;                          // Frames rejected by the checksum
+  uint32_t resyncs;                                 // Header lost within the stream, bytes skipped until the next one
+  uint32_t overruns;                                // UART buffer or FIFO full, bytes lost
+  uint32_t windowErrors;                            // Errors of the last window
+  uint32_t age_ms;                                  // Elapsed time since the last valid packet
+};
+
 
 /** I N C L I N O M E T E R ******************************************************************************************/
 class Inclinometer
 {
 private:
-  struct strAccelerationRaw
-  {
-    uint16_t acceleration[3];
-    uint16_t temperature;
-    uint8_t checksum;
-  };
-
-  struct strAngularVelocityRaw
+  // Last valid packet of a type, written by read() and copied by process_data() under a sequence lock :
+  // the sequence is odd while the writer is copying, a reader retries if it changed during its copy
+  struct strPacketSnapshot
   {
-    uint16_t velocity[3];
-    uint16_t voltage;
-    uint8_t checksum;
-  };
-
-  struct strAngularRaw
-  {
-    uint16_t angle[3];
-    uint16_t version;
-    uint8_t checksum;
+    volatile uint32_t sequence;
+    uint32_t arrival_us;
+    uint16_t values[4];
   };
 
   // Raw data
-  struct strAccelerationRaw incAccelerationRaw;
-  struct strAngularVelocityRaw inclAngularVelocityRaw;
-  struct strAngularRaw incAngularRaw;
+  struct strPacketSnapshot snapshots[INCLINOMETER_PACKET_COUNT];
+  uint32_t processedSequence[INCLINOMETER_PACKET_COUNT];
+  uint32_t packetArrival_us[INCLINOMETER_PACKET_COUNT];
+  volatile uint32_t checksumErrors;
+  volatile uint32_t resyncs;
+  volatile uint32_t overruns;
+  bool isSynchronized;
+
+  // Health : packets and errors at the start of the window, last valid packet
+  struct strSensorHealth health;
+  uint32_t windowPackets[INCLINOMETER_PACKET_COUNT];
+  uint32_t windowErrors;
+  unsigned long timerWindow_ms;
+  unsigned long timerLastPacket_ms;
 
   // Final data, shared with users
-  bool firstFrameDetected;
-  bool newDataReady;
   int16_t sign_x;
   int16_t sign_z;
   struct strAcceleration incAcceleration;
@@ -86,10 +123,24 @@ public:
   /*-------------------------------------------------------------------------------------------------------------------*/
   Inclinometer (void)
   {
-    this->newDataReady        = false;
-    this->firstFrameDetected  = false;
-    this->sign_x              = -1; // If X is inverted, y will be too
-    this->sign_z              = 180;
+    memset(this->snapshots, 0, sizeof(this->snapshots));
+    memset(this->processedSequence, 0, sizeof(this->processedSequence));
+    memset(this->packetArrival_us, 0, sizeof(this->packetArrival_us));
+    memset(&this->incAcceleration, 0, sizeof(this->incAcceleration));
+    memset(&this->inclAngularVelocity, 0, sizeof(this->inclAngularVelocity));
+    memset(&this->incAngular, 0, sizeof(this->incAngular));
+    memset(&this->health, 0, sizeof(this->health));
+    memset(this->windowPackets, 0, sizeof(this->windowPackets));
+    this->checksumErrors          = 0;
+    this->resyncs                 = 0;
+    this->overruns                = 0;
+    this->isSynchronized          = false;
+    this->windowErrors            = 0;
+    this->timerWindow_ms          = millis();
+    this->timerLastPacket_ms      = millis();
+    this->health.state            = INCLINOMETER_HEALTH_UNKNOWN;
+    this->sign_x                  = -1; // If X is inverted, y will be too
+    this->sign_z                  = 180;
   }
 
   /*-------------------------------------------------------------------------------------------------------------------*/
@@ -98,97 +149,163 @@ public:
   /*-------------------------------------------------------------------------------------------------------------------*/
   bool is_new_data_ready (void)
   {
-    return this->newDataReady;
+    for (uint8_t packet=0; packet<INCLINOMETER_PACKET_COUNT; packet++)
+    {
+      if (__atomic_load_n(&this->snapshots[packet].sequence, __ATOMIC_ACQUIRE) != this->processedSequence[packet])
+        return true;
+    }
+
+    return false;
   }
 
   /*-------------------------------------------------------------------------------------------------------------------*/
-  // @brief [PUBLIC] Read inclinometer data
+  // @brief [PUBLIC] Read inclinometer data, the checksum is verified once here and only valid packets are published
   // @param _ucData : data received from the UART link
   /*-------------------------------------------------------------------------------------------------------------------*/
   void read (unsigned char _ucData)
   {
-    static unsigned char ucRxBuffer[250];
-    static unsigned char ucRxCnt = 0;	
+    static unsigned char ucRxBuffer[INCLINOMETER_FRAME_SIZE];
+    static unsigned char ucRxCnt = 0;
 
     // Save data
     ucRxBuffer[ucRxCnt++] = _ucData;
 
-    // Check first Byte
-    if (ucRxBuffer[0] != 0x55) 
+    // Check first Byte, a header missing after a valid frame is a resynchronization (not the partial frame of the start)
+    if (ucRxBuffer[0] != INCLINOMETER_FRAME_HEADER)
     {
+      if (this->isSynchronized == true)
+      {
+        this->resyncs        = this->resyncs + 1;
+        this->isSynchronized = false;
+      }
       ucRxCnt = 0;
       return;
     }
 
     // If we haven't yet received all Bytes, we wait next Bytes
-    if (ucRxCnt < 11)
+    if (ucRxCnt < INCLINOMETER_FRAME_SIZE)
+      return;
+    ucRxCnt = 0;
+
+    // Full frame, the other packets of the sensor (time, magnetometer...) are checked but not used. A corrupted frame
+    // does not lose the synchronization, the next byte tells if the stream is still aligned
+    if (ucRxBuffer[INCLINOMETER_FRAME_SIZE-1] != this->checksum(&ucRxBuffer[2], ucRxBuffer[1]))
     {
+      if (this->isSynchronized == true)
+        this->checksumErrors = this->checksumErrors + 1;
       return;
     }
-    // Full frame, process data
-    else
+    this->isSynchronized = true;
+
+    uint8_t packet = ucRxBuffer[1] - INCLINOMETER_FRAME_ID_FIRST;
+
+    if (packet < INCLINOMETER_PACKET_COUNT)
+      this->publish(packet, &ucRxBuffer[2]);
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Count a UART overrun, called by the UART event task
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void count_overrun (void)
+  {
+    __atomic_fetch_add(&this->overruns, 1, __ATOMIC_RELAXED);
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Process inclinometer data, only the packets received since the last call are converted
+  // @return mask of the updated packets (INCLINOMETER_PACKET_MASK)
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  uint8_t process_data (void)
+  {
+    struct strPacketSnapshot snapshot;
+    uint8_t updatedMask = 0;
+
+    for (uint8_t packet=0; packet<INCLINOMETER_PACKET_COUNT; packet++)
     {
-      switch(ucRxBuffer[1])
+      // Torn or unchanged packets are left for the next call
+      if (this->load_snapshot(packet, &snapshot) == false)
+        continue;
+
+      this->processedSequence[packet] = snapshot.sequence;
+      this->packetArrival_us[packet]  = snapshot.arrival_us;
+      updatedMask |= INCLINOMETER_PACKET_MASK(packet);
+
+      switch (packet)
       {
-        case 0x51:	memcpy(&this->incAccelerationRaw,&ucRxBuffer[2],9);     this->newDataReady = true; break;
-        case 0x52:	memcpy(&this->inclAngularVelocityRaw,&ucRxBuffer[2],9); this->newDataReady = true; break;
-        case 0x53:	memcpy(&this->incAngularRaw,&ucRxBuffer[2],9);          this->newDataReady = true; break;
+        case INCLINOMETER_PACKET_ACCELERATION:
+          this->incAcceleration.acceleration[0] = this->value_saturation((double)snapshot.values[0]/32768.0*16.0, 16.0) * this->sign_x;
+          this->incAcceleration.acceleration[1] = this->value_saturation((double)snapshot.values[1]/32768.0*16.0, 16.0) * this->sign_x;
+          this->incAcceleration.acceleration[2] = this->value_saturation((double)snapshot.values[2]/32768.0*16.0, 16.0);
+          this->incAcceleration.temperature     = (double)snapshot.values[3]/100.0;
+          break;
+
+        case INCLINOMETER_PACKET_VELOCITY:
+          this->inclAngularVelocity.velocity[0] = this->value_saturation((double)snapshot.values[0]/32768.0*2000.0, 2000.0) * this->sign_x;
+          this->inclAngularVelocity.velocity[1] = this->value_saturation((double)snapshot.values[1]/32768.0*2000.0, 2000.0) * this->sign_x;
+          this->inclAngularVelocity.velocity[2] = this->value_saturation((double)snapshot.values[2]/32768.0*2000.0, 2000.0);
+          break;
+
+        case INCLINOMETER_PACKET_ANGULAR:
+          this->incAngular.angle[0] = this->value_saturation((double)snapshot.values[0]/32768.0*180.0, 180.0) * this->sign_x;
+          this->incAngular.angle[1] = this->value_saturation((double)snapshot.values[1]/32768.0*180.0, 180.0) * this->sign_x;
+          this->incAngular.angle[2] = this->value_saturation((double)snapshot.values[2]/32768.0*180.0, 180.0) + this->sign_z;
+          this->incAngular.version  = snapshot.values[3];
+          break;
       }
-      ucRxCnt = 0;
     }
+
+    if (updatedMask != 0)
+      this->timerLastPacket_ms = millis();
+    this->update_health();
+
+    return updatedMask;
   }
 
   /*-------------------------------------------------------------------------------------------------------------------*/
-  // @brief [PUBLIC] Process inclinometer data
+  // @brief [PUBLIC] Provide the health of the sensor, updated by process_data
+  // @return strSensorHealth data
   /*-------------------------------------------------------------------------------------------------------------------*/
-  void process_data (void)
+  struct strSensorHealth get_health (void)
   {
-    // Proccess data only if we have new data 
-    if (this->newDataReady == false)
-      return;
-    this->newDataReady = false;
+    return this->health;
+  }
 
-    // Because the first frame can't be good, skip it
-    if (this->firstFrameDetected == false)
-    {
-      this->firstFrameDetected = true;
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Print the health of the sensor, every INCLINOMETER_HEALTH_REPORT_MS
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void report (void)
+  {
+    static unsigned long timerReport_ms = millis();
+
+    if ((millis()-timerReport_ms) < INCLINOMETER_HEALTH_REPORT_MS)
       return;
-    }
+    timerReport_ms = millis();
 
-    if (this->incAccelerationRaw.checksum == this->checksum(&this->incAccelerationRaw, 0x51))
-    {
-      this->incAcceleration.acceleration[0] = this->value_saturation((double)this->incAccelerationRaw.acceleration[0]/32768.0*16.0, 16.0) * this->sign_x;
-      this->incAcceleration.acceleration[1] = this->value_saturation((double)this->incAccelerationRaw.acceleration[1]/32768.0*16.0, 16.0) * this->sign_x;
-      this->incAcceleration.acceleration[2] = this->value_saturation((double)this->incAccelerationRaw.acceleration[2]/32768.0*16.0, 16.0);
-      this->incAcceleration.temperature     = (double)this->incAccelerationRaw.temperature/100.0;
-    }
-    else
-    {
-      Serial.println("acceleration : CHECKSUM ERROR");
-    }
+    Serial.printf("INCLINOMETER : %s rates=%.1f/%.1f/%.1fHz checksum=%u resync=%u overrun=%u age=%ums\n",
+                  get_health_text(this->health.state), this->health.rate_hz[INCLINOMETER_PACKET_ACCELERATION],
+                  this->health.rate_hz[INCLINOMETER_PACKET_VELOCITY], this->health.rate_hz[INCLINOMETER_PACKET_ANGULAR],
+                  (unsigned int)this->health.checksumErrors, (unsigned int)this->health.resyncs,
+                  (unsigned int)this->health.overruns, (unsigned int)this->health.age_ms);
+  }
 
-    if (this->inclAngularVelocityRaw.checksum == this->checksum(&this->inclAngularVelocityRaw, 0x52))
-    {
-      this->inclAngularVelocity.velocity[0] = this->value_saturation((double)this->inclAngularVelocityRaw.velocity[0]/32768.0*2000.0, 2000.0) * this->sign_x;
-      this->inclAngularVelocity.velocity[1] = this->value_saturation((double)this->inclAngularVelocityRaw.velocity[1]/32768.0*2000.0, 2000.0) * this->sign_x;
-      this->inclAngularVelocity.velocity[2] = this->value_saturation((double)this->inclAngularVelocityRaw.velocity[2]/32768.0*2000.0, 2000.0);
-    }
-    else
-    {
-      Serial.println("velocity : CHECKSUM ERROR");
-    }
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Provide the number of valid packets received for a type
+  // @param _packet : INCLINOMETER_PACKET_xxx
+  // @return sequence number of the last processed packet
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  uint32_t get_packet_sequence (uint8_t _packet)
+  {
+    return this->processedSequence[_packet] / 2;
+  }
 
-    if (this->incAngularRaw.checksum == this->checksum(&this->incAngularRaw, 0x53))
-    {
-      this->incAngular.angle[0] = this->value_saturation((double)this->incAngularRaw.angle[0]/32768.0*180.0, 180.0) * this->sign_x;
-      this->incAngular.angle[1] = this->value_saturation((double)this->incAngularRaw.angle[1]/32768.0*180.0, 180.0) * this->sign_x;
-      this->incAngular.angle[2] = this->value_saturation((double)this->incAngularRaw.angle[2]/32768.0*180.0, 180.0) + this->sign_z;
-      this->incAngular.version  = this->incAngularRaw.version;
-    }
-    else
-    {
-      Serial.println("angular : CHECKSUM ERROR");
-    }
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Provide the arrival time of a packet type
+  // @param _packet : INCLINOMETER_PACKET_xxx
+  // @return reception time of the last processed packet [us]
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  uint32_t get_packet_arrival_us (uint8_t _packet)
+  {
+    return this->packetArrival_us[_packet];
   }
 
   /*-------------------------------------------------------------------------------------------------------------------*/
@@ -218,6 +335,37 @@ public:
     return this->incAngular;
   }
 
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Provide the name of a health state
+  // @param _state : INCLINOMETER_HEALTH_xxx
+  // @return name
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  static const char* get_health_text (uint8_t _state)
+  {
+    const char* text = "";
+
+    switch (_state)
+    {
+      case INCLINOMETER_HEALTH_OK:
+        text = "OK";
+        break;
+
+      case INCLINOMETER_HEALTH_DEGRADED:
+        text = "DEGRADED";
+        break;
+
+      case INCLINOMETER_HEALTH_STALE:
+        text = "STALE";
+        break;
+
+      default:
+        text = "UNKNOWN";
+        break;
+    }
+
+    return text;
+  }
+
   /*-------------------------------------------------------------------------------------------------------------------*/
   // @brief [PUBLIC] Show inclinometer data in the console
   /*-------------------------------------------------------------------------------------------------------------------*/
@@ -261,7 +409,7 @@ private:
   uint8_t checksum (const void* _memory_addr, uint8_t _id)
   {
     const uint8_t* bytes = (const uint8_t*)_memory_addr;
-    uint8_t sum = 0x55 + _id;
+    uint8_t sum = INCLINOMETER_FRAME_HEADER + _id;
 
     for (size_t i=0; i<8; ++i)
       sum += bytes[i];
@@ -269,6 +417,105 @@ private:
     return sum;
   }
 
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Publish a valid packet in its snapshot (writer side of the sequence lock)
+  // @param _packet : INCLINOMETER_PACKET_xxx
+  // @param _payload : the 4 values of the frame, little endian
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void publish (uint8_t _packet, const unsigned char* _payload)
+  {
+    struct strPacketSnapshot* snapshot = &this->snapshots[_packet];
+    uint32_t sequence = snapshot->sequence;
+
+    __atomic_store_n(&snapshot->sequence, sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    memcpy(snapshot->values, _payload, sizeof(snapshot->values));
+    snapshot->arrival_us = (uint32_t)micros();
+
+    __atomic_store_n(&snapshot->sequence, sequence + 2, __ATOMIC_RELEASE);
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Copy a snapshot if it changed since the last processing (reader side of the sequence lock)
+  // @param _packet : INCLINOMETER_PACKET_xxx
+  // @param _snapshot : copy of the snapshot
+  // @return true if a new and consistent copy is available
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  bool load_snapshot (uint8_t _packet, struct strPacketSnapshot* _snapshot)
+  {
+    struct strPacketSnapshot* snapshot = &this->snapshots[_packet];
+
+    for (uint8_t retry=0; retry<INCLINOMETER_SNAPSHOT_RETRY; retry++)
+    {
+      uint32_t sequence = __atomic_load_n(&snapshot->sequence, __ATOMIC_ACQUIRE);
+
+      if (sequence == this->processedSequence[_packet])
+        return false;
+      if ((sequence & 1) != 0)
+        continue;
+
+      memcpy(_snapshot->values, snapshot->values, sizeof(_snapshot->values));
+      _snapshot->arrival_us = snapshot->arrival_us;
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+      if (__atomic_load_n(&snapshot->sequence, __ATOMIC_RELAXED) == sequence)
+      {
+        _snapshot->sequence = sequence;
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Update the counters, the rates at the end of each window and the state : stale without valid
+  //                  packet during INCLINOMETER_HEALTH_STALE_MS, degraded with too many errors in the last window
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void update_health (void)
+  {
+    unsigned long elapsed_ms = millis() - this->timerWindow_ms;
+    uint8_t state = INCLINOMETER_HEALTH_OK;
+
+    for (uint8_t packet=0; packet<INCLINOMETER_PACKET_COUNT; packet++)
+      this->health.packets[packet] = this->processedSequence[packet] / 2;
+    this->health.checksumErrors = this->checksumErrors;
+    this->health.resyncs        = this->resyncs;
+    this->health.overruns       = __atomic_load_n(&this->overruns, __ATOMIC_RELAXED);
+    this->health.age_ms         = millis() - this->timerLastPacket_ms;
+
+    // End of the window
+    if (elapsed_ms >= INCLINOMETER_HEALTH_WINDOW_MS)
+    {
+      uint32_t errors = this->health.checksumErrors + this->health.resyncs + this->health.overruns;
+
+      for (uint8_t packet=0; packet<INCLINOMETER_PACKET_COUNT; packet++)
+      {
+        this->health.rate_hz[packet]  = (float)(this->health.packets[packet] - this->windowPackets[packet]) * 1000.0 / elapsed_ms;
+        this->windowPackets[packet]   = this->health.packets[packet];
+      }
+
+      this->health.windowErrors = errors - this->windowErrors;
+      this->windowErrors        = errors;
+      this->timerWindow_ms      = millis();
+    }
+
+    if ((this->health.packets[INCLINOMETER_PACKET_ACCELERATION] + this->health.packets[INCLINOMETER_PACKET_VELOCITY] + this->health.packets[INCLINOMETER_PACKET_ANGULAR]) == 0)
+      state = INCLINOMETER_HEALTH_UNKNOWN;
+    else if (this->health.age_ms >= INCLINOMETER_HEALTH_STALE_MS)
+      state = INCLINOMETER_HEALTH_STALE;
+    else if (this->health.windowErrors >= INCLINOMETER_HEALTH_DEGRADED_ERRORS)
+      state = INCLINOMETER_HEALTH_DEGRADED;
+
+    if (state != this->health.state)
+    {
+      Serial.print("INCLINOMETER : sensor ");
+      Serial.println(get_health_text(state));
+      this->health.state = state;
+    }
+  }
+
   /*-------------------------------------------------------------------------------------------------------------------*/
   // @brief [PRIVATE] Apply a 180° on an axis : -180°=+180° ==> 0°
   // @param _angle : angle to invert
@@ -0,0 +1,278 @@
+/*********************************************************************************************************************
+ * Project : Astro Alarm
+ * Author  : PEB <pebdev@lavache.com> 
+ * Date    : 2024.01.18
+ *********************************************************************************************************************
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ * 
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *********************************************************************************************************************/
+
+
+/** D E F I N E S ****************************************************************************************************/
+// Messages exchanged over the link, each board sends its keepalive and echoes the one of the other board
+#define LINK_QUALITY_KEEPALIVE              "isAlive;"    // isAlive;seq=<n>;t=<sender us>;data=<data lines sent before>
+#define LINK_QUALITY_ECHO                   "aliveEcho="  // aliveEcho=<t of the keepalive>
+#define LINK_QUALITY_MESSAGE_SIZE           (96)
+
+// Measurements
+#define LINK_QUALITY_KEEPALIVE_INTERVAL_MS  (1000)
+#define LINK_QUALITY_RSSI_INTERVAL_MS       (5000)
+#define LINK_QUALITY_TIMEOUT_MS             (3000)      // Without keepalive, the link health is unknown
+#define LINK_QUALITY_LOSS_WINDOW            (8)         // Keepalive intervals used for the loss rate
+#define LINK_QUALITY_RSSI_UNKNOWN           (0)
+#define LINK_QUALITY_REPORT_INTERVAL_MS     (10000)
+
+// Health thresholds, the worst metric gives the health
+#define LINK_QUALITY_RTT_GOOD_US            (50000)
+#define LINK_QUALITY_RTT_FAIR_US            (200000)
+#define LINK_QUALITY_JITTER_GOOD_US         (20000)
+#define LINK_QUALITY_JITTER_FAIR_US         (100000)
+#define LINK_QUALITY_LOSS_GOOD_PERCENT      (5.0)
+#define LINK_QUALITY_LOSS_FAIR_PERCENT      (20.0)
+
+// Link health
+#define LINK_HEALTH_UNKNOWN                 (0)
+#define LINK_HEALTH_GOOD                    (1)
+#define LINK_HEALTH_FAIR                    (2)
+#define LINK_HEALTH_POOR                    (3)
+
+
+/** S T R U C T S ****************************************************************************************************/
+struct strLinkQuality
+{
+  uint32_t rtt_us;          // Smoothed round trip of the keepalives, application processing included
+  uint32_t jitter_us;       // Inter-arrival jitter of the keepalives (RFC 3550)
+  float loss_percent;       // Lines sent by the other board and never received, over the last keepalive intervals
+  int8_t rssi_dBm;          // LINK_QUALITY_RSSI_UNKNOWN if not connected to the router
+  uint8_t health;           // LINK_HEALTH_xxx
+};
+
+
+/** L I N K  Q U A L I T Y *******************************************************************************************/
+class LinkQuality
+{
+private:
+  // Sent keepalives
+  uint32_t keepaliveSequence;
+  unsigned long timerKeepalive_ms;
+
+  // Received keepalives
+  bool isKeepaliveReceived;
+  uint32_t lastSequence;
+  uint32_t lastDataCount;
+  uint32_t dataReceived;
+  int64_t lastTransit_us;
+  unsigned long timerLastKeepalive_ms;
+
+  // Loss rate, circular buffer of the keepalive intervals
+  uint16_t lossExpected[LINK_QUALITY_LOSS_WINDOW];
+  uint16_t lossReceived[LINK_QUALITY_LOSS_WINDOW];
+  uint8_t lossCount;
+  uint8_t lossIndex;
+
+  // Metrics
+  bool isRttMeasured;
+  double rtt_us;
+  double jitter_us;
+  int8_t rssi_dBm;
+
+
+public:
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Constructor
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  LinkQuality (void)
+  {
+    this->rssi_dBm = LINK_QUALITY_RSSI_UNKNOWN;
+    this->reset();
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Restart the measurements, on a new connection
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void reset (void)
+  {
+    this->keepaliveSequence     = 0;
+    this->timerKeepalive_ms     = millis();
+    this->isKeepaliveReceived   = false;
+    this->lastSequence          = 0;
+    this->lastDataCount         = 0;
+    this->dataReceived          = 0;
+    this->lastTransit_us        = 0;
+    this->timerLastKeepalive_ms = millis();
+    this->lossCount             = 0;
+    this->lossIndex             = 0;
+    this->isRttMeasured         = false;
+    this->rtt_us                = 0.0;
+    this->jitter_us             = 0.0;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Build the next keepalive, at most every LINK_QUALITY_KEEPALIVE_INTERVAL_MS
+  // @param _buffer     : output, keepalive message
+  // @param _size       : size of the output buffer
+  // @param _data_count : data lines sent before this keepalive on this connection, dropped ones included
+  // @return true if a keepalive must be sent, otherwise false
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  bool prepare_keepalive (char* _buffer, uint16_t _size, uint32_t _data_count)
+  {
+    if ((millis()-this->timerKeepalive_ms) < LINK_QUALITY_KEEPALIVE_INTERVAL_MS)
+      return false;
+    this->timerKeepalive_ms = millis();
+
+    snprintf(_buffer, _size, LINK_QUALITY_KEEPALIVE "seq=%u;t=%lld;data=%u",
+             (unsigned int)++this->keepaliveSequence, (long long)ClockSync::local_time_us(), (unsigned int)_data_count);
+    return true;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Process a keepalive of the other board : jitter, loss and echo
+  // @param _keepalive  : received keepalive
+  // @param _receive_us : local time when the keepalive was received
+  // @param _buffer     : output, echo message
+  // @param _size       : size of the output buffer
+  // @return true if the keepalive is valid and the echo must be sent, otherwise false
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  bool process_keepalive (const char* _keepalive, int64_t _receive_us, char* _buffer, uint16_t _size)
+  {
+    unsigned int sequence, dataCount;
+    long long send_us;
+
+    if (sscanf(&_keepalive[strlen(LINK_QUALITY_KEEPALIVE)], "seq=%u;t=%lld;data=%u", &sequence, &send_us, &dataCount) != 3)
+      return false;
+
+    // Transit time in mixed timebases : the offset is cancelled by the difference between two keepalives
+    int64_t transit_us = _receive_us - (int64_t)send_us;
+
+    if (this->isKeepaliveReceived == true)
+    {
+      double delta_us = (double)llabs(transit_us - this->lastTransit_us);
+      this->jitter_us += (delta_us - this->jitter_us) / 16.0;
+
+      this->lossExpected[this->lossIndex] = (uint16_t)min((uint32_t)UINT16_MAX, (sequence - this->lastSequence) + (dataCount - this->lastDataCount));
+      this->lossReceived[this->lossIndex] = (uint16_t)min((uint32_t)UINT16_MAX, 1 + this->dataReceived);
+      this->lossIndex = (this->lossIndex + 1) % LINK_QUALITY_LOSS_WINDOW;
+      this->lossCount = min((uint8_t)LINK_QUALITY_LOSS_WINDOW, (uint8_t)(this->lossCount + 1));
+    }
+
+    this->isKeepaliveReceived   = true;
+    this->lastSequence          = sequence;
+    this->lastDataCount         = dataCount;
+    this->dataReceived          = 0;
+    this->lastTransit_us        = transit_us;
+    this->timerLastKeepalive_ms = millis();
+
+    snprintf(_buffer, _size, LINK_QUALITY_ECHO "%lld", send_us);
+    return true;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Process the echo of one of our keepalives : round trip
+  // @param _echo       : received echo
+  // @param _receive_us : local time when the echo was received
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void process_echo (const char* _echo, int64_t _receive_us)
+  {
+    char* end = NULL;
+    long long send_us = strtoll(&_echo[strlen(LINK_QUALITY_ECHO)], &end, 10);
+
+    if ((end == &_echo[strlen(LINK_QUALITY_ECHO)]) || (*end != '\0') || (_receive_us < send_us))
+      return;
+
+    double sample_us = (double)(_receive_us - send_us);
+
+    if (this->isRttMeasured == false)
+      this->rtt_us = sample_us;
+    else
+      this->rtt_us += (sample_us - this->rtt_us) / 8.0;
+    this->isRttMeasured = true;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Count a data line received from the other board
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void count_data_line (void)
+  {
+    this->dataReceived++;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Set the signal strength, sampled by the user every LINK_QUALITY_RSSI_INTERVAL_MS
+  // @param _rssi_dBm : signal strength, LINK_QUALITY_RSSI_UNKNOWN if not connected to the router
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void set_rssi (int8_t _rssi_dBm)
+  {
+    this->rssi_dBm = _rssi_dBm;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Provide the link metrics and its health
+  // @return strLinkQuality data
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  struct strLinkQuality get_data (void)
+  {
+    struct strLinkQuality quality;
+    uint32_t expected = 0;
+    uint32_t received = 0;
+
+    for (uint8_t i=0; i<this->lossCount; i++)
+    {
+      expected += this->lossExpected[i];
+      received += this->lossReceived[i];
+    }
+
+    quality.rtt_us        = (uint32_t)this->rtt_us;
+    quality.jitter_us     = (uint32_t)this->jitter_us;
+    quality.loss_percent  = ((expected > received) ? (100.0 * (expected - received) / expected) : 0.0);
+    quality.rssi_dBm      = this->rssi_dBm;
+    quality.health        = LINK_HEALTH_UNKNOWN;
+
+    if ((this->isRttMeasured == true) && ((millis()-this->timerLastKeepalive_ms) < LINK_QUALITY_TIMEOUT_MS))
+    {
+      quality.health = LINK_HEALTH_GOOD;
+
+      if ((quality.rtt_us >= LINK_QUALITY_RTT_GOOD_US) || (quality.jitter_us >= LINK_QUALITY_JITTER_GOOD_US) ||
+          (quality.loss_percent >= LINK_QUALITY_LOSS_GOOD_PERCENT))
+        quality.health = LINK_HEALTH_FAIR;
+
+      if ((quality.rtt_us >= LINK_QUALITY_RTT_FAIR_US) || (quality.jitter_us >= LINK_QUALITY_JITTER_FAIR_US) ||
+          (quality.loss_percent >= LINK_QUALITY_LOSS_FAIR_PERCENT))
+        quality.health = LINK_HEALTH_POOR;
+    }
+
+    return quality;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Print the link metrics, at most every LINK_QUALITY_REPORT_INTERVAL_MS
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void report (void)
+  {
+    static unsigned long timerReport_ms = millis();
+    const char* healthText[] = {"UNKNOWN", "GOOD", "FAIR", "POOR"};
+
+    if ((this->isRttMeasured == false) || ((millis()-timerReport_ms) < LINK_QUALITY_REPORT_INTERVAL_MS))
+      return;
+    timerReport_ms = millis();
+
+    struct strLinkQuality quality = this->get_data();
+    char rssi[8] = "--";
+
+    if (quality.rssi_dBm != LINK_QUALITY_RSSI_UNKNOWN)
+      snprintf(rssi, sizeof(rssi), "%d", quality.rssi_dBm);
+
+    Serial.printf("LINK : round trip=%.1fms jitter=%.1fms loss=%.1f%% rssi=%sdBm health=%s\n",
+                  quality.rtt_us / 1000.0, quality.jitter_us / 1000.0, quality.loss_percent, rssi,
+                  healthText[quality.health]);
+  }
+};
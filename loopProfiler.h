@@ -0,0 +1,92 @@
+/*********************************************************************************************************************
+ * Project : Astro Alarm
+ * Author  : PEB <pebdev@lavache.com> 
+ * Date    : 2024.01.18
+ *********************************************************************************************************************
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ * 
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *********************************************************************************************************************/
+
+
+/** D E F I N E S ****************************************************************************************************/
+// Uncomment to print the cost of the loop, used to compare the firmware roles (see CONFIG_BOARD_ROLE_xxx)
+//#define CONFIG_LOOP_PROFILER_ENABLED        (1)
+
+// Settings
+#define LOOP_PROFILER_REPORT_INTERVAL_MS      (10000)
+
+
+/** D E C L A R A T I O N S ******************************************************************************************/
+uint32_t loopProfilerStart        = 0;
+uint32_t loopProfilerCount        = 0;
+uint64_t loopProfilerTotal        = 0;
+uint32_t loopProfilerMin          = UINT32_MAX;
+uint32_t loopProfilerMax          = 0;
+
+
+/** L O O P  P R O F I L E R *****************************************************************************************/
+class LoopProfiler
+{
+public:
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Start the measurement of a loop
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  static void begin (void)
+  {
+    loopProfilerStart = ESP.getCycleCount();
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] End the measurement of a loop, the idle delay must not be included
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  static void end (void)
+  {
+    uint32_t cycles = ESP.getCycleCount() - loopProfilerStart;
+
+    loopProfilerCount++;
+    loopProfilerTotal += cycles;
+    loopProfilerMin    = min(loopProfilerMin, cycles);
+    loopProfilerMax    = max(loopProfilerMax, cycles);
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Print the cycles per loop, the firmware size and the heap, every LOOP_PROFILER_REPORT_INTERVAL_MS
+  // @param _role : name of the running role
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  static void report (const char* _role)
+  {
+    static unsigned long timerReport_ms = millis();
+
+    if (((millis()-timerReport_ms) < LOOP_PROFILER_REPORT_INTERVAL_MS) || (loopProfilerCount == 0))
+      return;
+    timerReport_ms = millis();
+
+    Serial.print("LOOP : ");
+    Serial.print(_role);
+    Serial.print(" cycles avg=");
+    Serial.print((uint32_t)(loopProfilerTotal / loopProfilerCount));
+    Serial.print(" min=");
+    Serial.print(loopProfilerMin);
+    Serial.print(" max=");
+    Serial.print(loopProfilerMax);
+    Serial.print(" | sketch=");
+    Serial.print(ESP.getSketchSize());
+    Serial.print(" heap free=");
+    Serial.println(ESP.getFreeHeap());
+
+    loopProfilerCount = 0;
+    loopProfilerTotal = 0;
+    loopProfilerMin   = UINT32_MAX;
+    loopProfilerMax   = 0;
+  }
+};
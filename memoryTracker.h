@@ -0,0 +1,263 @@
+/*********************************************************************************************************************
+ * Project : Astro Alarm
+ * Author  : PEB <pebdev@lavache.com> 
+ * Date    : 2024.01.18
+ *********************************************************************************************************************
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ * 
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *********************************************************************************************************************/
+
+
+/** D E F I N E S ****************************************************************************************************/
+// Uncomment to count the heap allocations (needs an ESP-IDF build with CONFIG_HEAP_USE_HOOKS)
+//#define CONFIG_MEMORY_TRACKER_ENABLED       (1)
+
+// Uncomment to flag every allocation done by the loop once the steady state is reached
+//#define CONFIG_MEMORY_TRACKER_STRICT        (1)
+
+// Settings
+#define MEMORY_TRACKER_MAX_SITES              (16)
+#define MEMORY_TRACKER_REPORT_INTERVAL_MS     (10000)
+
+// Call site marker, compiled out when the tracker is disabled
+#ifdef CONFIG_MEMORY_TRACKER_ENABLED
+#define MEMORY_TRACKER_SITE(_name)            MemoryTracker::set_site(_name)
+#else
+#define MEMORY_TRACKER_SITE(_name)
+#endif
+
+
+/** I N C L U D E S **************************************************************************************************/
+#include <esp_heap_caps.h>
+
+
+/** S T R U C T S ****************************************************************************************************/
+struct strMemorySite
+{
+  const char* name;
+  uint32_t allocations;
+  uint32_t bytes;
+};
+
+
+/** D E C L A R A T I O N S ******************************************************************************************/
+volatile bool memoryTrackerActive           = false;
+volatile TaskHandle_t memoryTrackerTask     = NULL;
+uint32_t memoryTrackerAllocations           = 0;
+int32_t memoryTrackerCurrentBytes           = 0;
+int32_t memoryTrackerPeakBytes              = 0;
+
+// Call sites, index 0 collects the allocations done outside of any marked site
+struct strMemorySite memoryTrackerSites[MEMORY_TRACKER_MAX_SITES] = {{"other", 0, 0}};
+uint8_t memoryTrackerSiteCount              = 1;
+volatile uint8_t memoryTrackerCurrentSite   = 0;
+
+// Steady state : allocations done by the loop after setup
+volatile bool memoryTrackerSteadyState      = false;
+uint32_t memoryTrackerViolations            = 0;
+
+
+/** H O O K S ********************************************************************************************************/
+#if defined(CONFIG_MEMORY_TRACKER_ENABLED) && defined(CONFIG_HEAP_USE_HOOKS)
+/*-------------------------------------------------------------------------------------------------------------------*/
+// @brief [PRIVATE] Called by the heap on each successful allocation, must not allocate
+// @param _ptr  : allocated memory
+// @param _size : requested size
+// @param _caps : memory capabilities
+/*-------------------------------------------------------------------------------------------------------------------*/
+extern "C" void esp_heap_trace_alloc_hook (void* _ptr, size_t _size, uint32_t _caps)
+{
+  if ((memoryTrackerActive == false) || (xTaskGetCurrentTaskHandle() != memoryTrackerTask))
+    return;
+
+  memoryTrackerAllocations++;
+  memoryTrackerCurrentBytes += _size;
+  if (memoryTrackerCurrentBytes > memoryTrackerPeakBytes)
+    memoryTrackerPeakBytes = memoryTrackerCurrentBytes;
+
+  memoryTrackerSites[memoryTrackerCurrentSite].allocations++;
+  memoryTrackerSites[memoryTrackerCurrentSite].bytes += _size;
+
+  if (memoryTrackerSteadyState == true)
+    memoryTrackerViolations++;
+}
+/*-------------------------------------------------------------------------------------------------------------------*/
+// @brief [PRIVATE] Called by the heap before each free, must not allocate
+// @param _ptr : memory to free
+/*-------------------------------------------------------------------------------------------------------------------*/
+extern "C" void esp_heap_trace_free_hook (void* _ptr)
+{
+  if ((_ptr == NULL) || (memoryTrackerActive == false) || (xTaskGetCurrentTaskHandle() != memoryTrackerTask))
+    return;
+
+  memoryTrackerCurrentBytes -= heap_caps_get_allocated_size(_ptr);
+}
+#endif
+
+
+/** M E M O R Y  T R A C K E R ***************************************************************************************/
+class MemoryTracker
+{
+public:
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Allow user to know if the allocations can be counted with this build
+  // @return true | false
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  static bool is_available (void)
+  {
+    #if defined(CONFIG_MEMORY_TRACKER_ENABLED) && defined(CONFIG_HEAP_USE_HOOKS)
+    return true;
+    #else
+    return false;
+    #endif
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Reset the counters and track the allocations done by the calling task
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  static void start (void)
+  {
+    memoryTrackerActive       = false;
+    memoryTrackerTask         = xTaskGetCurrentTaskHandle();
+    memoryTrackerAllocations  = 0;
+    memoryTrackerCurrentBytes = 0;
+    memoryTrackerPeakBytes    = 0;
+    memoryTrackerCurrentSite  = 0;
+    memoryTrackerActive       = true;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Called at the end of setup : every allocation done by the loop is now recorded by call site
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  static void start_steady_state (void)
+  {
+    for (uint8_t i=0; i<memoryTrackerSiteCount; i++)
+    {
+      memoryTrackerSites[i].allocations = 0;
+      memoryTrackerSites[i].bytes       = 0;
+    }
+    memoryTrackerViolations = 0;
+
+    start();
+
+    #ifdef CONFIG_MEMORY_TRACKER_STRICT
+    memoryTrackerSteadyState = true;
+    #endif
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Select the call site which the next allocations are assigned to
+  // @param _name : name of the call site, must be a constant string
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  static void set_site (const char* _name)
+  {
+    uint8_t index = 0;
+
+    // Sites are identified by their constant string address
+    while ((index < memoryTrackerSiteCount) && (memoryTrackerSites[index].name != _name))
+      index++;
+
+    if (index == memoryTrackerSiteCount)
+    {
+      if (memoryTrackerSiteCount >= MEMORY_TRACKER_MAX_SITES)
+        index = 0;
+      else
+      {
+        memoryTrackerSites[index].name        = _name;
+        memoryTrackerSites[index].allocations = 0;
+        memoryTrackerSites[index].bytes       = 0;
+        memoryTrackerSiteCount++;
+      }
+    }
+
+    memoryTrackerCurrentSite = index;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Print the call site counters and the high-water marks, at most every MEMORY_TRACKER_REPORT_INTERVAL_MS
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  static void report (void)
+  {
+    static unsigned long timerReport_ms = millis();
+
+    if ((millis()-timerReport_ms) < MEMORY_TRACKER_REPORT_INTERVAL_MS)
+      return;
+    timerReport_ms = millis();
+
+    // Printing must not be counted as an allocation of the last site
+    set_site(memoryTrackerSites[0].name);
+
+    Serial.print("MEMORY : heap free=");
+    Serial.print(heap_caps_get_free_size(MALLOC_CAP_DEFAULT));
+    Serial.print(" min=");
+    Serial.print(heap_caps_get_minimum_free_size(MALLOC_CAP_DEFAULT));
+    Serial.print(" largest=");
+    Serial.print(heap_caps_get_largest_free_block(MALLOC_CAP_DEFAULT));
+    Serial.print(" | stack min free=");
+    Serial.println(uxTaskGetStackHighWaterMark(NULL));
+
+    if (is_available() == false)
+    {
+      Serial.println("MEMORY : allocation tracking needs CONFIG_HEAP_USE_HOOKS");
+      return;
+    }
+
+    for (uint8_t i=0; i<memoryTrackerSiteCount; i++)
+    {
+      if (memoryTrackerSites[i].allocations == 0)
+        continue;
+
+      Serial.print("MEMORY : site ");
+      Serial.print(memoryTrackerSites[i].name);
+      Serial.print(" allocs=");
+      Serial.print(memoryTrackerSites[i].allocations);
+      Serial.print(" bytes=");
+      Serial.println(memoryTrackerSites[i].bytes);
+    }
+
+    #ifdef CONFIG_MEMORY_TRACKER_STRICT
+    if (memoryTrackerViolations > 0)
+    {
+      Serial.print("MEMORY : STRICT MODE VIOLATION, ");
+      Serial.print(memoryTrackerViolations);
+      Serial.println(" allocations in the steady state loop");
+    }
+    #endif
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Stop tracking, counters are kept
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  static void stop (void)
+  {
+    memoryTrackerActive = false;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Provide the number of allocations since start
+  // @return allocation count
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  static uint32_t get_allocations (void)
+  {
+    return memoryTrackerAllocations;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Provide the peak of allocated bytes since start
+  // @return peak in bytes
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  static int32_t get_peak_bytes (void)
+  {
+    return memoryTrackerPeakBytes;
+  }
+};
@@ -0,0 +1,226 @@
+/*********************************************************************************************************************
+ * Project : Astro Alarm
+ * Author  : PEB <pebdev@lavache.com> 
+ * Date    : 2024.01.18
+ *********************************************************************************************************************
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ * 
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *********************************************************************************************************************/
+
+
+/** D E F I N E S ****************************************************************************************************/
+// Sliding window
+#define MOTION_WINDOW_SIZE                (64)    // Number of gyro samples integrated by the sliding window (12.8s at 5Hz)
+#define MOTION_MAX_DT_S                   (1.0)   // Above this gap between two samples, the integration restarts
+
+// Filters
+#define MOTION_FUSION_ALPHA               (0.98)  // Complementary filter : weight of the gyro path
+#define MOTION_BIAS_ALPHA                 (0.02)  // Learning rate of the gyro bias (only when disarmed)
+
+// Thresholds
+#define MOTION_TILT_THRESHOLD_DEG         (1.0)   // Fused tilt deviation from the armed attitude
+#define MOTION_ROTATION_THRESHOLD_DEG     (0.5)   // Rotation integrated over the sliding window
+
+
+/** M O T I O N ******************************************************************************************************/
+class MotionDetector
+{
+private:
+  bool isArmed;
+  bool isSeeded;
+  uint8_t windowIndex;
+
+  // Sliding window of the rotation done during each sample (°), with its running sum
+  double window[MOTION_WINDOW_SIZE][3];
+  double windowSum[3];
+
+  // Gyro bias (°/s), learned while the alarm is disarmed
+  double gyroBias[3];
+
+  // Roll/pitch attitude (°) : recorded when armed, and fused gyro + acceleration estimation
+  double tiltInit[2];
+  double tiltFused[2];
+
+  // Last computed indicators
+  double rotation;
+  double tiltDeviation;
+
+
+public:
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Constructor
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  MotionDetector (void)
+  {
+    this->isArmed   = false;
+    this->isSeeded  = false;
+
+    for (uint8_t i=0; i<3; i++)
+      this->gyroBias[i] = 0.0;
+
+    this->reset();
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Arm the detector : current attitude becomes the reference
+  // @param _Xacc : acceleration on X
+  // @param _Yacc : acceleration on Y
+  // @param _Zacc : acceleration on Z
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void arm (double _Xacc, double _Yacc, double _Zacc)
+  {
+    this->reset();
+    this->acceleration_tilt(_Xacc, _Yacc, _Zacc, this->tiltInit);
+    this->tiltFused[0] = this->tiltInit[0];
+    this->tiltFused[1] = this->tiltInit[1];
+    this->isSeeded     = true;
+    this->isArmed      = true;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Disarm the detector, gyro bias learning is resumed
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void disarm (void)
+  {
+    this->isArmed = false;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Process a new sample, O(1)
+  // @param _Xacc : acceleration on X (g)
+  // @param _Yacc : acceleration on Y (g)
+  // @param _Zacc : acceleration on Z (g)
+  // @param _Xvel : angular velocity on X (°/s)
+  // @param _Yvel : angular velocity on Y (°/s)
+  // @param _Zvel : angular velocity on Z (°/s)
+  // @param _dt_s : elapsed time since the previous sample, 0 if there is no new sample
+  // @return true if a motion is detected while armed, otherwise false
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  bool update (double _Xacc, double _Yacc, double _Zacc, double _Xvel, double _Yvel, double _Zvel, double _dt_s)
+  {
+    double velocity[3] = {_Xvel, _Yvel, _Zvel};
+    double tiltAcc[2];
+
+    if (_dt_s <= 0.0)
+      return this->is_motion_detected();
+
+    this->acceleration_tilt(_Xacc, _Yacc, _Zacc, tiltAcc);
+
+    // Too long without sample, integrated values are meaningless
+    if ((_dt_s > MOTION_MAX_DT_S) || (this->isSeeded == false))
+    {
+      this->reset();
+      this->tiltFused[0] = tiltAcc[0];
+      this->tiltFused[1] = tiltAcc[1];
+      this->isSeeded     = true;
+      return this->is_motion_detected();
+    }
+
+    // Gyro bias is learned only when disarmed, otherwise a slow rotation would be absorbed
+    if (this->isArmed == false)
+    {
+      for (uint8_t i=0; i<3; i++)
+        this->gyroBias[i] += MOTION_BIAS_ALPHA * (velocity[i] - this->gyroBias[i]);
+    }
+
+    // Sliding window : remove the oldest rotation, add the new one
+    double rotationSquared = 0.0;
+    for (uint8_t i=0; i<3; i++)
+    {
+      double step = (velocity[i] - this->gyroBias[i]) * _dt_s;
+
+      this->windowSum[i] += step - this->window[this->windowIndex][i];
+      this->window[this->windowIndex][i] = step;
+      rotationSquared += this->windowSum[i] * this->windowSum[i];
+    }
+    this->windowIndex = (this->windowIndex + 1) % MOTION_WINDOW_SIZE;
+    this->rotation    = sqrt(rotationSquared);
+
+    // Complementary filter : gyro for the fast changes, acceleration to remove the gyro drift
+    for (uint8_t i=0; i<2; i++)
+    {
+      this->tiltFused[i] = MOTION_FUSION_ALPHA * (this->tiltFused[i] + (velocity[i] - this->gyroBias[i]) * _dt_s)
+                         + (1.0 - MOTION_FUSION_ALPHA) * tiltAcc[i];
+    }
+
+    if (this->isArmed == true)
+      this->tiltDeviation = fmax(abs(this->tiltFused[0] - this->tiltInit[0]), abs(this->tiltFused[1] - this->tiltInit[1]));
+
+    return this->is_motion_detected();
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Provide the rotation integrated over the sliding window
+  // @return rotation in degree
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  double get_rotation (void)
+  {
+    return this->rotation;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Provide the fused tilt deviation from the armed attitude
+  // @return deviation in degree
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  double get_tilt_deviation (void)
+  {
+    return this->tiltDeviation;
+  }
+
+
+private:
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Reset the sliding window and the indicators
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void reset (void)
+  {
+    this->windowIndex   = 0;
+    this->rotation      = 0.0;
+    this->tiltDeviation = 0.0;
+
+    for (uint8_t i=0; i<3; i++)
+    {
+      this->windowSum[i] = 0.0;
+      for (uint8_t j=0; j<MOTION_WINDOW_SIZE; j++)
+        this->window[j][i] = 0.0;
+    }
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Check the indicators against the thresholds
+  // @return true | false
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  bool is_motion_detected (void)
+  {
+    bool retval = false;
+
+    if ((this->isArmed == true)
+      && ((this->rotation >= MOTION_ROTATION_THRESHOLD_DEG) || (this->tiltDeviation >= MOTION_TILT_THRESHOLD_DEG)))
+      retval = true;
+
+    return retval;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Compute roll and pitch from the gravity projection
+  // @param _Xacc : acceleration on X
+  // @param _Yacc : acceleration on Y
+  // @param _Zacc : acceleration on Z
+  // @param _tilt : output, roll and pitch in degree
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void acceleration_tilt (double _Xacc, double _Yacc, double _Zacc, double* _tilt)
+  {
+    _tilt[0] = atan2(_Yacc, _Zacc) * 180.0 / M_PI;
+    _tilt[1] = atan2(-_Xacc, sqrt(_Yacc*_Yacc + _Zacc*_Zacc)) * 180.0 / M_PI;
+  }
+};
@@ -0,0 +1,262 @@
+/*********************************************************************************************************************
+ * Project : Astro Alarm
+ * Author  : PEB <pebdev@lavache.com> 
+ * Date    : 2024.01.18
+ *********************************************************************************************************************
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ * 
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *********************************************************************************************************************/
+
+
+/** D E F I N E S ****************************************************************************************************/
+// Decoding errors
+#define COM_DATA_ERROR_NONE             (0)
+#define COM_DATA_ERROR_NO_DATA          (1)   // Nothing received, previous values are kept
+#define COM_DATA_ERROR_INVALID_FIELD    (2)   // Field without key=value form
+#define COM_DATA_ERROR_INVALID_VALUE    (3)   // Value is not a number, or out of the sensor range
+#define COM_DATA_ERROR_INCOMPLETE       (4)   // Truncated frame, some values are missing
+
+// Frame settings
+#define COM_DATA_FRAME_SIZE             (256)   // Maximal size of a frame, end of line included
+#define COM_DATA_MAX_FIELDS             (24)
+#define COM_DATA_MAX_VALUE_SIZE         (31)
+
+// Sensor ranges, used to reject corrupted values
+#define COM_DATA_RANGE_ACCELERATION     (16.0)
+#define COM_DATA_RANGE_VELOCITY         (2000.0)
+#define COM_DATA_RANGE_ANGLE            (360.0)
+#define COM_DATA_RANGE_TEMPERATURE      (200.0)
+#define COM_DATA_RANGE_TIMESTAMP        (4294967295.0)
+#define COM_DATA_RANGE_SENSOR_HEALTH    (3.0)
+
+
+/** S T R U C T S ****************************************************************************************************/
+struct strComData
+{
+  uint8_t error;
+  uint32_t timestamp_ms;    // Server time of the sample, 0 if the server does not provide it
+  uint8_t sensorHealth;     // INCLINOMETER_HEALTH_xxx, unknown if the server does not provide it
+  struct strAngular incAngular;
+  struct strAngularVelocity inclAngularVelocity;
+  struct strAcceleration incAcceleration;
+};
+
+struct strSubstring
+{
+  const char* start;
+  uint16_t length;
+};
+
+
+/** P R O T O C O L **************************************************************************************************/
+/*-------------------------------------------------------------------------------------------------------------------*/
+// @brief Split a string, without copy
+// @param _input     : string to split
+// @param _length    : length of the string
+// @param _separator : separator between two parts
+// @param _parts     : output, parts pointing into the input string
+// @param _max_parts : size of the output array
+// @return number of parts, _max_parts+1 if there are too many parts
+/*-------------------------------------------------------------------------------------------------------------------*/
+uint8_t extract_substring (const char* _input, uint16_t _length, char _separator, struct strSubstring* _parts, uint8_t _max_parts)
+{
+  uint8_t count = 0;
+  uint16_t lastIndex = 0;
+
+  if (_length == 0)
+    return 0;
+
+  for (uint16_t index=0; index<=_length; index++)
+  {
+    if ((index == _length) || (_input[index] == _separator))
+    {
+      if (count >= _max_parts)
+        return _max_parts + 1;
+
+      _parts[count].start  = &_input[lastIndex];
+      _parts[count].length = index - lastIndex;
+      count++;
+      lastIndex = index + 1;
+    }
+  }
+
+  return count;
+}
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+// @brief Encode sensor data into a network frame
+// @param _data   : data to send
+// @param _buffer : output, frame
+// @param _size   : size of the output buffer
+// @return frame length, 0 if the buffer is too small
+/*-------------------------------------------------------------------------------------------------------------------*/
+uint16_t network_prepare_data (const struct strComData& _data, char* _buffer, uint16_t _size)
+{
+  int length = snprintf(_buffer, _size,
+                        "isAlive=1;Xac=%.4f;Yac=%.4f;Zac=%.4f;Xan=%.2f;Yan=%.2f;Zan=%.2f;Xve=%.3f;Yve=%.3f;Zve=%.3f;Tmp=%.2f;Tsv=%u;Sen=%u",
+                        _data.incAcceleration.acceleration[0], _data.incAcceleration.acceleration[1], _data.incAcceleration.acceleration[2],
+                        _data.incAngular.angle[0], _data.incAngular.angle[1], _data.incAngular.angle[2],
+                        _data.inclAngularVelocity.velocity[0], _data.inclAngularVelocity.velocity[1], _data.inclAngularVelocity.velocity[2],
+                        _data.incAcceleration.temperature, (unsigned int)_data.timestamp_ms, _data.sensorHealth);
+
+  if ((length < 0) || (length >= _size))
+    return 0;
+
+  return length;
+}
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+// @brief Convert a field value, the whole string must be a finite number within the range (trailing spaces allowed)
+// @param _value : string to convert
+// @param _range : maximal absolute value
+// @param _out   : output, converted value
+// @return true if the value is valid, otherwise false
+/*-------------------------------------------------------------------------------------------------------------------*/
+bool network_parse_value (const struct strSubstring& _value, double _range, double* _out)
+{
+  char text[COM_DATA_MAX_VALUE_SIZE+1];
+  char* end = NULL;
+
+  if ((_value.length == 0) || (_value.length > COM_DATA_MAX_VALUE_SIZE))
+    return false;
+
+  // strtod needs a terminated string
+  memcpy(text, _value.start, _value.length);
+  text[_value.length] = '\0';
+
+  // The end of line of the sender ("\r" of println) can be left after the last value
+  double value = strtod(text, &end);
+  while ((end < &text[_value.length]) && (isspace((unsigned char)*end)))
+    end++;
+
+  if ((end != &text[_value.length]) || (!std::isfinite(value)) || (abs(value) > _range))
+    return false;
+
+  *_out = value;
+  return true;
+}
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+// @brief Decode a network frame. A frame is applied only when it is fully valid, otherwise previous values are kept.
+// @param _data : received frame, null terminated
+// @return strComData data, error is one of the COM_DATA_ERROR_xxx values
+/*-------------------------------------------------------------------------------------------------------------------*/
+struct strComData network_parse_data (const char* _data)
+{
+  static struct strComData retval;
+  struct strComData frame;
+  struct strSubstring DataList[COM_DATA_MAX_FIELDS];
+  uint16_t fieldMask = 0;
+  double timestamp = 0.0;
+  double sensorHealth = INCLINOMETER_HEALTH_UNKNOWN;
+  uint16_t length = strnlen(_data, COM_DATA_FRAME_SIZE);
+
+  if (length <= 1)
+  {
+    retval.error = COM_DATA_ERROR_NO_DATA;
+    return retval;
+  }
+
+  // Data initialization
+  frame.error = COM_DATA_ERROR_NONE;
+  frame.timestamp_ms = 0;
+  frame.incAcceleration.acceleration[0] = 0.0;
+  frame.incAcceleration.acceleration[1] = 0.0;
+  frame.incAcceleration.acceleration[2] = 0.0;
+  frame.incAcceleration.temperature     = 0.0;
+  frame.incAngular.angle[0]             = 0.0;
+  frame.incAngular.angle[1]             = 0.0;
+  frame.incAngular.angle[2]             = 0.0;
+  frame.incAngular.version              = 0;
+  frame.inclAngularVelocity.velocity[0] = 0.0;
+  frame.inclAngularVelocity.velocity[1] = 0.0;
+  frame.inclAngularVelocity.velocity[2] = 0.0;
+  frame.inclAngularVelocity.voltage     = 0.0;
+
+  // Known fields : key, range, destination, mandatory
+  struct strField
+  {
+    const char* key;
+    double range;
+    double* value;
+    bool isRequired;
+  };
+
+  const struct strField fields[] = {
+    {"Xac", COM_DATA_RANGE_ACCELERATION, &frame.incAcceleration.acceleration[0],      true },
+    {"Yac", COM_DATA_RANGE_ACCELERATION, &frame.incAcceleration.acceleration[1],      true },
+    {"Zac", COM_DATA_RANGE_ACCELERATION, &frame.incAcceleration.acceleration[2],      true },
+    {"Xan", COM_DATA_RANGE_ANGLE,        &frame.incAngular.angle[0],                  true },
+    {"Yan", COM_DATA_RANGE_ANGLE,        &frame.incAngular.angle[1],                  true },
+    {"Zan", COM_DATA_RANGE_ANGLE,        &frame.incAngular.angle[2],                  true },
+    {"Xve", COM_DATA_RANGE_VELOCITY,     &frame.inclAngularVelocity.velocity[0],      true },
+    {"Yve", COM_DATA_RANGE_VELOCITY,     &frame.inclAngularVelocity.velocity[1],      true },
+    {"Zve", COM_DATA_RANGE_VELOCITY,     &frame.inclAngularVelocity.velocity[2],      true },
+    {"Tmp", COM_DATA_RANGE_TEMPERATURE,  &frame.incAcceleration.temperature,          true },
+    {"Tsv", COM_DATA_RANGE_TIMESTAMP,    &timestamp,                                  false},
+    {"Sen", COM_DATA_RANGE_SENSOR_HEALTH, &sensorHealth,                              false},
+  };
+  const uint8_t fieldCount = sizeof(fields) / sizeof(fields[0]);
+  uint16_t requiredMask = 0;
+
+  for (uint8_t i=0; i<fieldCount; i++)
+  {
+    if (fields[i].isRequired == true)
+      requiredMask |= (1 << i);
+  }
+
+  uint8_t partCount = extract_substring(_data, length, ';', DataList, COM_DATA_MAX_FIELDS);
+  if (partCount > COM_DATA_MAX_FIELDS)
+    frame.error = COM_DATA_ERROR_INVALID_FIELD;
+
+  for (uint8_t p=0; (p<partCount) && (frame.error == COM_DATA_ERROR_NONE); p++)
+  {
+    struct strSubstring var[2];
+
+    if (extract_substring(DataList[p].start, DataList[p].length, '=', var, 2) != 2)
+    {
+      frame.error = COM_DATA_ERROR_INVALID_FIELD;
+      break;
+    }
+
+    // Unknown keys are skipped, to stay compatible with newer servers
+    for (uint8_t i=0; i<fieldCount; i++)
+    {
+      if ((var[0].length == strlen(fields[i].key)) && (strncmp(var[0].start, fields[i].key, var[0].length) == 0))
+      {
+        if (network_parse_value(var[1], fields[i].range, fields[i].value) == false)
+          frame.error = COM_DATA_ERROR_INVALID_VALUE;
+        else
+          fieldMask |= (1 << i);
+        break;
+      }
+    }
+  }
+
+  if ((frame.error == COM_DATA_ERROR_NONE) && ((fieldMask & requiredMask) != requiredMask))
+    frame.error = COM_DATA_ERROR_INCOMPLETE;
+
+  // Integer values, negative values are out of range
+  if ((frame.error == COM_DATA_ERROR_NONE) && ((timestamp < 0.0) || (sensorHealth < 0.0)))
+    frame.error = COM_DATA_ERROR_INVALID_VALUE;
+  frame.timestamp_ms = (uint32_t)timestamp;
+  frame.sensorHealth = (uint8_t)sensorHealth;
+
+  // Only a valid frame replaces the previous values
+  if (frame.error == COM_DATA_ERROR_NONE)
+    retval = frame;
+  else
+    retval.error = frame.error;
+
+  return retval;
+}
@@ -0,0 +1,294 @@
+/*********************************************************************************************************************
+ * Project : Astro Alarm
+ * Author  : PEB <pebdev@lavache.com> 
+ * Date    : 2024.01.18
+ *********************************************************************************************************************
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ * 
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *********************************************************************************************************************/
+
+
+/** D E F I N E S ****************************************************************************************************/
+// Uncomment to check the pixel kernels against their reference and measure the frame composition at startup
+// (results are printed on the debug serial link)
+//#define CONFIG_PIXEL_BENCHMARK_ENABLED      (1)
+
+// Settings
+#define PIXEL_BENCHMARK_WIDTH               (320)     // Screen in landscape
+#define PIXEL_BENCHMARK_HEIGHT              (170)
+#define PIXEL_BENCHMARK_HEADER_HEIGHT       (28)      // Header of the strip chart, redrawn each frame
+#define PIXEL_BENCHMARK_FRAMES              (20)
+#define PIXEL_BENCHMARK_CHECKS              (2000)
+#define PIXEL_BENCHMARK_CHECK_SIZE          (1024)
+#define PIXEL_BENCHMARK_ALIGNMENTS          (16)      // Offsets of the checked buffers, a 128 bits block
+#define PIXEL_BENCHMARK_SEED                (0x20240118)
+
+
+/** S T R U C T S ****************************************************************************************************/
+struct strPixelMeasure
+{
+  uint64_t reference;
+  uint64_t kernel;
+};
+
+
+/** P I X E L  B E N C H M A R K *************************************************************************************/
+class PixelBenchmark
+{
+private:
+  uint32_t prngState;
+
+
+public:
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Constructor
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  PixelBenchmark (void)
+  {
+    this->prngState = PIXEL_BENCHMARK_SEED;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Run the bit for bit checks then the frame composition benchmark, and print the report
+  // @return number of mismatches between the kernels and their reference
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  uint32_t run (void)
+  {
+    uint32_t mismatches;
+
+    Serial.println("----------------------------------------------------------------------");
+    Serial.println("PIXEL BENCHMARK");
+    mismatches = this->run_checks();
+    this->run_composition();
+    Serial.println("----------------------------------------------------------------------");
+
+    return mismatches;
+  }
+
+
+private:
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Compare each kernel with its reference on random alignments, sizes, spans and palettes
+  // @return number of mismatches
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  uint32_t run_checks (void)
+  {
+    uint32_t mismatches[5] = {0, 0, 0, 0, 0};
+    uint8_t* buffer = (uint8_t*)malloc(4 * PIXEL_BENCHMARK_CHECK_SIZE + PIXEL_KERNELS_TABLE_SIZE * sizeof(uint32_t));
+
+    if (buffer == NULL)
+    {
+      Serial.println("PIXEL : ERROR, not enough memory for the checks");
+      return 1;
+    }
+
+    uint8_t* expected = buffer;
+    uint8_t* result   = &buffer[PIXEL_BENCHMARK_CHECK_SIZE];
+    uint8_t* source   = &buffer[2 * PIXEL_BENCHMARK_CHECK_SIZE];
+    uint16_t* pixels  = (uint16_t*)&buffer[3 * PIXEL_BENCHMARK_CHECK_SIZE];
+    uint32_t* table   = (uint32_t*)&buffer[4 * PIXEL_BENCHMARK_CHECK_SIZE];
+    uint16_t palette[16];
+
+    this->prngState = PIXEL_BENCHMARK_SEED;
+
+    for (uint32_t i=0; i<PIXEL_BENCHMARK_CHECKS; i++)
+    {
+      // Both outputs start from the same random content, the kernels must only write their range
+      uint32_t offset = this->random(PIXEL_BENCHMARK_ALIGNMENTS);
+      uint32_t length = this->random(PIXEL_BENCHMARK_CHECK_SIZE / 2 - offset);
+      uint8_t value   = this->random(256);
+
+      this->random_bytes(source, PIXEL_BENCHMARK_CHECK_SIZE);
+      memcpy(expected, source, PIXEL_BENCHMARK_CHECK_SIZE);
+      memcpy(result, source, PIXEL_BENCHMARK_CHECK_SIZE);
+
+      PixelKernels::fill_reference(&expected[offset], value, length);
+      PixelKernels::fill(&result[offset], value, length);
+      mismatches[0] += (memcmp(expected, result, PIXEL_BENCHMARK_CHECK_SIZE) != 0) ? 1 : 0;
+
+      // Same and different alignments of the source
+      uint32_t shift = (this->random(2) == 0) ? 0 : this->random(PIXEL_BENCHMARK_ALIGNMENTS);
+      PixelKernels::copy_reference(&expected[offset], &source[PIXEL_BENCHMARK_CHECK_SIZE / 2 + offset + shift - PIXEL_BENCHMARK_ALIGNMENTS], length);
+      PixelKernels::copy(&result[offset], &source[PIXEL_BENCHMARK_CHECK_SIZE / 2 + offset + shift - PIXEL_BENCHMARK_ALIGNMENTS], length);
+      mismatches[1] += (memcmp(expected, result, PIXEL_BENCHMARK_CHECK_SIZE) != 0) ? 1 : 0;
+
+      int32_t x     = this->random(2 * PIXEL_BENCHMARK_CHECK_SIZE - 1);
+      int32_t width = this->random(2 * PIXEL_BENCHMARK_CHECK_SIZE - x);
+      PixelKernels::fill_span_4bpp_reference(expected, x, width, value);
+      PixelKernels::fill_span_4bpp(result, x, width, value);
+      mismatches[2] += (memcmp(expected, result, PIXEL_BENCHMARK_CHECK_SIZE) != 0) ? 1 : 0;
+
+      uint32_t count = this->random(PIXEL_BENCHMARK_CHECK_SIZE / 2);
+      for (uint8_t j=0; j<16; j++)
+        palette[j] = this->random(0x10000);
+      PixelKernels::build_palette_table(table, palette);
+      PixelKernels::expand_4bpp_reference((uint16_t*)expected, &source[offset], count, palette);
+      PixelKernels::expand_4bpp(pixels, &source[offset], count, table);
+      mismatches[3] += (memcmp(expected, pixels, count * sizeof(uint16_t)) != 0) ? 1 : 0;
+
+      // Scroll of the strip chart, on a frame of 16 lines held by the check buffer
+      const int32_t stride = PIXEL_BENCHMARK_CHECK_SIZE / 16;
+      int32_t left    = this->random(2 * stride);
+      int32_t top     = this->random(16);
+      int32_t height  = this->random(16 - top + 1);
+      int32_t columns = this->random(2 * stride - left + 1);
+      width = (this->random(2) == 0) ? 2 * stride - left : this->random(2 * stride - left + 1);
+      memcpy(expected, source, PIXEL_BENCHMARK_CHECK_SIZE);
+      memcpy(result, source, PIXEL_BENCHMARK_CHECK_SIZE);
+      PixelKernels::scroll_left_4bpp_reference(expected, stride, left, top, width, height, columns, value);
+      PixelKernels::scroll_left_4bpp(result, stride, left, top, width, height, columns, value);
+      mismatches[4] += (memcmp(expected, result, PIXEL_BENCHMARK_CHECK_SIZE) != 0) ? 1 : 0;
+    }
+
+    free(buffer);
+
+    Serial.printf("mismatches           : fill %u, copy %u, span %u, expand %u, scroll %u / %u\n", (unsigned int)mismatches[0],
+                  (unsigned int)mismatches[1], (unsigned int)mismatches[2], (unsigned int)mismatches[3], (unsigned int)mismatches[4],
+                  (unsigned int)PIXEL_BENCHMARK_CHECKS);
+
+    return mismatches[0] + mismatches[1] + mismatches[2] + mismatches[3] + mismatches[4];
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Measure the composition of a strip chart frame : clear, header fill and expansion to RGB565 for
+  //                  the push, with the reference kernels then with the optimized ones
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void run_composition (void)
+  {
+    const int32_t stride = PIXEL_BENCHMARK_WIDTH / 2;
+    const uint32_t frameBytes = stride * PIXEL_BENCHMARK_HEIGHT;
+    struct strPixelMeasure clear  = {0, 0};
+    struct strPixelMeasure header = {0, 0};
+    struct strPixelMeasure expand = {0, 0};
+    uint8_t* frame = (uint8_t*)malloc(frameBytes);
+    uint16_t* line = (uint16_t*)malloc(PIXEL_BENCHMARK_WIDTH * sizeof(uint16_t));
+    uint32_t* table = (uint32_t*)malloc(PIXEL_KERNELS_TABLE_SIZE * sizeof(uint32_t));
+    uint16_t palette[16];
+
+    if ((frame == NULL) || (line == NULL) || (table == NULL))
+    {
+      Serial.println("PIXEL : ERROR, not enough memory for the benchmark");
+      free(frame);
+      free(line);
+      free(table);
+      return;
+    }
+
+    for (uint8_t i=0; i<16; i++)
+      palette[i] = this->random(0x10000);
+    PixelKernels::build_palette_table(table, palette);
+
+    for (uint32_t i=0; i<PIXEL_BENCHMARK_FRAMES; i++)
+    {
+      uint32_t start;
+
+      start = ESP.getCycleCount();
+      PixelKernels::fill_reference(frame, 0x00, frameBytes);
+      this->keep(frame);
+      clear.reference += (uint32_t)(ESP.getCycleCount() - start);
+
+      start = ESP.getCycleCount();
+      PixelKernels::fill(frame, 0x00, frameBytes);
+      this->keep(frame);
+      clear.kernel += (uint32_t)(ESP.getCycleCount() - start);
+
+      // Odd position and width, the slow path of TFT_eSprite
+      start = ESP.getCycleCount();
+      for (int32_t y=0; y<PIXEL_BENCHMARK_HEADER_HEIGHT; y++)
+        PixelKernels::fill_span_4bpp_reference(&frame[y * stride], 1, PIXEL_BENCHMARK_WIDTH - 3, 5);
+      this->keep(frame);
+      header.reference += (uint32_t)(ESP.getCycleCount() - start);
+
+      start = ESP.getCycleCount();
+      PixelKernels::fill_rect_4bpp(frame, stride, 1, 0, PIXEL_BENCHMARK_WIDTH - 3, PIXEL_BENCHMARK_HEADER_HEIGHT, 5);
+      this->keep(frame);
+      header.kernel += (uint32_t)(ESP.getCycleCount() - start);
+
+      start = ESP.getCycleCount();
+      for (int32_t y=0; y<PIXEL_BENCHMARK_HEIGHT; y++)
+      {
+        PixelKernels::expand_4bpp_reference(line, &frame[y * stride], PIXEL_BENCHMARK_WIDTH, palette);
+        this->keep(line);
+      }
+      expand.reference += (uint32_t)(ESP.getCycleCount() - start);
+
+      start = ESP.getCycleCount();
+      for (int32_t y=0; y<PIXEL_BENCHMARK_HEIGHT; y++)
+      {
+        PixelKernels::expand_4bpp(line, &frame[y * stride], PIXEL_BENCHMARK_WIDTH, table);
+        this->keep(line);
+      }
+      expand.kernel += (uint32_t)(ESP.getCycleCount() - start);
+    }
+
+    free(frame);
+    free(line);
+    free(table);
+
+    struct strPixelMeasure total = {clear.reference + header.reference + expand.reference, clear.kernel + header.kernel + expand.kernel};
+    Serial.printf("frame                : %dx%d, 4 bits per pixel, %u bytes\n", PIXEL_BENCHMARK_WIDTH, PIXEL_BENCHMARK_HEIGHT, (unsigned int)frameBytes);
+    this->print_measure("clear", clear);
+    this->print_measure("header fill", header);
+    this->print_measure("expand to RGB565", expand);
+    this->print_measure("composition", total);
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Print an accumulated measure, per frame
+  // @param _name    : measured step
+  // @param _measure : accumulated measure
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void print_measure (const char* _name, const struct strPixelMeasure& _measure)
+  {
+    uint32_t reference = (uint32_t)(_measure.reference / PIXEL_BENCHMARK_FRAMES);
+    uint32_t kernel = (uint32_t)(_measure.kernel / PIXEL_BENCHMARK_FRAMES);
+
+    Serial.printf("%-21s: %8u -> %8u cycles/frame (x%.1f, %u us saved)\n", _name, (unsigned int)reference, (unsigned int)kernel,
+                  (double)reference / ((kernel > 0) ? kernel : 1), (unsigned int)((reference - min(kernel, reference)) / getCpuFrequencyMhz()));
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Keep the writes of a measured step : without it, the compiler may drop the writes of the reference
+  //                  which are overwritten by the kernel, and measure nothing
+  // @param _buffer : written buffer
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void keep (const void* _buffer)
+  {
+    asm volatile ("" : : "r" (_buffer) : "memory");
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Fill a buffer with random bytes
+  // @param _buffer : buffer
+  // @param _size   : size of the buffer
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void random_bytes (uint8_t* _buffer, uint32_t _size)
+  {
+    for (uint32_t i=0; i<_size; i++)
+      _buffer[i] = this->random(256);
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Deterministic pseudo random number (xorshift32)
+  // @param _max : exclusive upper bound
+  // @return value in [0;_max[
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  uint32_t random (uint32_t _max)
+  {
+    this->prngState ^= this->prngState << 13;
+    this->prngState ^= this->prngState >> 17;
+    this->prngState ^= this->prngState << 5;
+
+    return (_max > 0) ? (this->prngState % _max) : 0;
+  }
+};
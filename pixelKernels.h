@@ -0,0 +1,297 @@
+/*********************************************************************************************************************
+ * Project : Astro Alarm
+ * Author  : PEB <pebdev@lavache.com> 
+ * Date    : 2024.01.18
+ *********************************************************************************************************************
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ * 
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *********************************************************************************************************************/
+
+
+/** I N C L U D E S **************************************************************************************************/
+#include <string.h>
+
+
+/** D E F I N E S ****************************************************************************************************/
+// Settings
+#define PIXEL_KERNELS_TABLE_SIZE      (256)     // One entry per byte of a 4 bits per pixel frame, a pair of pixels
+
+
+/** P I X E L  K E R N E L S *****************************************************************************************/
+// Frame composition kernels of the 4 bits per pixel screen sprites : a byte holds two palette indexes, the even pixel
+// in the high nibble (TFT_eSprite layout). Each kernel has a per pixel reference, used to check it bit for bit.
+// The fills and the copies are those of the C library : 128 bits PIE loops will only replace them once they are
+// assembled and measured on the ESP32-S3.
+class PixelKernels
+{
+public:
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Fill a buffer with a byte
+  // @param _dst   : buffer
+  // @param _value : byte value
+  // @param _bytes : size of the buffer
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  static void fill (void* _dst, uint8_t _value, uint32_t _bytes)
+  {
+    memset(_dst, _value, _bytes);
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Copy a buffer, the buffers must not overlap
+  // @param _dst   : destination buffer
+  // @param _src   : source buffer
+  // @param _bytes : size to copy
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  static void copy (void* _dst, const void* _src, uint32_t _bytes)
+  {
+    memcpy(_dst, _src, _bytes);
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Fill a horizontal span of a 4 bits per pixel line : nibbles on the edges, bytes in the middle
+  // @param _line  : first byte of the line
+  // @param _x     : first pixel of the span
+  // @param _width : number of pixels of the span
+  // @param _index : palette index
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  static void fill_span_4bpp (uint8_t* _line, int32_t _x, int32_t _width, uint8_t _index)
+  {
+    uint8_t index = _index & 0x0F;
+    uint8_t* dst = &_line[_x / 2];
+
+    if (_width <= 0)
+      return;
+
+    if ((_x % 2) != 0)
+    {
+      *dst = (*dst & 0xF0) | index;
+      dst++;
+      _width--;
+    }
+
+    PixelKernels::fill(dst, (index << 4) | index, _width / 2);
+    dst += _width / 2;
+
+    if ((_width % 2) != 0)
+      *dst = (*dst & 0x0F) | (index << 4);
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Fill a rectangle of a 4 bits per pixel frame, the rectangle must be inside the frame
+  // @param _frame  : first byte of the frame
+  // @param _stride : bytes per line
+  // @param _x      : left of the rectangle
+  // @param _y      : top of the rectangle
+  // @param _width  : width of the rectangle
+  // @param _height : height of the rectangle
+  // @param _index  : palette index
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  static void fill_rect_4bpp (uint8_t* _frame, int32_t _stride, int32_t _x, int32_t _y, int32_t _width, int32_t _height, uint8_t _index)
+  {
+    uint8_t* line = &_frame[_y * _stride];
+
+    // Full lines are one contiguous fill
+    if ((_x == 0) && (_width == (_stride * 2)))
+    {
+      PixelKernels::fill(line, ((_index & 0x0F) << 4) | (_index & 0x0F), _stride * max(_height, (int32_t)0));
+      return;
+    }
+
+    for (int32_t i=0; i<_height; i++)
+    {
+      PixelKernels::fill_span_4bpp(line, _x, _width, _index);
+      line += _stride;
+    }
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Scroll a rectangle of a 4 bits per pixel frame to the left, the freed columns on the right are
+  //                 filled. The rectangle must be inside the frame. An even shift moves bytes, an odd shift joins the
+  //                 nibbles of two source bytes.
+  // @param _frame   : first byte of the frame
+  // @param _stride  : bytes per line
+  // @param _x       : left of the rectangle
+  // @param _y       : top of the rectangle
+  // @param _width   : width of the rectangle
+  // @param _height  : height of the rectangle
+  // @param _columns : number of pixels of the scroll
+  // @param _index   : palette index of the freed columns
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  static void scroll_left_4bpp (uint8_t* _frame, int32_t _stride, int32_t _x, int32_t _y, int32_t _width, int32_t _height, int32_t _columns, uint8_t _index)
+  {
+    int32_t kept = _width - _columns;
+
+    if ((_columns <= 0) || (kept <= 0) || ((_x % 2) != 0) || ((_width % 2) != 0))
+    {
+      PixelKernels::scroll_left_4bpp_reference(_frame, _stride, _x, _y, _width, _height, _columns, _index);
+      return;
+    }
+
+    for (int32_t y=_y; y<(_y+_height); y++)
+    {
+      uint8_t* line = &_frame[y * _stride];
+      uint8_t* dst = &line[_x / 2];
+      const uint8_t* src = &dst[_columns / 2];
+
+      if ((_columns % 2) == 0)
+      {
+        memmove(dst, src, kept / 2);
+      }
+      else
+      {
+        // Forward, each source byte is read before it is written
+        for (int32_t i=0; i<(kept / 2); i++)
+          dst[i] = (src[i] << 4) | (src[i + 1] >> 4);
+        dst[kept / 2] = (dst[kept / 2] & 0x0F) | (src[kept / 2] << 4);
+      }
+
+      PixelKernels::fill_span_4bpp(line, _x + kept, _columns, _index);
+    }
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Build the expansion table of a palette : each entry is a pair of pixels, in the byte order of the
+  //                 screen bus, so that the expansion does the byte swap for free
+  // @param _table   : output, PIXEL_KERNELS_TABLE_SIZE entries
+  // @param _palette : 16 RGB565 colors
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  static void build_palette_table (uint32_t* _table, const uint16_t* _palette)
+  {
+    for (uint16_t i=0; i<PIXEL_KERNELS_TABLE_SIZE; i++)
+    {
+      uint16_t even = PixelKernels::swap(_palette[i >> 4]);
+      uint16_t odd  = PixelKernels::swap(_palette[i & 0x0F]);
+
+      // Little endian : the even pixel is the first one in memory
+      _table[i] = ((uint32_t)odd << 16) | even;
+    }
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Expand a 4 bits per pixel line into byte swapped RGB565 pixels, one table lookup per pixel pair.
+  //                 There is no vector gather on the ESP32-S3, the lookups are unrolled instead.
+  // @param _dst    : output pixels, 32 bits aligned
+  // @param _src    : 4 bits per pixel line
+  // @param _pixels : number of pixels
+  // @param _table  : expansion table of the palette (see build_palette_table)
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  static void expand_4bpp (uint16_t* _dst, const uint8_t* _src, uint32_t _pixels, const uint32_t* _table)
+  {
+    uint32_t* dst = (uint32_t*)_dst;
+    uint32_t pairs = _pixels / 2;
+
+    for (; pairs>=4; pairs-=4)
+    {
+      uint32_t src;
+
+      memcpy(&src, _src, sizeof(src));
+      dst[0] = _table[src & 0xFF];
+      dst[1] = _table[(src >> 8) & 0xFF];
+      dst[2] = _table[(src >> 16) & 0xFF];
+      dst[3] = _table[src >> 24];
+      dst  += 4;
+      _src += 4;
+    }
+
+    for (; pairs>0; pairs--)
+      *dst++ = _table[*_src++];
+
+    // Odd width : the last pixel is the even half of a pair
+    if ((_pixels % 2) != 0)
+      *(uint16_t*)dst = (uint16_t)_table[*_src];
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Reference of fill, byte per byte
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  static void fill_reference (void* _dst, uint8_t _value, uint32_t _bytes)
+  {
+    uint8_t* dst = (uint8_t*)_dst;
+
+    for (uint32_t i=0; i<_bytes; i++)
+      dst[i] = _value;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Reference of copy, byte per byte
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  static void copy_reference (void* _dst, const void* _src, uint32_t _bytes)
+  {
+    uint8_t* dst = (uint8_t*)_dst;
+    const uint8_t* src = (const uint8_t*)_src;
+
+    for (uint32_t i=0; i<_bytes; i++)
+      dst[i] = src[i];
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Reference of fill_span_4bpp, pixel per pixel as TFT_eSprite::drawPixel
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  static void fill_span_4bpp_reference (uint8_t* _line, int32_t _x, int32_t _width, uint8_t _index)
+  {
+    uint8_t index = _index & 0x0F;
+
+    for (int32_t x=_x; x<(_x+_width); x++)
+    {
+      if ((x % 2) == 0)
+        _line[x / 2] = (_line[x / 2] & 0x0F) | (index << 4);
+      else
+        _line[x / 2] = (_line[x / 2] & 0xF0) | index;
+    }
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Reference of scroll_left_4bpp, pixel per pixel
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  static void scroll_left_4bpp_reference (uint8_t* _frame, int32_t _stride, int32_t _x, int32_t _y, int32_t _width, int32_t _height, int32_t _columns, uint8_t _index)
+  {
+    for (int32_t y=_y; y<(_y+_height); y++)
+    {
+      uint8_t* line = &_frame[y * _stride];
+
+      for (int32_t x=_x; x<(_x+_width); x++)
+      {
+        int32_t from = x + _columns;
+        uint8_t index = _index;
+
+        if (from < (_x + _width))
+          index = ((from % 2) == 0) ? (line[from / 2] >> 4) : (line[from / 2] & 0x0F);
+        PixelKernels::fill_span_4bpp_reference(line, x, 1, index);
+      }
+    }
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Reference of expand_4bpp, palette lookup and byte swap per pixel as TFT_eSPI::pushImage
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  static void expand_4bpp_reference (uint16_t* _dst, const uint8_t* _src, uint32_t _pixels, const uint16_t* _palette)
+  {
+    for (uint32_t i=0; i<_pixels; i++)
+    {
+      uint8_t index = ((i % 2) == 0) ? (_src[i / 2] >> 4) : (_src[i / 2] & 0x0F);
+      _dst[i] = PixelKernels::swap(_palette[index]);
+    }
+  }
+
+
+private:
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Swap the bytes of a RGB565 color, the screen bus sends the high byte first
+  // @param _color : RGB565 color
+  // @return swapped color
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  static uint16_t swap (uint16_t _color)
+  {
+    return (uint16_t)((_color << 8) | (_color >> 8));
+  }
+};
@@ -0,0 +1,267 @@
+/*********************************************************************************************************************
+ * Project : Astro Alarm
+ * Author  : PEB <pebdev@lavache.com> 
+ * Date    : 2024.01.18
+ *********************************************************************************************************************
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ * 
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *********************************************************************************************************************/
+
+
+/** I N C L U D E S **************************************************************************************************/
+#include <esp_pm.h>
+#include <esp_sleep.h>
+#include <esp_timer.h>
+#include <driver/uart.h>
+
+
+/** D E F I N E S ****************************************************************************************************/
+// Uncomment to let the boards go to light sleep between the loops, otherwise only the CPU frequency is scaled.
+// Experimental : the idle current and the wake up latency were not measured on the boards, the frequency scaling alone
+// is the supported setting (and the USB console does not follow light sleep).
+//#define CONFIG_POWER_LIGHT_SLEEP            (1)
+
+// Locks
+#define POWER_LOCK_CPU                        (0)   // Maximal CPU frequency, for the work which has a deadline
+#define POWER_LOCK_AWAKE                      (1)   // No light sleep, something must keep running between two loops
+#define POWER_LOCK_COUNT                      (2)
+
+// Reasons to stay awake, bit mask
+#define POWER_AWAKE_NONE                      (0)
+#define POWER_AWAKE_BOOT                      (1 << 0)  // Until the first loop
+#define POWER_AWAKE_DISPLAY                   (1 << 1)  // The backlight PWM is stopped in light sleep
+#define POWER_AWAKE_INPUT                     (1 << 2)  // Button pushed, its sound and the following pushes
+#define POWER_AWAKE_ALARM                     (1 << 3)  // Alarm or warning, the buzzer is stopped in light sleep
+#define POWER_AWAKE_SENSOR                    (1 << 4)  // Inclinometer stream, the bytes received in light sleep are lost
+#define POWER_AWAKE_RADIO                     (1 << 5)  // ESP-NOW, the radio must listen all the time
+
+// Settings
+#define POWER_CPU_FREQ_MIN_MHZ                (80)      // APB stays at 80MHz : UART, backlight PWM and display bus
+#define POWER_AWAKE_HOLD_MS                   (1000)    // Delay before light sleep, once the last reason is gone
+#define POWER_UART_WAKEUP_EDGES               (3)       // The bytes received during the wake up are lost
+#define POWER_ALARM_DEADLINE_MS               (200)     // A frame of the server is evaluated before the next one
+#define POWER_REPORT_MS                       (10000)
+
+
+/** D E C L A R A T I O N S ******************************************************************************************/
+esp_pm_lock_handle_t powerLocks[POWER_LOCK_COUNT] = {NULL, NULL};
+bool powerIsLightSleepEnabled       = false;
+bool powerIsAwake                   = false;
+uint32_t powerAwakeReasons          = POWER_AWAKE_BOOT;
+unsigned long powerTimerAwake_ms    = 0;
+uint32_t powerFreqMax_mhz           = 0;
+
+// Statistics, reset by each report
+uint32_t powerIdleCount             = 0;
+uint32_t powerIdleSleepCount        = 0;    // Idle periods where light sleep was allowed
+uint32_t powerWakeLatencyMax_us     = 0;
+int64_t powerAlarmStart_us          = 0;
+int64_t powerAlarmLast_us           = 0;    // Previous evaluation, 0 when the deadline is not checked
+uint32_t powerAlarmPeriodMax_us     = 0;
+uint32_t powerAlarmDurationMax_us   = 0;
+uint32_t powerAlarmCount            = 0;
+uint32_t powerAlarmMisses           = 0;
+
+
+/** P O W E R  M A N A G E R *****************************************************************************************/
+// The CPU runs at POWER_CPU_FREQ_MIN_MHZ unless the CPU lock is taken, around the work which has a deadline. With
+// CONFIG_POWER_LIGHT_SLEEP, it also sleeps between the loops unless the awake lock is taken, while a reason to stay
+// awake is set by the loop
+class PowerManager
+{
+public:
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Setup the frequency scaling and, with CONFIG_POWER_LIGHT_SLEEP, the automatic light sleep : the
+  //                 board stays awake until the first call of set_awake(). Light sleep needs an ESP-IDF build with
+  //                 CONFIG_FREERTOS_USE_TICKLESS_IDLE, without it only the frequency is scaled.
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  static void start (void)
+  {
+    esp_pm_config_t config;
+    esp_err_t error;
+
+    powerFreqMax_mhz          = getCpuFrequencyMhz();
+    config.max_freq_mhz       = powerFreqMax_mhz;
+    config.min_freq_mhz       = POWER_CPU_FREQ_MIN_MHZ;
+    config.light_sleep_enable = false;
+    #ifdef CONFIG_POWER_LIGHT_SLEEP
+    config.light_sleep_enable = true;
+    #endif
+
+    error = esp_pm_configure(&config);
+    if ((error == ESP_ERR_NOT_SUPPORTED) && (config.light_sleep_enable == true))
+    {
+      config.light_sleep_enable = false;
+      error = esp_pm_configure(&config);
+    }
+
+    if (error != ESP_OK)
+    {
+      Serial.printf("POWER : ERROR, power management not available (%s), needs CONFIG_PM_ENABLE\n", esp_err_to_name(error));
+      return;
+    }
+    powerIsLightSleepEnabled = config.light_sleep_enable;
+
+    esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "astroCpu", &powerLocks[POWER_LOCK_CPU]);
+    esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "astroAwake", &powerLocks[POWER_LOCK_AWAKE]);
+
+    powerIsAwake       = true;
+    powerTimerAwake_ms = millis();
+    acquire(POWER_LOCK_AWAKE);
+
+    Serial.printf("POWER : CPU %u-%u MHz, light sleep %s\n", (unsigned int)POWER_CPU_FREQ_MIN_MHZ,
+                  (unsigned int)powerFreqMax_mhz, (powerIsLightSleepEnabled == true) ? "enabled" : "disabled");
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Wake up from light sleep when data are received by a UART. The RX pin must be the IO MUX one of
+  //                 the UART, and the first bytes are lost.
+  // @param _uart : UART_NUM_x
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  static void enable_uart_wakeup (uart_port_t _uart)
+  {
+    uart_set_wakeup_threshold(_uart, POWER_UART_WAKEUP_EDGES);
+    esp_sleep_enable_uart_wakeup(_uart);
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Take a lock, each call must be followed by a release(). Nothing is done before start().
+  // @param _lock : POWER_LOCK_xxx
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  static void acquire (uint8_t _lock)
+  {
+    if (powerLocks[_lock] != NULL)
+      esp_pm_lock_acquire(powerLocks[_lock]);
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Release a lock taken by acquire()
+  // @param _lock : POWER_LOCK_xxx
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  static void release (uint8_t _lock)
+  {
+    if (powerLocks[_lock] != NULL)
+      esp_pm_lock_release(powerLocks[_lock]);
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Give the reasons to stay awake, called by each loop. Light sleep is allowed POWER_AWAKE_HOLD_MS
+  //                 after the last reason is gone.
+  // @param _reasons : POWER_AWAKE_xxx mask
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  static void set_awake (uint32_t _reasons)
+  {
+    powerAwakeReasons = _reasons;
+
+    if (_reasons != POWER_AWAKE_NONE)
+    {
+      powerTimerAwake_ms = millis();
+      if (powerIsAwake == false)
+      {
+        powerIsAwake = true;
+        acquire(POWER_LOCK_AWAKE);
+      }
+    }
+    else if ((powerIsAwake == true) && ((millis()-powerTimerAwake_ms) >= POWER_AWAKE_HOLD_MS))
+    {
+      powerIsAwake = false;
+      release(POWER_LOCK_AWAKE);
+    }
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Start an alarm evaluation : the CPU lock is taken, and the time since the previous evaluation is
+  //                 checked against POWER_ALARM_DEADLINE_MS
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  static void begin_alarm (void)
+  {
+    acquire(POWER_LOCK_CPU);
+    powerAlarmStart_us = esp_timer_get_time();
+
+    if (powerAlarmLast_us == 0)
+      return;
+
+    uint32_t period_us = (uint32_t)(powerAlarmStart_us - powerAlarmLast_us);
+    powerAlarmPeriodMax_us = max(powerAlarmPeriodMax_us, period_us);
+    if (period_us > (POWER_ALARM_DEADLINE_MS * 1000))
+      powerAlarmMisses++;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] End of an alarm evaluation, the CPU lock is released
+  // @param _is_deadline_checked : false when the loop is delayed on purpose until the next evaluation (alarm sound)
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  static void end_alarm (bool _is_deadline_checked)
+  {
+    int64_t now_us = esp_timer_get_time();
+
+    powerAlarmDurationMax_us = max(powerAlarmDurationMax_us, (uint32_t)(now_us - powerAlarmStart_us));
+    powerAlarmCount++;
+    powerAlarmLast_us = (_is_deadline_checked == true) ? powerAlarmStart_us : 0;
+    release(POWER_LOCK_CPU);
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Idle period of the loop, the board sleeps when nothing keeps it awake. The delay overrun is the
+  //                 latency of the wake up.
+  // @param _delay_ms : idle time
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  static void idle (uint32_t _delay_ms)
+  {
+    bool isSleepAllowed = (powerIsLightSleepEnabled == true) && (powerIsAwake == false);
+    int64_t start_us = esp_timer_get_time();
+
+    delay(_delay_ms);
+
+    int64_t overrun_us = esp_timer_get_time() - start_us - (int64_t)_delay_ms * 1000;
+    powerIdleCount++;
+    if (isSleepAllowed == true)
+    {
+      powerIdleSleepCount++;
+      if (overrun_us > 0)
+        powerWakeLatencyMax_us = max(powerWakeLatencyMax_us, (uint32_t)overrun_us);
+    }
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Print the idle periods with light sleep allowed, the wake up latency and the alarm deadline,
+  //                 every POWER_REPORT_MS
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  static void report (void)
+  {
+    static unsigned long timerReport_ms = millis();
+
+    if (((millis()-timerReport_ms) < POWER_REPORT_MS) || (powerIdleCount == 0))
+      return;
+    timerReport_ms = millis();
+
+    Serial.printf("POWER : light sleep allowed in %u%% of the idle periods (awake=0x%02X), wake latency max %u us\n",
+                  (unsigned int)(powerIdleSleepCount * 100 / powerIdleCount), (unsigned int)powerAwakeReasons,
+                  (unsigned int)powerWakeLatencyMax_us);
+
+    if (powerAlarmCount != 0)
+    {
+      Serial.printf("POWER : alarm evaluated every %u ms max (deadline %u ms), in %u us max, %u late\n",
+                    (unsigned int)(powerAlarmPeriodMax_us / 1000), (unsigned int)POWER_ALARM_DEADLINE_MS,
+                    (unsigned int)powerAlarmDurationMax_us, (unsigned int)powerAlarmMisses);
+    }
+
+    powerIdleCount            = 0;
+    powerIdleSleepCount       = 0;
+    powerWakeLatencyMax_us    = 0;
+    powerAlarmPeriodMax_us    = 0;
+    powerAlarmDurationMax_us  = 0;
+    powerAlarmCount           = 0;
+    powerAlarmMisses          = 0;
+  }
+};
@@ -0,0 +1,340 @@
+/*********************************************************************************************************************
+ * Project : Astro Alarm
+ * Author  : PEB <pebdev@lavache.com> 
+ * Date    : 2024.01.18
+ *********************************************************************************************************************
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ * 
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *********************************************************************************************************************/
+
+
+/** D E F I N E S ****************************************************************************************************/
+// Uncomment to run the protocol benchmark and the decoder fuzzing at startup (results are printed on the debug serial link)
+// Enable CONFIG_MEMORY_TRACKER_ENABLED too, to get the allocation figures
+//#define CONFIG_PROTOCOL_BENCHMARK_ENABLED   (1)
+
+// Settings
+#define PROTOCOL_BENCHMARK_FRAMES             (2000)
+#define PROTOCOL_FUZZ_ITERATIONS              (20000)
+#define PROTOCOL_BENCHMARK_SEED               (0x20240118)
+
+
+/** S T R U C T S ****************************************************************************************************/
+struct strProtocolMeasure
+{
+  uint64_t cycles;
+  uint32_t allocations;
+  int32_t peakBytes;
+};
+
+
+/** P R O T O C O L  B E N C H M A R K *******************************************************************************/
+class ProtocolBenchmark
+{
+private:
+  uint32_t prngState;
+
+
+public:
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Constructor
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  ProtocolBenchmark (void)
+  {
+    this->prngState = PROTOCOL_BENCHMARK_SEED;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Run the throughput benchmark then the decoder fuzzing, and print the report
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void run (void)
+  {
+    Serial.println("----------------------------------------------------------------------");
+    Serial.println("PROTOCOL BENCHMARK");
+    this->run_throughput();
+    this->run_fuzzing();
+    Serial.println("----------------------------------------------------------------------");
+  }
+
+
+private:
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Measure the encoder, the splitter and the decoder on random valid frames
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void run_throughput (void)
+  {
+    struct strProtocolMeasure encode    = {0, 0, 0};
+    struct strProtocolMeasure split     = {0, 0, 0};
+    struct strProtocolMeasure decode    = {0, 0, 0};
+    uint32_t mismatches = 0;
+    uint32_t frameBytes = 0;
+
+    this->prngState = PROTOCOL_BENCHMARK_SEED;
+
+    for (uint32_t i=0; i<PROTOCOL_BENCHMARK_FRAMES; i++)
+    {
+      struct strComData data = this->random_data();
+      struct strSubstring parts[COM_DATA_MAX_FIELDS];
+      char frame[COM_DATA_FRAME_SIZE];
+      uint32_t start;
+
+      this->measure_start(&start);
+      uint16_t length = network_prepare_data(data, frame, sizeof(frame));
+      this->measure_stop(start, &encode);
+
+      this->measure_start(&start);
+      uint8_t partCount = extract_substring(frame, length, ';', parts, COM_DATA_MAX_FIELDS);
+      this->measure_stop(start, &split);
+
+      this->measure_start(&start);
+      struct strComData decoded = network_parse_data(frame);
+      this->measure_stop(start, &decode);
+
+      frameBytes += length;
+      if ((decoded.error != COM_DATA_ERROR_NONE) || (!this->is_same(data, decoded)) || (partCount != 12))
+        mismatches++;
+    }
+
+    Serial.printf("frame size           : %u bytes\n", (unsigned int)(frameBytes / PROTOCOL_BENCHMARK_FRAMES));
+    Serial.printf("round trip mismatches: %u / %u\n", (unsigned int)mismatches, (unsigned int)PROTOCOL_BENCHMARK_FRAMES);
+    this->print_measure("network_prepare_data", encode);
+    this->print_measure("extract_substring",    split);
+    this->print_measure("network_parse_data",   decode);
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Feed the decoder with mutated frames : truncations, bit flips, separators, garbage, odd numbers.
+  //                  A crash resets the board, so reaching the report means the decoder survived every input.
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void run_fuzzing (void)
+  {
+    static const char* dictionary[] = {";", "=", ";;", "==", "Xac=", "nan", "inf", "-", "1e999", "0x1p4", " ", "\r", "isAlive", "Tmp="};
+    const uint8_t dictionarySize = sizeof(dictionary) / sizeof(dictionary[0]);
+    uint32_t errors[COM_DATA_ERROR_INCOMPLETE+1] = {0, 0, 0, 0, 0};
+    uint32_t outOfRange = 0;
+
+    this->prngState = PROTOCOL_BENCHMARK_SEED + 1;
+
+    for (uint32_t i=0; i<PROTOCOL_FUZZ_ITERATIONS; i++)
+    {
+      // Twice the frame size, so that the decoder also sees oversized inputs
+      char input[2*COM_DATA_FRAME_SIZE];
+      uint16_t length = network_prepare_data(this->random_data(), input, COM_DATA_FRAME_SIZE);
+      uint8_t mutations = 1 + this->random(4);
+
+      for (uint8_t m=0; m<mutations; m++)
+      {
+        uint16_t position = this->random(length + 1);
+
+        switch (this->random(5))
+        {
+          // Truncated frame
+          case 0:
+            length = position;
+            break;
+
+          // Bit flip, null bytes included
+          case 1:
+            if (position < length)
+              input[position] ^= (1 << this->random(8));
+            break;
+
+          // Dictionary insertion
+          case 2:
+          {
+            const char* word = dictionary[this->random(dictionarySize)];
+            uint16_t wordLength = strlen(word);
+
+            if ((length + wordLength) < sizeof(input))
+            {
+              memmove(&input[position+wordLength], &input[position], length - position);
+              memcpy(&input[position], word, wordLength);
+              length += wordLength;
+            }
+            break;
+          }
+
+          // Random deletion
+          case 3:
+          {
+            uint16_t count = min((uint16_t)this->random(8), (uint16_t)(length - position));
+
+            memmove(&input[position], &input[position+count], length - position - count);
+            length -= count;
+            break;
+          }
+
+          // Pure garbage
+          default:
+            length = this->random(64);
+            for (uint16_t c=0; c<length; c++)
+              input[c] = (char)(1 + this->random(255));
+            break;
+        }
+      }
+      input[length] = '\0';
+
+      struct strComData decoded = network_parse_data(input);
+      if (decoded.error <= COM_DATA_ERROR_INCOMPLETE)
+        errors[decoded.error]++;
+
+      // An accepted frame must only contain values within the sensor ranges
+      if ((decoded.error == COM_DATA_ERROR_NONE) && (!this->is_in_range(decoded)))
+        outOfRange++;
+
+      if ((i % 1000) == 0)
+        yield();
+    }
+
+    Serial.printf("fuzzing              : %u inputs, accepted=%u no-data=%u invalid-field=%u invalid-value=%u incomplete=%u\n",
+                  (unsigned int)PROTOCOL_FUZZ_ITERATIONS, (unsigned int)errors[COM_DATA_ERROR_NONE], (unsigned int)errors[COM_DATA_ERROR_NO_DATA],
+                  (unsigned int)errors[COM_DATA_ERROR_INVALID_FIELD], (unsigned int)errors[COM_DATA_ERROR_INVALID_VALUE],
+                  (unsigned int)errors[COM_DATA_ERROR_INCOMPLETE]);
+    Serial.printf("accepted out of range: %u\n", (unsigned int)outOfRange);
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Start a measure
+  // @param _start : output, cycle counter
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void measure_start (uint32_t* _start)
+  {
+    MemoryTracker::start();
+    *_start = ESP.getCycleCount();
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Stop a measure and accumulate it
+  // @param _start   : cycle counter when the measure started
+  // @param _measure : accumulated measure
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void measure_stop (uint32_t _start, struct strProtocolMeasure* _measure)
+  {
+    uint32_t stop = ESP.getCycleCount();
+    MemoryTracker::stop();
+
+    _measure->cycles      += (uint32_t)(stop - _start);
+    _measure->allocations += MemoryTracker::get_allocations();
+    if (MemoryTracker::get_peak_bytes() > _measure->peakBytes)
+      _measure->peakBytes = MemoryTracker::get_peak_bytes();
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Print an accumulated measure
+  // @param _name    : measured function
+  // @param _measure : accumulated measure
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void print_measure (const char* _name, const struct strProtocolMeasure& _measure)
+  {
+    uint32_t cyclesPerFrame = (uint32_t)(_measure.cycles / PROTOCOL_BENCHMARK_FRAMES);
+    uint32_t framesPerSecond = (uint32_t)((uint64_t)getCpuFrequencyMhz() * 1000000 / ((cyclesPerFrame > 0) ? cyclesPerFrame : 1));
+
+    Serial.printf("%-21s: %7u cycles/frame, %7u frames/s", _name, (unsigned int)cyclesPerFrame, (unsigned int)framesPerSecond);
+
+    if (MemoryTracker::is_available() == true)
+      Serial.printf(", %.1f allocs/frame, peak heap %d bytes/frame\n", (double)_measure.allocations / PROTOCOL_BENCHMARK_FRAMES, (int)_measure.peakBytes);
+    else
+      Serial.println(", allocations n/a (CONFIG_MEMORY_TRACKER_ENABLED)");
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Build random sensor data, within the sensor ranges
+  // @return strComData data
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  struct strComData random_data (void)
+  {
+    struct strComData data;
+
+    data.error = COM_DATA_ERROR_NONE;
+    data.timestamp_ms = this->random(0xFFFFFFFF);
+    data.sensorHealth = this->random(INCLINOMETER_HEALTH_STALE + 1);
+    for (uint8_t i=0; i<3; i++)
+    {
+      data.incAcceleration.acceleration[i]  = this->random_value(2.0);
+      data.incAngular.angle[i]              = this->random_value(180.0);
+      data.inclAngularVelocity.velocity[i]  = this->random_value(50.0);
+    }
+    data.incAcceleration.temperature        = this->random_value(40.0);
+    data.incAngular.version                 = 0;
+    data.inclAngularVelocity.voltage        = 0.0;
+
+    return data;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Check if decoded data matches sent data, within the wire precision
+  // @param _sent     : encoded data
+  // @param _received : decoded data
+  // @return true | false
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  bool is_same (const struct strComData& _sent, const struct strComData& _received)
+  {
+    double precision = 0.006;
+    bool retval = (abs(_sent.incAcceleration.temperature - _received.incAcceleration.temperature) < precision);
+
+    retval &= (_sent.timestamp_ms == _received.timestamp_ms);
+    retval &= (_sent.sensorHealth == _received.sensorHealth);
+
+    for (uint8_t i=0; i<3; i++)
+    {
+      retval &= (abs(_sent.incAcceleration.acceleration[i] - _received.incAcceleration.acceleration[i]) < precision);
+      retval &= (abs(_sent.incAngular.angle[i] - _received.incAngular.angle[i]) < precision);
+      retval &= (abs(_sent.inclAngularVelocity.velocity[i] - _received.inclAngularVelocity.velocity[i]) < precision);
+    }
+
+    return retval;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Check that decoded values are within the sensor ranges
+  // @param _data : decoded data
+  // @return true | false
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  bool is_in_range (const struct strComData& _data)
+  {
+    bool retval = (abs(_data.incAcceleration.temperature) <= COM_DATA_RANGE_TEMPERATURE);
+
+    for (uint8_t i=0; i<3; i++)
+    {
+      retval &= (abs(_data.incAcceleration.acceleration[i]) <= COM_DATA_RANGE_ACCELERATION);
+      retval &= (abs(_data.incAngular.angle[i]) <= COM_DATA_RANGE_ANGLE);
+      retval &= (abs(_data.inclAngularVelocity.velocity[i]) <= COM_DATA_RANGE_VELOCITY);
+    }
+
+    return retval;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Deterministic pseudo random number (xorshift32)
+  // @param _max : exclusive upper bound
+  // @return value in [0;_max[
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  uint32_t random (uint32_t _max)
+  {
+    this->prngState ^= this->prngState << 13;
+    this->prngState ^= this->prngState >> 17;
+    this->prngState ^= this->prngState << 5;
+
+    return (_max > 0) ? (this->prngState % _max) : 0;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Deterministic pseudo random value
+  // @param _range : maximal absolute value
+  // @return value in [-_range;_range]
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  double random_value (double _range)
+  {
+    return ((double)this->random(20001) / 10000.0 - 1.0) * _range;
+  }
+};
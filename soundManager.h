@@ -37,7 +37,13 @@ public:
   SoundManager (uint8_t _pin)
   {
     this->pin = _pin;
+  }
 
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Setup the buzzer output
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void start (void)
+  {
     #ifdef CONFIG_SOUND_ENABLED
     Serial.println("SOUND : ENABLED");
     pinMode(this->pin, OUTPUT);
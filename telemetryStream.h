@@ -0,0 +1,303 @@
+/*********************************************************************************************************************
+ * Project : Astro Alarm
+ * Author  : PEB <pebdev@lavache.com> 
+ * Date    : 2024.01.18
+ *********************************************************************************************************************
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ * 
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *********************************************************************************************************************/
+
+
+/** D E F I N E S ****************************************************************************************************/
+// Frame : sync (2) | type (1) | payload length (1) | sequence (2) | payload | CRC-16 CCITT (2), little endian.
+// The CRC covers type, length, sequence and payload, a reader resynchronizes on the sync bytes after any error.
+#define TELEMETRY_SYNC_0                  (0xA5)
+#define TELEMETRY_SYNC_1                  (0x5A)
+#define TELEMETRY_HEADER_SIZE             (6)
+#define TELEMETRY_CRC_SIZE                (2)
+#define TELEMETRY_MAX_PAYLOAD_SIZE        (64)
+#define TELEMETRY_FRAME_SIZE              (TELEMETRY_HEADER_SIZE + TELEMETRY_MAX_PAYLOAD_SIZE + TELEMETRY_CRC_SIZE)
+
+// Record types
+#define TELEMETRY_RECORD_SAMPLE           (1)   // strTelemetrySample
+#define TELEMETRY_RECORD_ALARM            (2)   // strTelemetryAlarm
+#define TELEMETRY_RECORD_LINK             (4)   // strTelemetryLink
+#define TELEMETRY_RECORD_LINK_V1          (3)   // Previous link record, 32 bits clock offset (decoded by the reader only)
+
+// Sample sources
+#define TELEMETRY_SOURCE_INCLINOMETER     (0)   // Processed by the Server
+#define TELEMETRY_SOURCE_NETWORK          (1)   // Received by the Client
+
+// Serial commands
+#define TELEMETRY_COMMAND_START           ('t')
+#define TELEMETRY_COMMAND_STOP            ('q')
+
+// Link statistics
+#define TELEMETRY_LINK_INTERVAL_MS        (1000)
+#define TELEMETRY_RSSI_UNKNOWN            (0)   // Same as LINK_QUALITY_RSSI_UNKNOWN
+
+
+/** S T R U C T S ****************************************************************************************************/
+// Records, shared with the host reader (tools/telemetry_reader.cpp) : fields must only be added at the end
+struct __attribute__((packed)) strTelemetrySample
+{
+  uint32_t timestamp_ms;    // Server time when available, otherwise local time
+  uint8_t source;           // TELEMETRY_SOURCE_xxx
+  float acceleration[3];    // g
+  float velocity[3];        // °/s
+  float angle[3];           // °
+  float temperature;        // °C
+};
+
+struct __attribute__((packed)) strTelemetryAlarm
+{
+  uint32_t timestamp_ms;
+  uint8_t state;            // ALARM_STATE_xxx
+  uint8_t status;           // ALARM_STATUS_xxx
+  uint8_t trigger;          // ALARM_TRIGGER_xxx
+};
+
+struct __attribute__((packed)) strTelemetryLink
+{
+  uint32_t timestamp_ms;
+  uint8_t appStatus;        // CONNECTION_STATUS_APP_xxx
+  int8_t rssi_dBm;          // TELEMETRY_RSSI_UNKNOWN if not connected to the router
+  uint8_t isClockSynced;
+  int64_t clockOffset_us;   // Server time - local time, 0 if not synced (the uptimes of the boards can differ by days)
+  uint32_t droppedRecords;  // Records dropped because the host did not read fast enough
+};
+
+
+/** T E L E M E T R Y  F O R M A T ***********************************************************************************/
+/*-------------------------------------------------------------------------------------------------------------------*/
+// @brief CRC-16 CCITT (polynomial 0x1021), to be chained over several buffers
+// @param _crc    : previous value, 0xFFFF for the first buffer
+// @param _data   : data
+// @param _length : length of the data
+// @return CRC value
+/*-------------------------------------------------------------------------------------------------------------------*/
+uint16_t telemetry_crc16 (uint16_t _crc, const uint8_t* _data, uint16_t _length)
+{
+  for (uint16_t i=0; i<_length; i++)
+  {
+    _crc ^= (uint16_t)_data[i] << 8;
+    for (uint8_t bit=0; bit<8; bit++)
+      _crc = (_crc & 0x8000) ? (uint16_t)((_crc << 1) ^ 0x1021) : (uint16_t)(_crc << 1);
+  }
+
+  return _crc;
+}
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+// @brief Encode a record into a frame
+// @param _type     : TELEMETRY_RECORD_xxx
+// @param _sequence : frame counter, used by the reader to count the lost frames
+// @param _payload  : record
+// @param _length   : length of the record
+// @param _frame    : output, frame, at least TELEMETRY_FRAME_SIZE bytes
+// @return frame length, 0 if the record is too long
+/*-------------------------------------------------------------------------------------------------------------------*/
+uint16_t telemetry_encode (uint8_t _type, uint16_t _sequence, const void* _payload, uint8_t _length, uint8_t* _frame)
+{
+  if (_length > TELEMETRY_MAX_PAYLOAD_SIZE)
+    return 0;
+
+  _frame[0] = TELEMETRY_SYNC_0;
+  _frame[1] = TELEMETRY_SYNC_1;
+  _frame[2] = _type;
+  _frame[3] = _length;
+  _frame[4] = (uint8_t)(_sequence & 0xFF);
+  _frame[5] = (uint8_t)(_sequence >> 8);
+  memcpy(&_frame[TELEMETRY_HEADER_SIZE], _payload, _length);
+
+  uint16_t crc = telemetry_crc16(0xFFFF, &_frame[2], TELEMETRY_HEADER_SIZE - 2 + _length);
+  _frame[TELEMETRY_HEADER_SIZE + _length]     = (uint8_t)(crc & 0xFF);
+  _frame[TELEMETRY_HEADER_SIZE + _length + 1] = (uint8_t)(crc >> 8);
+
+  return TELEMETRY_HEADER_SIZE + _length + TELEMETRY_CRC_SIZE;
+}
+
+
+#ifdef ARDUINO
+/** T E L E M E T R Y  S T R E A M ***********************************************************************************/
+class TelemetryStream
+{
+private:
+  bool isEnabled;
+  uint16_t sequence;
+  uint32_t droppedRecords;
+  uint8_t frame[TELEMETRY_FRAME_SIZE];
+  unsigned long timerLink_ms;
+
+  // Last sent alarm state, records are sent on change
+  uint8_t alarmState;
+  uint8_t alarmStatus;
+
+
+public:
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Constructor
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  TelemetryStream (void)
+  {
+    this->isEnabled       = false;
+    this->sequence        = 0;
+    this->droppedRecords  = 0;
+    this->timerLink_ms    = 0;
+    this->alarmState      = 0xFF;
+    this->alarmStatus     = 0xFF;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Process a command received on the serial console
+  // @param _command : TELEMETRY_COMMAND_START | TELEMETRY_COMMAND_STOP
+  // @return true if the command is a telemetry command
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  bool process_command (char _command)
+  {
+    if (_command == TELEMETRY_COMMAND_START)
+    {
+      Serial.println("TELEMETRY : binary stream started");
+      this->isEnabled       = true;
+      this->droppedRecords  = 0;
+      this->alarmState      = 0xFF;
+      this->alarmStatus     = 0xFF;
+      return true;
+    }
+
+    if (_command == TELEMETRY_COMMAND_STOP)
+    {
+      this->isEnabled = false;
+      Serial.println("TELEMETRY : binary stream stopped");
+      return true;
+    }
+
+    return false;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Allow user to know if the binary stream is running
+  // @return true | false
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  bool is_enabled (void)
+  {
+    return this->isEnabled;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Send a processed sample
+  // @param _data         : sample
+  // @param _timestamp_ms : time of the sample
+  // @param _source       : TELEMETRY_SOURCE_xxx
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void send_sample (const struct strComData& _data, uint32_t _timestamp_ms, uint8_t _source)
+  {
+    struct strTelemetrySample record;
+
+    if (this->isEnabled == false)
+      return;
+
+    record.timestamp_ms = _timestamp_ms;
+    record.source       = _source;
+    for (uint8_t i=0; i<3; i++)
+    {
+      record.acceleration[i]  = (float)_data.incAcceleration.acceleration[i];
+      record.velocity[i]      = (float)_data.inclAngularVelocity.velocity[i];
+      record.angle[i]         = (float)_data.incAngular.angle[i];
+    }
+    record.temperature = (float)_data.incAcceleration.temperature;
+
+    this->write_record(TELEMETRY_RECORD_SAMPLE, &record, sizeof(record));
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Send the alarm state when it changed
+  // @param _alarm        : alarm data
+  // @param _timestamp_ms : current time
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void update_alarm (const struct strAlarmData& _alarm, uint32_t _timestamp_ms)
+  {
+    struct strTelemetryAlarm record;
+
+    if ((this->isEnabled == false) || ((_alarm.alarmState == this->alarmState) && (_alarm.alarmStatus == this->alarmStatus)))
+      return;
+
+    record.timestamp_ms = _timestamp_ms;
+    record.state        = _alarm.alarmState;
+    record.status       = _alarm.alarmStatus;
+    record.trigger      = _alarm.alarmTrigger;
+
+    // A dropped record is sent again on the next call
+    if (this->write_record(TELEMETRY_RECORD_ALARM, &record, sizeof(record)) == true)
+    {
+      this->alarmState  = _alarm.alarmState;
+      this->alarmStatus = _alarm.alarmStatus;
+    }
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Send the link statistics, every TELEMETRY_LINK_INTERVAL_MS
+  // @param _app_status   : CONNECTION_STATUS_APP_xxx
+  // @param _rssi_dBm     : wifi signal strength in dBm, TELEMETRY_RSSI_UNKNOWN if not connected to the router
+  // @param _clock_sync   : clock synchronization of the Client, NULL on the Server
+  // @param _timestamp_ms : current time
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void update_link (uint8_t _app_status, int8_t _rssi_dBm, ClockSync* _clock_sync, uint32_t _timestamp_ms)
+  {
+    struct strTelemetryLink record;
+
+    if ((this->isEnabled == false) || ((millis()-this->timerLink_ms) < TELEMETRY_LINK_INTERVAL_MS))
+      return;
+    this->timerLink_ms = millis();
+
+    record.timestamp_ms   = _timestamp_ms;
+    record.appStatus      = _app_status;
+    record.rssi_dBm       = _rssi_dBm;
+    record.isClockSynced  = 0;
+    record.clockOffset_us = 0;
+    if ((_clock_sync != NULL) && (_clock_sync->is_synced() == true))
+    {
+      int64_t now_us = ClockSync::local_time_us();
+      record.isClockSynced  = 1;
+      record.clockOffset_us = _clock_sync->to_server_time_us(now_us) - now_us;
+    }
+    record.droppedRecords = this->droppedRecords;
+
+    this->write_record(TELEMETRY_RECORD_LINK, &record, sizeof(record));
+  }
+
+
+private:
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Send a record, it is dropped if the USB buffer can not take the whole frame, so the loop is
+  //                  never blocked by a host which does not read
+  // @param _type    : TELEMETRY_RECORD_xxx
+  // @param _payload : record
+  // @param _length  : length of the record
+  // @return true if the record is sent
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  bool write_record (uint8_t _type, const void* _payload, uint8_t _length)
+  {
+    uint16_t length = telemetry_encode(_type, this->sequence++, _payload, _length, this->frame);
+
+    if ((length == 0) || (Serial.availableForWrite() < length))
+    {
+      this->droppedRecords++;
+      return false;
+    }
+
+    Serial.write(this->frame, length);
+    return true;
+  }
+};
+#endif
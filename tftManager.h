@@ -49,6 +49,16 @@ public:
   // @brief [PUBLIC] Constructor
   /*-------------------------------------------------------------------------------------------------------------------*/
   TftManager (void)
+  {
+    lcdState = TFT_STATE_OFF;
+    this->timeoutOffScreen_ms = 100000;
+    this->timerOffScreen_ms   = TFT_STATE_NO_AUTO_SHUTDOWN;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Power the display and setup the backlight, must be done before the display initialization
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void start (void)
   {
     // Turn on display power (needed when board can be powered with a battery)
     pinMode(15, OUTPUT);
@@ -65,10 +75,6 @@ public:
 
 
     ledcWrite(1, TFT_BRIGHTNESS);
-
-    lcdState = TFT_STATE_OFF;
-    this->timeoutOffScreen_ms = 100000;
-    this->timerOffScreen_ms   = TFT_STATE_NO_AUTO_SHUTDOWN;
   }
   
   /*-------------------------------------------------------------------------------------------------------------------*/
@@ -78,7 +84,9 @@ public:
   void set_auto_shutdown_timeout (unsigned long _off_screen_timeout_ms)
   {
     this->timeoutOffScreen_ms = _off_screen_timeout_ms;
-    Serial.println("TFT : set auto shutdown timeout ("+String(this->timeoutOffScreen_ms)+")");
+    Serial.print("TFT : set auto shutdown timeout (");
+    Serial.print(this->timeoutOffScreen_ms);
+    Serial.println(")");
   }
 
   /*-------------------------------------------------------------------------------------------------------------------*/
@@ -144,6 +152,15 @@ public:
     }
   }
 
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Provide the state of the TFT backlight
+  // @return true if the backlight is on
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  bool is_enabled (void)
+  {
+    return (lcdState == TFT_STATE_ON);
+  }
+
   /*-------------------------------------------------------------------------------------------------------------------*/
   // @brief [PUBLIC] Switch state of the TFT backlight
   /*-------------------------------------------------------------------------------------------------------------------*/
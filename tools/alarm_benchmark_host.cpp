@@ -0,0 +1,111 @@
+/*********************************************************************************************************************
+ * Project : Astro Alarm
+ * Author  : PEB <pebdev@lavache.com> 
+ * Date    : 2024.01.18
+ *********************************************************************************************************************
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ * 
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *********************************************************************************************************************/
+
+
+/** I N C L U D E S **************************************************************************************************/
+// Linux host harness of alarmBenchmark.h : the labelled corpus is replayed through the detector for each acceleration
+// margin, the report is the same as on the board
+//   g++ -O2 -o alarm_benchmark_host tools/alarm_benchmark_host.cpp
+//   ./alarm_benchmark_host [-v]
+// The corpus is synthesized from a fixed seed, two runs give the same false positives and latencies. The logs of the
+// detector are only printed with -v. A "cycle" of the host is one nanosecond.
+#include <algorithm>
+#include <cmath>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+
+/** A R D U I N O  S H I M S *****************************************************************************************/
+using std::abs;
+using std::max;
+using std::min;
+
+bool hostVerbose = false;
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+unsigned long millis (void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (unsigned long)(now.tv_sec * 1000 + now.tv_nsec / 1000000);
+}
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+void yield (void)
+{
+}
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+struct EspShim
+{
+  uint32_t getCycleCount (void)
+  {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t)((uint64_t)now.tv_sec * 1000000000 + now.tv_nsec);
+  }
+} ESP;
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+// The detector logs ("ALARM : ..." lines, the only ones built with print) are hidden, the report is printed with printf
+struct SerialShim
+{
+  bool isLineHidden = false;
+
+  void print (const char* _text)    { this->hide_line(); if (hostVerbose == true) ::printf("%s", _text); }
+  void print (double _value)        { this->hide_line(); if (hostVerbose == true) ::printf("%.2f", _value); }
+  void hide_line (void)             { this->isLineHidden = (hostVerbose == false); }
+
+  void println (const char* _text)
+  {
+    if ((this->isLineHidden == false) && ((hostVerbose == true) || (strncmp(_text, "ALARM :", 7) != 0)))
+      ::printf("%s\n", _text);
+    this->isLineHidden = false;
+  }
+
+  void printf (const char* _format, ...)
+  {
+    va_list args;
+
+    va_start(args, _format);
+    vprintf(_format, args);
+    va_end(args);
+  }
+} Serial;
+
+#include "../alarmManager.h"
+#include "../alarmBenchmark.h"
+
+
+/** M A I N  F U N C T I O N S ***************************************************************************************/
+/*-------------------------------------------------------------------------------------------------------------------*/
+int main (int _argc, char** _argv)
+{
+  AlarmBenchmark alarmBenchmark;
+
+  hostVerbose = (_argc > 1) && (strcmp(_argv[1], "-v") == 0);
+  alarmBenchmark.run();
+
+  return 0;
+}
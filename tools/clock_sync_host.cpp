@@ -0,0 +1,190 @@
+/*********************************************************************************************************************
+ * Project : Astro Alarm
+ * Author  : PEB <pebdev@lavache.com> 
+ * Date    : 2024.01.18
+ *********************************************************************************************************************
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ * 
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *********************************************************************************************************************/
+
+
+/** I N C L U D E S **************************************************************************************************/
+// Linux host simulation of clockSync.h : the exchanges of the client and the server run on simulated clocks
+//   g++ -O2 -o clock_sync_host tools/clock_sync_host.cpp
+//   ./clock_sync_host
+// The server clock drifts by 40ppm, each way of an exchange has an exponential delay (mean 8ms, one way can be much
+// longer than the other). Three phases of 240s : a first link, a reboot of the server (its time starts again from
+// 0), then a link with another server whose time is ahead (a new session). In each phase, the error of the mapping
+// to the server time must be below 5ms within 20s and stay there, and below 3ms once the 16 points of the model are
+// filled (64s). The exit code is the number of failed phases.
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+
+/** A R D U I N O  S H I M S *****************************************************************************************/
+using std::max;
+using std::min;
+
+// Simulated time of the client, in us
+int64_t hostClientTime_us = 0;
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+int64_t esp_timer_get_time (void)
+{
+  return hostClientTime_us;
+}
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+unsigned long millis (void)
+{
+  return (unsigned long)(hostClientTime_us / 1000);
+}
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+struct SerialShim
+{
+  void println (const char* _text)
+  {
+    fprintf(stdout, "  %s\n", _text);
+  }
+
+  void printf (const char* _format, ...);
+} Serial;
+
+#include "../clockSync.h"
+
+
+/** S I M U L A T I O N **********************************************************************************************/
+#define HOST_EXCHANGE_INTERVAL_US     (500000)
+#define HOST_PHASE_US                 (240000000)
+#define HOST_RECOVERY_US              (20000000)
+#define HOST_FULL_MODEL_US            (64000000)  // 16 points of 8 exchanges
+#define HOST_MAX_FULL_ERROR_US        (3000)
+#define HOST_MAX_ERROR_US             (5000)
+#define HOST_DELAY_MEAN_US            (8000.0)
+#define HOST_PROCESSING_US            (300)
+
+// Server time = (client time - start) * (1 + drift) + origin
+struct strHostServer
+{
+  int64_t start_us;
+  int64_t origin_us;
+  double drift;
+};
+
+uint32_t hostPrngState = 0x20240118;
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+// @brief Deterministic exponential delay of one way of an exchange
+// @return delay in us
+/*-------------------------------------------------------------------------------------------------------------------*/
+int64_t host_delay_us (void)
+{
+  hostPrngState ^= hostPrngState << 13;
+  hostPrngState ^= hostPrngState >> 17;
+  hostPrngState ^= hostPrngState << 5;
+
+  double uniform = ((double)hostPrngState + 1.0) / 4294967296.0;
+  return 500 + (int64_t)(-HOST_DELAY_MEAN_US * log(uniform));
+}
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+// @brief Server time at a client time
+/*-------------------------------------------------------------------------------------------------------------------*/
+int64_t host_server_time_us (const struct strHostServer& _server, int64_t _client_us)
+{
+  return _server.origin_us + (int64_t)((double)(_client_us - _server.start_us) * (1.0 + _server.drift));
+}
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+// @brief Run the exchanges of a phase
+// @param _clock  : client synchronization
+// @param _server : server clock
+// @param _name   : name of the phase
+// @return true if the error was back below HOST_MAX_ERROR_US within HOST_RECOVERY_US and stayed there, and below
+//         HOST_MAX_FULL_ERROR_US once the model is full
+/*-------------------------------------------------------------------------------------------------------------------*/
+bool host_run_phase (ClockSync* _clock, const struct strHostServer& _server, const char* _name)
+{
+  int64_t start_us = hostClientTime_us;
+  int64_t end_us = start_us + HOST_PHASE_US;
+  int64_t lastBad_us = start_us;
+  int64_t maxError_us = 0;
+
+  printf("%s\n", _name);
+  while (hostClientTime_us < end_us)
+  {
+    char response[CLOCK_SYNC_MESSAGE_SIZE];
+    int64_t t1 = hostClientTime_us;
+    int64_t receive_us = t1 + host_delay_us();
+    int64_t send_us = receive_us + HOST_PROCESSING_US;
+    int64_t t4 = send_us + host_delay_us();
+
+    snprintf(response, sizeof(response), CLOCK_SYNC_RESPONSE "%lld,%lld,%lld", (long long)t1,
+             (long long)host_server_time_us(_server, receive_us), (long long)host_server_time_us(_server, send_us));
+    hostClientTime_us = t4;
+    _clock->process_response(response, t4);
+
+    // Once synced, the error must stay small, the points of a previous timebase would give seconds
+    int64_t error_us = _clock->to_server_time_us(hostClientTime_us) - host_server_time_us(_server, hostClientTime_us);
+    if ((_clock->is_synced() == false) || (llabs(error_us) >= HOST_MAX_ERROR_US))
+      lastBad_us = hostClientTime_us;
+    if (hostClientTime_us >= (start_us + HOST_FULL_MODEL_US))
+      maxError_us = max(maxError_us, (int64_t)llabs(error_us));
+
+    hostClientTime_us = t1 + HOST_EXCHANGE_INTERVAL_US;
+  }
+
+  int64_t recovery_us = lastBad_us - start_us;
+  bool isPassed = (recovery_us < HOST_RECOVERY_US) && (maxError_us < HOST_MAX_FULL_ERROR_US);
+  printf("  error below 5ms after %.1fs, max error with a full model %lld us -> %s\n", (double)recovery_us / 1000000.0,
+         (long long)maxError_us, (isPassed == true) ? "OK" : "FAIL");
+
+  return isPassed;
+}
+
+
+/** M A I N  F U N C T I O N S ***************************************************************************************/
+/*-------------------------------------------------------------------------------------------------------------------*/
+int main (void)
+{
+  ClockSync clockSync;
+  int failures = 0;
+
+  hostClientTime_us = 5000000;
+
+  // First link, the server booted 42s before the client
+  struct strHostServer server = {hostClientTime_us, 47000000, 40e-6};
+  failures += (host_run_phase(&clockSync, server, "first link") == true) ? 0 : 1;
+
+  // The server reboots : same link, its time starts again
+  server = {hostClientTime_us, 0, 40e-6};
+  failures += (host_run_phase(&clockSync, server, "server reboot") == true) ? 0 : 1;
+
+  // Another server, on a new session (reset by the wifi manager) : its time is ahead
+  server = {hostClientTime_us, 3600000000LL, -25e-6};
+  clockSync.reset();
+  failures += (host_run_phase(&clockSync, server, "new session") == true) ? 0 : 1;
+
+  return failures;
+}
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+void SerialShim::printf (const char* _format, ...)
+{
+  (void)_format;
+}
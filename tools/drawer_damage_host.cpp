@@ -0,0 +1,554 @@
+/*********************************************************************************************************************
+ * Project : Astro Alarm
+ * Author  : PEB <pebdev@lavache.com> 
+ * Date    : 2024.01.18
+ *********************************************************************************************************************
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ * 
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *********************************************************************************************************************/
+
+
+/** I N C L U D E S **************************************************************************************************/
+// Linux host harness of drawerManager.h : a drawer with its push task draws a random live view and sends only the
+// changed areas, each frame received by its panel is compared with the same frame drawn by a new drawer, which sends
+// it as a whole
+//   g++ -std=gnu++20 -O2 -pthread -o drawer_damage_host tools/drawer_damage_host.cpp
+//   ./drawer_damage_host [frames] [seed]    (default : 3000 7)
+// The TFT is a panel in memory and the sprites draw simple shapes, in the same boxes as the fonts of TFT_eSPI. The
+// CPU locks of PowerManager are counted, all of them must be released once a frame is sent. The exit code is the
+// number of errors (frames which differ from the reference, locks left or released twice).
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <semaphore>
+#include <thread>
+#include <vector>
+
+
+/** A R D U I N O  S H I M S *****************************************************************************************/
+using std::abs;
+using std::max;
+using std::min;
+
+// Simulated time, in ms
+unsigned long hostTime_ms = 1000;
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+unsigned long millis (void)
+{
+  return hostTime_ms;
+}
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+unsigned long micros (void)
+{
+  return hostTime_ms * 1000;
+}
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+template <typename T> T constrain (T _value, T _low, T _high)
+{
+  return min(max(_value, _low), _high);
+}
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+struct SerialShim
+{
+  template <typename T> void print (T _value)              { (void)_value; }
+  template <typename T> void println (T _value)            { (void)_value; }
+  void printf (const char* _format, ...)                   { (void)_format; }
+  void write (const uint8_t* _data, size_t _length)        { (void)_data; (void)_length; }
+} Serial;
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+struct BootTimeline
+{
+  static void mark (const char* _name) { (void)_name; }
+};
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+// CPU locks, counted : they must be balanced once a frame is sent
+#define POWER_LOCK_CPU                (0)
+
+std::atomic<int32_t> hostCpuLocks(0);
+std::atomic<uint32_t> hostLockErrors(0);
+
+struct PowerManager
+{
+  static void acquire (uint8_t _lock) { (void)_lock; hostCpuLocks++; }
+  static void release (uint8_t _lock) { (void)_lock; if (--hostCpuLocks < 0) hostLockErrors++; }
+};
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+// Heap of ESP-IDF, the blocks are freed with the drawer which allocated them (see host_free_blocks)
+#define MALLOC_CAP_INTERNAL           (1 << 0)
+#define MALLOC_CAP_8BIT               (1 << 1)
+#define MALLOC_CAP_SPIRAM             (1 << 2)
+
+std::vector<void*> hostBlocks;
+
+void* heap_caps_malloc (size_t _size, uint32_t _caps)
+{
+  (void)_caps;
+  hostBlocks.push_back(malloc(_size));
+  return hostBlocks.back();
+}
+
+void* heap_caps_aligned_alloc (size_t _alignment, size_t _size, uint32_t _caps)
+{
+  (void)_caps;
+  hostBlocks.push_back(aligned_alloc(_alignment, (_size + _alignment - 1) / _alignment * _alignment));
+  return hostBlocks.back();
+}
+
+void host_free_blocks (size_t _first)
+{
+  for (size_t i=_first; i<hostBlocks.size(); i++)
+    free(hostBlocks[i]);
+  hostBlocks.resize(_first);
+}
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+// FreeRTOS over the standard threads, the task creation can be refused to get a drawer without push task
+#define portMAX_DELAY                 (0)
+#define pdPASS                        (1)
+
+typedef std::binary_semaphore* SemaphoreHandle_t;
+typedef std::thread* TaskHandle_t;
+
+bool hostTaskRefused = false;
+
+SemaphoreHandle_t xSemaphoreCreateBinary (void)                 { return new std::binary_semaphore(0); }
+void xSemaphoreTake (SemaphoreHandle_t _semaphore, int _delay)  { (void)_delay; _semaphore->acquire(); }
+void xSemaphoreGive (SemaphoreHandle_t _semaphore)              { _semaphore->release(); }
+void vSemaphoreDelete (SemaphoreHandle_t _semaphore)            { delete _semaphore; }
+
+int xTaskCreatePinnedToCore (void (*_task)(void*), const char* _name, int _stack, void* _param, int _priority,
+                             TaskHandle_t* _handle, int _core)
+{
+  (void)_name; (void)_stack; (void)_priority; (void)_core;
+  if (hostTaskRefused == true)
+    return !pdPASS;
+
+  *_handle = new std::thread(_task, _param);
+  (*_handle)->detach();
+  return pdPASS;
+}
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+// TFT_eSPI : colors, text datums, the TFT is a panel in memory which receives the RGB565 pixels
+#define TFT_BLACK                     (0x0000)
+#define TFT_NAVY                      (0x000F)
+#define TFT_DARKCYAN                  (0x03EF)
+#define TFT_DARKGREY                  (0x7BEF)
+#define TFT_RED                       (0xF800)
+#define TFT_GREEN                     (0x07E0)
+#define TFT_ORANGE                    (0xFDA0)
+#define TFT_WHITE                     (0xFFFF)
+#define TFT_YELLOW                    (0xFFE0)
+#define TL_DATUM                      (0)
+#define TR_DATUM                      (2)
+#define HOST_WIDTH                    (320)
+#define HOST_HEIGHT                   (170)
+
+class TFT_eSPI;
+TFT_eSPI* hostLastTft = NULL;     // TFT of the last drawer created, private in the drawer
+
+class TFT_eSPI
+{
+public:
+  TFT_eSPI (void)                       { hostLastTft = this; }
+
+  std::vector<uint16_t> panel = std::vector<uint16_t>(HOST_WIDTH * HOST_HEIGHT, 0);
+  std::atomic<uint32_t> frames = {0};
+  bool isSwapped = false;
+  int32_t window[4] = {0, 0, 0, 0};
+  int32_t cursor = 0;
+
+  int16_t width (void)                  { return HOST_WIDTH; }
+  int16_t height (void)                 { return HOST_HEIGHT; }
+  void init (void)                      { }
+  void setRotation (uint8_t _rotation)  { (void)_rotation; }
+  void setSwapBytes (bool _isSwapped)   { this->isSwapped = _isSwapped; }
+  bool getSwapBytes (void)              { return this->isSwapped; }
+  void startWrite (void)                { }
+  void endWrite (void)                  { this->frames++; }
+
+  void setAddrWindow (int32_t _x, int32_t _y, int32_t _width, int32_t _height)
+  {
+    this->window[0] = _x;
+    this->window[1] = _y;
+    this->window[2] = _width;
+    this->window[3] = _height;
+    this->cursor = 0;
+  }
+
+  // The bus sends the high byte first : the pixels are swapped when the TFT_eSPI swap is off
+  void pushPixels (const void* _pixels, uint32_t _count)
+  {
+    const uint16_t* pixels = (const uint16_t*)_pixels;
+
+    for (uint32_t i=0; i<_count; i++, this->cursor++)
+    {
+      uint16_t color = (this->isSwapped == true) ? pixels[i] : (uint16_t)((pixels[i] << 8) | (pixels[i] >> 8));
+      int32_t x = this->window[0] + this->cursor % this->window[2];
+      int32_t y = this->window[1] + this->cursor / this->window[2];
+
+      this->panel[y * HOST_WIDTH + x] = color;
+    }
+  }
+};
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+// TFT_eSprite with 4 bits per pixel, even pixel in the high nibble. The shapes are simplified, but drawn inside the
+// same boxes as TFT_eSPI : the widgets of the live view stay in their bounds.
+class TFT_eSprite
+{
+public:
+  uint8_t* buffer = NULL;
+  int32_t w = 0;
+  int32_t h = 0;
+  int32_t viewport[4] = {0, 0, 0, 0};
+  uint16_t textColor = 0;
+  uint8_t textDatum = TL_DATUM;
+
+  TFT_eSprite (TFT_eSPI* _tft)                      { (void)_tft; }
+  ~TFT_eSprite (void)                               { free(this->buffer); }
+  void setColorDepth (int8_t _depth)                { (void)_depth; }
+  void createPalette (const uint16_t* _palette, uint8_t _colors) { (void)_palette; (void)_colors; }
+  void setPaletteColor (uint8_t _index, uint16_t _color) { (void)_index; (void)_color; }
+  void setSwapBytes (bool _isSwapped)               { (void)_isSwapped; }
+  void* getPointer (void)                           { return this->buffer; }
+  int16_t width (void)                              { return this->w; }
+  int16_t height (void)                             { return this->h; }
+  void setTextColor (uint16_t _color)               { this->textColor = _color; }
+  void setTextColor (uint16_t _color, uint16_t _background) { (void)_background; this->textColor = _color; }
+  void setTextDatum (uint8_t _datum)                { this->textDatum = _datum; }
+  int16_t textWidth (const char* _text, uint8_t _font) { return strlen(_text) * ((_font == 4) ? 14 : 8); }
+  int16_t fontHeight (int16_t _font)                { return (_font == 4) ? 26 : 16; }
+  void pushSprite (int32_t _x, int32_t _y)          { (void)_x; (void)_y; ::printf("DRAWER : unexpected pushSprite\n"); }
+
+  void createSprite (int16_t _width, int16_t _height)
+  {
+    this->w = _width;
+    this->h = _height;
+    this->buffer = (uint8_t*)calloc((_width + 1) / 2 * _height, 1);
+    this->resetViewport();
+  }
+
+  void setViewport (int32_t _x, int32_t _y, int32_t _width, int32_t _height, bool _isClipped)
+  {
+    (void)_isClipped;
+    this->viewport[0] = _x;
+    this->viewport[1] = _y;
+    this->viewport[2] = _width;
+    this->viewport[3] = _height;
+  }
+
+  void resetViewport (void)
+  {
+    this->setViewport(0, 0, this->w, this->h, true);
+  }
+
+  void drawPixel (int32_t _x, int32_t _y, uint32_t _index)
+  {
+    if ((_x < max(this->viewport[0], (int32_t)0)) || (_x >= min(this->viewport[0] + this->viewport[2], this->w)) ||
+        (_y < max(this->viewport[1], (int32_t)0)) || (_y >= min(this->viewport[1] + this->viewport[3], this->h)))
+      return;
+
+    uint8_t* pair = &this->buffer[_y * ((this->w + 1) / 2) + _x / 2];
+    *pair = ((_x % 2) == 0) ? ((*pair & 0x0F) | (_index << 4)) : ((*pair & 0xF0) | (_index & 0x0F));
+  }
+
+  void fillRect (int32_t _x, int32_t _y, int32_t _width, int32_t _height, uint32_t _index)
+  {
+    for (int32_t y=_y; y<(_y + _height); y++)
+      for (int32_t x=_x; x<(_x + _width); x++)
+        this->drawPixel(x, y, _index);
+  }
+
+  void fillSprite (uint32_t _index)                                         { this->fillRect(0, 0, this->w, this->h, _index); }
+  void drawFastHLine (int32_t _x, int32_t _y, int32_t _width, uint32_t _index)  { this->fillRect(_x, _y, _width, 1, _index); }
+  void drawFastVLine (int32_t _x, int32_t _y, int32_t _height, uint32_t _index) { this->fillRect(_x, _y, 1, _height, _index); }
+
+  void fillRoundRect (int32_t _x, int32_t _y, int32_t _width, int32_t _height, int32_t _radius, uint32_t _index)
+  {
+    (void)_radius;
+    this->fillRect(_x, _y, _width, _height, _index);
+  }
+
+  void fillCircle (int32_t _x, int32_t _y, int32_t _radius, uint32_t _index)
+  {
+    for (int32_t j=-_radius; j<=_radius; j++)
+      for (int32_t i=-_radius; i<=_radius; i++)
+        if ((i*i + j*j) <= (_radius * _radius))
+          this->drawPixel(_x + i, _y + j, _index);
+  }
+
+  void drawCircle (int32_t _x, int32_t _y, int32_t _radius, uint32_t _index)
+  {
+    for (int32_t a=0; a<360; a++)
+      this->drawPixel(_x + lround(_radius * cos(a * M_PI / 180)), _y + lround(_radius * sin(a * M_PI / 180)), _index);
+  }
+
+  // Hatched bounding box of the triangle
+  void fillTriangle (int32_t _x1, int32_t _y1, int32_t _x2, int32_t _y2, int32_t _x3, int32_t _y3, uint32_t _index)
+  {
+    for (int32_t y=min(_y1, min(_y2, _y3)); y<=max(_y1, max(_y2, _y3)); y++)
+      for (int32_t x=min(_x1, min(_x2, _x3)); x<=max(_x1, max(_x2, _x3)); x++)
+        if (((x + y) % 3) == 0)
+          this->drawPixel(x, y, _index);
+  }
+
+  void drawLine (int32_t _x0, int32_t _y0, int32_t _x1, int32_t _y1, uint32_t _index)
+  {
+    int32_t steps = max(max(abs(_x1 - _x0), abs(_y1 - _y0)), (int32_t)1);
+
+    for (int32_t i=0; i<=steps; i++)
+      this->drawPixel(_x0 + (_x1 - _x0) * i / steps, _y0 + (_y1 - _y0) * i / steps, _index);
+  }
+
+  // Text : a pattern of the characters in the box of the font
+  int16_t drawString (const char* _text, int32_t _x, int32_t _y, uint8_t _font)
+  {
+    int32_t width = this->textWidth(_text, _font);
+    uint32_t hash = 0;
+
+    if (this->textDatum == TR_DATUM)
+      _x -= width;
+    for (const char* c=_text; *c!='\0'; c++)
+      hash = hash * 31 + *c;
+
+    for (int32_t y=0; y<this->fontHeight(_font); y++)
+      for (int32_t x=0; x<width; x++)
+        if (((hash >> ((x + y) % 16)) & 1) != 0)
+          this->drawPixel(_x + x, _y + y, this->textColor);
+
+    return width;
+  }
+};
+
+#include "../inclinometer.h"
+#include "../networkProtocol.h"
+#include "../alarmManager.h"
+#include "../flightRecorder.h"
+#include "../pixelKernels.h"
+#include "../drawerManager.h"
+
+
+/** D E F I N E S ****************************************************************************************************/
+#define HOST_FRAME_MS                 (10)
+#define HOST_PUSH_TIMEOUT_MS          (1000)
+#define HOST_PING_MS                  (250)     // Ping widget of the drawer : visible 250ms, at most every 750ms
+#define HOST_PING_PERIOD_MS           (750)
+
+
+/** S T R U C T S ****************************************************************************************************/
+struct strHostView
+{
+  double x, y, z;
+  double temperature;
+  double batteryPercentage, batteryVoltage;
+  double memoryX, memoryY;
+  uint32_t wifiColor, healthColor;
+  int32_t rtt_ms;
+  bool isPing;
+  bool isMemory;
+  bool isSensor;
+  bool isAlarmBar;
+  bool isAlarmOn;
+};
+
+
+/** M A I N  F U N C T I O N S ***************************************************************************************/
+/*-------------------------------------------------------------------------------------------------------------------*/
+// @brief Pseudo random number of the harness
+// @param _max : exclusive upper bound
+// @return value in [0;_max[
+/*-------------------------------------------------------------------------------------------------------------------*/
+uint32_t host_random (uint32_t _max)
+{
+  return (uint32_t)rand() % _max;
+}
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+// @brief Give the live view to a drawer, the widgets in the order of the loop
+// @param _drawer : drawer
+// @param _view   : content of the view
+/*-------------------------------------------------------------------------------------------------------------------*/
+void host_draw_view (DrawerManager* _drawer, const struct strHostView* _view)
+{
+  _drawer->draw_background();
+  _drawer->draw_ping_status(_view->isPing);
+  _drawer->draw_wifi_status(_view->wifiColor, _view->healthColor, _view->rtt_ms);
+  _drawer->draw_north_point(_view->z);
+  _drawer->draw_main_point(_view->x, _view->y);
+  _drawer->draw_inclinometer_values(_view->x, _view->y);
+  _drawer->draw_temperature_value(_view->temperature);
+  _drawer->draw_battery_data(_view->batteryPercentage, _view->batteryVoltage);
+  if (_view->isMemory == true)
+    _drawer->draw_memory_values(_view->memoryX, _view->memoryY);
+  if (_view->isSensor == true)
+    _drawer->draw_sensor_status(TFT_ORANGE, "DEGRADED");
+  if (_view->isAlarmBar == true)
+    _drawer->draw_alarm_state((_view->isAlarmOn == true) ? TFT_RED : TFT_GREEN, (_view->isAlarmOn == true) ? "ON" : "OFF");
+}
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+// @brief Wait until a frame is sent by the push task and its CPU lock is released
+// @param _tft    : TFT of the drawer
+// @param _frames : frames sent before this one
+// @return true if the frame was sent with balanced locks
+/*-------------------------------------------------------------------------------------------------------------------*/
+bool host_wait_frame (TFT_eSPI* _tft, uint32_t _frames)
+{
+  for (uint32_t i=0; i<HOST_PUSH_TIMEOUT_MS; i++)
+  {
+    if ((_tft->frames > _frames) && (hostCpuLocks == 0))
+      return true;
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  return false;
+}
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+// @brief Draw a frame from scratch : a new drawer without push task sends the whole view at once
+// @param _view      : content of the view
+// @param _isPing    : ping widget visible in the checked drawer
+// @param _reference : output, pixels received by the panel
+/*-------------------------------------------------------------------------------------------------------------------*/
+void host_draw_reference (const struct strHostView* _view, bool _isPing, std::vector<uint16_t>* _reference)
+{
+  struct strHostView view = *_view;
+  size_t firstBlock = hostBlocks.size();
+
+  // Created one ping period earlier : its ping widget follows the given status at once
+  hostTime_ms -= HOST_PING_PERIOD_MS + 1;
+  DrawerManager* drawer = new DrawerManager();
+  TFT_eSPI* tft = hostLastTft;
+  hostTime_ms += HOST_PING_PERIOD_MS + 1;
+
+  hostTaskRefused = true;
+  drawer->start();
+  drawer->wait_ready();
+  hostTaskRefused = false;
+
+  view.isPing = _isPing;
+  host_draw_view(drawer, &view);
+  drawer->draw_update();
+  *_reference = tft->panel;
+
+  delete drawer;
+  host_free_blocks(firstBlock);
+}
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+int main (int _argc, char* _argv[])
+{
+  uint32_t frameCount = (_argc > 1) ? atoi(_argv[1]) : 3000;
+  uint32_t seed = (_argc > 2) ? atoi(_argv[2]) : 7;
+  struct strHostView view = {0.05, 0.02, 10.0, 12.0, 80.0, 3.9, 0.1, 0.1, TFT_GREEN, TFT_GREEN, 12, false, false, false, true, false};
+  std::vector<uint16_t> reference;
+  unsigned long pingTimer_ms = hostTime_ms;
+  uint32_t checked = 0;
+  uint32_t immediate = 0;
+  uint32_t mismatches = 0;
+  uint32_t timeouts = 0;
+  uint64_t changedPixels = 0;
+
+  srand(seed);
+
+  DrawerManager* drawer = new DrawerManager();
+  TFT_eSPI* tft = hostLastTft;
+  drawer->start();
+  drawer->wait_ready();
+
+  for (uint32_t frame=0; frame<frameCount; frame++)
+  {
+    bool isImmediate = (host_random(100) < 2);
+    uint32_t change = host_random(100);
+    uint32_t frames = tft->frames;
+    std::vector<uint16_t> previous = tft->panel;
+
+    hostTime_ms += HOST_FRAME_MS;
+
+    // Mostly static, sometimes a change of one widget
+    if (change < 10)       view.x += (int32_t)(host_random(21) - 10) * 0.01;
+    else if (change < 14)  view.y += (int32_t)(host_random(21) - 10) * 0.3;
+    else if (change < 17)  view.z += host_random(30);
+    else if (change < 19)  view.rtt_ms = host_random(300);
+    else if (change < 20)  view.temperature = host_random(40);
+    else if (change < 21)  view.isSensor = !view.isSensor;
+    else if (change < 22)  view.isAlarmBar = !view.isAlarmBar;
+    else if (change < 23)  view.isMemory = !view.isMemory;
+    else if (change < 24)  view.isAlarmOn = !view.isAlarmOn;
+    else if (change < 25)  view.wifiColor = (view.wifiColor == TFT_GREEN) ? TFT_RED : TFT_GREEN;
+    view.isPing = (host_random(100) < 30);
+
+    // Same rule as DrawerManager::draw_ping_status
+    if ((view.isPing == true) && ((hostTime_ms - pingTimer_ms) > HOST_PING_MS) && ((hostTime_ms - pingTimer_ms) > HOST_PING_PERIOD_MS))
+      pingTimer_ms = hostTime_ms;
+
+    host_draw_view(drawer, &view);
+    if (isImmediate == true)
+      drawer->draw_alarm_data(1.0, 2.0, 3.0, 4.0, 5.0, 6.0);
+    drawer->draw_update();
+
+    if (host_wait_frame(tft, frames) == false)
+    {
+      timeouts++;
+      ::printf("DRAWER : frame %u not sent, %d CPU locks left\n", (unsigned int)frame, (int)hostCpuLocks);
+      break;
+    }
+
+    for (size_t i=0; i<previous.size(); i++)
+      changedPixels += (previous[i] != tft->panel[i]) ? 1 : 0;
+
+    // The frames with the alarm data are drawn in full, the next live view is checked
+    if (isImmediate == true)
+    {
+      immediate++;
+      continue;
+    }
+
+    host_draw_reference(&view, (hostTime_ms - pingTimer_ms) < HOST_PING_MS, &reference);
+    checked++;
+
+    uint32_t differences = 0;
+    for (size_t i=0; i<reference.size(); i++)
+      differences += (reference[i] != tft->panel[i]) ? 1 : 0;
+    if (differences > 0)
+    {
+      mismatches++;
+      if (mismatches <= 5)
+        ::printf("DRAWER : frame %u, %u pixels differ from the reference\n", (unsigned int)frame, (unsigned int)differences);
+    }
+  }
+
+  uint32_t errors = mismatches + timeouts + hostLockErrors;
+
+  ::printf("DRAWER : frames=%u checked=%u immediate=%u, pixels changed per frame=%.1f%%\n", (unsigned int)frameCount,
+           (unsigned int)checked, (unsigned int)immediate, 100.0 * changedPixels / ((double)HOST_WIDTH * HOST_HEIGHT * max(frameCount, (uint32_t)1)));
+  ::printf("DRAWER : mismatches=%u not sent=%u lock errors=%u -> %s\n", (unsigned int)mismatches, (unsigned int)timeouts,
+           (unsigned int)hostLockErrors, (errors == 0) ? "OK" : "FAIL");
+
+  // The push task never ends, the process exits with it
+  return (int)min(errors, (uint32_t)125);
+}
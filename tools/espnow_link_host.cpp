@@ -0,0 +1,323 @@
+/*********************************************************************************************************************
+ * Project : Astro Alarm
+ * Author  : PEB <pebdev@lavache.com> 
+ * Date    : 2024.01.18
+ *********************************************************************************************************************
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ * 
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *********************************************************************************************************************/
+
+
+/** I N C L U D E S **************************************************************************************************/
+// Linux host harness of transportEspNow.h : a client board (WifiManager over the ESP-NOW backend) receives the lines of
+// an emulated server through a lossy radio
+//   g++ -O2 -o espnow_link_host tools/espnow_link_host.cpp
+//   ./espnow_link_host [lines] [loss_percent]    (default : 5000 5)
+// The server packets are built as described in transportEspNow.h, a line longer than a payload uses two packets. The
+// radio loses packets at random, and the client stops reading from time to time so that its reception queue
+// overflows. Every line received by the client must be one of the sent lines, unaltered, and every line whose packets
+// all reached the queue must be received. The packets sent by the client must be numbered without gap. The exit code
+// is the number of errors.
+#include <algorithm>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+
+/** A R D U I N O  S H I M S *****************************************************************************************/
+using std::max;
+using std::min;
+
+// Simulated time, in us
+int64_t hostTime_us = 0;
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+int64_t esp_timer_get_time (void)
+{
+  return hostTime_us;
+}
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+unsigned long millis (void)
+{
+  return (unsigned long)(hostTime_us / 1000);
+}
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+bool hostVerbose = false;
+
+struct SerialShim
+{
+  template <typename T> void print (T _value)     { if (hostVerbose == true) this->show(_value, ""); }
+  template <typename T> void println (T _value)   { if (hostVerbose == true) this->show(_value, "\n"); }
+  void show (const char* _text, const char* _end) { ::printf("%s%s", _text, _end); }
+  void show (unsigned long _value, const char* _end) { ::printf("%lu%s", _value, _end); }
+  void show (int _value, const char* _end)        { ::printf("%d%s", _value, _end); }
+  void show (unsigned int _value, const char* _end) { ::printf("%u%s", _value, _end); }
+
+  void printf (const char* _format, ...)
+  {
+    va_list args;
+
+    if (hostVerbose == false)
+      return;
+    va_start(args, _format);
+    vprintf(_format, args);
+    va_end(args);
+  }
+} Serial;
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+struct BootTimeline
+{
+  static void mark (const char* _name) { (void)_name; }
+};
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+// WiFi and ESP-NOW API of ESP-IDF 5.5, the radio is the harness
+#define WIFI_STA                      (1)
+#define ESP_OK                        (0)
+#define ESP_NOW_ETH_ALEN              (6)
+#define ESP_NOW_MAX_DATA_LEN          (250)
+#define ESP_IDF_VERSION_VAL(major, minor, patch)  (((major) << 16) | ((minor) << 8) | (patch))
+#define ESP_IDF_VERSION               ESP_IDF_VERSION_VAL(5, 5, 0)
+
+typedef int esp_err_t;
+enum wifi_interface_t { WIFI_IF_STA };
+enum wifi_second_chan_t { WIFI_SECOND_CHAN_NONE };
+enum esp_now_send_status_t { ESP_NOW_SEND_SUCCESS, ESP_NOW_SEND_FAIL };
+struct wifi_pkt_rx_ctrl_t { int8_t rssi; };
+struct esp_now_recv_info_t { const uint8_t* src_addr; const uint8_t* des_addr; wifi_pkt_rx_ctrl_t* rx_ctrl; };
+struct wifi_tx_info_t { const uint8_t* des_addr; };
+struct esp_now_peer_info_t { uint8_t peer_addr[ESP_NOW_ETH_ALEN]; uint8_t channel; wifi_interface_t ifidx; bool encrypt; };
+typedef void (*esp_now_recv_cb_t) (const esp_now_recv_info_t*, const uint8_t*, int);
+typedef void (*esp_now_send_cb_t) (const wifi_tx_info_t*, esp_now_send_status_t);
+
+struct WiFiShim
+{
+  void mode (int _mode) { (void)_mode; }
+} WiFi;
+
+esp_now_recv_cb_t hostReceiveCallback = NULL;
+esp_now_send_cb_t hostSentCallback = NULL;
+std::vector<std::vector<uint8_t>> hostClientPackets;    // Data packets sent by the client board
+
+esp_err_t esp_wifi_set_channel (uint8_t _channel, wifi_second_chan_t _second)  { (void)_channel; (void)_second; return ESP_OK; }
+esp_err_t esp_now_init (void)                                                  { return ESP_OK; }
+esp_err_t esp_now_register_recv_cb (esp_now_recv_cb_t _callback)               { hostReceiveCallback = _callback; return ESP_OK; }
+esp_err_t esp_now_register_send_cb (esp_now_send_cb_t _callback)               { hostSentCallback = _callback; return ESP_OK; }
+esp_err_t esp_now_add_peer (const esp_now_peer_info_t* _peer)                  { (void)_peer; return ESP_OK; }
+esp_err_t esp_now_del_peer (const uint8_t* _mac)                               { (void)_mac; return ESP_OK; }
+bool esp_now_is_peer_exist (const uint8_t* _mac)                               { (void)_mac; return false; }
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+// The packets of the client are acknowledged at once by the emulated server
+esp_err_t esp_now_send (const uint8_t* _mac, const uint8_t* _data, size_t _length)
+{
+  wifi_tx_info_t info = {_mac};
+
+  if (_data[2] != 'H')
+    hostClientPackets.push_back(std::vector<uint8_t>(_data, _data + _length));
+  hostSentCallback(&info, ESP_NOW_SEND_SUCCESS);
+
+  return ESP_OK;
+}
+
+#include "../clockSync.h"
+#include "../linkQuality.h"
+#include "../transport.h"
+#include "../transportEspNow.h"
+#include "../wifiManager.h"
+
+
+/** E M U L A T E D  S E R V E R *************************************************************************************/
+#define HOST_LOOP_MS                  (10)
+#define HOST_STALL_INTERVAL           (400)     // Loops between two stalls of the client reading
+#define HOST_STALL_LOOPS              (25)
+
+const uint8_t hostServerMac[ESP_NOW_ETH_ALEN] = {0x24, 0x0A, 0xC4, 0x00, 0x00, 0x01};
+uint32_t hostPrngState = 0x20240118;
+uint8_t hostServerSequence = 0;
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+// @brief Deterministic pseudo random number (xorshift32)
+// @param _max : exclusive upper bound
+// @return value in [0;_max[
+/*-------------------------------------------------------------------------------------------------------------------*/
+uint32_t host_random (uint32_t _max)
+{
+  hostPrngState ^= hostPrngState << 13;
+  hostPrngState ^= hostPrngState >> 17;
+  hostPrngState ^= hostPrngState << 5;
+
+  return hostPrngState % _max;
+}
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+// @brief Give a packet of the server to the client board, as the wifi task does
+// @param _type    : TRANSPORT_ESPNOW_TYPE_xxx
+// @param _data    : bytes of the stream
+// @param _length  : number of bytes
+// @return true if the packet reached the reception queue of the client
+/*-------------------------------------------------------------------------------------------------------------------*/
+bool host_receive (uint8_t _type, const char* _data, uint16_t _length)
+{
+  uint8_t packet[ESP_NOW_MAX_DATA_LEN] = {TRANSPORT_ESPNOW_MAGIC_0, TRANSPORT_ESPNOW_MAGIC_1, _type, TRANSPORT_ESPNOW_ROLE_SERVER, hostServerSequence};
+  wifi_pkt_rx_ctrl_t control = {-60};
+  esp_now_recv_info_t info = {hostServerMac, NULL, &control};
+  uint32_t lost = espNowRxLost;
+
+  memcpy(&packet[TRANSPORT_ESPNOW_HEADER_SIZE], _data, _length);
+  hostReceiveCallback(&info, packet, TRANSPORT_ESPNOW_HEADER_SIZE + _length);
+
+  return (espNowRxLost == lost);
+}
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+// @brief Send a line from the server : one packet per payload, the first one starts the line
+// @param _line         : line, with its end of line
+// @param _loss_percent : probability to lose each packet on the radio
+// @return true if all the packets of the line reached the reception queue of the client
+/*-------------------------------------------------------------------------------------------------------------------*/
+bool host_send_line (const std::string& _line, uint32_t _loss_percent)
+{
+  bool isComplete = true;
+
+  for (size_t offset=0; offset<_line.size(); offset+=TRANSPORT_ESPNOW_PAYLOAD_SIZE)
+  {
+    uint16_t length = min(_line.size() - offset, (size_t)TRANSPORT_ESPNOW_PAYLOAD_SIZE);
+    uint8_t type = (offset == 0) ? TRANSPORT_ESPNOW_TYPE_DATA : TRANSPORT_ESPNOW_TYPE_DATA_NEXT;
+
+    if (host_random(100) < _loss_percent)
+      isComplete = false;
+    else
+      isComplete &= host_receive(type, &_line[offset], length);
+    hostServerSequence++;
+  }
+
+  return isComplete;
+}
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+// @brief Check the data packets sent by the client : numbered without gap, a new line starts each TYPE_DATA packet
+// @return number of errors
+/*-------------------------------------------------------------------------------------------------------------------*/
+uint32_t host_check_client_packets (void)
+{
+  uint32_t errors = 0;
+  bool isLineStart = true;
+
+  for (size_t i=0; i<hostClientPackets.size(); i++)
+  {
+    const std::vector<uint8_t>& packet = hostClientPackets[i];
+
+    if ((i > 0) && (packet[4] != (uint8_t)(hostClientPackets[i-1][4] + 1)))
+      errors++;
+    if ((packet[2] == TRANSPORT_ESPNOW_TYPE_DATA) != isLineStart)
+      errors++;
+    isLineStart = (packet.back() == '\n');
+  }
+
+  return errors;
+}
+
+
+/** M A I N  F U N C T I O N S ***************************************************************************************/
+/*-------------------------------------------------------------------------------------------------------------------*/
+int main (int _argc, char** _argv)
+{
+  uint32_t lineCount = (_argc > 1) ? atoi(_argv[1]) : 5000;
+  uint32_t lossPercent = (_argc > 2) ? atoi(_argv[2]) : 5;
+  std::vector<std::string> lines;
+  std::vector<bool> isDeliverable;
+  std::vector<bool> isReceived;
+  uint32_t corrupted = 0;
+  uint32_t duplicated = 0;
+  uint32_t split = 0;
+  TransportEspNow transport;
+  WifiManager client(&transport);
+
+  client.start();
+
+  // The server is heard by the client
+  hostTime_us = 1000000;
+  uint8_t hello[TRANSPORT_ESPNOW_HEADER_SIZE] = {TRANSPORT_ESPNOW_MAGIC_0, TRANSPORT_ESPNOW_MAGIC_1, TRANSPORT_ESPNOW_TYPE_HELLO, TRANSPORT_ESPNOW_ROLE_SERVER, 0};
+  wifi_pkt_rx_ctrl_t control = {-60};
+  esp_now_recv_info_t info = {hostServerMac, NULL, &control};
+  client.client_update();
+  hostReceiveCallback(&info, hello, sizeof(hello));
+
+  for (uint32_t loop=0; loop<(lineCount + HOST_STALL_LOOPS); loop++)
+  {
+    hostTime_us += HOST_LOOP_MS * 1000;
+    client.client_update();
+
+    // One line per loop, from 20 to 253 characters : half of them are long, from 244 characters they use two packets
+    if (lines.size() < lineCount)
+    {
+      char head[32];
+      uint32_t length = (host_random(2) == 0) ? 20 + host_random(200) : 230 + host_random(24);
+      snprintf(head, sizeof(head), "frame=%u;", (unsigned int)lines.size());
+      std::string line = head + std::string(length - strlen(head), 'a' + (lines.size() % 26)) + "\r\n";
+
+      split += (line.size() > TRANSPORT_ESPNOW_PAYLOAD_SIZE) ? 1 : 0;
+      isDeliverable.push_back(host_send_line(line, lossPercent));
+      isReceived.push_back(false);
+      lines.push_back(line.substr(0, line.size() - 2));
+    }
+
+    // The reading of the client is stalled from time to time, its reception queue overflows
+    if ((loop % HOST_STALL_INTERVAL) < (HOST_STALL_INTERVAL - HOST_STALL_LOOPS))
+    {
+      const char* line;
+
+      while ((line = client.read_data(false))[0] != '\0')
+      {
+        uint32_t frame = atoi(&line[strlen("frame=")]);
+
+        if ((strncmp(line, "frame=", strlen("frame=")) != 0) || (frame >= lines.size()) || (lines[frame] != line))
+          corrupted++;
+        else if (isReceived[frame] == true)
+          duplicated++;
+        else
+          isReceived[frame] = true;
+      }
+    }
+  }
+
+  uint32_t deliverable = 0;
+  uint32_t received = 0;
+  uint32_t missed = 0;
+  for (size_t i=0; i<lines.size(); i++)
+  {
+    deliverable += (isDeliverable[i] == true) ? 1 : 0;
+    received += (isReceived[i] == true) ? 1 : 0;
+    missed += ((isDeliverable[i] == true) && (isReceived[i] == false)) ? 1 : 0;
+  }
+
+  uint32_t txErrors = host_check_client_packets();
+  uint32_t errors = corrupted + duplicated + missed + txErrors;
+
+  printf("ESPNOW : lines sent=%u (%u on two packets) loss=%u%% queue overflows=%u\n", (unsigned int)lines.size(),
+         split, lossPercent, espNowRxLost);
+  printf("ESPNOW : lines complete in the queue=%u received=%u | corrupted=%u duplicated=%u missed=%u\n", deliverable,
+         received, corrupted, duplicated, missed);
+  printf("ESPNOW : client packets=%u, numbering errors=%u -> %s\n", (unsigned int)hostClientPackets.size(), txErrors,
+         (errors == 0) ? "OK" : "FAIL");
+
+  return (int)min(errors, (uint32_t)125);
+}
@@ -0,0 +1,304 @@
+/*********************************************************************************************************************
+ * Project : Astro Alarm
+ * Author  : PEB <pebdev@lavache.com> 
+ * Date    : 2024.01.18
+ *********************************************************************************************************************
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ * 
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *********************************************************************************************************************/
+
+
+/** I N C L U D E S **************************************************************************************************/
+// Linux host decoder of the flight recorder dump (command 'd' of flightRecorder.h), one CSV file per incident :
+//   g++ -O2 -o flight_recorder_reader tools/flight_recorder_reader.cpp
+//   ./flight_recorder_reader /dev/ttyACM0 -o incidents
+//   ./flight_recorder_reader capture.bin -o incidents
+// A device is asked for the dump, which is read until the board stays silent for 1s. The text printed by the board
+// around the dump is skipped, an incident with a wrong size or checksum is reported and ignored.
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+
+
+/** A R D U I N O  S H I M S *****************************************************************************************/
+using std::abs;
+using std::max;
+using std::min;
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+unsigned long millis (void)
+{
+  return 0;
+}
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+unsigned long micros (void)
+{
+  return 0;
+}
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+template <typename T> T constrain (T _value, T _low, T _high)
+{
+  return min(max(_value, _low), _high);
+}
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+struct SerialShim
+{
+  template <typename T> void print (T _value)              { (void)_value; }
+  template <typename T> void println (T _value)            { (void)_value; }
+  void printf (const char* _format, ...)                   { (void)_format; }
+  void write (const uint8_t* _data, size_t _length)        { (void)_data; (void)_length; }
+} Serial;
+
+#include "../inclinometer.h"
+#include "../networkProtocol.h"
+#include "../alarmManager.h"
+#include "../flightRecorder.h"
+
+
+/** D E F I N E S ****************************************************************************************************/
+#define READER_MAX_DUMP_SIZE    (RECORDER_DUMP_HEADER_SIZE + RECORDER_DUMP_INCIDENT_SIZE \
+                                 + RECORDER_INCIDENT_SAMPLES * RECORDER_DUMP_SAMPLE_SIZE + 2)
+#define READER_MAX_INPUT_SIZE   (RECORDER_MAX_INCIDENTS * READER_MAX_DUMP_SIZE * 4)
+#define READER_DEFAULT_PREFIX   "incident"
+
+
+/** D E C O D E R ****************************************************************************************************/
+/*-------------------------------------------------------------------------------------------------------------------*/
+// @brief Read a little endian value
+// @param _data : first byte
+// @param _size : number of bytes
+// @return value
+/*-------------------------------------------------------------------------------------------------------------------*/
+uint32_t get_bytes (const uint8_t* _data, uint8_t _size)
+{
+  uint32_t value = 0;
+
+  for (uint8_t i=0; i<_size; i++)
+    value |= (uint32_t)_data[i] << (8 * i);
+
+  return value;
+}
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+// @brief Decode the incident data of a dump into a CSV file
+// @param _data   : incident data, checksum verified
+// @param _size   : number of bytes
+// @param _prefix : prefix of the CSV files
+// @return true if the incident is consistent
+/*-------------------------------------------------------------------------------------------------------------------*/
+bool write_incident (const uint8_t* _data, uint16_t _size, const char* _prefix)
+{
+  uint32_t number         = get_bytes(&_data[0], 4);
+  uint32_t triggerTime_ms = get_bytes(&_data[4], 4);
+  uint8_t trigger         = _data[8];
+  uint16_t triggerIndex   = get_bytes(&_data[9], 2);
+  uint16_t sampleCount    = get_bytes(&_data[11], 2);
+  int16_t baseline[3];
+
+  for (uint8_t i=0; i<3; i++)
+    baseline[i] = (int16_t)get_bytes(&_data[13 + 2*i], 2);
+
+  if ((sampleCount > RECORDER_INCIDENT_SAMPLES) || (_size != RECORDER_DUMP_INCIDENT_SIZE + sampleCount * RECORDER_DUMP_SAMPLE_SIZE))
+  {
+    fprintf(stderr, "RECORDER : incident %u, %u samples do not match the size %u\n", number, sampleCount, _size);
+    return false;
+  }
+
+  char path[512];
+  snprintf(path, sizeof(path), "%s_%u.csv", _prefix, number);
+  FILE* file = fopen(path, "w");
+  if (file == NULL)
+  {
+    perror(path);
+    return false;
+  }
+
+  // Deviations are relative to the armed position, as on the screen
+  fprintf(file, "index,timestamp_ms,after_trigger,acc_x_g,acc_y_g,acc_z_g,dev_x_mg,dev_y_mg,dev_z_mg,vel_x_dps,vel_y_dps,vel_z_dps\n");
+  for (uint16_t s=0; s<sampleCount; s++)
+  {
+    const uint8_t* sample = &_data[RECORDER_DUMP_INCIDENT_SIZE + s * RECORDER_DUMP_SAMPLE_SIZE];
+    double acceleration[3];
+    double velocity[3];
+
+    for (uint8_t i=0; i<3; i++)
+    {
+      acceleration[i] = (int16_t)get_bytes(&sample[4 + 2*i], 2) / RECORDER_ACCELERATION_LSB_PER_G;
+      velocity[i]     = (int16_t)get_bytes(&sample[10 + 2*i], 2) / RECORDER_VELOCITY_LSB_PER_DPS;
+    }
+
+    fprintf(file, "%u,%u,%u,%.5f,%.5f,%.5f,%.1f,%.1f,%.1f,%.3f,%.3f,%.3f\n", s, get_bytes(sample, 4), (s >= triggerIndex) ? 1 : 0,
+            acceleration[0], acceleration[1], acceleration[2],
+            (acceleration[0] - baseline[0] / RECORDER_ACCELERATION_LSB_PER_G) * 1000.0,
+            (acceleration[1] - baseline[1] / RECORDER_ACCELERATION_LSB_PER_G) * 1000.0,
+            (acceleration[2] - baseline[2] / RECORDER_ACCELERATION_LSB_PER_G) * 1000.0,
+            velocity[0], velocity[1], velocity[2]);
+  }
+  fclose(file);
+
+  printf("RECORDER : incident %u at %ums, trigger=%u, samples=%u (%u before) -> %s\n", number, triggerTime_ms, trigger,
+         sampleCount, triggerIndex, path);
+  return true;
+}
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+// @brief Search the dumps in the received bytes
+// @param _data   : received bytes
+// @param _length : number of bytes
+// @param _prefix : prefix of the CSV files
+// @return number of bad incidents
+/*-------------------------------------------------------------------------------------------------------------------*/
+int decode (const uint8_t* _data, size_t _length, const char* _prefix)
+{
+  int errors = 0;
+  int incidents = 0;
+  size_t i = 0;
+
+  while (i + RECORDER_DUMP_HEADER_SIZE <= _length)
+  {
+    if ((_data[i] != RECORDER_DUMP_MAGIC[0]) || (_data[i+1] != RECORDER_DUMP_MAGIC[1]))
+    {
+      i++;
+      continue;
+    }
+
+    // "FR" can also be printed text, only a known version is a dump
+    uint8_t version = _data[i+2];
+    uint16_t size = get_bytes(&_data[i+3], 2);
+    if ((version != RECORDER_DUMP_VERSION) || (size < RECORDER_DUMP_INCIDENT_SIZE))
+    {
+      if (version < RECORDER_DUMP_VERSION)
+        fprintf(stderr, "RECORDER : dump version %u is not supported\n", version);
+      i++;
+      continue;
+    }
+
+    const uint8_t* incident = &_data[i + RECORDER_DUMP_HEADER_SIZE];
+    if (i + RECORDER_DUMP_HEADER_SIZE + size + 2 > _length)
+    {
+      fprintf(stderr, "RECORDER : truncated dump\n");
+      errors++;
+      break;
+    }
+
+    uint8_t sum1 = 0;
+    uint8_t sum2 = 0;
+    for (uint16_t n=0; n<size; n++)
+    {
+      sum1 = (sum1 + incident[n]) % 255;
+      sum2 = (sum2 + sum1) % 255;
+    }
+
+    if ((sum1 != incident[size]) || (sum2 != incident[size+1]))
+    {
+      fprintf(stderr, "RECORDER : checksum error\n");
+      errors++;
+      i++;
+      continue;
+    }
+
+    errors += (write_incident(incident, size, _prefix) == true) ? 0 : 1;
+    incidents++;
+    i += RECORDER_DUMP_HEADER_SIZE + size + 2;
+  }
+
+  printf("RECORDER : %d incident(s), %d error(s)\n", incidents, errors);
+  return errors;
+}
+
+
+/** M A I N  F U N C T I O N S ***************************************************************************************/
+/*-------------------------------------------------------------------------------------------------------------------*/
+// @brief Configure a serial port in raw mode, reads return after 1s of silence
+// @param _fd : serial port
+// @return true on success
+/*-------------------------------------------------------------------------------------------------------------------*/
+bool configure_port (int _fd)
+{
+  struct termios tty;
+
+  if (tcgetattr(_fd, &tty) != 0)
+    return false;
+
+  cfmakeraw(&tty);
+  cfsetspeed(&tty, B115200);
+  tty.c_cc[VMIN]  = 0;
+  tty.c_cc[VTIME] = 10;
+
+  return (tcsetattr(_fd, TCSANOW, &tty) == 0);
+}
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+int main (int _argc, char** _argv)
+{
+  const char* input = NULL;
+  const char* prefix = READER_DEFAULT_PREFIX;
+  static uint8_t buffer[READER_MAX_INPUT_SIZE];
+  size_t length = 0;
+
+  for (int i=1; i<_argc; i++)
+  {
+    if ((strcmp(_argv[i], "-o") == 0) && (i+1 < _argc))
+      prefix = _argv[++i];
+    else if (input == NULL)
+      input = _argv[i];
+  }
+
+  if (input == NULL)
+  {
+    fprintf(stderr, "usage : %s <device|capture file> [-o csv prefix]\n", _argv[0]);
+    return 1;
+  }
+
+  int fd = open(input, O_RDWR | O_NOCTTY);
+  if (fd < 0)
+    fd = open(input, O_RDONLY);
+  if (fd < 0)
+  {
+    perror(input);
+    return 1;
+  }
+
+  // A device is asked for the dump, a capture file is decoded
+  if (isatty(fd) == 1)
+  {
+    char command = 'd';
+    if ((configure_port(fd) == false) || (write(fd, &command, 1) != 1))
+    {
+      perror(input);
+      close(fd);
+      return 1;
+    }
+  }
+
+  while (length < sizeof(buffer))
+  {
+    ssize_t received = read(fd, &buffer[length], sizeof(buffer) - length);
+    if (received <= 0)
+      break;
+    length += received;
+  }
+  close(fd);
+
+  return decode(buffer, length, prefix);
+}
@@ -0,0 +1,177 @@
+/*********************************************************************************************************************
+ * Project : Astro Alarm
+ * Author  : PEB <pebdev@lavache.com> 
+ * Date    : 2024.01.18
+ *********************************************************************************************************************
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ * 
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *********************************************************************************************************************/
+
+
+/** I N C L U D E S **************************************************************************************************/
+// Linux host harness of httpServer.h, with simulated sensor data :
+//   g++ -O2 -o http_server_host tools/http_server_host.cpp
+//   ./http_server_host 8080 &
+//   curl http://localhost:8080/  |  curl -N http://localhost:8080/events
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <csignal>
+#include <ctime>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+
+/** A R D U I N O  S H I M S *****************************************************************************************/
+#define PROGMEM
+
+using std::min;
+
+uint16_t hostPort = 8080;
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+unsigned long millis (void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (unsigned long)(now.tv_sec * 1000 + now.tv_nsec / 1000000);
+}
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+struct SerialShim
+{
+  void println (const char* _text)
+  {
+    printf("%s\n", _text);
+    fflush(stdout);
+  }
+} Serial;
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+class WiFiClient
+{
+private:
+  int socketFd;
+
+public:
+  WiFiClient (int _fd = -1) : socketFd(_fd) {}
+  int fd (void) const { return this->socketFd; }
+  explicit operator bool (void) const { return (this->socketFd >= 0); }
+
+  void stop (void)
+  {
+    if (this->socketFd >= 0)
+      ::close(this->socketFd);
+    this->socketFd = -1;
+  }
+};
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+// The port of the harness replaces HTTP_SERVER_PORT, which needs root on Linux
+class WiFiServer
+{
+private:
+  int listenFd;
+
+public:
+  WiFiServer (uint16_t _port) : listenFd(-1) { (void)_port; }
+
+  void begin (void)
+  {
+    struct sockaddr_in address;
+    int enable = 1;
+
+    this->listenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    setsockopt(this->listenFd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+    memset(&address, 0, sizeof(address));
+    address.sin_family      = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port        = htons(hostPort);
+
+    if ((bind(this->listenFd, (struct sockaddr*)&address, sizeof(address)) != 0) || (listen(this->listenFd, 8) != 0))
+    {
+      perror("bind");
+      exit(1);
+    }
+  }
+
+  // Send buffer of the ESP32 lwIP configuration (TCP_SND_BUF), slow readers are detected as on the board
+  WiFiClient available (void)
+  {
+    int size = 5744;
+    int fd = accept4(this->listenFd, NULL, NULL, SOCK_NONBLOCK);
+
+    if (fd >= 0)
+      setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+    return WiFiClient(fd);
+  }
+};
+
+#include "../httpServer.h"
+
+
+/** M A I N  F U N C T I O N S ***************************************************************************************/
+/*-------------------------------------------------------------------------------------------------------------------*/
+int main (int _argc, char** _argv)
+{
+  unsigned long publishInterval_ms = 200;
+  unsigned long timerPublish_ms = millis();
+  HttpServer httpServer;
+
+  if (_argc > 1)
+    hostPort = atoi(_argv[1]);
+  if (_argc > 2)
+    publishInterval_ms = atoi(_argv[2]);
+
+  // Like lwIP, a write to a closed connection returns an error instead of raising a signal
+  signal(SIGPIPE, SIG_IGN);
+
+  while (true)
+  {
+    httpServer.update();
+
+    if ((millis()-timerPublish_ms) >= publishInterval_ms)
+    {
+      struct strHttpStatus status;
+      double t = millis() / 1000.0;
+
+      status.angle[0]           = 0.5 * sin(t / 10.0);
+      status.angle[1]           = 0.3 * cos(t / 7.0);
+      status.angle[2]           = 182.0;
+      status.acceleration[0]    = 0.001 * sin(t);
+      status.acceleration[1]    = 0.001 * cos(t);
+      status.acceleration[2]    = 1.0;
+      status.temperature        = 12.5;
+      status.batteryPercentage  = 87.0;
+      status.batteryVoltage     = 3.48;
+      status.isClientConnected  = true;
+      status.alarmState         = 0;
+      status.alarmStatus        = 0;
+      status.sensorHealth       = 1;
+
+      httpServer.publish(status);
+      timerPublish_ms = millis();
+    }
+
+    usleep(10000);
+  }
+
+  return 0;
+}
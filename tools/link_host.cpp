@@ -0,0 +1,207 @@
+/*********************************************************************************************************************
+ * Project : Astro Alarm
+ * Author  : PEB <pebdev@lavache.com> 
+ * Date    : 2024.01.18
+ *********************************************************************************************************************
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ * 
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *********************************************************************************************************************/
+
+
+/** I N C L U D E S **************************************************************************************************/
+// Linux host harness of wifiManager.h : the server and its client boards run in the same process over the loopback
+// transport
+//   g++ -O2 -o link_host tools/link_host.cpp
+//   ./link_host [duration_s] [stall_start_s] [stall_duration_s] [clients]    (default : 30 8 7 3)
+// The data frames of the server are read by the clients, the reading of the last client is stalled during the given
+// window to show the dropped frames, the liveness timeout and the reconnection, without effect on the other clients.
+// The exit code is the number of healthy clients (never stalled) which missed a frame.
+#include <algorithm>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <unistd.h>
+
+
+/** A R D U I N O  S H I M S *****************************************************************************************/
+using std::max;
+using std::min;
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+int64_t esp_timer_get_time (void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+unsigned long millis (void)
+{
+  return (unsigned long)(esp_timer_get_time() / 1000);
+}
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+// Each line is prefixed by the role of the board which prints it
+const char* hostRole = "";
+
+struct SerialShim
+{
+  bool isLineStart = true;
+
+  void prefix (void)
+  {
+    if (this->isLineStart == true)
+      ::printf("[%s] ", hostRole);
+    this->isLineStart = false;
+  }
+
+  void print (const char* _text)      { this->prefix(); ::printf("%s", _text); }
+  void print (unsigned long _value)   { this->prefix(); ::printf("%lu", _value); }
+  void println (const char* _text)    { this->prefix(); ::printf("%s\n", _text); this->isLineStart = true; }
+  void println (unsigned long _value) { this->prefix(); ::printf("%lu\n", _value); this->isLineStart = true; }
+
+  void printf (const char* _format, ...)
+  {
+    va_list args;
+
+    this->prefix();
+    va_start(args, _format);
+    vprintf(_format, args);
+    va_end(args);
+    this->isLineStart = (_format[strlen(_format)-1] == '\n');
+  }
+} Serial;
+
+// The server accepts several subscribers
+#define BOARD_WITH_SERVER_ROLE      (1)
+
+#include "../clockSync.h"
+#include "../linkQuality.h"
+#include "../transport.h"
+#include "../transportLoopback.h"
+#include "../wifiManager.h"
+
+
+/** M A I N  F U N C T I O N S ***************************************************************************************/
+/*-------------------------------------------------------------------------------------------------------------------*/
+int main (int _argc, char** _argv)
+{
+  unsigned long duration_ms       = 30000;
+  unsigned long stallStart_ms     = 8000;
+  unsigned long stallDuration_ms  = 7000;
+  uint8_t clientCount             = 3;
+  uint32_t framesSent             = 0;
+  uint32_t framesReceived[TRANSPORT_MAX_PEERS] = {0};
+  TransportLoopback serverTransport;
+  TransportLoopback clientTransports[TRANSPORT_MAX_PEERS];
+  WifiManager* clients[TRANSPORT_MAX_PEERS];
+  char clientRoles[TRANSPORT_MAX_PEERS][16];
+
+  if (_argc > 1)
+    duration_ms = atoi(_argv[1]) * 1000;
+  if (_argc > 2)
+    stallStart_ms = atoi(_argv[2]) * 1000;
+  if (_argc > 3)
+    stallDuration_ms = atoi(_argv[3]) * 1000;
+  if (_argc > 4)
+    clientCount = min(max(atoi(_argv[4]), 1), TRANSPORT_MAX_PEERS);
+
+  WifiManager server(&serverTransport);
+  hostRole = "SERVER";
+  server.start();
+
+  for (uint8_t i=0; i<clientCount; i++)
+  {
+    serverTransport.link(&clientTransports[i]);
+    clients[i] = new WifiManager(&clientTransports[i]);
+    snprintf(clientRoles[i], sizeof(clientRoles[i]), "CLIENT %u", i);
+    hostRole = clientRoles[i];
+    clients[i]->start();
+  }
+
+  unsigned long start_ms = millis();
+  bool isStalled = false;
+
+  while ((millis()-start_ms) < duration_ms)
+  {
+    unsigned long elapsed_ms = millis() - start_ms;
+    char frame[WIFI_LINE_SIZE];
+
+    // Reading of the last client stalled during the window
+    bool stall = ((elapsed_ms >= stallStart_ms) && (elapsed_ms < (stallStart_ms + stallDuration_ms)));
+    if (stall != isStalled)
+    {
+      printf("---- client %u reading %s\n", clientCount-1, (stall == true) ? "stalled" : "resumed");
+      clientTransports[clientCount-1].set_stalled(stall);
+      isStalled = stall;
+    }
+
+    // Server : a data frame every 200ms
+    hostRole = "SERVER";
+    server.server_update();
+    if (server.is_time_to_send(200))
+    {
+      snprintf(frame, sizeof(frame), "isAlive=1;Xac=0.0012;Yac=-0.0008;Zac=0.9987;Xan=0.12;Yan=-0.05;Zan=182.30;"
+                                     "Xve=0.001;Yve=0.002;Zve=0.000;Tmp=12.50;Tsv=%u", (unsigned int)millis());
+      server.send_data(frame, 200);
+      framesSent++;
+    }
+    server.report_tx();
+    server.get_link_quality()->report();
+
+    // Clients : read all the frames, the first one sends its alarm state with the keepalive
+    for (uint8_t i=0; i<clientCount; i++)
+    {
+      hostRole = clientRoles[i];
+      if (i == 0)
+        clients[i]->set_alarm_state(1, 0);
+      clients[i]->client_update();
+      while (clients[i]->read_data(false)[0] != '\0')
+        framesReceived[i]++;
+      clients[i]->get_link_quality()->report();
+    }
+
+    usleep(10000);
+  }
+
+  struct strWifiTxStats tx = server.get_tx_stats();
+  uint8_t alarmState, alarmStatus;
+  server.get_alarm_state(&alarmState, &alarmStatus);
+
+  printf("---- frames sent=%u dropped=%u stalls=%u depth max=%u peers=%u | alarm at server=%u,%u\n", framesSent,
+         tx.dataDropped, tx.controlStalls, tx.queueDepthMax, tx.peers, alarmState, alarmStatus);
+
+  // Only the last client is stalled, and only if the window is within the run
+  bool isLastStalled = (stallDuration_ms > 0) && (stallStart_ms < duration_ms);
+  int unhealthy = 0;
+
+  for (uint8_t i=0; i<clientCount; i++)
+  {
+    struct strLinkQuality quality = clients[i]->get_link_quality()->get_data();
+    bool isHealthy = (i < clientCount-1) || (isLastStalled == false);
+    bool isMissing = (isHealthy == true) && (framesReceived[i] < framesSent);
+
+    printf("---- client %u : received=%u round trip=%.1fms jitter=%.1fms loss=%.1f%% health=%u%s\n", i, framesReceived[i],
+           quality.rtt_us / 1000.0, quality.jitter_us / 1000.0, quality.loss_percent, quality.health,
+           (isMissing == true) ? " -> FAIL, frames missed by a healthy client" : "");
+    unhealthy += (isMissing == true) ? 1 : 0;
+    delete clients[i];
+  }
+
+  return unhealthy;
+}
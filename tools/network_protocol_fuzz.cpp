@@ -0,0 +1,264 @@
+/*********************************************************************************************************************
+ * Project : Astro Alarm
+ * Author  : PEB <pebdev@lavache.com> 
+ * Date    : 2024.01.18
+ *********************************************************************************************************************
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ * 
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *********************************************************************************************************************/
+
+
+/** I N C L U D E S **************************************************************************************************/
+// Fuzz target of the decoder of networkProtocol.h, built with libFuzzer :
+//   clang++ -g -O1 -fsanitize=fuzzer,address,undefined -DNETWORK_FUZZ_LIBFUZZER -o network_protocol_fuzz tools/network_protocol_fuzz.cpp
+//   ./network_protocol_fuzz -max_len=512 corpus/
+// Without libFuzzer, the same checks run on the given files, or on the built-in frames and on deterministic mutations :
+//   g++ -g -O1 -fsanitize=address,undefined -o network_protocol_fuzz tools/network_protocol_fuzz.cpp
+//   ./network_protocol_fuzz [files]
+// A frame accepted by the decoder must hold finite values within the sensor ranges, and must still be accepted once
+// encoded again. Any violation aborts (crash of the fuzzer), the exit code of the replay is the number of failures.
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+
+/** A R D U I N O  S H I M S *****************************************************************************************/
+using std::abs;
+using std::max;
+using std::min;
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+unsigned long millis (void)
+{
+  return 0;
+}
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+unsigned long micros (void)
+{
+  return 0;
+}
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+struct SerialShim
+{
+  template <typename T> void print (T _value)    { (void)_value; }
+  template <typename T> void println (T _value)  { (void)_value; }
+  void printf (const char* _format, ...)         { (void)_format; }
+} Serial;
+
+#include "../inclinometer.h"
+#include "../networkProtocol.h"
+
+
+/** F U Z Z  T A R G E T *********************************************************************************************/
+/*-------------------------------------------------------------------------------------------------------------------*/
+// @brief Check the values of an accepted frame
+// @param _data : decoded frame
+// @return true if every value is finite and within its range
+/*-------------------------------------------------------------------------------------------------------------------*/
+bool is_frame_valid (const struct strComData& _data)
+{
+  const double values[][2] = {
+    {_data.incAcceleration.acceleration[0],  COM_DATA_RANGE_ACCELERATION},
+    {_data.incAcceleration.acceleration[1],  COM_DATA_RANGE_ACCELERATION},
+    {_data.incAcceleration.acceleration[2],  COM_DATA_RANGE_ACCELERATION},
+    {_data.incAngular.angle[0],              COM_DATA_RANGE_ANGLE},
+    {_data.incAngular.angle[1],              COM_DATA_RANGE_ANGLE},
+    {_data.incAngular.angle[2],              COM_DATA_RANGE_ANGLE},
+    {_data.inclAngularVelocity.velocity[0],  COM_DATA_RANGE_VELOCITY},
+    {_data.inclAngularVelocity.velocity[1],  COM_DATA_RANGE_VELOCITY},
+    {_data.inclAngularVelocity.velocity[2],  COM_DATA_RANGE_VELOCITY},
+    {_data.incAcceleration.temperature,      COM_DATA_RANGE_TEMPERATURE},
+  };
+
+  for (const auto& value : values)
+  {
+    if ((!std::isfinite(value[0])) || (abs(value[0]) > value[1]))
+      return false;
+  }
+
+  return (_data.sensorHealth <= COM_DATA_RANGE_SENSOR_HEALTH);
+}
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+// @brief Decode one input and check the decoder invariants
+// @param _input  : raw input, not null terminated
+// @param _length : size of the input
+// @return true if the invariants hold
+/*-------------------------------------------------------------------------------------------------------------------*/
+bool check_input (const uint8_t* _input, size_t _length)
+{
+  static char frame[2*COM_DATA_FRAME_SIZE+1];
+  char encoded[COM_DATA_FRAME_SIZE];
+
+  // The wifi manager gives null terminated lines, longer inputs are cut like an oversized line
+  _length = min(_length, sizeof(frame) - 1);
+  memcpy(frame, _input, _length);
+  frame[_length] = '\0';
+
+  struct strComData decoded = network_parse_data(frame);
+  if (decoded.error > COM_DATA_ERROR_INCOMPLETE)
+    return false;
+  if (decoded.error != COM_DATA_ERROR_NONE)
+    return true;
+  if (is_frame_valid(decoded) == false)
+    return false;
+
+  // Round trip : the frame sent by the server for these values must be accepted
+  if (network_prepare_data(decoded, encoded, sizeof(encoded)) == 0)
+    return false;
+
+  return (network_parse_data(encoded).error == COM_DATA_ERROR_NONE);
+}
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+extern "C" int LLVMFuzzerTestOneInput (const uint8_t* _data, size_t _size)
+{
+  if (check_input(_data, _size) == false)
+    abort();
+
+  return 0;
+}
+
+
+#ifndef NETWORK_FUZZ_LIBFUZZER
+/** R E P L A Y ******************************************************************************************************/
+// Frames of the server, as read by the client ("\r" left by println on the TCP link)
+const char* replaySeeds[] = {
+  "isAlive=1;Xac=0.0012;Yac=-0.0153;Zac=0.9981;Xan=0.42;Yan=-0.87;Zan=182.00;Xve=0.012;Yve=-0.004;Zve=0.000;Tmp=12.50;Tsv=123456;Sen=1",
+  "isAlive=1;Xac=0.0012;Yac=-0.0153;Zac=0.9981;Xan=0.42;Yan=-0.87;Zan=182.00;Xve=0.012;Yve=-0.004;Zve=0.000;Tmp=12.50;Tsv=123456;Sen=1\r",
+  "isAlive=1;Xac=0.0012;Yac=-0.0153;Zac=0.9981;Xan=0.42;Yan=-0.87;Zan=182.00;Xve=0.012;Yve=-0.004;Zve=0.000;Tmp=12.50\r",
+};
+
+uint32_t replayState = 0x20240118;
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+uint32_t replay_random (uint32_t _max)
+{
+  replayState ^= replayState << 13;
+  replayState ^= replayState >> 17;
+  replayState ^= replayState << 5;
+
+  return (_max == 0) ? 0 : (replayState % _max);
+}
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+int main (int _argc, char** _argv)
+{
+  static const char* dictionary[] = {";", "=", "\r", "\n", " ", "nan", "inf", "-", "1e999", "0x1p4", "Xac=", "Sen=9"};
+  uint8_t input[2*COM_DATA_FRAME_SIZE];
+  uint32_t inputs = 0;
+  int failures = 0;
+
+  // Given files, one input each
+  for (int i=1; i<_argc; i++)
+  {
+    FILE* file = fopen(_argv[i], "rb");
+    if (file == NULL)
+    {
+      perror(_argv[i]);
+      return 1;
+    }
+
+    size_t length = fread(input, 1, sizeof(input), file);
+    fclose(file);
+    inputs++;
+    if (check_input(input, length) == false)
+    {
+      printf("FAIL : %s\n", _argv[i]);
+      failures++;
+    }
+  }
+  if (_argc > 1)
+  {
+    printf("%u inputs, %d failures\n", (unsigned int)inputs, failures);
+    return failures;
+  }
+
+  // The valid frames must be accepted
+  for (const char* seed : replaySeeds)
+  {
+    inputs++;
+    if (network_parse_data(seed).error != COM_DATA_ERROR_NONE)
+    {
+      printf("FAIL : frame rejected : %s\n", seed);
+      failures++;
+    }
+  }
+
+  // Deterministic mutations of the valid frames
+  for (uint32_t i=0; i<200000; i++)
+  {
+    const char* seed = replaySeeds[replay_random(sizeof(replaySeeds) / sizeof(replaySeeds[0]))];
+    size_t length = strlen(seed);
+    uint8_t mutations = 1 + replay_random(4);
+
+    memcpy(input, seed, length);
+    for (uint8_t m=0; m<mutations; m++)
+    {
+      size_t position = replay_random(length + 1);
+
+      switch (replay_random(4))
+      {
+        case 0:
+          length = position;
+          break;
+
+        case 1:
+          if (position < length)
+            input[position] ^= (1 << replay_random(8));
+          break;
+
+        case 2:
+        {
+          const char* word = dictionary[replay_random(sizeof(dictionary) / sizeof(dictionary[0]))];
+          size_t wordLength = strlen(word);
+
+          if ((length + wordLength) <= sizeof(input))
+          {
+            memmove(&input[position+wordLength], &input[position], length - position);
+            memcpy(&input[position], word, wordLength);
+            length += wordLength;
+          }
+          break;
+        }
+
+        default:
+        {
+          size_t count = min((size_t)replay_random(8), length - position);
+
+          memmove(&input[position], &input[position+count], length - position - count);
+          length -= count;
+          break;
+        }
+      }
+    }
+
+    inputs++;
+    if (check_input(input, length) == false)
+    {
+      printf("FAIL : mutation %u\n", (unsigned int)i);
+      failures++;
+    }
+  }
+
+  printf("%u inputs, %d failures\n", (unsigned int)inputs, failures);
+  return min(failures, 125);
+}
+#endif
@@ -0,0 +1,87 @@
+/*********************************************************************************************************************
+ * Project : Astro Alarm
+ * Author  : PEB <pebdev@lavache.com> 
+ * Date    : 2024.01.18
+ *********************************************************************************************************************
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ * 
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *********************************************************************************************************************/
+
+
+/** I N C L U D E S **************************************************************************************************/
+// Linux host harness of pixelKernels.h : the kernels are checked bit for bit against their reference, and the frame
+// composition is measured.
+//   g++ -O2 -o pixel_kernels_host tools/pixel_kernels_host.cpp
+//   ./pixel_kernels_host
+// The exit code is the number of mismatches. A "cycle" of the host is one nanosecond.
+#include <algorithm>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+
+/** A R D U I N O  S H I M S *****************************************************************************************/
+using std::max;
+using std::min;
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+uint32_t getCpuFrequencyMhz (void)
+{
+  return 1000;
+}
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+struct EspShim
+{
+  uint32_t getCycleCount (void)
+  {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t)((uint64_t)now.tv_sec * 1000000000 + now.tv_nsec);
+  }
+} ESP;
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+struct SerialShim
+{
+  void println (const char* _text)
+  {
+    printf("%s\n", _text);
+  }
+
+  void printf (const char* _format, ...)
+  {
+    va_list args;
+
+    va_start(args, _format);
+    vprintf(_format, args);
+    va_end(args);
+  }
+} Serial;
+
+#include "../pixelKernels.h"
+#include "../pixelBenchmark.h"
+
+
+/** M A I N  F U N C T I O N S ***************************************************************************************/
+/*-------------------------------------------------------------------------------------------------------------------*/
+int main (void)
+{
+  PixelBenchmark pixelBenchmark;
+
+  return (int)min(pixelBenchmark.run(), (uint32_t)125);
+}
@@ -0,0 +1,474 @@
+/*********************************************************************************************************************
+ * Project : Astro Alarm
+ * Author  : PEB <pebdev@lavache.com> 
+ * Date    : 2024.01.18
+ *********************************************************************************************************************
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ * 
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *********************************************************************************************************************/
+
+
+/** I N C L U D E S **************************************************************************************************/
+// Linux host harness of transportTcp.h : a server board (WifiManager over the TCP backend) sends its data frames to a
+// subscriber over a loopback TCP connection
+//   g++ -O2 -o tcp_transport_host tools/tcp_transport_host.cpp
+//   ./tcp_transport_host [frames] [send_buffer]    (default : 200 4096, up to 300 frames : a longer stall exceeds the
+//                                                  control queue of the server, which closes the connection)
+// The socket of the server gets the given send buffer, like the lwIP one (TCP_SND_BUF). The subscriber first stops reading while the
+// frames are sent : no call may block, the frames which do not fit are dropped, and some lines must be cut by partial
+// writes. Then it reads again : the newest frame must be received, and every received frame unaltered, the cut ones
+// included. Finally the same number of frames is sent while the subscriber reads every loop, none may be dropped.
+// Nagle's algorithm must be disabled on the socket. The exit code is the number of errors.
+#include <algorithm>
+#include <cerrno>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <csignal>
+#include <ctime>
+#include <string>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <linux/sockios.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+
+/** A R D U I N O  S H I M S *****************************************************************************************/
+using std::max;
+using std::min;
+
+// Simulated time, in us : the liveness and keepalive timers follow the loops, not the speed of the host
+int64_t hostTime_us = 0;
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+int64_t esp_timer_get_time (void)
+{
+  return hostTime_us;
+}
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+unsigned long millis (void)
+{
+  return (unsigned long)(hostTime_us / 1000);
+}
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+bool hostVerbose = false;
+
+struct SerialShim
+{
+  template <typename T> void print (T _value)     { if (hostVerbose == true) this->show(_value, ""); }
+  template <typename T> void println (T _value)   { if (hostVerbose == true) this->show(_value, "\n"); }
+  void show (const char* _text, const char* _end) { ::printf("%s%s", _text, _end); }
+  void show (unsigned long _value, const char* _end) { ::printf("%lu%s", _value, _end); }
+  void show (int _value, const char* _end)        { ::printf("%d%s", _value, _end); }
+  void show (unsigned int _value, const char* _end) { ::printf("%u%s", _value, _end); }
+
+  void printf (const char* _format, ...)
+  {
+    va_list args;
+
+    if (hostVerbose == false)
+      return;
+    va_start(args, _format);
+    vprintf(_format, args);
+    va_end(args);
+  }
+} Serial;
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+struct BootTimeline
+{
+  static void mark (const char* _name) { (void)_name; }
+};
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+// Settings of wifi_info.h, the port of the server is chosen by the kernel
+const char* wifi_ssid = "host";
+const char* wifi_key = "";
+const char* wifi_ip_server = "127.0.0.1";
+uint16_t wifi_port = 0;
+
+#define WL_CONNECTED                  (3)
+
+struct WiFiShim
+{
+  void begin (const char* _ssid, const char* _key) { (void)_ssid; (void)_key; }
+  int status (void)                                { return WL_CONNECTED; }
+  int8_t RSSI (void)                               { return -60; }
+  void reconnect (void)                            {}
+} WiFi;
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+class WiFiClient
+{
+private:
+  int socketFd;
+
+public:
+  WiFiClient (int _fd = -1) : socketFd(_fd) {}
+  int fd (void) const { return this->socketFd; }
+  explicit operator bool (void) const { return (this->socketFd >= 0); }
+
+  bool connected (void)
+  {
+    char c;
+
+    if (this->socketFd < 0)
+      return false;
+    return (recv(this->socketFd, &c, 1, MSG_PEEK | MSG_DONTWAIT) != 0);
+  }
+
+  void setNoDelay (bool _enable)
+  {
+    int enable = (_enable == true) ? 1 : 0;
+    setsockopt(this->socketFd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+  }
+
+  int connect (const char* _ip, uint16_t _port)
+  {
+    (void)_ip;
+    (void)_port;
+    return 0;
+  }
+
+  void stop (void)
+  {
+    if (this->socketFd >= 0)
+      ::close(this->socketFd);
+    this->socketFd = -1;
+  }
+};
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+// Listening socket on the loopback, the send buffer of the board is emulated by HostTransport
+int hostSendBuffer = 4096;
+int hostServerFd = -1;
+
+class WiFiServer
+{
+private:
+  int listenFd;
+
+public:
+  WiFiServer (uint16_t _port = 0) : listenFd(-1) { (void)_port; }
+
+  void begin (void)
+  {
+    struct sockaddr_in address;
+    socklen_t length = sizeof(address);
+
+    this->listenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    memset(&address, 0, sizeof(address));
+    address.sin_family      = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port        = 0;
+
+    if ((bind(this->listenFd, (struct sockaddr*)&address, sizeof(address)) != 0) || (listen(this->listenFd, 4) != 0))
+    {
+      perror("bind");
+      exit(1);
+    }
+    getsockname(this->listenFd, (struct sockaddr*)&address, &length);
+    wifi_port = ntohs(address.sin_port);
+  }
+
+  void end (void)
+  {
+    ::close(this->listenFd);
+    this->listenFd = -1;
+  }
+
+  WiFiClient available (void)
+  {
+    int fd = accept4(this->listenFd, NULL, NULL, SOCK_NONBLOCK);
+
+    if (fd >= 0)
+      hostServerFd = fd;
+    return WiFiClient(fd);
+  }
+};
+
+#include "../clockSync.h"
+#include "../linkQuality.h"
+#include "../transport.h"
+#include "../transportTcp.h"
+#include "../wifiManager.h"
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+// Backend of the server : lwIP accepts the bytes which fit in its send buffer, Linux accounts whole buffers per write
+// and rarely cuts a short line. The write is limited to the free bytes of the send buffer, as on the board, and the
+// partial writes are counted.
+class HostTransport : public TransportTcp
+{
+public:
+  uint32_t partialWrites = 0;
+
+  int write (uint8_t _peer, const uint8_t* _data, uint16_t _length)
+  {
+    int queued = 0;
+
+    ioctl(hostServerFd, SIOCOUTQ, &queued);
+    int sent = TransportTcp::write(_peer, _data, min((int)_length, max(hostSendBuffer - queued, 0)));
+
+    if ((sent > 0) && (sent < _length))
+      this->partialWrites++;
+    return sent;
+  }
+};
+
+
+/** S U B S C R I B E R **********************************************************************************************/
+#define HOST_LOOP_MS                  (10)
+#define HOST_DRAIN_LOOPS              (100)
+#define HOST_KEEPALIVE_LOOPS          (100)     // Loops between two keepalives of the subscriber, when it reads
+#define HOST_CALL_MAX_US              (50000)   // Longest update or send allowed, a blocking write waits forever
+
+uint32_t hostPrngState = 0x20240118;
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+// @brief Deterministic pseudo random number (xorshift32)
+// @param _max : exclusive upper bound
+// @return value in [0;_max[
+/*-------------------------------------------------------------------------------------------------------------------*/
+uint32_t host_random (uint32_t _max)
+{
+  hostPrngState ^= hostPrngState << 13;
+  hostPrngState ^= hostPrngState >> 17;
+  hostPrngState ^= hostPrngState << 5;
+
+  return hostPrngState % _max;
+}
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+// @brief Provide the real time, to measure the calls
+// @return time in us
+/*-------------------------------------------------------------------------------------------------------------------*/
+int64_t host_real_time_us (void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+// Subscriber : a raw socket with a small receive buffer, the lines are rebuilt from the bytes
+struct strHostSubscriber
+{
+  int fd;
+  uint32_t keepalives;
+  std::string pending;                  // Bytes of the line being received
+  std::vector<std::string> lines;       // Data lines received, the control lines are ignored
+};
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+// @brief Connect a subscriber to the server
+// @param _subscriber : subscriber
+/*-------------------------------------------------------------------------------------------------------------------*/
+void host_connect (struct strHostSubscriber* _subscriber)
+{
+  struct sockaddr_in address;
+  int size = 2048;
+
+  _subscriber->fd         = socket(AF_INET, SOCK_STREAM, 0);
+  _subscriber->keepalives = 0;
+  setsockopt(_subscriber->fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+  memset(&address, 0, sizeof(address));
+  address.sin_family      = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port        = htons(wifi_port);
+
+  if (connect(_subscriber->fd, (struct sockaddr*)&address, sizeof(address)) != 0)
+  {
+    perror("connect");
+    exit(1);
+  }
+}
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+// @brief Read all the bytes waiting in the socket of the subscriber, without blocking, and send its keepalive from
+//        time to time so that the server keeps the connection
+// @param _subscriber : subscriber
+/*-------------------------------------------------------------------------------------------------------------------*/
+void host_read (struct strHostSubscriber* _subscriber)
+{
+  char data[512];
+  int length;
+
+  if ((millis() / HOST_LOOP_MS) >= ((_subscriber->keepalives + 1) * HOST_KEEPALIVE_LOOPS))
+  {
+    length = snprintf(data, sizeof(data), LINK_QUALITY_KEEPALIVE "seq=%u;t=%lld;data=0\r\n", _subscriber->keepalives++,
+                      (long long)hostTime_us);
+    send(_subscriber->fd, data, length, 0);
+  }
+
+  while ((length = recv(_subscriber->fd, data, sizeof(data), MSG_DONTWAIT)) > 0)
+  {
+    for (int i=0; i<length; i++)
+    {
+      if (data[i] == '\r')
+        continue;
+
+      if (data[i] != '\n')
+      {
+        _subscriber->pending += data[i];
+        continue;
+      }
+
+      if (strncmp(_subscriber->pending.c_str(), "frame=", strlen("frame=")) == 0)
+        _subscriber->lines.push_back(_subscriber->pending);
+      _subscriber->pending.clear();
+    }
+  }
+}
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+// @brief Run one loop of the server, the time of each call is measured
+// @param _server   : server board
+// @param _frame    : data frame to send, empty for none
+// @param _max_us   : longest call so far, updated
+/*-------------------------------------------------------------------------------------------------------------------*/
+void host_loop (WifiManager* _server, const std::string& _frame, int64_t* _max_us)
+{
+  int64_t start_us = host_real_time_us();
+
+  hostTime_us += HOST_LOOP_MS * 1000;
+  _server->server_update();
+  if (_frame.empty() == false)
+    _server->send_data(_frame.c_str(), 0);
+
+  *_max_us = max(*_max_us, host_real_time_us() - start_us);
+}
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+// @brief Check the frames received by a subscriber : each one unaltered, in order, without duplicate
+// @param _subscriber : subscriber
+// @param _frames     : sent frames
+// @return number of errors
+/*-------------------------------------------------------------------------------------------------------------------*/
+uint32_t host_check_lines (struct strHostSubscriber* _subscriber, const std::vector<std::string>& _frames)
+{
+  uint32_t errors = 0;
+  int64_t previous = -1;
+
+  for (size_t i=0; i<_subscriber->lines.size(); i++)
+  {
+    const std::string& line = _subscriber->lines[i];
+    int64_t frame = atoi(&line[strlen("frame=")]);
+
+    if ((frame >= (int64_t)_frames.size()) || (_frames[frame] != line) || (frame <= previous))
+      errors++;
+    previous = frame;
+  }
+
+  return errors;
+}
+
+
+/** M A I N  F U N C T I O N S ***************************************************************************************/
+/*-------------------------------------------------------------------------------------------------------------------*/
+int main (int _argc, char** _argv)
+{
+  uint32_t frameCount = (_argc > 1) ? atoi(_argv[1]) : 200;
+  std::vector<std::string> frames;
+  struct strHostSubscriber subscriber;
+  int64_t maxCall_us = 0;
+  uint32_t errors = 0;
+  HostTransport transport;
+  WifiManager server(&transport);
+
+  if (_argc > 2)
+    hostSendBuffer = atoi(_argv[2]);
+
+  // Like lwIP, a write to a closed connection returns an error instead of raising a signal
+  signal(SIGPIPE, SIG_IGN);
+
+  // One frame per loop, from 40 to 239 characters
+  for (uint32_t i=0; i<(2 * frameCount); i++)
+  {
+    char head[32];
+    uint32_t length = 40 + host_random(200);
+    snprintf(head, sizeof(head), "frame=%u;", (unsigned int)i);
+    frames.push_back(head + std::string(length - strlen(head), 'a' + (i % 26)));
+  }
+
+  // The server starts, then accepts the subscriber
+  server.start();
+  host_loop(&server, "", &maxCall_us);
+  host_connect(&subscriber);
+  for (uint32_t loop=0; (loop<100) && (hostServerFd < 0); loop++)
+  {
+    usleep(1000);
+    host_loop(&server, "", &maxCall_us);
+  }
+
+  int noDelay = 0;
+  socklen_t optionSize = sizeof(noDelay);
+  getsockopt(hostServerFd, IPPROTO_TCP, TCP_NODELAY, &noDelay, &optionSize);
+  errors += (noDelay == 1) ? 0 : 1;
+
+  // Stalled subscriber : every frame is given to the server, which must not block
+  for (uint32_t i=0; i<frameCount; i++)
+    host_loop(&server, frames[i], &maxCall_us);
+
+  struct strWifiTxStats stalled = server.get_tx_stats();
+  uint32_t partialWrites = transport.partialWrites;
+
+  // The subscriber reads again : the lines cut by the partial writes are completed, then the newest frame is sent
+  for (uint32_t loop=0; loop<HOST_DRAIN_LOOPS; loop++)
+  {
+    host_loop(&server, "", &maxCall_us);
+    host_read(&subscriber);
+  }
+
+  uint32_t stalledReceived = subscriber.lines.size();
+  bool isNewestReceived = ((subscriber.lines.empty() == false) && (subscriber.lines.back() == frames[frameCount-1]));
+  uint32_t stalledErrors = host_check_lines(&subscriber, frames);
+  errors += stalledErrors + ((partialWrites > 0) ? 0 : 1) + ((isNewestReceived == true) ? 0 : 1);
+
+  // Subscriber reading every loop : nothing is dropped
+  for (uint32_t i=frameCount; i<(2 * frameCount); i++)
+  {
+    host_loop(&server, frames[i], &maxCall_us);
+    host_read(&subscriber);
+  }
+  for (uint32_t loop=0; loop<HOST_DRAIN_LOOPS; loop++)
+  {
+    host_loop(&server, "", &maxCall_us);
+    host_read(&subscriber);
+  }
+
+  struct strWifiTxStats reading = server.get_tx_stats();
+  uint32_t readingReceived = subscriber.lines.size() - stalledReceived;
+  uint32_t readingDropped = reading.dataDropped - stalled.dataDropped;
+  uint32_t readingErrors = host_check_lines(&subscriber, frames) - stalledErrors;
+  errors += readingErrors + ((readingReceived == frameCount) ? 0 : 1) + ((readingDropped == 0) ? 0 : 1);
+  errors += (reading.peers == 1) ? 0 : 1;
+  errors += (maxCall_us < HOST_CALL_MAX_US) ? 0 : 1;
+
+  printf("TCP : send buffer=%d TCP_NODELAY=%d, longest call=%lld us\n", hostSendBuffer, noDelay, (long long)maxCall_us);
+  printf("TCP : stalled reader, frames=%u dropped=%u partial writes=%u, received=%u newest=%s errors=%u\n", frameCount,
+         stalled.dataDropped, partialWrites, stalledReceived, (isNewestReceived == true) ? "yes" : "no", stalledErrors);
+  printf("TCP : reading subscriber, frames=%u received=%u dropped=%u errors=%u, connected=%u -> %s\n", frameCount,
+         readingReceived, readingDropped, readingErrors, reading.peers, (errors == 0) ? "OK" : "FAIL");
+
+  ::close(subscriber.fd);
+  return (int)min(errors, (uint32_t)125);
+}
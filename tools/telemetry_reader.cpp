@@ -0,0 +1,385 @@
+/*********************************************************************************************************************
+ * Project : Astro Alarm
+ * Author  : PEB <pebdev@lavache.com> 
+ * Date    : 2024.01.18
+ *********************************************************************************************************************
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ * 
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *********************************************************************************************************************/
+
+
+/** I N C L U D E S **************************************************************************************************/
+// Linux host tool : g++ -O2 -o telemetry_reader tools/telemetry_reader.cpp
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <csignal>
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "../telemetryStream.h"
+
+
+/** D E F I N E S ****************************************************************************************************/
+#define READER_BUFFER_SIZE      (4096)
+#define READER_DEFAULT_PREFIX   "telemetry"
+
+
+/** D E C L A R A T I O N S ******************************************************************************************/
+volatile sig_atomic_t isRunning = 1;
+
+
+/** D E C O D E R ****************************************************************************************************/
+class TelemetryDecoder
+{
+private:
+  uint8_t frame[TELEMETRY_FRAME_SIZE];
+  uint16_t frameLength;
+  bool isSequenceKnown;
+  uint16_t nextSequence;
+
+  // Outputs
+  FILE* samplesFile;
+  FILE* alarmFile;
+  FILE* linkFile;
+  FILE* binaryFile;
+
+
+public:
+  // Statistics
+  uint32_t frames;
+  uint32_t crcErrors;
+  uint32_t lostFrames;
+  uint32_t skippedBytes;
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Constructor
+  // @param _prefix : prefix of the CSV files, NULL to disable them
+  // @param _binary : binary file which receives the valid frames, NULL to disable it
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  TelemetryDecoder (const char* _prefix, const char* _binary)
+  {
+    this->frameLength     = 0;
+    this->isSequenceKnown = false;
+    this->nextSequence    = 0;
+    this->frames          = 0;
+    this->crcErrors       = 0;
+    this->lostFrames      = 0;
+    this->skippedBytes    = 0;
+    this->samplesFile     = NULL;
+    this->alarmFile       = NULL;
+    this->linkFile        = NULL;
+    this->binaryFile      = NULL;
+
+    if (_prefix != NULL)
+    {
+      this->samplesFile = this->open_csv(_prefix, "samples", "sequence,timestamp_ms,source,acc_x_g,acc_y_g,acc_z_g,vel_x_dps,vel_y_dps,vel_z_dps,angle_x_deg,angle_y_deg,angle_z_deg,temperature_c");
+      this->alarmFile   = this->open_csv(_prefix, "alarm", "sequence,timestamp_ms,state,status,trigger");
+      this->linkFile    = this->open_csv(_prefix, "link", "sequence,timestamp_ms,app_status,rssi_dbm,clock_synced,clock_offset_us,dropped_records");
+    }
+
+    if (_binary != NULL)
+    {
+      this->binaryFile = fopen(_binary, "wb");
+      if (this->binaryFile == NULL)
+        perror(_binary);
+    }
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Destructor, outputs are closed
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  ~TelemetryDecoder (void)
+  {
+    FILE* files[] = {this->samplesFile, this->alarmFile, this->linkFile, this->binaryFile};
+
+    for (FILE* file : files)
+    {
+      if (file != NULL)
+        fclose(file);
+    }
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Decode received bytes, text lines printed by the board between the frames are skipped
+  // @param _data   : received bytes
+  // @param _length : number of bytes
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void decode (const uint8_t* _data, size_t _length)
+  {
+    for (size_t i=0; i<_length; i++)
+    {
+      this->frame[this->frameLength++] = _data[i];
+
+      // Sync bytes
+      if ((this->frameLength == 1) && (this->frame[0] != TELEMETRY_SYNC_0))
+      {
+        this->frameLength = 0;
+        this->skippedBytes++;
+        continue;
+      }
+      if ((this->frameLength == 2) && (this->frame[1] != TELEMETRY_SYNC_1))
+      {
+        this->resync();
+        continue;
+      }
+
+      // Header, the payload length is known
+      if ((this->frameLength == 4) && (this->frame[3] > TELEMETRY_MAX_PAYLOAD_SIZE))
+      {
+        this->resync();
+        continue;
+      }
+      if ((this->frameLength < TELEMETRY_HEADER_SIZE) || (this->frameLength < TELEMETRY_HEADER_SIZE + this->frame[3] + TELEMETRY_CRC_SIZE))
+        continue;
+
+      // Full frame
+      uint8_t length = this->frame[3];
+      uint16_t crc = this->frame[TELEMETRY_HEADER_SIZE + length] | (this->frame[TELEMETRY_HEADER_SIZE + length + 1] << 8);
+      if (telemetry_crc16(0xFFFF, &this->frame[2], TELEMETRY_HEADER_SIZE - 2 + length) != crc)
+      {
+        this->crcErrors++;
+        this->resync();
+        continue;
+      }
+
+      this->process_frame();
+      this->frameLength = 0;
+    }
+  }
+
+
+private:
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Open a CSV output
+  // @param _prefix : prefix of the file name
+  // @param _name   : name of the record
+  // @param _header : first line of the file
+  // @return file, NULL on error
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  FILE* open_csv (const char* _prefix, const char* _name, const char* _header)
+  {
+    char path[512];
+
+    snprintf(path, sizeof(path), "%s_%s.csv", _prefix, _name);
+    FILE* file = fopen(path, "w");
+    if (file == NULL)
+    {
+      perror(path);
+      return NULL;
+    }
+
+    fprintf(file, "%s\n", _header);
+    return file;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Drop the first byte of the current frame and search the next sync bytes in the remaining ones
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void resync (void)
+  {
+    uint16_t start = 1;
+
+    while ((start < this->frameLength) && (this->frame[start] != TELEMETRY_SYNC_0))
+      start++;
+
+    // The kept bytes are checked again
+    uint8_t pending[TELEMETRY_FRAME_SIZE];
+    uint16_t pendingLength = this->frameLength - start;
+    memcpy(pending, &this->frame[start], pendingLength);
+    this->skippedBytes += start;
+    this->frameLength   = 0;
+    this->decode(pending, pendingLength);
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Write a valid frame to the outputs
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void process_frame (void)
+  {
+    uint8_t type = this->frame[2];
+    uint8_t length = this->frame[3];
+    uint16_t sequence = this->frame[4] | (this->frame[5] << 8);
+    const uint8_t* payload = &this->frame[TELEMETRY_HEADER_SIZE];
+
+    // Sequence gaps are the frames dropped by the board or corrupted on the way
+    if (this->isSequenceKnown == true)
+      this->lostFrames += (uint16_t)(sequence - this->nextSequence);
+    this->isSequenceKnown = true;
+    this->nextSequence    = sequence + 1;
+    this->frames++;
+
+    if (this->binaryFile != NULL)
+      fwrite(this->frame, 1, TELEMETRY_HEADER_SIZE + length + TELEMETRY_CRC_SIZE, this->binaryFile);
+
+    // Records can be longer when fields are added by a newer firmware
+    if ((type == TELEMETRY_RECORD_SAMPLE) && (length >= sizeof(strTelemetrySample)) && (this->samplesFile != NULL))
+    {
+      struct strTelemetrySample record;
+      memcpy(&record, payload, sizeof(record));
+      fprintf(this->samplesFile, "%u,%u,%u,%.5f,%.5f,%.5f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.2f\n",
+              sequence, record.timestamp_ms, record.source,
+              record.acceleration[0], record.acceleration[1], record.acceleration[2],
+              record.velocity[0], record.velocity[1], record.velocity[2],
+              record.angle[0], record.angle[1], record.angle[2], record.temperature);
+    }
+    else if ((type == TELEMETRY_RECORD_ALARM) && (length >= sizeof(strTelemetryAlarm)) && (this->alarmFile != NULL))
+    {
+      struct strTelemetryAlarm record;
+      memcpy(&record, payload, sizeof(record));
+      fprintf(this->alarmFile, "%u,%u,%u,%u,%u\n", sequence, record.timestamp_ms, record.state, record.status, record.trigger);
+    }
+    else if ((type == TELEMETRY_RECORD_LINK) && (length >= sizeof(strTelemetryLink)) && (this->linkFile != NULL))
+    {
+      struct strTelemetryLink record;
+      memcpy(&record, payload, sizeof(record));
+      this->write_link(sequence, record);
+    }
+    else if ((type == TELEMETRY_RECORD_LINK_V1) && (length >= 15) && (this->linkFile != NULL))
+    {
+      // Captures of the previous firmwares : same fields, 32 bits clock offset
+      struct strTelemetryLink record;
+      int32_t clockOffset_us;
+      memcpy(&record, payload, offsetof(strTelemetryLink, clockOffset_us));
+      memcpy(&clockOffset_us, &payload[offsetof(strTelemetryLink, clockOffset_us)], sizeof(clockOffset_us));
+      memcpy(&record.droppedRecords, &payload[offsetof(strTelemetryLink, clockOffset_us) + sizeof(clockOffset_us)], sizeof(record.droppedRecords));
+      record.clockOffset_us = clockOffset_us;
+      this->write_link(sequence, record);
+    }
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Write a link record, an unknown signal strength is an empty field
+  // @param _sequence : frame sequence
+  // @param _record   : link record
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void write_link (uint16_t _sequence, const struct strTelemetryLink& _record)
+  {
+    char rssi[8] = "";
+
+    if (_record.rssi_dBm != TELEMETRY_RSSI_UNKNOWN)
+      snprintf(rssi, sizeof(rssi), "%d", _record.rssi_dBm);
+
+    fprintf(this->linkFile, "%u,%u,%u,%s,%u,%lld,%u\n", _sequence, _record.timestamp_ms, _record.appStatus, rssi,
+            _record.isClockSynced, (long long)_record.clockOffset_us, _record.droppedRecords);
+  }
+};
+
+
+/** M A I N  F U N C T I O N S ***************************************************************************************/
+/*-------------------------------------------------------------------------------------------------------------------*/
+// @brief Stop the capture on Ctrl+C
+// @param _signal : received signal
+/*-------------------------------------------------------------------------------------------------------------------*/
+void stop_capture (int _signal)
+{
+  (void)_signal;
+  isRunning = 0;
+}
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+// @brief Configure a serial port in raw mode, the USB CDC speed is not limited by the baudrate
+// @param _fd : serial port
+// @return true on success
+/*-------------------------------------------------------------------------------------------------------------------*/
+bool configure_port (int _fd)
+{
+  struct termios tty;
+
+  if (tcgetattr(_fd, &tty) != 0)
+    return false;
+
+  cfmakeraw(&tty);
+  cfsetspeed(&tty, B115200);
+  tty.c_cc[VMIN]  = 0;
+  tty.c_cc[VTIME] = 2;    // Reads return every 200ms, to handle Ctrl+C
+
+  return (tcsetattr(_fd, TCSANOW, &tty) == 0);
+}
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+int main (int _argc, char** _argv)
+{
+  const char* input = NULL;
+  const char* prefix = READER_DEFAULT_PREFIX;
+  const char* binary = NULL;
+  uint8_t buffer[READER_BUFFER_SIZE];
+
+  for (int i=1; i<_argc; i++)
+  {
+    if ((strcmp(_argv[i], "-o") == 0) && (i+1 < _argc))
+      prefix = _argv[++i];
+    else if ((strcmp(_argv[i], "-b") == 0) && (i+1 < _argc))
+      binary = _argv[++i];
+    else if (strcmp(_argv[i], "-n") == 0)
+      prefix = NULL;
+    else if (input == NULL)
+      input = _argv[i];
+  }
+
+  if (input == NULL)
+  {
+    fprintf(stderr, "usage : %s <device|capture file> [-o csv prefix] [-n no csv] [-b binary capture]\n", _argv[0]);
+    fprintf(stderr, "        %s /dev/ttyACM0 -o session1 -b session1.bin\n", _argv[0]);
+    return 1;
+  }
+
+  int fd = open(input, O_RDWR | O_NOCTTY);
+  if (fd < 0)
+    fd = open(input, O_RDONLY);
+  if (fd < 0)
+  {
+    perror(input);
+    return 1;
+  }
+
+  // A device is asked to start the stream, a capture file is replayed
+  bool isDevice = (isatty(fd) == 1);
+  if (isDevice == true)
+  {
+    char command = TELEMETRY_COMMAND_START;
+    if ((configure_port(fd) == false) || (write(fd, &command, 1) != 1))
+    {
+      perror(input);
+      close(fd);
+      return 1;
+    }
+  }
+
+  signal(SIGINT, stop_capture);
+  TelemetryDecoder decoder(prefix, binary);
+
+  while (isRunning)
+  {
+    ssize_t length = read(fd, buffer, sizeof(buffer));
+    if (length > 0)
+      decoder.decode(buffer, length);
+    else if ((length < 0) || (isDevice == false))
+      break;
+  }
+
+  if (isDevice == true)
+  {
+    char command = TELEMETRY_COMMAND_STOP;
+    if (write(fd, &command, 1) != 1)
+      perror(input);
+  }
+  close(fd);
+
+  fprintf(stderr, "TELEMETRY : frames=%u lost=%u crc errors=%u skipped bytes=%u\n",
+          decoder.frames, decoder.lostFrames, decoder.crcErrors, decoder.skippedBytes);
+  return 0;
+}
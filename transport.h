@@ -0,0 +1,110 @@
+/*********************************************************************************************************************
+ * Project : Astro Alarm
+ * Author  : PEB <pebdev@lavache.com> 
+ * Date    : 2024.01.18
+ *********************************************************************************************************************
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ * 
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *********************************************************************************************************************/
+
+
+/** D E F I N E S ****************************************************************************************************/
+// Uncomment to link the boards directly with ESP-NOW, without router (the status page is not available)
+//#define CONFIG_TRANSPORT_ESPNOW                 (1)
+
+// Client and Server states
+#define CONNECTION_STATUS_APP_DISCONNECTED        (0)
+#define CONNECTION_STATUS_APP_CONNECTING          (1)
+#define CONNECTION_STATUS_APP_CONNECTED           (2)
+
+// Read : bytes were lost by the backend, the line being received is incomplete
+#define TRANSPORT_BYTES_LOST                      (-2)
+
+// Peers linked at the same time : the server accepts several subscribers (client boards, laptops), a client only has
+// the server (peer 0)
+#ifdef BOARD_WITH_SERVER_ROLE
+#define TRANSPORT_MAX_PEERS                       (4)
+#else
+#define TRANSPORT_MAX_PEERS                       (1)
+#endif
+
+
+/** T R A N S P O R T ************************************************************************************************/
+// Byte streams between the boards, used by WifiManager. The lines, the keepalives and the liveness are handled above,
+// a backend only establishes the links and moves the bytes without blocking. Each link uses a peer slot, from 0 to
+// TRANSPORT_MAX_PEERS-1.
+class Transport
+{
+public:
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Start the radio
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  virtual void start (void) = 0;
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Establish or check the links with the other boards
+  // @param _is_server : role of this board
+  // @return CONNECTION_STATUS_APP_CONNECTED if at least one peer is linked, otherwise
+  //         CONNECTION_STATUS_APP_DISCONNECTED | CONNECTION_STATUS_APP_CONNECTING
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  virtual uint8_t update (bool _is_server) = 0;
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Identify the link of a peer slot, a new link on the slot gets a new value
+  // @param _peer : peer slot
+  // @return 0 if the slot is free, otherwise the session of the link
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  virtual uint16_t session (uint8_t _peer) = 0;
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Drop the link with a peer (not alive anymore), the slot is reused by update
+  // @param _peer : peer slot
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  virtual void disconnect (uint8_t _peer) = 0;
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Close everything but the radio, before a role change
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  virtual void reset (void) = 0;
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Read the bytes received from a peer, without blocking
+  // @param _peer   : peer slot
+  // @param _buffer : output buffer
+  // @param _size   : size of the output buffer
+  // @return number of bytes read, 0 if nothing was received, TRANSPORT_BYTES_LOST if bytes were lost before the next
+  //         ones (packet backends), other negative values on error
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  virtual int read (uint8_t _peer, uint8_t* _buffer, uint16_t _size) = 0;
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Write bytes to a peer, without blocking
+  // @param _peer   : peer slot
+  // @param _data   : bytes to send
+  // @param _length : number of bytes
+  // @return number of bytes accepted, 0 if the backend is full, negative on error
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  virtual int write (uint8_t _peer, const uint8_t* _data, uint16_t _length) = 0;
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Provide the signal strength, the backend samples it at a low rate
+  // @return signal strength in dBm, LINK_QUALITY_RSSI_UNKNOWN if not available
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  virtual int8_t rssi (void) = 0;
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Provide the name of the backend, for the logs
+  // @return name
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  virtual const char* name (void) = 0;
+};
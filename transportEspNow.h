@@ -0,0 +1,487 @@
+/*********************************************************************************************************************
+ * Project : Astro Alarm
+ * Author  : PEB <pebdev@lavache.com> 
+ * Date    : 2024.01.18
+ *********************************************************************************************************************
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ * 
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *********************************************************************************************************************/
+
+
+/** I N C L U D E S **************************************************************************************************/
+#ifdef ARDUINO
+#include <WiFi.h>
+#include <esp_now.h>
+#include <esp_wifi.h>
+#include <esp_idf_version.h>
+#endif
+
+
+/** D E F I N E S ****************************************************************************************************/
+// Radio : both boards must use the same channel, there is no router
+#define TRANSPORT_ESPNOW_CHANNEL              (1)
+
+// Packets : header (magic, type, role, sequence) + bytes of the stream. The sequence counts the data packets, a
+// receiver which misses one drops the line being received, the radio does not retry forever.
+#define TRANSPORT_ESPNOW_MAGIC_0              ('A')
+#define TRANSPORT_ESPNOW_MAGIC_1              ('A')
+#define TRANSPORT_ESPNOW_TYPE_HELLO           ('H')     // Broadcasted until the other board is known
+#define TRANSPORT_ESPNOW_TYPE_DATA            ('D')     // First byte starts a line
+#define TRANSPORT_ESPNOW_TYPE_DATA_NEXT       ('N')     // First byte continues the line of the previous packet
+#define TRANSPORT_ESPNOW_ROLE_SERVER          ('S')
+#define TRANSPORT_ESPNOW_ROLE_CLIENT          ('C')
+#define TRANSPORT_ESPNOW_HEADER_SIZE          (5)
+#define TRANSPORT_ESPNOW_PAYLOAD_SIZE         (ESP_NOW_MAX_DATA_LEN - TRANSPORT_ESPNOW_HEADER_SIZE)
+
+// Link
+#define TRANSPORT_ESPNOW_HELLO_INTERVAL_MS    (200)
+#define TRANSPORT_ESPNOW_MAX_IN_FLIGHT        (4)       // Packets given to the driver and not yet acknowledged
+
+// Reception queue, size is a power of two
+#define TRANSPORT_ESPNOW_RX_QUEUE_SIZE        (8)
+
+
+/** S T R U C T S ****************************************************************************************************/
+struct strEspNowPacket
+{
+  uint8_t length;
+  bool isLineStart;       // TRANSPORT_ESPNOW_TYPE_DATA
+  bool isAfterGap;        // Packets were lost before this one
+  uint8_t data[TRANSPORT_ESPNOW_PAYLOAD_SIZE];
+};
+
+
+/** D E C L A R A T I O N S ******************************************************************************************/
+// Reception queue : written by the wifi task only (head), read by the loop only (tail)
+struct strEspNowPacket espNowRxPackets[TRANSPORT_ESPNOW_RX_QUEUE_SIZE];
+volatile uint8_t espNowRxHead         = 0;
+volatile uint8_t espNowRxTail         = 0;
+uint32_t espNowRxLost                 = 0;    // Packets dropped because the loop did not read the queue
+uint8_t espNowRxSequence              = 0;    // Sequence expected from the peer
+volatile bool isEspNowRxSequenceKnown = false;
+bool isEspNowRxGap                    = false; // A packet was dropped, the next queued one follows a gap
+
+// Other board : candidate found by the wifi task, peer set by the loop
+uint8_t espNowCandidate[ESP_NOW_ETH_ALEN];
+volatile bool isEspNowCandidateFound  = false;
+uint8_t espNowPeer[ESP_NOW_ETH_ALEN];
+volatile bool isEspNowPeerKnown       = false;
+volatile uint8_t espNowRole           = TRANSPORT_ESPNOW_ROLE_CLIENT;
+volatile int8_t espNowRssi_dBm        = LINK_QUALITY_RSSI_UNKNOWN;
+
+// Transmission
+volatile uint8_t espNowInFlight       = 0;
+uint32_t espNowSendFailed             = 0;    // Packets not acknowledged by the other board
+const uint8_t espNowBroadcast[ESP_NOW_ETH_ALEN] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+
+
+/** C A L L B A C K S ************************************************************************************************/
+/*-------------------------------------------------------------------------------------------------------------------*/
+// @brief [PRIVATE] Called by the wifi task for each received packet : packets of the other role are kept, the data
+//                  is queued only if it comes from the known peer
+// @param _mac    : address of the sender
+// @param _data   : packet
+// @param _length : size of the packet
+// @param _rssi   : signal strength of the packet
+/*-------------------------------------------------------------------------------------------------------------------*/
+void espnow_process_packet (const uint8_t* _mac, const uint8_t* _data, int _length, int8_t _rssi)
+{
+  if ((_length < TRANSPORT_ESPNOW_HEADER_SIZE) || (_data[0] != TRANSPORT_ESPNOW_MAGIC_0) || (_data[1] != TRANSPORT_ESPNOW_MAGIC_1))
+    return;
+
+  // A board of the same role is not a peer
+  if (_data[3] == espNowRole)
+    return;
+
+  if (__atomic_load_n(&isEspNowPeerKnown, __ATOMIC_ACQUIRE) == false)
+  {
+    if (__atomic_load_n(&isEspNowCandidateFound, __ATOMIC_ACQUIRE) == false)
+    {
+      memcpy(espNowCandidate, _mac, ESP_NOW_ETH_ALEN);
+      __atomic_store_n(&isEspNowCandidateFound, true, __ATOMIC_RELEASE);
+    }
+    return;
+  }
+
+  if (memcmp(_mac, espNowPeer, ESP_NOW_ETH_ALEN) != 0)
+    return;
+  espNowRssi_dBm = _rssi;
+
+  if (((_data[2] != TRANSPORT_ESPNOW_TYPE_DATA) && (_data[2] != TRANSPORT_ESPNOW_TYPE_DATA_NEXT)) || (_length == TRANSPORT_ESPNOW_HEADER_SIZE))
+    return;
+
+  // Packets not acknowledged after the retries of the radio are not sent again
+  if ((__atomic_load_n(&isEspNowRxSequenceKnown, __ATOMIC_ACQUIRE) == true) && (_data[4] != espNowRxSequence))
+    isEspNowRxGap = true;
+  espNowRxSequence = _data[4] + 1;
+  __atomic_store_n(&isEspNowRxSequenceKnown, true, __ATOMIC_RELEASE);
+
+  uint8_t head = espNowRxHead;
+  uint8_t next = (head + 1) & (TRANSPORT_ESPNOW_RX_QUEUE_SIZE - 1);
+
+  if (next == __atomic_load_n(&espNowRxTail, __ATOMIC_ACQUIRE))
+  {
+    espNowRxLost++;
+    isEspNowRxGap = true;
+    return;
+  }
+
+  espNowRxPackets[head].isLineStart = (_data[2] == TRANSPORT_ESPNOW_TYPE_DATA);
+  espNowRxPackets[head].isAfterGap  = isEspNowRxGap;
+  isEspNowRxGap                     = false;
+  espNowRxPackets[head].length      = _length - TRANSPORT_ESPNOW_HEADER_SIZE;
+  memcpy(espNowRxPackets[head].data, &_data[TRANSPORT_ESPNOW_HEADER_SIZE], espNowRxPackets[head].length);
+  __atomic_store_n(&espNowRxHead, next, __ATOMIC_RELEASE);
+}
+
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 0, 0)
+/*-------------------------------------------------------------------------------------------------------------------*/
+void espnow_receive (const esp_now_recv_info_t* _info, const uint8_t* _data, int _length)
+{
+  espnow_process_packet(_info->src_addr, _data, _length, _info->rx_ctrl->rssi);
+}
+#else
+/*-------------------------------------------------------------------------------------------------------------------*/
+void espnow_receive (const uint8_t* _mac, const uint8_t* _data, int _length)
+{
+  espnow_process_packet(_mac, _data, _length, LINK_QUALITY_RSSI_UNKNOWN);
+}
+#endif
+
+/*-------------------------------------------------------------------------------------------------------------------*/
+// @brief [PRIVATE] Called by the wifi task when a packet is acknowledged, or not, by the other board (the hello
+//                  packets are broadcasted, they are not counted)
+// @param _mac    : address of the receiver
+// @param _status : ESP_NOW_SEND_SUCCESS if acknowledged
+/*-------------------------------------------------------------------------------------------------------------------*/
+void espnow_process_sent (const uint8_t* _mac, esp_now_send_status_t _status)
+{
+  if (memcmp(_mac, espNowBroadcast, ESP_NOW_ETH_ALEN) == 0)
+    return;
+
+  if (_status != ESP_NOW_SEND_SUCCESS)
+    espNowSendFailed++;
+
+  if (espNowInFlight > 0)
+    __atomic_fetch_sub(&espNowInFlight, 1, __ATOMIC_RELEASE);
+}
+
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 5, 0)
+/*-------------------------------------------------------------------------------------------------------------------*/
+void espnow_sent (const wifi_tx_info_t* _info, esp_now_send_status_t _status)
+{
+  espnow_process_sent(_info->des_addr, _status);
+}
+#else
+/*-------------------------------------------------------------------------------------------------------------------*/
+void espnow_sent (const uint8_t* _mac, esp_now_send_status_t _status)
+{
+  espnow_process_sent(_mac, _status);
+}
+#endif
+
+
+/** T R A N S P O R T  E S P - N O W *********************************************************************************/
+// Direct link between both boards, without router : each board broadcasts hello packets until it receives a packet
+// from a board of the other role, then the stream is sent to this peer only (unicast, acknowledged by the radio). The
+// link has a single peer (slot 0), the server does not accept more subscribers with this backend.
+class TransportEspNow : public Transport
+{
+private:
+  bool isStarted;
+  uint8_t appConnectionState;
+  unsigned long timerHello_ms;
+  unsigned long timerRssi_ms;
+  int8_t rssi_dBm;
+  uint16_t peerSession;
+
+  // Packet being read, the bytes of a line cut by a gap are skipped
+  uint8_t rxOffset;
+  bool isRxSkipping;
+
+  // Packets sent
+  uint8_t txSequence;
+  bool isTxLineStart;
+
+
+public:
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Constructor
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  TransportEspNow (void)
+  {
+    this->isStarted           = false;
+    this->appConnectionState  = CONNECTION_STATUS_APP_DISCONNECTED;
+    this->timerHello_ms       = millis();
+    this->timerRssi_ms        = millis();
+    this->rssi_dBm            = LINK_QUALITY_RSSI_UNKNOWN;
+    this->peerSession         = 0;
+    this->rxOffset            = 0;
+    this->isRxSkipping        = false;
+    this->txSequence          = 0;
+    this->isTxLineStart       = true;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Start the radio, without joining a router
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void start (void)
+  {
+    esp_now_peer_info_t broadcast;
+
+    WiFi.mode(WIFI_STA);
+    esp_wifi_set_channel(TRANSPORT_ESPNOW_CHANNEL, WIFI_SECOND_CHAN_NONE);
+
+    if (esp_now_init() != ESP_OK)
+    {
+      Serial.println("ESPNOW : initialization failed !");
+      return;
+    }
+
+    esp_now_register_recv_cb(espnow_receive);
+    esp_now_register_send_cb(espnow_sent);
+
+    memset(&broadcast, 0, sizeof(broadcast));
+    memcpy(broadcast.peer_addr, espNowBroadcast, ESP_NOW_ETH_ALEN);
+    broadcast.channel = TRANSPORT_ESPNOW_CHANNEL;
+    broadcast.ifidx   = WIFI_IF_STA;
+    broadcast.encrypt = false;
+    esp_now_add_peer(&broadcast);
+
+    this->isStarted = true;
+    BootTimeline::mark("espnow started");
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Search the other board, or check the link
+  // @param _is_server : role of this board
+  // @return CONNECTION_STATUS_APP_DISCONNECTED | CONNECTION_STATUS_APP_CONNECTING | CONNECTION_STATUS_APP_CONNECTED
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  uint8_t update (bool _is_server)
+  {
+    if (this->isStarted == false)
+      return CONNECTION_STATUS_APP_DISCONNECTED;
+
+    espNowRole = (_is_server == true) ? TRANSPORT_ESPNOW_ROLE_SERVER : TRANSPORT_ESPNOW_ROLE_CLIENT;
+
+    if (this->appConnectionState != CONNECTION_STATUS_APP_CONNECTED)
+    {
+      this->appConnectionState = CONNECTION_STATUS_APP_CONNECTING;
+
+      // A board of the other role was heard
+      if (__atomic_load_n(&isEspNowCandidateFound, __ATOMIC_ACQUIRE) == true)
+      {
+        if (this->add_peer(espNowCandidate) == true)
+        {
+          this->peerSession        = (this->peerSession == UINT16_MAX) ? 1 : (this->peerSession + 1);
+          this->appConnectionState = CONNECTION_STATUS_APP_CONNECTED;
+        }
+        else
+          __atomic_store_n(&isEspNowCandidateFound, false, __ATOMIC_RELEASE);
+      }
+
+      // Otherwise, announce this board
+      else if ((millis()-this->timerHello_ms) >= TRANSPORT_ESPNOW_HELLO_INTERVAL_MS)
+      {
+        uint8_t hello[TRANSPORT_ESPNOW_HEADER_SIZE] = {TRANSPORT_ESPNOW_MAGIC_0, TRANSPORT_ESPNOW_MAGIC_1, TRANSPORT_ESPNOW_TYPE_HELLO, espNowRole, 0};
+        esp_now_send(espNowBroadcast, hello, sizeof(hello));
+        this->timerHello_ms = millis();
+      }
+    }
+
+    // The signal strength of the last packet, sampled at a low rate
+    if ((millis()-this->timerRssi_ms) >= LINK_QUALITY_RSSI_INTERVAL_MS)
+    {
+      this->rssi_dBm     = espNowRssi_dBm;
+      this->timerRssi_ms = millis();
+    }
+
+    return this->appConnectionState;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Identify the link with the other board
+  // @param _peer : peer slot, only 0 is used
+  // @return 0 if the other board is not known, otherwise the session of the link
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  uint16_t session (uint8_t _peer)
+  {
+    if ((_peer != 0) || (this->appConnectionState != CONNECTION_STATUS_APP_CONNECTED))
+      return 0;
+
+    return this->peerSession;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Forget the peer, the other board is searched again
+  // @param _peer : peer slot, only 0 is used
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void disconnect (uint8_t _peer)
+  {
+    if (_peer != 0)
+      return;
+
+    if (__atomic_load_n(&isEspNowPeerKnown, __ATOMIC_ACQUIRE) == true)
+    {
+      __atomic_store_n(&isEspNowPeerKnown, false, __ATOMIC_RELEASE);
+      esp_now_del_peer(espNowPeer);
+      Serial.println("ESPNOW : peer lost !");
+    }
+
+    __atomic_store_n(&isEspNowCandidateFound, false, __ATOMIC_RELEASE);
+    __atomic_store_n(&espNowRxTail, __atomic_load_n(&espNowRxHead, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+    __atomic_store_n(&isEspNowRxSequenceKnown, false, __ATOMIC_RELEASE);
+    this->rxOffset            = 0;
+    this->isRxSkipping        = false;
+    this->isTxLineStart       = true;
+    espNowRssi_dBm            = LINK_QUALITY_RSSI_UNKNOWN;
+    this->appConnectionState  = CONNECTION_STATUS_APP_CONNECTING;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Forget the peer, before a role change
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void reset (void)
+  {
+    this->disconnect(0);
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Read the received bytes, without blocking. After a gap, the line being received is incomplete :
+  //                 TRANSPORT_BYTES_LOST is returned once, then the rest of the lost line is skipped.
+  // @param _peer   : peer slot, only 0 is used
+  // @param _buffer : output buffer
+  // @param _size   : size of the output buffer
+  // @return number of bytes read, 0 if nothing was received, TRANSPORT_BYTES_LOST after a gap
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  int read (uint8_t _peer, uint8_t* _buffer, uint16_t _size)
+  {
+    if (_peer != 0)
+      return 0;
+
+    while (true)
+    {
+      uint8_t tail = espNowRxTail;
+
+      if (tail == __atomic_load_n(&espNowRxHead, __ATOMIC_ACQUIRE))
+        return 0;
+
+      struct strEspNowPacket* packet = &espNowRxPackets[tail];
+
+      if ((this->rxOffset == 0) && (packet->isAfterGap == true))
+      {
+        packet->isAfterGap = false;
+        this->isRxSkipping = true;
+        return TRANSPORT_BYTES_LOST;
+      }
+
+      // Bytes of the lost line, up to its end of line
+      if ((this->rxOffset == 0) && (packet->isLineStart == true))
+        this->isRxSkipping = false;
+      while ((this->isRxSkipping == true) && (this->rxOffset < packet->length))
+        this->isRxSkipping = (packet->data[this->rxOffset++] != '\n');
+
+      uint16_t length = min((uint16_t)(packet->length - this->rxOffset), _size);
+
+      memcpy(_buffer, &packet->data[this->rxOffset], length);
+      this->rxOffset += length;
+
+      // Packet fully read
+      if (this->rxOffset >= packet->length)
+      {
+        this->rxOffset = 0;
+        __atomic_store_n(&espNowRxTail, (uint8_t)((tail + 1) & (TRANSPORT_ESPNOW_RX_QUEUE_SIZE - 1)), __ATOMIC_RELEASE);
+      }
+
+      if (length > 0)
+        return length;
+    }
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Send bytes to the peer, in one numbered packet, without blocking
+  // @param _peer   : peer slot, only 0 is used
+  // @param _data   : bytes to send
+  // @param _length : number of bytes
+  // @return number of bytes accepted, 0 if the radio queue is full, negative on error
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  int write (uint8_t _peer, const uint8_t* _data, uint16_t _length)
+  {
+    uint8_t type = (this->isTxLineStart == true) ? TRANSPORT_ESPNOW_TYPE_DATA : TRANSPORT_ESPNOW_TYPE_DATA_NEXT;
+    uint8_t packet[ESP_NOW_MAX_DATA_LEN] = {TRANSPORT_ESPNOW_MAGIC_0, TRANSPORT_ESPNOW_MAGIC_1, type, espNowRole, this->txSequence};
+    uint16_t length = min(_length, (uint16_t)TRANSPORT_ESPNOW_PAYLOAD_SIZE);
+
+    if ((_peer != 0) || (__atomic_load_n(&isEspNowPeerKnown, __ATOMIC_ACQUIRE) == false))
+      return -1;
+    if ((length == 0) || (__atomic_load_n(&espNowInFlight, __ATOMIC_ACQUIRE) >= TRANSPORT_ESPNOW_MAX_IN_FLIGHT))
+      return 0;
+
+    memcpy(&packet[TRANSPORT_ESPNOW_HEADER_SIZE], _data, length);
+    __atomic_fetch_add(&espNowInFlight, 1, __ATOMIC_ACQUIRE);
+
+    if (esp_now_send(espNowPeer, packet, TRANSPORT_ESPNOW_HEADER_SIZE + length) != ESP_OK)
+    {
+      __atomic_fetch_sub(&espNowInFlight, 1, __ATOMIC_RELEASE);
+      return 0;
+    }
+
+    this->txSequence++;
+    this->isTxLineStart = (_data[length - 1] == '\n');
+    return length;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Provide the signal strength of the peer, sampled every LINK_QUALITY_RSSI_INTERVAL_MS
+  // @return signal strength in dBm, LINK_QUALITY_RSSI_UNKNOWN if not available
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  int8_t rssi (void)
+  {
+    return this->rssi_dBm;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Provide the name of the backend
+  // @return name
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  const char* name (void)
+  {
+    return "ESP-NOW";
+  }
+
+
+private:
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Register the other board as the peer of the link
+  // @param _mac : address of the other board
+  // @return true if the peer is registered
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  bool add_peer (const uint8_t* _mac)
+  {
+    esp_now_peer_info_t peer;
+
+    memset(&peer, 0, sizeof(peer));
+    memcpy(peer.peer_addr, _mac, ESP_NOW_ETH_ALEN);
+    peer.channel = TRANSPORT_ESPNOW_CHANNEL;
+    peer.ifidx   = WIFI_IF_STA;
+    peer.encrypt = false;
+
+    if ((esp_now_is_peer_exist(_mac) == false) && (esp_now_add_peer(&peer) != ESP_OK))
+      return false;
+
+    memcpy(espNowPeer, _mac, ESP_NOW_ETH_ALEN);
+    __atomic_store_n(&isEspNowPeerKnown, true, __ATOMIC_RELEASE);
+
+    Serial.printf("ESPNOW : linked with %02X:%02X:%02X:%02X:%02X:%02X\n", _mac[0], _mac[1], _mac[2], _mac[3], _mac[4], _mac[5]);
+    return true;
+  }
+};
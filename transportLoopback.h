@@ -0,0 +1,257 @@
+/*********************************************************************************************************************
+ * Project : Astro Alarm
+ * Author  : PEB <pebdev@lavache.com> 
+ * Date    : 2024.01.18
+ *********************************************************************************************************************
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ * 
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *********************************************************************************************************************/
+
+
+/** D E F I N E S ****************************************************************************************************/
+#define TRANSPORT_LOOPBACK_BUFFER_SIZE        (2048)
+
+
+/** S T R U C T S ****************************************************************************************************/
+// Bytes of one direction, circular buffer bounded like a socket
+struct strLoopbackBuffer
+{
+  uint8_t data[TRANSPORT_LOOPBACK_BUFFER_SIZE];
+  uint16_t start;
+  uint16_t count;
+};
+
+
+/** T R A N S P O R T  L O O P B A C K *******************************************************************************/
+// In-process links between instances, to run both roles together on a host (see tools/link_host.cpp) : a server
+// instance is linked to up to TRANSPORT_MAX_PEERS client instances. Each client instance holds the buffers of its link
+// with the server, and its reading can be stalled to test the outbound queue.
+class TransportLoopback : public Transport
+{
+private:
+  // Server side : the client instances, client side : the server instance (peer 0)
+  TransportLoopback* peers[TRANSPORT_MAX_PEERS];
+  uint16_t sessions[TRANSPORT_MAX_PEERS];
+  uint16_t lastSession;
+  bool isServer;
+  bool isStalled;
+
+  // Client side : bytes sent to the server and received from it
+  struct strLoopbackBuffer toServer;
+  struct strLoopbackBuffer toClient;
+
+
+public:
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Constructor
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  TransportLoopback (void)
+  {
+    this->lastSession     = 0;
+    this->isServer        = false;
+    this->isStalled       = false;
+    this->toServer.start  = 0;
+    this->toServer.count  = 0;
+    this->toClient.start  = 0;
+    this->toClient.count  = 0;
+    memset(this->peers, 0, sizeof(this->peers));
+    memset(this->sessions, 0, sizeof(this->sessions));
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Link a client instance to this server instance, in the first free slot
+  // @param _client : instance of the client board
+  // @return true if linked, false if all the slots are used
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  bool link (TransportLoopback* _client)
+  {
+    for (uint8_t i=0; i<TRANSPORT_MAX_PEERS; i++)
+    {
+      if (this->peers[i] == NULL)
+      {
+        this->peers[i]      = _client;
+        this->isServer      = true;
+        _client->peers[0]   = this;
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Stop or restart the reading of this client board, the server sees a full buffer
+  // @param _is_stalled : true to stop reading
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void set_stalled (bool _is_stalled)
+  {
+    this->isStalled = _is_stalled;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Nothing to start
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void start (void)
+  {
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] A link is up as soon as the peer is set, a dropped link is established again with a new session
+  // @param _is_server : role of this board, not used
+  // @return CONNECTION_STATUS_APP_DISCONNECTED if there is no peer, otherwise CONNECTION_STATUS_APP_CONNECTED
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  uint8_t update (bool _is_server)
+  {
+    uint8_t retval = CONNECTION_STATUS_APP_DISCONNECTED;
+
+    (void)_is_server;
+
+    for (uint8_t i=0; i<TRANSPORT_MAX_PEERS; i++)
+    {
+      if (this->peers[i] == NULL)
+        continue;
+
+      if (this->sessions[i] == 0)
+        this->sessions[i] = this->next_session();
+      retval = CONNECTION_STATUS_APP_CONNECTED;
+    }
+
+    return retval;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Identify the link of a peer slot
+  // @param _peer : peer slot
+  // @return 0 if the link is down, otherwise the session of the link
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  uint16_t session (uint8_t _peer)
+  {
+    return this->sessions[_peer];
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Drop the link with a peer on both sides, the bytes in flight are lost
+  // @param _peer : peer slot
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void disconnect (uint8_t _peer)
+  {
+    TransportLoopback* peer = this->peers[_peer];
+
+    if (peer == NULL)
+      return;
+
+    this->sessions[_peer] = 0;
+
+    for (uint8_t i=0; i<TRANSPORT_MAX_PEERS; i++)
+    {
+      if (peer->peers[i] == this)
+        peer->sessions[i] = 0;
+    }
+
+    TransportLoopback* wire = (this->isServer == true) ? peer : this;
+    wire->toServer.count = 0;
+    wire->toClient.count = 0;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Drop all the links
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void reset (void)
+  {
+    for (uint8_t i=0; i<TRANSPORT_MAX_PEERS; i++)
+      this->disconnect(i);
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Read the bytes sent by a peer
+  // @param _peer   : peer slot
+  // @param _buffer : output buffer
+  // @param _size   : size of the output buffer
+  // @return number of bytes read, 0 if nothing was received or if the reading is stalled
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  int read (uint8_t _peer, uint8_t* _buffer, uint16_t _size)
+  {
+    uint16_t length = 0;
+
+    if ((this->sessions[_peer] == 0) || (this->isStalled == true))
+      return 0;
+
+    struct strLoopbackBuffer* buffer = (this->isServer == true) ? &this->peers[_peer]->toServer : &this->toClient;
+
+    while ((length < _size) && (buffer->count > 0))
+    {
+      _buffer[length++] = buffer->data[buffer->start];
+      buffer->start     = (buffer->start + 1) % TRANSPORT_LOOPBACK_BUFFER_SIZE;
+      buffer->count--;
+    }
+
+    return length;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Write bytes to a peer
+  // @param _peer   : peer slot
+  // @param _data   : bytes to send
+  // @param _length : number of bytes
+  // @return number of bytes accepted, 0 if the buffer is full, negative if not linked
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  int write (uint8_t _peer, const uint8_t* _data, uint16_t _length)
+  {
+    uint16_t length = 0;
+
+    if (this->sessions[_peer] == 0)
+      return -1;
+
+    struct strLoopbackBuffer* buffer = (this->isServer == true) ? &this->peers[_peer]->toClient : &this->toServer;
+
+    while ((length < _length) && (buffer->count < TRANSPORT_LOOPBACK_BUFFER_SIZE))
+    {
+      buffer->data[(buffer->start + buffer->count) % TRANSPORT_LOOPBACK_BUFFER_SIZE] = _data[length++];
+      buffer->count++;
+    }
+
+    return length;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] No radio
+  // @return LINK_QUALITY_RSSI_UNKNOWN
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  int8_t rssi (void)
+  {
+    return LINK_QUALITY_RSSI_UNKNOWN;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Provide the name of the backend
+  // @return name
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  const char* name (void)
+  {
+    return "LOOPBACK";
+  }
+
+
+private:
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Provide the session of a new link, never 0
+  // @return session
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  uint16_t next_session (void)
+  {
+    if (++this->lastSession == 0)
+      this->lastSession = 1;
+
+    return this->lastSession;
+  }
+};
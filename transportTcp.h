@@ -0,0 +1,377 @@
+/*********************************************************************************************************************
+ * Project : Astro Alarm
+ * Author  : PEB <pebdev@lavache.com> 
+ * Date    : 2024.01.18
+ *********************************************************************************************************************
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ * 
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *********************************************************************************************************************/
+
+
+/** I N C L U D E S **************************************************************************************************/
+#ifdef ARDUINO
+#include <WiFi.h>
+#include <lwip/sockets.h>
+#include "wifi_info.h"
+#endif
+
+
+/** D E F I N E S ****************************************************************************************************/
+// Wifi connection state
+#define CONNECTION_STATUS_WIFI_DISCONNECTED       (0)
+#define CONNECTION_STATUS_WIFI_CONNECTING         (1)
+#define CONNECTION_STATUS_WIFI_CONNECTED          (2)
+
+// Timer
+#define CONNECTION_RETRY_INTERVAL_MS              (5000)
+
+
+/** T R A N S P O R T  T C P *****************************************************************************************/
+// Both boards join the router (wifi_info.h), the Server listens on wifi_port and accepts up to TRANSPORT_MAX_PEERS
+// subscribers, the Client connects to wifi_ip_server (peer 0)
+class TransportTcp : public Transport
+{
+private:
+  uint8_t wifiConnectionState;
+  uint8_t appConnectionState;
+  bool isServerStarted;
+  WiFiServer server;
+  WiFiClient clients[TRANSPORT_MAX_PEERS];
+  uint16_t sessions[TRANSPORT_MAX_PEERS];
+  uint16_t lastSession;
+  unsigned long timerRetry_ms;
+  unsigned long timerRssi_ms;
+  int8_t rssi_dBm;
+
+
+public:
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Constructor
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  TransportTcp (void)
+  {
+    this->wifiConnectionState = CONNECTION_STATUS_WIFI_DISCONNECTED;
+    this->appConnectionState  = CONNECTION_STATUS_APP_DISCONNECTED;
+    this->isServerStarted     = false;
+    this->lastSession         = 0;
+    this->timerRetry_ms       = millis();
+    this->timerRssi_ms        = millis();
+    this->rssi_dBm            = LINK_QUALITY_RSSI_UNKNOWN;
+    memset(this->sessions, 0, sizeof(this->sessions));
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Start the wifi
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void start (void)
+  {
+    WiFi.begin(wifi_ssid, wifi_key);
+    this->server = WiFiServer(wifi_port);
+    this->wifiConnectionState = CONNECTION_STATUS_WIFI_CONNECTING;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Establish or check the connections
+  // @param _is_server : role of this board
+  // @return CONNECTION_STATUS_APP_CONNECTED if at least one peer is connected, otherwise
+  //         CONNECTION_STATUS_APP_DISCONNECTED | CONNECTION_STATUS_APP_CONNECTING
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  uint8_t update (bool _is_server)
+  {
+    // Update Wifi connection state
+    this->wifi_manage();
+
+    // Wifi disconnected
+    if (this->wifiConnectionState != CONNECTION_STATUS_WIFI_CONNECTED)
+    {
+      if (this->appConnectionState != CONNECTION_STATUS_APP_DISCONNECTED)
+      {
+        Serial.println("WIFI : connection lost !");
+        this->reset();
+      }
+
+      return this->appConnectionState;
+    }
+
+    if (_is_server == true)
+      this->server_update();
+    else
+      this->client_update();
+
+    return this->appConnectionState;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Identify the connection of a peer slot
+  // @param _peer : peer slot
+  // @return 0 if the slot is free, otherwise the session of the connection
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  uint16_t session (uint8_t _peer)
+  {
+    return this->sessions[_peer];
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Close the connection of a peer : the Server keeps the other subscribers, the Client connects again
+  // @param _peer : peer slot
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void disconnect (uint8_t _peer)
+  {
+    this->close_peer(_peer);
+    this->timerRetry_ms = millis();
+
+    if (this->isServerStarted == true)
+      this->appConnectionState = (this->count_peers() > 0) ? CONNECTION_STATUS_APP_CONNECTED : CONNECTION_STATUS_APP_CONNECTING;
+    else
+      this->appConnectionState = CONNECTION_STATUS_APP_DISCONNECTED;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Close the connections and the server, the wifi connection is kept
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void reset (void)
+  {
+    for (uint8_t i=0; i<TRANSPORT_MAX_PEERS; i++)
+      this->close_peer(i);
+
+    if (this->isServerStarted == true)
+    {
+      this->server.end();
+      this->isServerStarted = false;
+      Serial.println("WIFI : server closed !");
+    }
+
+    this->appConnectionState = CONNECTION_STATUS_APP_DISCONNECTED;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Read the bytes received from a peer, without blocking
+  // @param _peer   : peer slot
+  // @param _buffer : output buffer
+  // @param _size   : size of the output buffer
+  // @return number of bytes read, 0 if nothing was received
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  int read (uint8_t _peer, uint8_t* _buffer, uint16_t _size)
+  {
+    if (this->sessions[_peer] == 0)
+      return 0;
+
+    int length = recv(this->clients[_peer].fd(), _buffer, _size, MSG_DONTWAIT);
+    return max(length, 0);
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Write bytes in the socket of a peer, without blocking
+  // @param _peer   : peer slot
+  // @param _data   : bytes to send
+  // @param _length : number of bytes
+  // @return number of bytes accepted, 0 if the socket is full, negative on error
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  int write (uint8_t _peer, const uint8_t* _data, uint16_t _length)
+  {
+    if (this->sessions[_peer] == 0)
+      return -1;
+
+    int sent = send(this->clients[_peer].fd(), _data, _length, MSG_DONTWAIT);
+
+    if ((sent < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK)))
+      return 0;
+    return sent;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Provide the signal strength of the router, sampled every LINK_QUALITY_RSSI_INTERVAL_MS
+  // @return signal strength in dBm, LINK_QUALITY_RSSI_UNKNOWN if not connected to the router
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  int8_t rssi (void)
+  {
+    return this->rssi_dBm;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Provide the name of the backend
+  // @return name
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  const char* name (void)
+  {
+    return "TCP";
+  }
+
+
+private:
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Manage connection state with the Wifi router
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void wifi_manage (void)
+  {
+    // Connected to the wifi router
+    if (WiFi.status() == WL_CONNECTED)
+    {
+      if (this->wifiConnectionState == CONNECTION_STATUS_WIFI_CONNECTING)
+      {
+        BootTimeline::mark("wifi connected");
+        Serial.println("WIFI : connected to the router !");
+        this->timerRssi_ms = millis() - LINK_QUALITY_RSSI_INTERVAL_MS;
+      }
+      
+      this->wifiConnectionState = CONNECTION_STATUS_WIFI_CONNECTED;
+
+      // The signal strength is a driver request, it is sampled at a low rate
+      if ((millis()-this->timerRssi_ms) >= LINK_QUALITY_RSSI_INTERVAL_MS)
+      {
+        this->rssi_dBm     = WiFi.RSSI();
+        this->timerRssi_ms = millis();
+      }
+    }
+    // Disconnected or not yet connected
+    else
+    {
+      // Lost Wifi connection
+      if (this->wifiConnectionState != CONNECTION_STATUS_WIFI_CONNECTING)
+      {
+        this->wifiConnectionState = CONNECTION_STATUS_WIFI_CONNECTING;
+        this->rssi_dBm            = LINK_QUALITY_RSSI_UNKNOWN;
+        WiFi.reconnect();
+        Serial.println("WIFI : connecting to the router...");
+      }
+    }
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Server side : listen, check the subscribers and accept the new ones in the free slots (the
+  //                  listening socket does not block, a subscriber is refused if all the slots are used)
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void server_update (void)
+  {
+    // Not yet started
+    if (this->isServerStarted == false)
+    {
+      this->server.begin();
+      this->isServerStarted    = true;
+      this->appConnectionState = CONNECTION_STATUS_APP_CONNECTING;
+      Serial.println("WIFI : server started !");
+    }
+
+    // Check subscribers status
+    for (uint8_t i=0; i<TRANSPORT_MAX_PEERS; i++)
+    {
+      if ((this->sessions[i] != 0) && (!this->clients[i].connected()))
+      {
+        Serial.printf("WIFI : connection lost with client %u !\n", i);
+        this->close_peer(i);
+      }
+    }
+
+    // New subscriber
+    WiFiClient incoming = this->server.available();
+    if (incoming)
+    {
+      uint8_t slot = 0;
+
+      while ((slot < TRANSPORT_MAX_PEERS) && (this->sessions[slot] != 0))
+        slot++;
+
+      if (slot < TRANSPORT_MAX_PEERS)
+      {
+        incoming.setNoDelay(true);
+        this->clients[slot]  = incoming;
+        this->sessions[slot] = this->next_session();
+        Serial.printf("WIFI : client %u connected !\n", slot);
+      }
+      else
+      {
+        incoming.stop();
+        Serial.println("WIFI : client refused, no free slot !");
+      }
+    }
+
+    this->appConnectionState = (this->count_peers() > 0) ? CONNECTION_STATUS_APP_CONNECTED : CONNECTION_STATUS_APP_CONNECTING;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Client side : connect to the server, retry every CONNECTION_RETRY_INTERVAL_MS
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void client_update (void)
+  {
+    // Not yet connected
+    if (this->appConnectionState == CONNECTION_STATUS_APP_DISCONNECTED)
+    {
+      this->clients[0].connect(wifi_ip_server, wifi_port);
+      this->timerRetry_ms      = millis();
+      this->appConnectionState = CONNECTION_STATUS_APP_CONNECTING;
+      Serial.println("WIFI : client connection...");
+    }
+
+    // Wait for server connection
+    if (this->appConnectionState == CONNECTION_STATUS_APP_CONNECTING)
+    {
+      if (this->clients[0].connected())
+      {
+        this->clients[0].setNoDelay(true);
+        this->sessions[0]        = this->next_session();
+        this->appConnectionState = CONNECTION_STATUS_APP_CONNECTED;
+        Serial.println("WIFI : connected to the server !");
+      }
+      else if ((millis()-this->timerRetry_ms) > CONNECTION_RETRY_INTERVAL_MS)
+      {
+        this->clients[0].stop();
+        this->clients[0].connect(wifi_ip_server, wifi_port);
+        this->timerRetry_ms = millis();
+      }
+    }
+
+    // Connection closed by the server
+    else if (!this->clients[0].connected())
+    {
+      this->close_peer(0);
+      this->appConnectionState = CONNECTION_STATUS_APP_DISCONNECTED;
+      Serial.println("WIFI : disconnected from the server !");
+    }
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Close the socket of a peer and free its slot
+  // @param _peer : peer slot
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void close_peer (uint8_t _peer)
+  {
+    this->clients[_peer].stop();
+    this->sessions[_peer] = 0;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Count the connected peers
+  // @return number of used slots
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  uint8_t count_peers (void)
+  {
+    uint8_t retval = 0;
+
+    for (uint8_t i=0; i<TRANSPORT_MAX_PEERS; i++)
+      retval += (this->sessions[i] != 0) ? 1 : 0;
+
+    return retval;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Provide the session of a new connection, never 0
+  // @return session
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  uint16_t next_session (void)
+  {
+    if (++this->lastSession == 0)
+      this->lastSession = 1;
+
+    return this->lastSession;
+  }
+};
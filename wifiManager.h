@@ -18,119 +18,287 @@
  *********************************************************************************************************************/
 
 
-/** I N C L U D E S **************************************************************************************************/
-#include <WiFi.h>
-#include "wifi_info.h"
+/** D E F I N E S ****************************************************************************************************/
+// Timer
+#define CONNECTION_ALIVE_TIMEOUT_MS               (5000)
 
+// Buffers
+#define WIFI_LINE_SIZE                            (256)
+#define WIFI_RX_CHUNK_SIZE                        (64)
 
-/** D E F I N E S ****************************************************************************************************/
-// Wifi connection state
-#define CONNECTION_STATUS_WIFI_DISCONNECTED       (0)
-#define CONNECTION_STATUS_WIFI_CONNECTING         (1)
-#define CONNECTION_STATUS_WIFI_CONNECTED          (2)
+// Outbound queue of each peer : the last data frame (shared by all the peers, a newer one replaces it if its write did
+// not start) and the control lines (never dropped)
+#define WIFI_TX_CONTROL_SLOTS                     (4)
+#define WIFI_TX_CONTROL_SIZE                      (LINK_QUALITY_MESSAGE_SIZE)
+#define WIFI_TX_REPORT_INTERVAL_MS                (10000)
 
-// Client and Server states
-#define CONNECTION_STATUS_APP_DISCONNECTED        (0)
-#define CONNECTION_STATUS_APP_CONNECTING          (1)
-#define CONNECTION_STATUS_APP_CONNECTED           (2)
+// Alarm state of the client, sent with the keepalive : "isAlive;...;alarm=<state>,<status>"
+#define WIFI_ALARM_FIELD                          "alarm="
+#define WIFI_ALARM_UNKNOWN                        (0xFF)
 
-// Timer
-#define CONNECTION_RETRY_INTERVAL_MS              (5000)
-#define CONNECTION_ALIVE_TIMEOUT_MS               (5000)
-#define CONNECTION_ALIVE_SEND_INTERVAL_MS         (1000)
+
+/** S T R U C T S ****************************************************************************************************/
+struct strWifiTxStats
+{
+  uint32_t linesSent;           // Lines fully accepted by the transport, all peers
+  uint32_t dataDropped;         // Data lines replaced by a newer one before being sent, all peers
+  uint32_t controlStalls;       // Control queue full, the connection was considered lost
+  uint8_t queueDepth;           // Lines waiting for the slowest peer, the one being written included
+  uint8_t queueDepthMax;        // Highest depth since the start
+  uint8_t peers;                // Peers connected (subscribers of the server)
+};
+
+// Link with one peer : the server has one for each subscriber, the client only uses the first one
+struct strWifiPeer
+{
+  uint16_t session;             // Session of the transport slot, 0 if not connected
+  unsigned long timerAlive_ms;  // Last line received
+
+  // Reception : bytes read from the transport and line being received
+  uint8_t rxChunk[WIFI_RX_CHUNK_SIZE];
+  uint8_t rxChunkStart;
+  uint8_t rxChunkLength;
+  char rxLine[WIFI_LINE_SIZE];
+  uint16_t rxLineLength;
+  bool rxLineOverflow;
+
+  // Transmission : line being written (partial writes are resumed), control lines, and sequences of the shared data
+  // frame when the link was opened and when its last write started
+  char txLine[WIFI_LINE_SIZE+2];
+  uint16_t txLineLength;
+  uint16_t txLineOffset;
+  char txControl[WIFI_TX_CONTROL_SLOTS][WIFI_TX_CONTROL_SIZE];
+  uint8_t txControlStart;
+  uint8_t txControlCount;
+  bool isTxStalled;
+  uint32_t txDataFirst;
+  uint32_t txDataSent;
+
+  // Round trip, jitter and loss of the link, and alarm state received from a client board
+  LinkQuality linkQuality;
+  uint8_t alarmState;
+  uint8_t alarmStatus;
+};
 
 
 /** W I F I **********************************************************************************************************/
+// Line exchange between the boards over a Transport backend (TCP, ESP-NOW...) : keepalives, liveness, clock
+// synchronization and outbound queue are common to all backends. The server sends its data frames to all its
+// subscribers : a frame is encoded once, each peer only keeps its position, so a stalled peer does not slow the others.
 class WifiManager
 {
 private:
+  Transport* transport;
   bool isPingReceived;
-  uint8_t wifiConnectionState;
   uint8_t appConnectionState;
-  WiFiServer server;
-  WiFiClient client;
-  unsigned long timerCheckConnectionAlive_ms  = millis();
   unsigned long timerToSendWifiData_ms        = millis();
 
+  // Peers, by transport slot
+  struct strWifiPeer peers[TRANSPORT_MAX_PEERS];
+
+  // Last complete data line received
+  char rxMessage[WIFI_LINE_SIZE];
+
+  // Timebase of the server, estimated by the client
+  ClockSync clockSync;
+
+  // Alarm state : set by the client, sent with its keepalive
+  uint8_t alarmState;
+  uint8_t alarmStatus;
+
+  // Last data frame, with its end of line, and its sequence
+  char txData[WIFI_LINE_SIZE+2];
+  uint16_t txDataLength;
+  uint32_t txDataSequence;
+  struct strWifiTxStats txStats;
+  uint32_t txReportedDrops;
+
 
 public:
   /*-------------------------------------------------------------------------------------------------------------------*/
   // @brief [PUBLIC] Constructor
+  // @param _transport : backend of the link
   /*-------------------------------------------------------------------------------------------------------------------*/
-  WifiManager (void)
+  WifiManager (Transport* _transport)
   {
+    this->transport           = _transport;
     this->isPingReceived      = false;
-    this->wifiConnectionState = CONNECTION_STATUS_WIFI_DISCONNECTED;
     this->appConnectionState  = CONNECTION_STATUS_APP_DISCONNECTED;
+    this->rxMessage[0]        = '\0';
+    this->alarmState          = WIFI_ALARM_UNKNOWN;
+    this->alarmStatus         = WIFI_ALARM_UNKNOWN;
+    this->txDataLength        = 0;
+    this->txDataSequence      = 0;
+    this->txReportedDrops     = 0;
+    memset(&this->txStats, 0, sizeof(this->txStats));
+
+    for (uint8_t i=0; i<TRANSPORT_MAX_PEERS; i++)
+    {
+      this->open_peer(&this->peers[i]);
+      this->peers[i].session = 0;
+    }
   }
 
   /*-------------------------------------------------------------------------------------------------------------------*/
-  // @brief [PUBLIC] Start the wifi
+  // @brief [PUBLIC] Start the radio of the transport
   /*-------------------------------------------------------------------------------------------------------------------*/
   void start (void)
   {
-    WiFi.begin(wifi_ssid, wifi_key);
-    this->server = WiFiServer(wifi_port);
-    this->wifiConnectionState = CONNECTION_STATUS_WIFI_CONNECTING;
+    Serial.print("WIFI : transport ");
+    Serial.println(this->transport->name());
+    this->transport->start();
   }
 
   /*-------------------------------------------------------------------------------------------------------------------*/
-  // @brief [PUBLIC] Send data to a client
+  // @brief [PUBLIC] Close the application connections (client and server), the radio is kept
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void reset (void)
+  {
+    if (this->appConnectionState != CONNECTION_STATUS_APP_DISCONNECTED)
+      Serial.println("WIFI : application connection reset");
+
+    this->transport->reset();
+    this->flush();
+    this->appConnectionState = CONNECTION_STATUS_APP_DISCONNECTED;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Send data to the peers, without blocking : the frame is stored once, and written to each peer
+  //                 when its socket accepts it. A frame not yet started for a peer is replaced by this one (only the
+  //                 freshest data is useful)
   // @param _data      : string to send 
   // @param _period_ms : elapsed time in ms between two send frames
   /*-------------------------------------------------------------------------------------------------------------------*/
-  void send_data (String _data, unsigned long _period_ms)
+  void send_data (const char* _data, unsigned long _period_ms)
   {
     if (this->appConnectionState == CONNECTION_STATUS_APP_CONNECTED)
     {
       if ((millis()-this->timerToSendWifiData_ms) > _period_ms)
       {
-        this->client.println(_data);
+        int length = snprintf(this->txData, sizeof(this->txData), "%.*s\r\n", WIFI_LINE_SIZE-1, _data);
+
+        this->txDataLength = min(length, (int)sizeof(this->txData)-1);
         this->timerToSendWifiData_ms = millis();
+
+        for (uint8_t i=0; i<TRANSPORT_MAX_PEERS; i++)
+        {
+          if ((this->peers[i].session != 0) && (this->peers[i].txDataSent != this->txDataSequence))
+            this->txStats.dataDropped++;
+        }
+
+        this->txDataSequence++;
+
+        for (uint8_t i=0; i<TRANSPORT_MAX_PEERS; i++)
+        {
+          if (this->peers[i].session != 0)
+            this->pump_tx(i);
+        }
       }
     }
   }
 
   /*-------------------------------------------------------------------------------------------------------------------*/
-  // @brief [PUBLIC] Read data from the server
+  // @brief [PUBLIC] Provide the statistics of the outbound queues
+  // @return strWifiTxStats data
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  struct strWifiTxStats get_tx_stats (void)
+  {
+    return this->txStats;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Print the outbound queue statistics, every WIFI_TX_REPORT_INTERVAL_MS if data lines were dropped
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void report_tx (void)
+  {
+    static unsigned long timerReport_ms = millis();
+
+    if ((millis()-timerReport_ms) < WIFI_TX_REPORT_INTERVAL_MS)
+      return;
+    timerReport_ms = millis();
+
+    if (this->txStats.dataDropped == this->txReportedDrops)
+      return;
+    this->txReportedDrops = this->txStats.dataDropped;
+
+    Serial.print("WIFI : tx peers=");
+    Serial.print(this->txStats.peers);
+    Serial.print(" sent=");
+    Serial.print(this->txStats.linesSent);
+    Serial.print(" dropped=");
+    Serial.print(this->txStats.dataDropped);
+    Serial.print(" stalls=");
+    Serial.print(this->txStats.controlStalls);
+    Serial.print(" depth max=");
+    Serial.println(this->txStats.queueDepthMax);
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Check if it is time to send data, to avoid encoding a frame which would not be sent
+  // @param _period_ms : elapsed time in ms between two send frames
+  // @return true | false
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  bool is_time_to_send (unsigned long _period_ms)
+  {
+    return ((this->appConnectionState == CONNECTION_STATUS_APP_CONNECTED) && ((millis()-this->timerToSendWifiData_ms) > _period_ms));
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Read data from the server, without blocking : a partial line is kept until its end is received
   // @param _last_msg : return the latest received message
   // @param _force    : force the read even if status is not connected
-  // @return empty string if there is no data, otherwise received data
+  // @return empty string if there is no data, otherwise received data (valid until the next call)
   /*-------------------------------------------------------------------------------------------------------------------*/
-  String read_data (bool _last_msg=false, bool _force=false)
+  const char* read_data (bool _last_msg=false, bool _force=false)
   {
-    String previousRetval = "";
-    String retval = "";
+    this->rxMessage[0] = '\0';
 
     if ((_force == true) || (this->appConnectionState == CONNECTION_STATUS_APP_CONNECTED))
-    {
-      do
-      {
-        previousRetval = retval;
-        retval = "";
+      this->read_peer(0, _last_msg);
 
-        // Read data in the buffer
-        if (this->client.available())
-        {
-          retval = this->client.readStringUntil('\n');
-          
-          // Reset the watchdog
-          if (retval != "")
-            this->timerCheckConnectionAlive_ms = millis();
-          
-          // isAlive fram is only used by tye watchdog, filter this
-          if (retval.indexOf("isAlive") != -1)
-            this->isPingReceived = true;
-        }
-      } while ((_last_msg == true) && (retval != ""));
+    return this->rxMessage;
+  }
 
-      if (_last_msg == true)
-      {
-        retval = previousRetval;
-      }
-    }
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Provide the clock synchronization with the server (client side)
+  // @return ClockSync object
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  ClockSync* get_clock_sync (void)
+  {
+    return &this->clockSync;
+  }
 
-    return retval;
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Provide the quality of the link with the other board (the main peer on the server side)
+  // @return LinkQuality object
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  LinkQuality* get_link_quality (void)
+  {
+    return &this->main_peer()->linkQuality;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Set the alarm state sent to the server with the keepalive (client side)
+  // @param _state  : ALARM_STATE_xxx
+  // @param _status : ALARM_STATUS_xxx
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void set_alarm_state (uint8_t _state, uint8_t _status)
+  {
+    this->alarmState  = _state;
+    this->alarmStatus = _status;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Provide the alarm state of the client board (server side, main peer)
+  // @param _state  : output, ALARM_STATE_xxx, WIFI_ALARM_UNKNOWN if never received
+  // @param _status : output, ALARM_STATUS_xxx, WIFI_ALARM_UNKNOWN if never received
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void get_alarm_state (uint8_t* _state, uint8_t* _status)
+  {
+    struct strWifiPeer* peer = this->main_peer();
+
+    *_state  = peer->alarmState;
+    *_status = peer->alarmStatus;
   }
 
   /*-------------------------------------------------------------------------------------------------------------------*/
@@ -146,202 +314,431 @@ public:
   }
 
   /*-------------------------------------------------------------------------------------------------------------------*/
-  // @brief [PUBLIC] Allow user to get the Wifi strength.
-  // @return quality in percentage
+  // @brief [PUBLIC] Update server state
+  // @return CONNECTION_STATUS_APP_DISCONNECTED | CONNECTION_STATUS_APP_CONNECTING | CONNECTION_STATUS_APP_CONNECTED
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  uint8_t server_update (void)
+  {
+    return this->update(true);
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PUBLIC] Update client state
+  // @return CONNECTION_STATUS_APP_DISCONNECTED | CONNECTION_STATUS_APP_CONNECTING | CONNECTION_STATUS_APP_CONNECTED
   /*-------------------------------------------------------------------------------------------------------------------*/
-  int8_t signal_strength (void)
+  uint8_t client_update (void)
   {
-    int8_t retval = map(WiFi.RSSI(), -100, -20, 0, 100);
-    retval = constrain(retval, 0, 100);
-    return retval;
+    return this->update(false);
   }
 
+
+private:
   /*-------------------------------------------------------------------------------------------------------------------*/
-  // @brief [PUBLIC] Update server state
+  // @brief [PRIVATE] Update the links : the server refreshes the ping of each peer (the client reads its data in its
+  //                  loop), both boards send their keepalives, the client requests the clock synchronization. Each
+  //                  peer has its own liveness, a lost one is closed without touching the others.
+  // @param _is_server : role of this board
   // @return CONNECTION_STATUS_APP_DISCONNECTED | CONNECTION_STATUS_APP_CONNECTING | CONNECTION_STATUS_APP_CONNECTED
   /*-------------------------------------------------------------------------------------------------------------------*/
-  uint8_t server_update (void)
+  uint8_t update (bool _is_server)
   {
-    // Update Wifi connection state
-    this->wifi_manage();
-
-    // If we are connected to the router
-    if (this->wifiConnectionState == CONNECTION_STATUS_WIFI_CONNECTED)
-    { 
-      // Not yet connected
-      if (this->appConnectionState == CONNECTION_STATUS_APP_DISCONNECTED)
+    uint8_t connectedPeers = 0;
+    uint8_t queueDepth = 0;
+
+    this->appConnectionState = this->transport->update(_is_server);
+    int8_t rssi = this->transport->rssi();
+
+    for (uint8_t i=0; i<TRANSPORT_MAX_PEERS; i++)
+    {
+      struct strWifiPeer* peer = &this->peers[i];
+      uint16_t session = this->transport->session(i);
+
+      // New link on this slot, nothing from the previous one is kept, the clock of the server is learned again
+      if ((session != 0) && (session != peer->session))
       {
-        this->server.begin();
-        this->appConnectionState = CONNECTION_STATUS_APP_CONNECTING;
-        Serial.println("WIFI : server started !");
+        this->open_peer(peer);
+        if (_is_server == false)
+          this->clockSync.reset();
       }
+      peer->session = session;
+
+      if (peer->session == 0)
+        continue;
 
-      // Check client status
-      else
+      peer->linkQuality.set_rssi(rssi);
+
+      if (_is_server == true)
+        this->read_peer(i, true);
+
+      this->send_keepalive(i, _is_server == false);
+
+      // Clock synchronization request
+      char request[CLOCK_SYNC_MESSAGE_SIZE];
+      if ((_is_server == false) && (this->clockSync.prepare_request(request, sizeof(request)) == true))
+        this->send_control(i, request);
+
+      // Continue the pending writes
+      this->pump_tx(i);
+
+      // Check connection status
+      if (!this->is_connection_alive(peer))
       {
-        if ((!this->client.connected()) || ((this->appConnectionState == CONNECTION_STATUS_APP_CONNECTED) && (!this->is_connection_alive())))
-        {
-          if (this->appConnectionState == CONNECTION_STATUS_APP_CONNECTED)
-            Serial.println("WIFI : connection lost with client !");
-          
-          this->appConnectionState = CONNECTION_STATUS_APP_CONNECTING;
-          this->client = this->server.available();
-        }
+        if (_is_server == true)
+          Serial.printf("WIFI : connection lost with client %u !\n", i);
         else
+          Serial.println("WIFI : disconnected from the server !");
+
+        this->transport->disconnect(i);
+        peer->session = 0;
+        continue;
+      }
+
+      connectedPeers++;
+      queueDepth = max(queueDepth, this->get_queue_depth(peer));
+    }
+
+    this->txStats.peers         = connectedPeers;
+    this->txStats.queueDepth    = queueDepth;
+    this->txStats.queueDepthMax = max(this->txStats.queueDepthMax, queueDepth);
+
+    // All the peers were lost during this update
+    if ((connectedPeers == 0) && (this->appConnectionState == CONNECTION_STATUS_APP_CONNECTED))
+      this->appConnectionState = (_is_server == true) ? CONNECTION_STATUS_APP_CONNECTING : CONNECTION_STATUS_APP_DISCONNECTED;
+
+    return this->appConnectionState;
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Read the lines of a peer, the control lines are handled, the last data line is kept in rxMessage
+  // @param _peer     : peer slot
+  // @param _last_msg : read all the lines, otherwise stop after the first data line
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void read_peer (uint8_t _peer, bool _last_msg)
+  {
+    struct strWifiPeer* peer = &this->peers[_peer];
+    char c;
+
+    while (this->read_byte(_peer, &c) == true)
+    {
+      if (c == '\r')
+        continue;
+
+      if (c != '\n')
+      {
+        // Too long line, it will be dropped
+        if (peer->rxLineLength < (WIFI_LINE_SIZE-1))
+          peer->rxLine[peer->rxLineLength++] = c;
+        else
+          peer->rxLineOverflow = true;
+        continue;
+      }
+
+      // End of line
+      if ((peer->rxLineOverflow == false) && (peer->rxLineLength > 0))
+      {
+        int64_t receiveTime_us = ClockSync::local_time_us();
+        peer->rxLine[peer->rxLineLength] = '\0';
+
+        // Reset the watchdog
+        peer->timerAlive_ms = millis();
+
+        // Clock synchronization and keepalive messages are handled here, they are not provided to the user
+        if (this->process_control(_peer, peer->rxLine, receiveTime_us) == false)
         {
-          if (this->appConnectionState == CONNECTION_STATUS_APP_CONNECTING)
-          {
-            this->timerCheckConnectionAlive_ms = millis();
-            this->appConnectionState = CONNECTION_STATUS_APP_CONNECTED;
-            Serial.println("WIFI : client connected !");
-          }
-          else
-          {
-            // Refresh the ping
-            this->read_data(true, false);
-          }
+          memcpy(this->rxMessage, peer->rxLine, peer->rxLineLength+1);
+          peer->linkQuality.count_data_line();
+
+          // The data frames of the server are also used as ping
+          if (strstr(this->rxMessage, "isAlive") != NULL)
+            this->isPingReceived = true;
         }
       }
+
+      peer->rxLineLength   = 0;
+      peer->rxLineOverflow = false;
+
+      if ((_last_msg == false) && (this->rxMessage[0] != '\0'))
+        break;
     }
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Provide the next byte received from a peer, the transport is read by chunks
+  // @param _peer : peer slot
+  // @param _c    : output, received byte
+  // @return true if a byte is available
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  bool read_byte (uint8_t _peer, char* _c)
+  {
+    struct strWifiPeer* peer = &this->peers[_peer];
 
-    // Wifi disconnected
-    else
+    while (peer->rxChunkStart >= peer->rxChunkLength)
     {
-      if (this->appConnectionState != CONNECTION_STATUS_APP_DISCONNECTED)
+      int length = this->transport->read(_peer, peer->rxChunk, sizeof(peer->rxChunk));
+
+      // The end of the line being received is lost, its start must not be joined to the next line
+      if (length == TRANSPORT_BYTES_LOST)
       {
-        Serial.println("WIFI : server closed !");
-        this->server.end();
+        peer->rxLineLength   = 0;
+        peer->rxLineOverflow = false;
+        continue;
       }
 
-      this->appConnectionState = CONNECTION_STATUS_APP_DISCONNECTED;
+      if (length <= 0)
+        return false;
+
+      peer->rxChunkStart  = 0;
+      peer->rxChunkLength = length;
     }
 
-    return this->appConnectionState;
+    *_c = (char)peer->rxChunk[peer->rxChunkStart++];
+    return true;
   }
 
   /*-------------------------------------------------------------------------------------------------------------------*/
-  // @brief [PUBLIC] Update client state
-  // @return CONNECTION_STATUS_APP_DISCONNECTED | CONNECTION_STATUS_APP_CONNECTING | CONNECTION_STATUS_APP_CONNECTED
+  // @brief [PRIVATE] Queue a control line (keepalive, clock synchronization), they are sent before the data and never
+  //                  dropped : if the queue is full, the peer does not read anymore and its connection is closed
+  // @param _peer : peer slot
+  // @param _data : string to send, without end of line
   /*-------------------------------------------------------------------------------------------------------------------*/
-  uint8_t client_update (void)
+  void send_control (uint8_t _peer, const char* _data)
   {
-    // Update Wifi connection state
-    this->wifi_manage();
-
-    // If we are connected to the router
-    if (this->wifiConnectionState == CONNECTION_STATUS_WIFI_CONNECTED)
-    { 
-      // Not yet connected
-      if (this->appConnectionState == CONNECTION_STATUS_APP_DISCONNECTED)
+    struct strWifiPeer* peer = &this->peers[_peer];
+
+    if (peer->txControlCount >= WIFI_TX_CONTROL_SLOTS)
+    {
+      if (peer->isTxStalled == false)
       {
-        this->client.connect(wifi_ip_server, wifi_port);
-        this->timerCheckConnectionAlive_ms = millis();
-        this->appConnectionState = CONNECTION_STATUS_APP_CONNECTING;
-        Serial.println("WIFI : client connection...");
+        this->txStats.controlStalls++;
+        Serial.println("WIFI : peer does not read anymore, connection closed");
       }
+      peer->isTxStalled = true;
+      return;
+    }
 
-      // Wait for server connection
-      if (this->appConnectionState == CONNECTION_STATUS_APP_CONNECTING)
+    char* slot = peer->txControl[(peer->txControlStart + peer->txControlCount) % WIFI_TX_CONTROL_SLOTS];
+    strncpy(slot, _data, WIFI_TX_CONTROL_SIZE-1);
+    slot[WIFI_TX_CONTROL_SIZE-1] = '\0';
+    peer->txControlCount++;
+    this->pump_tx(_peer);
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Write the pending lines of a peer in the transport until it is full, without blocking. The data
+  //                  frame is copied when its write starts, a newer frame does not alter it.
+  // @param _peer : peer slot
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void pump_tx (uint8_t _peer)
+  {
+    struct strWifiPeer* peer = &this->peers[_peer];
+
+    while (peer->isTxStalled == false)
+    {
+      // Next line : control lines first
+      if (peer->txLineOffset >= peer->txLineLength)
       {
-        if (this->client.connected())
+        if (peer->txControlCount > 0)
         {
-          this->timerCheckConnectionAlive_ms = millis();
-          this->appConnectionState = CONNECTION_STATUS_APP_CONNECTED;
-          Serial.println("WIFI : connected to the server !");
+          const char* line = peer->txControl[peer->txControlStart];
+          uint16_t length = strlen(line);
+
+          memcpy(peer->txLine, line, length);
+          memcpy(&peer->txLine[length], "\r\n", 2);
+          peer->txLineLength   = length + 2;
+          peer->txControlStart = (peer->txControlStart + 1) % WIFI_TX_CONTROL_SLOTS;
+          peer->txControlCount--;
+        }
+        else if (peer->txDataSent != this->txDataSequence)
+        {
+          memcpy(peer->txLine, this->txData, this->txDataLength);
+          peer->txLineLength = this->txDataLength;
+          peer->txDataSent   = this->txDataSequence;
         }
         else
         {
-          // Retry to connect
-          if ((millis()-this->timerCheckConnectionAlive_ms) > CONNECTION_RETRY_INTERVAL_MS)
-          {
-            this->client.stop();
-            this->flush();
-            this->client.connect(wifi_ip_server, wifi_port);
-            this->timerCheckConnectionAlive_ms = millis();
-          }
+          break;
         }
+
+        peer->txLineOffset = 0;
       }
 
-      // Check for connection status
-      if (this->appConnectionState == CONNECTION_STATUS_APP_CONNECTED)
-      {
-        this->send_data("isAlive", CONNECTION_ALIVE_SEND_INTERVAL_MS);
+      int sent = this->transport->write(_peer, (const uint8_t*)&peer->txLine[peer->txLineOffset], peer->txLineLength-peer->txLineOffset);
 
-        // Check connection status
-        if (!this->is_connection_alive())
-        {
-          this->appConnectionState = CONNECTION_STATUS_APP_DISCONNECTED;
-          this->client.stop();
-          this->flush();
-          Serial.println("WIFI : disconnected from the server !");
-        }
-      }
+      // Transport full, or error : the connection state is checked by the update
+      if (sent <= 0)
+        break;
+
+      peer->txLineOffset += sent;
+      if (peer->txLineOffset >= peer->txLineLength)
+        this->txStats.linesSent++;
     }
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Provide the number of lines waiting for a peer, the one being written included
+  // @param _peer : peer
+  // @return number of lines
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  uint8_t get_queue_depth (struct strWifiPeer* _peer)
+  {
+    return _peer->txControlCount + ((_peer->txDataSent != this->txDataSequence) ? 1 : 0) + ((_peer->txLineOffset < _peer->txLineLength) ? 1 : 0);
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Prepare a peer for a new connection : nothing from the previous one is received or sent, the
+  //                  current data frame is not sent, the next one will be
+  // @param _peer : peer
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  void open_peer (struct strWifiPeer* _peer)
+  {
+    _peer->timerAlive_ms  = millis();
+    _peer->rxChunkStart   = 0;
+    _peer->rxChunkLength  = 0;
+    _peer->rxLineLength   = 0;
+    _peer->rxLineOverflow = false;
+    _peer->txLineLength   = 0;
+    _peer->txLineOffset   = 0;
+    _peer->txControlStart = 0;
+    _peer->txControlCount = 0;
+    _peer->isTxStalled    = false;
+    _peer->txDataFirst    = this->txDataSequence;
+    _peer->txDataSent     = this->txDataSequence;
+    _peer->alarmState     = WIFI_ALARM_UNKNOWN;
+    _peer->alarmStatus    = WIFI_ALARM_UNKNOWN;
+    _peer->linkQuality.reset();
+  }
 
-    // Wifi disconnected
-    else
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Provide the peer shown to the user : the first client board (its alarm state was received),
+  //                  otherwise the first connected peer
+  // @return peer, the first slot if none is connected
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  struct strWifiPeer* main_peer (void)
+  {
+    struct strWifiPeer* retval = NULL;
+
+    for (uint8_t i=0; i<TRANSPORT_MAX_PEERS; i++)
     {
-      if (this->appConnectionState != CONNECTION_STATUS_APP_DISCONNECTED)
-      {
-        Serial.println("WIFI : connection lost !");
-        client.stop();
-      }
+      if (this->peers[i].session == 0)
+        continue;
 
-      this->appConnectionState = CONNECTION_STATUS_APP_DISCONNECTED;
+      if (this->peers[i].alarmState != WIFI_ALARM_UNKNOWN)
+        return &this->peers[i];
+
+      if (retval == NULL)
+        retval = &this->peers[i];
     }
 
-    return this->appConnectionState;
+    return (retval != NULL) ? retval : &this->peers[0];
   }
 
-
-private:
   /*-------------------------------------------------------------------------------------------------------------------*/
-  // @brief [PRIVATE] Manage connection state with the Wifi router
+  // @brief [PRIVATE] Send the keepalive to a peer, at most every LINK_QUALITY_KEEPALIVE_INTERVAL_MS. It is sent before
+  //                  the pending data frame, so this one is not counted
+  // @param _peer       : peer slot
+  // @param _with_alarm : add the alarm state (client side)
   /*-------------------------------------------------------------------------------------------------------------------*/
-  void wifi_manage (void)
+  void send_keepalive (uint8_t _peer, bool _with_alarm)
   {
-    // Connected to the wifi router
-    if (WiFi.status() == WL_CONNECTED)
+    struct strWifiPeer* peer = &this->peers[_peer];
+    char keepalive[LINK_QUALITY_MESSAGE_SIZE];
+    uint32_t dataCount = (this->txDataSequence - peer->txDataFirst) - ((peer->txDataSent != this->txDataSequence) ? 1 : 0);
+
+    if (peer->linkQuality.prepare_keepalive(keepalive, sizeof(keepalive), dataCount) == false)
+      return;
+
+    if (_with_alarm == true)
     {
-      if (this->wifiConnectionState == CONNECTION_STATUS_WIFI_CONNECTING)
-        Serial.println("WIFI : connected to the router !");
-      
-      this->wifiConnectionState = CONNECTION_STATUS_WIFI_CONNECTED;
+      size_t length = strlen(keepalive);
+      snprintf(&keepalive[length], sizeof(keepalive)-length, ";" WIFI_ALARM_FIELD "%u,%u", this->alarmState, this->alarmStatus);
     }
-    // Disconnected or not yet connected
-    else
+
+    this->send_control(_peer, keepalive);
+  }
+
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  // @brief [PRIVATE] Handle a control message : the keepalives are echoed and carry the alarm state of the client,
+  //                  the server answers the clock synchronization requests, the client processes the responses
+  // @param _peer       : peer slot
+  // @param _line       : received line
+  // @param _receive_us : local time when the line was received
+  // @return true if the line was a control message, otherwise false
+  /*-------------------------------------------------------------------------------------------------------------------*/
+  bool process_control (uint8_t _peer, const char* _line, int64_t _receive_us)
+  {
+    struct strWifiPeer* peer = &this->peers[_peer];
+
+    if (strncmp(_line, LINK_QUALITY_KEEPALIVE, strlen(LINK_QUALITY_KEEPALIVE)) == 0)
     {
-      // Lost Wifi connection
-      if (this->wifiConnectionState != CONNECTION_STATUS_WIFI_CONNECTING)
+      char echo[LINK_QUALITY_MESSAGE_SIZE];
+      const char* alarm = strstr(_line, WIFI_ALARM_FIELD);
+      unsigned int state, status;
+
+      this->isPingReceived = true;
+      if (peer->linkQuality.process_keepalive(_line, _receive_us, echo, sizeof(echo)) == true)
+        this->send_control(_peer, echo);
+
+      if ((alarm != NULL) && (sscanf(alarm + strlen(WIFI_ALARM_FIELD), "%u,%u", &state, &status) == 2))
       {
-        this->wifiConnectionState = CONNECTION_STATUS_WIFI_CONNECTING;
-        WiFi.reconnect();
-        Serial.println("WIFI : connecting to the router...");
+        peer->alarmState  = state;
+        peer->alarmStatus = status;
       }
+      return true;
+    }
+
+    if (strncmp(_line, LINK_QUALITY_ECHO, strlen(LINK_QUALITY_ECHO)) == 0)
+    {
+      peer->linkQuality.process_echo(_line, _receive_us);
+      return true;
     }
+
+    if (strncmp(_line, CLOCK_SYNC_REQUEST, strlen(CLOCK_SYNC_REQUEST)) == 0)
+    {
+      char response[CLOCK_SYNC_MESSAGE_SIZE];
+
+      if (ClockSync::prepare_response(_line, _receive_us, response, sizeof(response)) == true)
+        this->send_control(_peer, response);
+      return true;
+    }
+
+    if (strncmp(_line, CLOCK_SYNC_RESPONSE, strlen(CLOCK_SYNC_RESPONSE)) == 0)
+    {
+      this->clockSync.process_response(_line, _receive_us);
+      return true;
+    }
+
+    return false;
   }
 
   /*-------------------------------------------------------------------------------------------------------------------*/
-  // @brief [PRIVATE] Get connection status with the other device
+  // @brief [PRIVATE] Get connection status with a peer
+  // @param _peer : peer
   // @return true | false
   /*-------------------------------------------------------------------------------------------------------------------*/
-  bool is_connection_alive (void)
+  bool is_connection_alive (struct strWifiPeer* _peer)
   {
     bool retval = false;
 
-    // timer was reseted when a 'isAlive' data is received
-    if ((millis()-this->timerCheckConnectionAlive_ms) < CONNECTION_ALIVE_TIMEOUT_MS)
+    // timer was reseted when a line is received, a stalled peer is considered lost
+    if (((millis()-_peer->timerAlive_ms) < CONNECTION_ALIVE_TIMEOUT_MS) && (_peer->isTxStalled == false))
       retval = true;
 
     return retval;
   }
 
   /*-------------------------------------------------------------------------------------------------------------------*/
-  // @brief [PRIVATE] Flush Rx buffer
+  // @brief [PRIVATE] Forget the peers and their Rx buffers
   /*-------------------------------------------------------------------------------------------------------------------*/
   void flush (void)
   {
-    while (this->read_data(false, true) != "");
+    for (uint8_t i=0; i<TRANSPORT_MAX_PEERS; i++)
+    {
+      this->open_peer(&this->peers[i]);
+      this->peers[i].session = 0;
+    }
+
+    this->rxMessage[0]   = '\0';
     this->isPingReceived = false;
+    this->clockSync.reset();
   }
 };